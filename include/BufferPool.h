@@ -0,0 +1,80 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace MicroCv
+{
+// Every pixel buffer starts on a cache line, which is enough for any SIMD load or store
+const size_t PIXEL_ALIGNMENT = 64;
+
+/*
+ * Pixel buffers are recycled through a process wide pool: freed buffers are kept on a free list
+ * per size, so the repeated same sized allocations of batch processing reuse memory that is
+ * already mapped instead of going back to malloc (and taking fresh page faults) every time.
+ */
+void* allocatePixels(size_t bytes);
+void releasePixels(void* ptr, size_t bytes);
+
+// Most bytes kept on the free lists, 0 turns pooling off and frees everything cached so far
+void setBufferPoolCapacity(size_t bytes);
+size_t bufferPoolCapacity();
+// Bytes currently held on the free lists
+size_t bufferPoolCachedBytes();
+// Free every cached buffer
+void clearBufferPool();
+
+/*
+ * Allocator for pixel storage: aligned pooled memory and no value-initialization, so resizing a
+ * buffer that is about to be overwritten does not memset it first.
+ */
+template<typename T>
+class PixelAllocator
+{
+public:
+  typedef T value_type;
+
+  PixelAllocator() {}
+  template<typename U>
+  PixelAllocator(const PixelAllocator<U>&) {}
+
+  T* allocate(size_t n)
+  {
+    return static_cast<T*>(allocatePixels(n * sizeof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n)
+  {
+    releasePixels(ptr, n * sizeof(T));
+  }
+
+  // Default-initialize instead of value-initialize, the pixels are left as they are
+  template<typename U>
+  void construct(U* ptr)
+  {
+    ::new(static_cast<void*>(ptr)) U;
+  }
+
+  template<typename U, typename... Args>
+  void construct(U* ptr, Args&&... args)
+  {
+    ::new(static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+  }
+};
+
+template<typename T, typename U>
+bool operator==(const PixelAllocator<T>&, const PixelAllocator<U>&)
+{
+  return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const PixelAllocator<T>&, const PixelAllocator<U>&)
+{
+  return false;
+}
+};
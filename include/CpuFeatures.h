@@ -0,0 +1,30 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+
+// SIMD kernels are only compiled for x86 with a GCC compatible compiler, everything else uses scalar code
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MICROCV_X86_SIMD 1
+#endif
+
+namespace MicroCv
+{
+  // Instruction sets the kernels are written for (in increasing order)
+  enum SimdLevel
+  {
+    SimdScalar,
+    SimdSse2,
+    SimdSsse3,
+    SimdAvx2
+  };
+
+  // Best level supported by the CPU we are running on
+  SimdLevel detectSimdLevel();
+
+  // Level the kernels dispatch to - defaults to detectSimdLevel()
+  SimdLevel simdLevel();
+  // Force a lower level (e.g. for testing or benchmarking), it is clamped to what the CPU supports
+  void setSimdLevel(SimdLevel level);
+};
@@ -15,11 +15,47 @@ namespace MicroCv
     Jpeg,
     Png,
     Tiff,
+    Mcv, // Uncompressed MicroCv raw format (.mcv), rows are 64 byte aligned so files can be memory mapped
+    Pnm, // Binary PGM (gray) and PPM (RGB)
     Unsupported
   };
+
+  // Options for reading an image at a reduced size, e.g. for thumbnails and previews
+  struct ReadOptions
+  {
+    ReadOptions();
+
+    // Shrink the image to 1/scaleDenominator of its size: 1 (full size), 2, 4 or 8
+    int scaleDenominator;
+    // When set, the largest scale that keeps the image at least this size is used instead (0 ignores a dimension)
+    int targetWidth;
+    int targetHeight;
+    // Only the region [regionX1, regionX2) x [regionY1, regionY2) of the (scaled) image is read, the whole
+    // image is read if the region is empty or does not fit
+    int regionX1;
+    int regionY1;
+    int regionX2;
+    int regionY2;
+    // Layout of the result, full size reads split the decoded rows into planes a few rows at a time
+    MatLayout layout;
+    // Read 16 bit PNG and TIFF files into DepthU16 Mats instead of reducing them to 8 bits (other files
+    // are still read as DepthU8). DepthU16 Mats are always interleaved
+    bool keep16Bits;
+  };
+
   // Specific file types
   Mat readMatFromFile(const std::string& filename, ImageFileType type, bool& readOk);
-  bool writeMatToFile(const std::string& filename, const Mat& mat, ImageFileType type);
+  // JPEG is decoded at the reduced size, interlaced PNGs and pyramidal TIFFs read only their reduced
+  // image, everything else is decoded at full size and every block of pixels is averaged
+  // The result is ceil(width / scale) x ceil(height / scale), or the size of the stored TIFF level
+  // JPEGs decode only the blocks that intersect a region, TIFFs and uncompressed files only read its strips,
+  // tiles or rows and the other formats stop decoding after its last row
+  Mat readMatFromFile(const std::string& filename, ImageFileType type, const ReadOptions& options, bool& readOk);
+  // Read only the header of the file
+  bool readImageSize(const std::string& filename, ImageFileType type, int& width, int& height, int& channels);
+  // Planar views are merged back into interleaved rows a few rows at a time while encoding
+  // DepthU16 views are written as 16 bit PNG and TIFF files, the other formats only take DepthU8 views
+  bool writeMatToFile(const std::string& filename, const MatView& view, ImageFileType type);
 
   // Try to figure out filetype from string
   ImageFileType imageTypeFromFilename(const std::string& filename);
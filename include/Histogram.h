@@ -0,0 +1,32 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "Mat.h"
+
+namespace MicroCv
+{
+// Number of pixels of one channel with each of the 256 values
+typedef std::array<uint64_t, 256> Histogram;
+
+// One histogram per channel of the view, counted one band of rows per thread, empty unless the view is DepthU8
+std::vector<Histogram> computeHistograms(const MatView& view);
+
+// Exact statistics of one channel, the standard deviation is the population one (divided by n)
+struct ChannelStatistics
+{
+  int min;
+  int max;
+  double mean;
+  double stddev;
+};
+
+// Statistics of every channel of the view in one vectorized pass, empty for views without pixels or
+// that are not DepthU8
+std::vector<ChannelStatistics> channelStatistics(const MatView& view);
+};
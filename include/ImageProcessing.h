@@ -4,18 +4,176 @@
  *  @author Andrei Polzounov
  */
 
+#include <vector>
+
 #include "Mat.h"
 
 namespace MicroCv
 {
+  /*
+   * The functions taking an output Mat write the result into it, reusing its buffer when it is
+   * large enough, so calling them in a loop does not allocate. The output may be the input Mat.
+   * Planar inputs (see MatLayout) give planar outputs, the filters process one plane at a time.
+   * Only DepthU8 images are processed, the others give empty outputs unless stated otherwise.
+   */
+
   // Crop image
   void cropMat(Mat& mat, int x1, int y1, int x2, int y2);
+  void cropMat(const MatView& inputView, Mat& outputMat, int x1, int y1, int x2, int y2);
+  // Crop without copying - the returned view points into the pixels of the input
+  MatView cropView(const MatView& view, int x1, int y1, int x2, int y2);
+
+  // Weightings of the R, G and B channels when converting to gray
+  enum GrayConversion
+  {
+    GrayAverage, // (R + G + B) / 3
+    GrayBt601,   // 0.299 R + 0.587 G + 0.114 B (SDTV luma)
+    GrayBt709    // 0.2126 R + 0.7152 G + 0.0722 B (HDTV luma)
+  };
 
   // Color space conversions
-  Mat rgbToGray(const Mat& inputMat);
-  Mat grayToRgb(const Mat& inputMat);
+  Mat rgbToGray(const MatView& inputView, GrayConversion conversion = GrayAverage);
+  void rgbToGray(const MatView& inputView, Mat& outputMat, GrayConversion conversion = GrayAverage);
+  // Planar RGB inputs are converted plane by plane, grayToRgb writes RGB in the layout asked for
+  Mat grayToRgb(const MatView& inputView, MatLayout layout = LayoutInterleaved);
+  void grayToRgb(const MatView& inputView, Mat& outputMat, MatLayout layout = LayoutInterleaved);
+
+  // Copy of the image in the other channel layout (see MatLayout), the 3 and 4 channel images are
+  // split into planes and merged back in SIMD
+  Mat convertLayout(const MatView& inputView, MatLayout layout);
+  void convertLayout(const MatView& inputView, Mat& outputMat, MatLayout layout);
+
+  // Copy of the image with its values converted to another depth (see MatDepth): value * scale + offset,
+  // rounded and saturated for the integer depths, e.g. a scale of 1.0 / 257 maps 16 bit images to 8 bits.
+  // Planar images stay planar when converted to DepthU8, otherwise the result is interleaved
+  Mat convertDepth(const MatView& inputView, MatDepth depth, double scale = 1, double offset = 0);
+  void convertDepth(const MatView& inputView, Mat& outputMat, MatDepth depth, double scale = 1, double offset = 0);
+
+  // Resampling filter of resizeMat
+  enum ResizeMethod
+  {
+    ResizeArea,     // Average of the input area under every output pixel, the best choice for shrinking
+    ResizeBilinear, // Triangle filter, widened when shrinking so that every input pixel contributes
+    ResizeLanczos3  // Windowed sinc with 3 lobes, the sharpest (also widened when shrinking)
+  };
+
+  // Resize 1 or 3 channel images to width x height
+  Mat resizeMat(const MatView& inputView, int width, int height, ResizeMethod method = ResizeArea);
+  void resizeMat(const MatView& inputView, Mat& outputMat, int width, int height, ResizeMethod method = ResizeArea);
+
+  // How filters read the pixels outside the image
+  enum BorderMode
+  {
+    BorderConstant,  // Zeros
+    BorderReplicate, // The edge pixel repeated - aaa|abcd|ddd
+    BorderReflect    // Mirrored at the edge pixel, which is not repeated - dcb|abcd|cba
+  };
+
+  /*
+   * Integer convolution kernel with an odd width and height. Every channel of an output pixel is
+   * sum(weight * input pixel) / divisor + offset rounded half to even and saturated to [0, 255],
+   * where weights[0] is applied to the top-left neighbour (the kernel is not flipped). The sums are
+   * exact, so kernels are limited to 255 * sum(|weight|) < 2^24 and filter2D rejects larger ones.
+   */
+  struct FilterKernel
+  {
+    FilterKernel();
+    FilterKernel(int width, int height, const std::vector<int>& weights, int divisor = 1, int offset = 0);
+
+    int width;
+    int height;
+    std::vector<int> weights; // Row major
+    int divisor;
+    int offset;
+  };
+
+  // Common kernels, which filter2D runs on code specialized for their weights at compile time
+  // Derivatives are signed, use an offset of 128 to keep the negative half
+  FilterKernel sobelXKernel();           // [-1 0 1] smoothed by [1 2 1] vertically
+  FilterKernel sobelYKernel();           // [-1 0 1]^T smoothed by [1 2 1] horizontally
+  FilterKernel scharrXKernel();          // [-1 0 1] smoothed by [3 10 3] vertically
+  FilterKernel scharrYKernel();          // [-1 0 1]^T smoothed by [3 10 3] horizontally
+  FilterKernel laplacianKernel();        // 4-neighbour Laplacian
+  FilterKernel boxKernel(int size);      // Mean of size x size pixels (specialized for sizes 3 and 5)
+  FilterKernel binomialKernel(int size); // Binomial approximation of a Gaussian (specialized for sizes 3 and 5)
+
+  // Convolve every channel with the kernel, the output has the size and channels of the input
+  // Separable kernels are detected and filtered in two 1D passes
+  Mat filter2D(const MatView& inputView, const FilterKernel& kernel, BorderMode border = BorderReflect);
+  void filter2D(const MatView& inputView, Mat& outputMat, const FilterKernel& kernel, BorderMode border = BorderReflect);
+
+  // Gaussian blur of every channel with a standard deviation of sigma pixels. Sigmas up to 4 run a
+  // separable fixed point kernel of radius 4 * sigma in SIMD, larger sigmas a recursive filter
+  // (Young - van Vliet) whose cost does not depend on sigma, capped at 4096. A sigma of 0 copies the input
+  Mat gaussianBlur(const MatView& inputView, double sigma, BorderMode border = BorderReflect);
+  void gaussianBlur(const MatView& inputView, Mat& outputMat, double sigma, BorderMode border = BorderReflect);
+
+  // Mean of every channel over the (2 * radius + 1)^2 window around each pixel, rounded, where the
+  // window is clipped to the image. It is computed from an integral image (see IntegralImage.h),
+  // so the cost does not depend on the radius
+  Mat boxFilter(const MatView& inputView, int radius);
+  void boxFilter(const MatView& inputView, Mat& outputMat, int radius);
+
+  // Local mean binarization, e.g. of scanned documents: 255 where the gray pixel plus offset is at
+  // least the mean of the (2 * radius + 1)^2 window around it (clipped to the image), 0 elsewhere.
+  // The offset keeps the noise of flat backgrounds white. RGB images are converted to gray first.
+  // Also computed from an integral image
+  Mat adaptiveThreshold(const MatView& inputView, int radius, int offset = 10);
+  void adaptiveThreshold(const MatView& inputView, Mat& outputMat, int radius, int offset = 10);
+
+  // Morphology of every channel with the (2 * radiusX + 1) x (2 * radiusY + 1) rectangle around each
+  // pixel, clipped to the image. Rows take 1 + log2(radiusX) passes of SIMD min or max over shifted
+  // rows, columns run van Herk/Gil-Werman, whose 3 mins per pixel do not depend on radiusY
+  Mat erode(const MatView& inputView, int radiusX, int radiusY); // Minimum over the rectangle
+  void erode(const MatView& inputView, Mat& outputMat, int radiusX, int radiusY);
+  Mat dilate(const MatView& inputView, int radiusX, int radiusY); // Maximum over the rectangle
+  void dilate(const MatView& inputView, Mat& outputMat, int radiusX, int radiusY);
+  // Erode then dilate: removes bright details smaller than the rectangle
+  Mat morphologyOpen(const MatView& inputView, int radiusX, int radiusY);
+  void morphologyOpen(const MatView& inputView, Mat& outputMat, int radiusX, int radiusY);
+  // Dilate then erode: fills dark gaps smaller than the rectangle
+  Mat morphologyClose(const MatView& inputView, int radiusX, int radiusY);
+  void morphologyClose(const MatView& inputView, Mat& outputMat, int radiusX, int radiusY);
+  // Dilate minus erode: the outlines of the shapes
+  Mat morphologyGradient(const MatView& inputView, int radiusX, int radiusY);
+  void morphologyGradient(const MatView& inputView, Mat& outputMat, int radiusX, int radiusY);
+
+  // Histogram equalization of every channel: each value maps to its share of the pixels at or below
+  // it, so the least value of the image becomes 0 and the largest 255. An image of one value is copied
+  Mat equalizeHistogram(const MatView& inputView);
+  void equalizeHistogram(const MatView& inputView, Mat& outputMat);
+
+  // Contrast limited adaptive histogram equalization (CLAHE) of every channel. The image is split
+  // into tilesX x tilesY tiles that are equalized on their own after clipping their histograms at
+  // clipLimit times the mean count (0 does not clip), and every pixel blends the tables of the four
+  // nearest tiles so that no tile edges show
+  Mat equalizeHistogramClahe(const MatView& inputView, double clipLimit = 2.0, int tilesX = 8, int tilesY = 8);
+  void equalizeHistogramClahe(const MatView& inputView, Mat& outputMat, double clipLimit = 2.0, int tilesX = 8,
+      int tilesY = 8);
+
+  // How the Sobel x and y derivatives are combined into the edge magnitude
+  enum SobelMagnitude
+  {
+    SobelL1, // |Gx| + |Gy| saturated to 255
+    SobelL2  // sqrt(Gx^2 + Gy^2) rounded and saturated to 255
+  };
+
+  // Edge detection (high-pass filter), border pixels are set to 0
+  Mat sobelEdgeDetector(const MatView& inputView, SobelMagnitude magnitude = SobelL1);
+  void sobelEdgeDetector(const MatView& inputView, Mat& outputMat, SobelMagnitude magnitude = SobelL1);
+
+  // The Sobel derivatives themselves as DepthS16 images, without the saturation of the magnitude:
+  // Gx is positive where the image gets brighter to the right, Gy where it gets brighter downwards, the
+  // signs of sobelXKernel and sobelYKernel. Both are within +-1020. RGB images are converted to gray
+  // first, border pixels are set to 0
+  void sobelGradients(const MatView& inputView, Mat& gradientX, Mat& gradientY);
 
-  // Edge detection (high-pass filter)
-  Mat sobelEdgeDetector(const Mat& inputMat);
+  // Canny edge detection: thin, connected edges set to 255 on 0. The Sobel gradient is thinned to
+  // the pixels that are a maximum across the edge, those with a magnitude above highThreshold start
+  // edges and those above lowThreshold continue them. The magnitude is not saturated here, it goes up
+  // to 2040 for SobelL1 and 1443 for SobelL2. RGB images are converted to gray first
+  Mat cannyEdgeDetector(const MatView& inputView, int lowThreshold, int highThreshold, SobelMagnitude magnitude = SobelL1);
+  void cannyEdgeDetector(const MatView& inputView, Mat& outputMat, int lowThreshold, int highThreshold,
+      SobelMagnitude magnitude = SobelL1);
 };
 
@@ -0,0 +1,97 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * Instrumentation records how long every stage (decode, color conversion, Sobel, encode and the
+ * row bands they run on) takes, how many bytes it processed and the pixel buffer allocations of
+ * every thread. Recording is off by default and costs one atomic load per stage then, building
+ * with -DMICROCV_DISABLE_INSTRUMENTATION (cmake -DMICROCV_INSTRUMENTATION=OFF) removes it entirely.
+ */
+namespace MicroCv
+{
+  // Totals of one stage over all threads
+  struct StageStats
+  {
+    std::string name;
+    uint64_t calls;
+    uint64_t bytes;
+    double seconds;
+  };
+
+  // Pixel buffer allocations made by one thread
+  struct ThreadStats
+  {
+    int thread;
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+    // Allocations served from the free lists of the buffer pool
+    uint64_t poolHits;
+  };
+
+  // Record stage totals and allocation counts
+  void setStatsEnabled(bool enabled);
+  bool statsEnabled();
+  // Also keep every stage call as an event for writeChromeTrace(), implies setStatsEnabled(true)
+  void setTraceEnabled(bool enabled);
+  bool traceEnabled();
+
+  std::vector<StageStats> stageStats();
+  std::vector<ThreadStats> threadStats();
+  void resetStats();
+  // Human readable table of stageStats() and threadStats()
+  void printStats(std::ostream& out);
+  // Trace Event JSON that can be loaded in chrome://tracing or Perfetto, one timeline per thread
+  bool writeChromeTrace(const std::string& filename);
+
+  // Times one stage from construction to destruction, name must be a string literal
+  class StageTimer
+  {
+  public:
+    explicit StageTimer(const char* name, uint64_t bytes = 0);
+    ~StageTimer();
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+  private:
+    const char* name_;
+    uint64_t bytes_;
+    int64_t startNs_;
+  };
+
+  // Called by the buffer pool for every pixel buffer handed out
+  void recordAllocation(size_t bytes, bool fromPool);
+
+  // Turns on stats and/or tracing for a command line tool, then prints the stats to stdout and
+  // writes the trace file when it goes out of scope
+  class StatsSession
+  {
+  public:
+    StatsSession(bool showStats, const std::string& traceFilename);
+    ~StatsSession();
+
+  private:
+    bool printStats_;
+    std::string traceFilename_;
+  };
+};
+
+#ifdef MICROCV_DISABLE_INSTRUMENTATION
+#define MICROCV_STAGE(name, bytes) do {} while(0)
+#define MICROCV_RECORD_ALLOCATION(bytes, fromPool) do {} while(0)
+#else
+#define MICROCV_STAGE_JOIN2(a, b) a##b
+#define MICROCV_STAGE_JOIN(a, b) MICROCV_STAGE_JOIN2(a, b)
+// Time the rest of the enclosing scope as stage name
+#define MICROCV_STAGE(name, bytes) \
+  MicroCv::StageTimer MICROCV_STAGE_JOIN(microcvStageTimer, __LINE__)(name, static_cast<uint64_t>(bytes))
+#define MICROCV_RECORD_ALLOCATION(bytes, fromPool) MicroCv::recordAllocation(bytes, fromPool)
+#endif
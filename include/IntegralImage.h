@@ -0,0 +1,53 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+#include <vector>
+
+#include "Mat.h"
+
+namespace MicroCv
+{
+/*
+ * IntegralImage is the summed area table of an image: entry (x, y) of the table holds the sums of
+ * every channel over the pixels above and left of (x, y), so the sum over any box is four lookups.
+ * The table is (width + 1) x (height + 1) with a zero first row and column.
+ * 32 bit sums wrap around on images of more than 2^32 / 255 (16.8 million) pixels, but box sums
+ * are differences taken modulo 2^32, so they stay exact for any box smaller than that.
+ * 64 bit sums never wrap.
+ */
+template<typename T>
+class IntegralImage
+{
+public:
+  IntegralImage();
+  explicit IntegralImage(const MatView& view);
+
+  // Sum the pixels of view, one band of rows per thread, reusing the table when it is large enough
+  // Views that are not DepthU8 leave the table empty
+  void compute(const MatView& view);
+
+  // Size of the summed image
+  int width() const;
+  int height() const;
+  int channels() const;
+  bool empty() const;
+
+  // Row y of the table, (width + 1) * channels sums over the pixels of rows [0, y)
+  const T* row(int y) const;
+
+  // Sum of one channel over the pixels [x1, x2) x [y1, y2), the box is clipped to the image
+  T boxSum(int x1, int y1, int x2, int y2, int channel = 0) const;
+
+private:
+  int width_;
+  int height_;
+  int channels_;
+  std::vector<T> sums_;
+};
+
+typedef IntegralImage<uint32_t> IntegralImage32;
+typedef IntegralImage<uint64_t> IntegralImage64;
+};
@@ -0,0 +1,42 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstddef>
+#include <string>
+
+#include "Mat.h"
+
+namespace MicroCv
+{
+/*
+ * MappedImage memory maps an uncompressed image file (.mcv or a binary PGM/PPM with 8 bit
+ * samples) and exposes its pixels as a MatView without reading or copying them, the pages are
+ * only loaded from disk (or the page cache) when they are touched. This makes handing images
+ * between the stages of a multi-process pipeline nearly free.
+ *
+ * The view is only valid while the MappedImage is open.
+ */
+class MappedImage
+{
+public:
+  MappedImage();
+  ~MappedImage();
+
+  MappedImage(const MappedImage&) = delete;
+  MappedImage& operator=(const MappedImage&) = delete;
+
+  // Map the file, the format is recognized from its header. Returns false if it can not be mapped
+  bool open(const std::string& filename);
+  void close();
+  bool isOpen() const;
+
+  MatView view() const;
+
+private:
+  void* mapping_;
+  size_t mappingSize_;
+  MatView view_;
+};
+};
@@ -3,44 +3,186 @@
  *  Micro Computer Vision library
  *  @author Andrei Polzounov
  */
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <vector>
 
+#include "BufferPool.h"
+
 namespace MicroCv
 {
+class MatView;
+
+// Pixel storage: 64 byte aligned, pooled and not zero-filled on resize
+typedef std::vector<uint8_t, PixelAllocator<uint8_t>> PixelBuffer;
+
+// Row size in bytes rounded up so that every row starts on a PIXEL_ALIGNMENT boundary
+int alignedStride(int width, int channels);
+
+// How the channels of the pixels are stored
+enum MatLayout
+{
+  LayoutInterleaved, // RGBRGB... - every row holds all channels of its pixels
+  LayoutPlanar       // RR...GG...BB... - one plane of continuous rows per channel, every plane
+                     // starting on a PIXEL_ALIGNMENT boundary. Gray images are always interleaved
+};
+
+// Type of the values of the pixels. The image processing functions work on DepthU8 images, the
+// other depths hold data that 8 bits cannot, e.g. 16 bit files or signed gradients
+enum MatDepth
+{
+  DepthU8,  // uint8_t
+  DepthU16, // uint16_t
+  DepthS16, // int16_t
+  DepthF32  // float
+};
+
+// Size of one value of a depth in bytes
+int depthSize(MatDepth depth);
+
+// Depth of an element type, e.g. DepthOf<int16_t>::value is DepthS16
+template<typename T> struct DepthOf;
+template<> struct DepthOf<uint8_t> { static const MatDepth value = DepthU8; };
+template<> struct DepthOf<uint16_t> { static const MatDepth value = DepthU16; };
+template<> struct DepthOf<int16_t> { static const MatDepth value = DepthS16; };
+template<> struct DepthOf<float> { static const MatDepth value = DepthF32; };
+
 /*
  * Mat is a simple container for an RGB or grayscale image
+ * Rows are continuous unless a larger stride is passed to resize()
+ * The channels are interleaved unless the Mat is resized with LayoutPlanar, then row(y) is row y
+ * of the first plane and plane(c) points to the plane of channel c
+ * The values are bytes unless the Mat is resized with another MatDepth, row<T>(y) then points to
+ * the values of row y as T. Strides are in bytes whatever the depth. Planar Mats are always DepthU8
+ *
+ * Copies share the pixel buffer (copy-on-write): the non-const accessors make a private copy of
+ * the pixels first if the buffer is shared, so pointers returned by them are only valid until the
+ * Mat is copied. Moving a Mat never copies pixels.
  */
 class Mat
 {
 public:
   Mat();
   Mat(const Mat& rhs);
+  Mat(Mat&& rhs) noexcept;
+  // The pixels of a new Mat are set to 0
   Mat(int width, int height, int channels);
+  Mat(int width, int height, int channels, MatLayout layout);
+  Mat(int width, int height, int channels, MatDepth depth);
+  // Deep copy of the pixels seen through a view, in the layout and depth of the view
+  explicit Mat(const MatView& view);
   virtual ~Mat();
 
   Mat& operator=(const Mat& rhs);
+  Mat& operator=(Mat&& rhs) noexcept;
   bool operator==(const Mat& rhs) const;
 
   bool isGrayscale() const;
 
-  // Pixel data accessors
+  // Pixel data accessors, the non-const ones unshare the buffer
   uint8_t* data();
   const uint8_t* data() const;
+  uint8_t* row(int y);
+  const uint8_t* row(int y) const;
+  // Row y as values of the depth of the Mat, e.g. row<int16_t>(y) of a DepthS16 Mat
+  template<typename T> T* row(int y) { return reinterpret_cast<T*>(row(y)); }
+  template<typename T> const T* row(int y) const { return reinterpret_cast<const T*>(row(y)); }
+  // First pixel of the plane of a channel of a planar Mat (or of a gray Mat)
+  uint8_t* plane(int channel);
+  const uint8_t* plane(int channel) const;
+  // True if the pixel buffer is shared with a copy of this Mat
+  bool isShared() const;
 
   int width() const;
   int height() const;
   int channels() const;
+  // Number of bytes between the starts of two consecutive rows
+  int stride() const;
+  // True if there are no gaps between rows
+  bool isContinuous() const;
+  MatLayout layout() const;
+  bool isPlanar() const;
+  // Number of bytes between the starts of two consecutive planes, 0 unless the Mat is planar
+  size_t planeStride() const;
+  MatDepth depth() const;
+  // Size of one value in bytes
+  int elementSize() const;
 
-  std::vector<uint8_t>* vectorPtr();
+  PixelBuffer* vectorPtr();
+  // The pixels are left uninitialized, the buffer is reused when it is large enough
   void resize(int width, int height, int channels);
+  // Rows are stride bytes apart (at least width*channels), e.g. alignedStride(width, channels)
+  void resize(int width, int height, int channels, int stride);
+  // Interleaved as above, or one continuous plane of width * height bytes per channel
+  void resize(int width, int height, int channels, MatLayout layout);
+  // Continuous interleaved rows of width * channels values of the depth, the other resizes make a DepthU8 Mat
+  void resize(int width, int height, int channels, MatDepth depth);
   void reserve(int width, int height, int channels);
+  void swap(Mat& other);
+
+private:
+  // Make the buffer private to this Mat before it is written
+  void detach();
+
+  std::shared_ptr<PixelBuffer> data_;
+  int width_;
+  int height_;
+  int channels_;
+  int stride_;
+  size_t planeStride_;
+  MatDepth depth_;
+};
+
+/*
+ * MatView is a non-owning view onto pixel memory, usually a Mat or a region of one.
+ * Rows are stride() bytes apart, so a sub-region can be viewed without copying.
+ * Views of planar Mats are planar too, row(y) is then row y of the first plane.
+ * Views have the depth of what they view, row<T>(y) reads the values of other depths.
+ * The viewed memory must outlive the view.
+ */
+class MatView
+{
+public:
+  MatView();
+  MatView(const Mat& mat);
+  MatView(const uint8_t* data, int width, int height, int channels, int stride);
+  // Planar view of channels planes that start planeStride bytes apart
+  MatView(const uint8_t* data, int width, int height, int channels, int stride, size_t planeStride);
+  // Interleaved view of values of any depth, the stride is in bytes
+  MatView(const uint8_t* data, int width, int height, int channels, int stride, MatDepth depth);
+
+  bool isGrayscale() const;
+  // True if there are no gaps between rows
+  bool isContinuous() const;
+  bool empty() const;
+
+  // Pixel data accessors
+  const uint8_t* data() const;
+  const uint8_t* row(int y) const;
+  template<typename T> const T* row(int y) const { return reinterpret_cast<const T*>(row(y)); }
+
+  int width() const;
+  int height() const;
+  int channels() const;
+  int stride() const;
+  MatLayout layout() const;
+  bool isPlanar() const;
+  size_t planeStride() const;
+  MatDepth depth() const;
+  int elementSize() const;
+
+  // Gray view of one channel of a planar view, a gray view is its own plane 0
+  MatView plane(int channel) const;
 
 private:
-  std::vector<uint8_t> data_;
+  const uint8_t* data_;
   int width_;
   int height_;
   int channels_;
+  int stride_;
+  size_t planeStride_;
+  MatDepth depth_;
 };
 
 };
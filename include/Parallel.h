@@ -0,0 +1,78 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MicroCv
+{
+/*
+ * ThreadPool is a fixed set of worker threads that run batches of indexed tasks.
+ * The calling thread works on the batch too, and calls made from inside a task run inline,
+ * so nested parallel code can never deadlock the pool.
+ */
+class ThreadPool
+{
+public:
+  explicit ThreadPool(int numWorkers);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Number of worker threads (not counting callers of run())
+  int numWorkers() const;
+
+  // Call task(i) for every i in [0, numTasks) and return once all of them are done
+  // The first exception thrown by a task is rethrown here
+  void run(int numTasks, const std::function<void(int)>& task);
+
+  // True when called from a thread that belongs to any ThreadPool
+  static bool isWorkerThread();
+
+private:
+  void workerLoop();
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> queue_;
+  std::mutex mutex_;
+  std::condition_variable wakeUp_;
+  bool stopping_;
+};
+
+// Number of threads the image processing functions use, defaults to the number of cores
+int numThreads();
+// 0 resets to the number of cores and 1 runs everything on the calling thread
+// Must not be called while image processing functions are running
+void setNumThreads(int threads);
+
+// A horizontal band of rows [begin, end) processed by one task
+// Neighbourhood operations may also read the halo rows [haloBegin, haloEnd), which are clamped to the image
+struct RowBand
+{
+  int begin;
+  int end;
+  int haloBegin;
+  int haloEnd;
+};
+
+// Split height rows into at most numBands bands of (almost) equal size
+std::vector<RowBand> partitionRows(int height, int numBands, int halo);
+
+// The bands parallelForRows() splits an image into for the current numThreads()
+// Small images are not split so that the threading overhead never dominates
+std::vector<RowBand> rowBands(int width, int height, int halo);
+
+// Call fn(i) for every band index i using numThreads() threads, for passes that have to run over
+// the same bands more than once
+void parallelForBands(const std::vector<RowBand>& bands, const std::function<void(int)>& fn);
+
+// Split an image into row bands and call fn on each band using numThreads() threads
+void parallelForRows(int width, int height, int halo, const std::function<void(const RowBand&)>& fn);
+};
@@ -0,0 +1,78 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <vector>
+
+#include "ImageProcessing.h"
+#include "Mat.h"
+
+namespace MicroCv
+{
+/*
+ * Pipeline is a lazy chain of image operations on a view, nothing is computed until evaluate().
+ * The whole chain is then evaluated band by band in a single pass: every stage produces its rows
+ * on demand from the rows of the stage before it, so the intermediate images only ever exist as a
+ * few rows in cache and the only full size buffer is the output.
+ *
+ *   Mat edges = Pipeline(image).crop(10, 10, 200, 100).sobel().evaluate();
+ *   Mat smoothEdges = Pipeline(noisyFrame).gray().blur(1.5).sobel().evaluate();
+ */
+class Pipeline
+{
+public:
+  explicit Pipeline(const MatView& input);
+
+  // Same bounds rules as cropMat(), an invalid region leaves the image as it is
+  // A crop before any neighbourhood operation only narrows the input view
+  Pipeline& crop(int x1, int y1, int x2, int y2);
+  // Same as rgbToGray(), gray images are passed through
+  Pipeline& gray(GrayConversion conversion = GrayAverage);
+  // Same as gaussianBlur() for sigmas up to 4. Larger sigmas keep the fixed point kernel here, whose
+  // cost grows with sigma, as the recursive filter of gaussianBlur() needs whole columns
+  Pipeline& blur(double sigma, BorderMode border = BorderReflect);
+  // Same as sobelEdgeDetector(), RGB images are converted to gray on the fly
+  Pipeline& sobel(SobelMagnitude magnitude = SobelL1);
+
+  // Size of the result, 0 when the chain can not be applied to the input (or it is not DepthU8)
+  int width() const;
+  int height() const;
+  int channels() const;
+
+  // Run the chain on numThreads() threads
+  Mat evaluate() const;
+  // Same, writing into outputMat and reusing its buffer (outputMat may hold the input pixels)
+  void evaluate(Mat& outputMat) const;
+
+private:
+  enum StageType
+  {
+    StageCrop,
+    StageGray,
+    StageBlur,
+    StageSobel
+  };
+
+  struct Stage
+  {
+    StageType type;
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+    GrayConversion conversion;
+    double sigma;
+    BorderMode border;
+    SobelMagnitude magnitude;
+  };
+
+  Stage& addStage(StageType type);
+
+  MatView input_;
+  std::vector<Stage> stages_;
+  int width_;
+  int height_;
+  int channels_;
+};
+};
@@ -0,0 +1,149 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "FileIo.h"
+#include "ImageProcessing.h"
+#include "Mat.h"
+
+namespace MicroCv
+{
+namespace Codecs
+{
+class ImageDecoder;
+};
+namespace Kernels
+{
+class SobelEngine;
+};
+
+/*
+ * RowSource produces an image one row at a time, from top to bottom.
+ * Sources are chained into a pipeline (decoder -> filters -> encoder) that only ever keeps a
+ * few rows in memory, so the memory use is proportional to the image width, not its area.
+ */
+class RowSource
+{
+public:
+  virtual ~RowSource();
+
+  virtual int width() const = 0;
+  virtual int height() const = 0;
+  virtual int channels() const = 0;
+
+  // Pointer to the next row, it stays valid until the next call
+  // Returns nullptr once all rows have been read or if the input failed
+  virtual const uint8_t* nextRow() = 0;
+};
+
+// Decodes an image file row by row
+class FileRowSource : public RowSource
+{
+public:
+  FileRowSource();
+  ~FileRowSource();
+
+  // Read the header of the file, returns false if it can not be decoded
+  bool open(const std::string& filename, ImageFileType type);
+
+  int width() const;
+  int height() const;
+  int channels() const;
+  const uint8_t* nextRow();
+
+private:
+  std::unique_ptr<Codecs::ImageDecoder> decoder_;
+  std::vector<uint8_t> row_;
+  int rowsRead_;
+};
+
+// Rows of an image that is already in memory (no copies are made, except that the rows of planar
+// images are merged into interleaved pixels)
+class ViewRowSource : public RowSource
+{
+public:
+  explicit ViewRowSource(const MatView& view);
+
+  int width() const;
+  int height() const;
+  int channels() const;
+  const uint8_t* nextRow();
+
+private:
+  MatView view_;
+  std::vector<uint8_t> row_;
+  int rowsRead_;
+};
+
+// Row-local RGB to gray conversion, gray input is passed through
+class GrayRowFilter : public RowSource
+{
+public:
+  GrayRowFilter(RowSource& input, GrayConversion conversion = GrayAverage);
+
+  int width() const;
+  int height() const;
+  int channels() const;
+  const uint8_t* nextRow();
+
+private:
+  RowSource& input_;
+  GrayConversion conversion_;
+  std::vector<uint8_t> row_;
+};
+
+// Crop with the same bounds rules as cropMat(), rows above the region are skipped
+// and the remaining rows are returned in place (offset by x1)
+class CropRowFilter : public RowSource
+{
+public:
+  CropRowFilter(RowSource& input, int x1, int y1, int x2, int y2);
+
+  int width() const;
+  int height() const;
+  int channels() const;
+  const uint8_t* nextRow();
+
+private:
+  RowSource& input_;
+  int x1_;
+  int y1_;
+  int width_;
+  int height_;
+  int rowsRead_;
+};
+
+// Sobel edge detector over a sliding window of three input rows, same output as sobelEdgeDetector()
+class SobelRowFilter : public RowSource
+{
+public:
+  SobelRowFilter(RowSource& input, SobelMagnitude magnitude = SobelL1);
+  ~SobelRowFilter();
+
+  int width() const;
+  int height() const;
+  int channels() const;
+  const uint8_t* nextRow();
+
+private:
+  bool pushInputRow();
+
+  RowSource& input_;
+  std::unique_ptr<Kernels::SobelEngine> engine_;
+  std::vector<uint8_t> grayRow_;
+  std::vector<uint8_t> row_;
+  int rowsRead_;
+};
+
+// Pull every row out of a source and encode it, returns false if reading or writing failed
+bool writeRowsToFile(const std::string& filename, RowSource& source, ImageFileType type);
+
+// Pull every row out of a source into a Mat, returns false if reading failed
+bool readRowsIntoMat(RowSource& source, Mat& mat);
+};
@@ -0,0 +1,127 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "BufferPool.h"
+#include "Instrumentation.h"
+
+namespace
+{
+  // Default upper limit of the memory kept on the free lists
+  const size_t DEFAULT_POOL_CAPACITY = 256u << 20;
+
+  struct BufferPoolState
+  {
+    BufferPoolState() : capacity(DEFAULT_POOL_CAPACITY), cachedBytes(0) {}
+
+    std::mutex mutex;
+    std::unordered_map<size_t, std::vector<void*>> freeLists;
+    size_t capacity;
+    size_t cachedBytes;
+  };
+
+  // Never destroyed, Mats in static storage may release their buffers after main() returns
+  BufferPoolState& poolState()
+  {
+    static BufferPoolState* state = new BufferPoolState();
+    return *state;
+  }
+
+  inline size_t roundUpSize(size_t bytes)
+  {
+    return (bytes + MicroCv::PIXEL_ALIGNMENT - 1) & ~(MicroCv::PIXEL_ALIGNMENT - 1);
+  }
+
+  // Called with the pool locked
+  void freeCachedBuffers(BufferPoolState& state)
+  {
+    for(auto itr = state.freeLists.begin(); itr != state.freeLists.end(); ++itr)
+    {
+      for(auto ptr = itr->second.begin(); ptr != itr->second.end(); ++ptr)
+        std::free(*ptr);
+    }
+    state.freeLists.clear();
+    state.cachedBytes = 0;
+  }
+}
+
+void* MicroCv::allocatePixels(size_t bytes)
+{
+  if(bytes == 0)
+    return nullptr;
+  const size_t size = roundUpSize(bytes);
+
+  BufferPoolState& state = poolState();
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    auto itr = state.freeLists.find(size);
+    if(itr != state.freeLists.end() && !itr->second.empty())
+    {
+      void* ptr = itr->second.back();
+      itr->second.pop_back();
+      state.cachedBytes -= size;
+      MICROCV_RECORD_ALLOCATION(size, true);
+      return ptr;
+    }
+  }
+
+  void* ptr = nullptr;
+  if(posix_memalign(&ptr, PIXEL_ALIGNMENT, size) != 0)
+    throw std::bad_alloc();
+  MICROCV_RECORD_ALLOCATION(size, false);
+  return ptr;
+}
+
+void MicroCv::releasePixels(void* ptr, size_t bytes)
+{
+  if(!ptr)
+    return;
+  const size_t size = roundUpSize(bytes);
+
+  BufferPoolState& state = poolState();
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if(state.cachedBytes + size <= state.capacity)
+    {
+      state.freeLists[size].push_back(ptr);
+      state.cachedBytes += size;
+      return;
+    }
+  }
+  std::free(ptr);
+}
+
+void MicroCv::setBufferPoolCapacity(size_t bytes)
+{
+  BufferPoolState& state = poolState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.capacity = bytes;
+  if(state.cachedBytes > bytes)
+    freeCachedBuffers(state);
+}
+
+size_t MicroCv::bufferPoolCapacity()
+{
+  BufferPoolState& state = poolState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return state.capacity;
+}
+
+size_t MicroCv::bufferPoolCachedBytes()
+{
+  BufferPoolState& state = poolState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return state.cachedBytes;
+}
+
+void MicroCv::clearBufferPool()
+{
+  BufferPoolState& state = poolState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  freeCachedBuffers(state);
+}
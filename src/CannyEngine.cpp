@@ -0,0 +1,519 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "CannyEngine.h"
+#include "Instrumentation.h"
+#include "LumaKernels.h"
+#include "Parallel.h"
+#include "SobelEngine.h"
+
+#ifdef MICROCV_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace MicroCv;
+using namespace MicroCv::Kernels;
+
+namespace
+{
+  // Labels in the output while the edges are traced, strong pixels are already final
+  const uint8_t LABEL_NONE = 0;
+  const uint8_t LABEL_WEAK = 1;
+  const uint8_t LABEL_STRONG = 255;
+
+  // tan(22.5 degrees) in 15 bit fixed point, tan(67.5 degrees) is 2 more
+  const int TAN_22_5 = 13573;
+  // Larger than any magnitude, so the squares of the thresholds fit int32 for SobelL2
+  const int MAX_THRESHOLD = 4096;
+
+  // Gx and Gy of one row and the magnitude they are compared with, squared for SobelL2
+  struct GradientRow
+  {
+    explicit GradientRow(int width)
+    : gx(width)
+    , gy(width)
+    , magnitude(width)
+    {
+    }
+
+    std::vector<int16_t> gx;
+    std::vector<int16_t> gy;
+    std::vector<int32_t> magnitude;
+  };
+
+  void magnitudeRowScalar(const int16_t* gx, const int16_t* gy, int32_t* magnitude, int x, int width,
+      SobelMagnitude norm)
+  {
+    if(norm == SobelL2)
+    {
+      for(; x < width; x++)
+        magnitude[x] = gx[x]*gx[x] + gy[x]*gy[x];
+    }
+    else
+    {
+      for(; x < width; x++)
+        magnitude[x] = std::abs(gx[x]) + std::abs(gy[x]);
+    }
+  }
+
+#ifdef MICROCV_X86_SIMD
+  __attribute__((target("sse2")))
+  inline __m128i absSse2(__m128i v)
+  {
+    return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+  }
+
+  __attribute__((target("sse2")))
+  int magnitudeRowSse2(const int16_t* gx, const int16_t* gy, int32_t* magnitude, int x, int width, SobelMagnitude norm)
+  {
+    for(; x + 8 <= width; x += 8)
+    {
+      __m128i gxv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gx + x));
+      __m128i gyv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gy + x));
+      __m128i lo, hi;
+      if(norm == SobelL2)
+      {
+        lo = _mm_unpacklo_epi16(gxv, gyv);
+        hi = _mm_unpackhi_epi16(gxv, gyv);
+        lo = _mm_madd_epi16(lo, lo);
+        hi = _mm_madd_epi16(hi, hi);
+      }
+      else
+      {
+        // At most 2040, so the sum does not wrap and widens with zeros
+        __m128i sum = _mm_add_epi16(absSse2(gxv), absSse2(gyv));
+        lo = _mm_unpacklo_epi16(sum, _mm_setzero_si128());
+        hi = _mm_unpackhi_epi16(sum, _mm_setzero_si128());
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(magnitude + x), lo);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(magnitude + x + 4), hi);
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  int magnitudeRowAvx2(const int16_t* gx, const int16_t* gy, int32_t* magnitude, int x, int width, SobelMagnitude norm)
+  {
+    for(; x + 8 <= width; x += 8)
+    {
+      __m256i gxv = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(gx + x)));
+      __m256i gyv = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(gy + x)));
+      __m256i m;
+      if(norm == SobelL2)
+        m = _mm256_add_epi32(_mm256_mullo_epi32(gxv, gxv), _mm256_mullo_epi32(gyv, gyv));
+      else
+        m = _mm256_add_epi32(_mm256_abs_epi32(gxv), _mm256_abs_epi32(gyv));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(magnitude + x), m);
+    }
+    return x;
+  }
+#endif
+
+  void magnitudeRow(const int16_t* gx, const int16_t* gy, int32_t* magnitude, int width, SobelMagnitude norm,
+      SimdLevel level)
+  {
+    int x = 0;
+#ifdef MICROCV_X86_SIMD
+    if(level >= SimdAvx2)
+      x = magnitudeRowAvx2(gx, gy, magnitude, x, width, norm);
+    if(level >= SimdSse2)
+      x = magnitudeRowSse2(gx, gy, magnitude, x, width, norm);
+#else
+    (void)level;
+#endif
+    magnitudeRowScalar(gx, gy, magnitude, x, width, norm);
+  }
+
+  /*
+   * Non-maximum suppression of the middle row: a pixel above low stays when it is larger than
+   * both neighbours along its gradient, quantized to horizontal, vertical or one of the
+   * diagonals. Ties go to the first neighbour, so a plateau keeps one pixel instead of two.
+   * Gy is bottom minus top, so the gradient points down and right when Gx and Gy have the same sign.
+   */
+  int suppressRowScalar(const int32_t* above, const int32_t* middle, const int32_t* below, const int16_t* gx,
+      const int16_t* gy, int x, int end, int32_t low, int32_t high, uint8_t* labels, std::vector<uint8_t*>& strong)
+  {
+    for(; x < end; x++)
+    {
+      const int32_t m = middle[x];
+      labels[x] = LABEL_NONE;
+      if(m <= low)
+        continue;
+
+      const int ax = std::abs(gx[x]);
+      const int ay = std::abs(gy[x]) << 15;
+      const int tan22 = ax * TAN_22_5;
+      bool isMaximum;
+      if(ay < tan22)
+        isMaximum = m > middle[x-1] && m >= middle[x+1];
+      else if(ay > tan22 + (ax << 16))
+        isMaximum = m > above[x] && m >= below[x];
+      else
+      {
+        const int d = (gx[x] ^ gy[x]) < 0 ? -1 : 1;
+        isMaximum = m > above[x-d] && m > below[x+d];
+      }
+      if(!isMaximum)
+        continue;
+      if(m > high)
+      {
+        labels[x] = LABEL_STRONG;
+        strong.push_back(labels + x);
+      }
+      else
+        labels[x] = LABEL_WEAK;
+    }
+    return x;
+  }
+
+#ifdef MICROCV_X86_SIMD
+  // Stack the pixels whose bit is set in mask, bit i is the pixel at labels[i]
+  inline void pushStrong(uint32_t mask, uint8_t* labels, std::vector<uint8_t*>& strong)
+  {
+    for(; mask != 0; mask &= mask - 1)
+      strong.push_back(labels + __builtin_ctz(mask));
+  }
+
+  /*
+   * The vector paths decide all directions for every pixel and select with masks. The scalar
+   * tests are rewritten around A = |gx| * tan22 - |gy| << 15: horizontal is A > 0 and vertical
+   * is A + |gx| << 16 < 0, which are the same integers so the labels are too.
+   */
+  __attribute__((target("sse2")))
+  inline __m128i greaterSse2(__m128i a, const int32_t* b)
+  {
+    return _mm_cmpgt_epi32(a, _mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+  }
+
+  // Maxima of 4 pixels at x along the direction selected by the horizontal, vertical and rising masks
+  __attribute__((target("sse2")))
+  inline __m128i maximum4Sse2(const int32_t* above, const int32_t* middle, const int32_t* below, int x,
+      __m128i horizontal, __m128i vertical, __m128i rising)
+  {
+    __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(middle + x));
+    __m128i rightAbove = _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(middle + x + 1)), m);
+    __m128i belowAbove = _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x)), m);
+    __m128i alongRow = _mm_andnot_si128(rightAbove, greaterSse2(m, middle + x - 1));
+    __m128i alongColumn = _mm_andnot_si128(belowAbove, greaterSse2(m, above + x));
+    __m128i antiDiagonal = _mm_and_si128(greaterSse2(m, above + x - 1), greaterSse2(m, below + x + 1));
+    __m128i diagonal = _mm_and_si128(greaterSse2(m, above + x + 1), greaterSse2(m, below + x - 1));
+    __m128i result = _mm_or_si128(_mm_and_si128(rising, diagonal), _mm_andnot_si128(rising, antiDiagonal));
+    result = _mm_or_si128(_mm_and_si128(vertical, alongColumn), _mm_andnot_si128(vertical, result));
+    return _mm_or_si128(_mm_and_si128(horizontal, alongRow), _mm_andnot_si128(horizontal, result));
+  }
+
+  // Keep and strong masks of 8 pixels at x as int16 lanes
+  __attribute__((target("sse2")))
+  inline void suppress8Sse2(const int32_t* above, const int32_t* middle, const int32_t* below, const int16_t* gx,
+      const int16_t* gy, int x, __m128i low, __m128i high, __m128i& keep, __m128i& strong)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i tanPair = _mm_unpacklo_epi16(_mm_set1_epi16(TAN_22_5), _mm_set1_epi16(-32768));
+    __m128i gxv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gx + x));
+    __m128i gyv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gy + x));
+    __m128i ax = absSse2(gxv);
+    __m128i ay = absSse2(gyv);
+    __m128i sign = _mm_srai_epi16(_mm_xor_si128(gxv, gyv), 15);
+
+    __m128i keepHalves[2], strongHalves[2];
+    for(int half = 0; half < 2; half++)
+    {
+      __m128i pair = half == 0 ? _mm_unpacklo_epi16(ax, ay) : _mm_unpackhi_epi16(ax, ay);
+      __m128i axShifted = half == 0 ? _mm_unpacklo_epi16(zero, ax) : _mm_unpackhi_epi16(zero, ax);
+      __m128i rising = half == 0 ? _mm_unpacklo_epi16(sign, sign) : _mm_unpackhi_epi16(sign, sign);
+      __m128i a = _mm_madd_epi16(pair, tanPair);
+      __m128i horizontal = _mm_cmpgt_epi32(a, zero);
+      __m128i vertical = _mm_cmplt_epi32(_mm_add_epi32(a, axShifted), zero);
+      const int at = x + 4 * half;
+      __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(middle + at));
+      keepHalves[half] = _mm_and_si128(maximum4Sse2(above, middle, below, at, horizontal, vertical, rising),
+          _mm_cmpgt_epi32(m, low));
+      strongHalves[half] = _mm_and_si128(keepHalves[half], _mm_cmpgt_epi32(m, high));
+    }
+    keep = _mm_packs_epi32(keepHalves[0], keepHalves[1]);
+    strong = _mm_packs_epi32(strongHalves[0], strongHalves[1]);
+  }
+
+  __attribute__((target("sse2")))
+  int suppressRowSse2(const int32_t* above, const int32_t* middle, const int32_t* below, const int16_t* gx,
+      const int16_t* gy, int x, int end, int32_t low, int32_t high, uint8_t* labels, std::vector<uint8_t*>& strong)
+  {
+    const __m128i lowV = _mm_set1_epi32(low);
+    const __m128i highV = _mm_set1_epi32(high);
+    for(; x + 16 <= end; x += 16)
+    {
+      __m128i keep0, strong0, keep1, strong1;
+      suppress8Sse2(above, middle, below, gx, gy, x, lowV, highV, keep0, strong0);
+      suppress8Sse2(above, middle, below, gx, gy, x + 8, lowV, highV, keep1, strong1);
+      __m128i keep = _mm_packs_epi16(keep0, keep1);
+      __m128i strongMask = _mm_packs_epi16(strong0, strong1);
+      // Strong masks are 0xFF, which is LABEL_STRONG
+      __m128i label = _mm_or_si128(_mm_and_si128(keep, _mm_set1_epi8(LABEL_WEAK)), strongMask);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(labels + x), label);
+      pushStrong(static_cast<uint32_t>(_mm_movemask_epi8(strongMask)), labels + x, strong);
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i greaterAvx2(__m256i a, const int32_t* b)
+  {
+    return _mm256_cmpgt_epi32(a, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)));
+  }
+
+  // Keep and strong masks of 8 pixels at x as int32 lanes
+  __attribute__((target("avx2")))
+  inline void suppress8Avx2(const int32_t* above, const int32_t* middle, const int32_t* below, const int16_t* gx,
+      const int16_t* gy, int x, __m256i low, __m256i high, __m256i& keep, __m256i& strong)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i gxv = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(gx + x)));
+    __m256i gyv = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(gy + x)));
+    __m256i ax = _mm256_abs_epi32(gxv);
+    __m256i a = _mm256_sub_epi32(_mm256_mullo_epi32(ax, _mm256_set1_epi32(TAN_22_5)),
+        _mm256_slli_epi32(_mm256_abs_epi32(gyv), 15));
+    __m256i horizontal = _mm256_cmpgt_epi32(a, zero);
+    __m256i vertical = _mm256_cmpgt_epi32(zero, _mm256_add_epi32(a, _mm256_slli_epi32(ax, 16)));
+    __m256i rising = _mm256_srai_epi32(_mm256_xor_si256(gxv, gyv), 31);
+
+    __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(middle + x));
+    __m256i rightAbove = _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(middle + x + 1)), m);
+    __m256i belowAbove = _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(below + x)), m);
+    __m256i alongRow = _mm256_andnot_si256(rightAbove, greaterAvx2(m, middle + x - 1));
+    __m256i alongColumn = _mm256_andnot_si256(belowAbove, greaterAvx2(m, above + x));
+    __m256i antiDiagonal = _mm256_and_si256(greaterAvx2(m, above + x - 1), greaterAvx2(m, below + x + 1));
+    __m256i diagonal = _mm256_and_si256(greaterAvx2(m, above + x + 1), greaterAvx2(m, below + x - 1));
+    __m256i result = _mm256_blendv_epi8(antiDiagonal, diagonal, rising);
+    result = _mm256_blendv_epi8(result, alongColumn, vertical);
+    result = _mm256_blendv_epi8(result, alongRow, horizontal);
+    keep = _mm256_and_si256(result, _mm256_cmpgt_epi32(m, low));
+    strong = _mm256_and_si256(keep, _mm256_cmpgt_epi32(m, high));
+  }
+
+  // 16 int32 masks to 16 bytes in pixel order
+  __attribute__((target("avx2")))
+  inline __m128i packMasksAvx2(__m256i first, __m256i second)
+  {
+    // The pack interleaves the 128 bit lanes of its inputs, put the 64 bit blocks back in order
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(first, second), 0xD8);
+    return _mm_packs_epi16(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1));
+  }
+
+  __attribute__((target("avx2")))
+  int suppressRowAvx2(const int32_t* above, const int32_t* middle, const int32_t* below, const int16_t* gx,
+      const int16_t* gy, int x, int end, int32_t low, int32_t high, uint8_t* labels, std::vector<uint8_t*>& strong)
+  {
+    const __m256i lowV = _mm256_set1_epi32(low);
+    const __m256i highV = _mm256_set1_epi32(high);
+    for(; x + 16 <= end; x += 16)
+    {
+      __m256i keep0, strong0, keep1, strong1;
+      suppress8Avx2(above, middle, below, gx, gy, x, lowV, highV, keep0, strong0);
+      suppress8Avx2(above, middle, below, gx, gy, x + 8, lowV, highV, keep1, strong1);
+      __m128i keep = packMasksAvx2(keep0, keep1);
+      __m128i strongMask = packMasksAvx2(strong0, strong1);
+      __m128i label = _mm_or_si128(_mm_and_si128(keep, _mm_set1_epi8(LABEL_WEAK)), strongMask);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(labels + x), label);
+      pushStrong(static_cast<uint32_t>(_mm_movemask_epi8(strongMask)), labels + x, strong);
+    }
+    return x;
+  }
+#endif
+
+  /*
+   * Non-maximum suppression of the middle row: a pixel above low stays when it is larger than
+   * both neighbours along its gradient, quantized to horizontal, vertical or one of the
+   * diagonals. Ties go to the first neighbour, so a plateau keeps one pixel instead of two.
+   * Gy is bottom minus top, so the gradient points down and right when Gx and Gy have the same sign.
+   */
+  void suppressRow(const int32_t* above, const int32_t* middle, const int32_t* below, const int16_t* gx,
+      const int16_t* gy, int width, int32_t low, int32_t high, uint8_t* labels, std::vector<uint8_t*>& strong,
+      SimdLevel level)
+  {
+    labels[0] = LABEL_NONE;
+    labels[width-1] = LABEL_NONE;
+    const int end = width - 1;
+    int x = 1;
+#ifdef MICROCV_X86_SIMD
+    if(level >= SimdAvx2)
+      x = suppressRowAvx2(above, middle, below, gx, gy, x, end, low, high, labels, strong);
+    if(level >= SimdSse2)
+      x = suppressRowSse2(above, middle, below, gx, gy, x, end, low, high, labels, strong);
+#else
+    (void)level;
+#endif
+    suppressRowScalar(above, middle, below, gx, gy, x, end, low, high, labels, strong);
+  }
+
+  // Turn the weak pixels 8-connected to the stacked strong ones strong, staying in [first, end)
+  void traceEdges(std::vector<uint8_t*>& stack, uint8_t* first, uint8_t* end, int width)
+  {
+    const ptrdiff_t offsets[] = {-width - 1, -width, -width + 1, -1, 1, width - 1, width, width + 1};
+    while(!stack.empty())
+    {
+      uint8_t* pixel = stack.back();
+      stack.pop_back();
+      for(ptrdiff_t offset : offsets)
+      {
+        uint8_t* neighbour = pixel + offset;
+        if(neighbour >= first && neighbour < end && *neighbour == LABEL_WEAK)
+        {
+          *neighbour = LABEL_STRONG;
+          stack.push_back(neighbour);
+        }
+      }
+    }
+  }
+
+  // Strong pixels of the row just outside a band turn the weak pixels next to them in row strong
+  void joinSeam(const uint8_t* outside, uint8_t* row, int width, std::vector<uint8_t*>& stack)
+  {
+    for(int x = 1; x < width - 1; x++)
+    {
+      if(outside[x] != LABEL_STRONG)
+        continue;
+      for(int dx = -1; dx <= 1; dx++)
+      {
+        if(row[x + dx] == LABEL_WEAK)
+        {
+          row[x + dx] = LABEL_STRONG;
+          stack.push_back(row + x + dx);
+        }
+      }
+    }
+  }
+}
+
+void MicroCv::Kernels::cannyEdges(const MatView& view, int lowThreshold, int highThreshold, SobelMagnitude magnitude,
+    uint8_t* outPtr)
+{
+  const int width = view.width();
+  const int height = view.height();
+  const int channels = view.channels();
+  lowThreshold = std::min(lowThreshold, MAX_THRESHOLD);
+  highThreshold = std::min(highThreshold, MAX_THRESHOLD);
+  const int32_t low = magnitude == SobelL2 ? lowThreshold * lowThreshold : lowThreshold;
+  const int32_t high = magnitude == SobelL2 ? highThreshold * highThreshold : highThreshold;
+  const LumaCoefficients coeffs = lumaCoefficients(GrayAverage);
+  const MatView r = view.plane(0);
+  const MatView g = view.plane(1);
+  const MatView b = view.plane(2);
+  const SimdLevel level = simdLevel();
+
+  // The gradient of a row needs the rows above and below it and its suppression the gradients of
+  // those, so a band reads two rows past each end
+  const std::vector<RowBand> bands = rowBands(width, height, 2);
+  const int numBands = static_cast<int>(bands.size());
+  // Per round parity and band, copies of the first and the last row of the band
+  std::vector<uint8_t> seams(static_cast<size_t>(2 * numBands) * 2 * width);
+  auto seamRow = [&](int parity, int band, int last) -> uint8_t*
+  {
+    return seams.data() + (static_cast<size_t>(parity * numBands + band) * 2 + last) * width;
+  };
+  auto copySeams = [&](int parity, int i)
+  {
+    std::memcpy(seamRow(parity, i, 0), outPtr + static_cast<size_t>(bands[i].begin) * width, width);
+    std::memcpy(seamRow(parity, i, 1), outPtr + static_cast<size_t>(bands[i].end - 1) * width, width);
+  };
+
+  parallelForBands(bands, [&](int i)
+  {
+    const RowBand& band = bands[i];
+    MICROCV_STAGE("cannyEdgeDetector band", static_cast<uint64_t>(width) * (channels + 1) * (band.end - band.begin));
+    // The border rows and columns have no gradient, like the ones of sobelEdgeDetector
+    const int yBegin = std::max(band.begin, 1);
+    const int yEnd = width >= 3 ? std::min(band.end, height - 1) : yBegin;
+    for(int y = band.begin; y < band.end; y++)
+    {
+      if(y < yBegin || y >= yEnd)
+        std::memset(outPtr + static_cast<size_t>(y) * width, LABEL_NONE, width);
+    }
+
+    std::vector<uint8_t*> stack;
+    if(yBegin < yEnd)
+    {
+      // Gray input rows are read in place, RGB rows are converted one at a time into a scratch row
+      std::vector<uint8_t> grayRow(channels == 3 ? width : 0);
+      auto inputRow = [&](int y) -> const uint8_t*
+      {
+        if(channels == 1)
+          return view.row(y);
+        if(view.isPlanar())
+          planarRowToGray(r.row(y), g.row(y), b.row(y), grayRow.data(), width, coeffs);
+        else
+          rgbRowToGray(view.row(y), grayRow.data(), width, coeffs);
+        return grayRow.data();
+      };
+
+      SobelEngine engine(width, magnitude);
+      int nextInputRow = std::max(yBegin - 2, 0);
+      GradientRow rows[] = {GradientRow(width), GradientRow(width), GradientRow(width)};
+      // Rows outside [1, height - 1) have no gradient
+      auto computeGradientRow = [&](int y, GradientRow& row)
+      {
+        if(y < 1 || y >= height - 1)
+        {
+          std::fill(row.magnitude.begin(), row.magnitude.end(), 0);
+          return;
+        }
+        for(; nextInputRow <= y + 1; nextInputRow++)
+          engine.pushRow(inputRow(nextInputRow));
+        engine.computeGradients(row.gx.data(), row.gy.data());
+        magnitudeRow(row.gx.data(), row.gy.data(), row.magnitude.data(), width, magnitude, level);
+      };
+
+      computeGradientRow(yBegin - 1, rows[(yBegin - 1) % 3]);
+      computeGradientRow(yBegin, rows[yBegin % 3]);
+      for(int y = yBegin; y < yEnd; y++)
+      {
+        computeGradientRow(y + 1, rows[(y + 1) % 3]);
+        const GradientRow& middle = rows[y % 3];
+        suppressRow(rows[(y - 1) % 3].magnitude.data(), middle.magnitude.data(), rows[(y + 1) % 3].magnitude.data(),
+            middle.gx.data(), middle.gy.data(), width, low, high, outPtr + static_cast<size_t>(y) * width, stack,
+            level);
+      }
+      traceEdges(stack, outPtr + static_cast<size_t>(band.begin) * width, outPtr + static_cast<size_t>(band.end) * width,
+          width);
+    }
+    copySeams(0, i);
+  });
+
+  // Join the edges across the band borders until no seam changes any more
+  std::vector<char> changed(numBands, numBands > 1);
+  for(int round = 0; std::find(changed.begin(), changed.end(), 1) != changed.end(); round++)
+  {
+    const int parity = round % 2;
+    parallelForBands(bands, [&](int i)
+    {
+      const RowBand& band = bands[i];
+      MICROCV_STAGE("cannyEdgeDetector seams", 4 * static_cast<uint64_t>(width));
+      uint8_t* first = outPtr + static_cast<size_t>(band.begin) * width;
+      uint8_t* last = outPtr + static_cast<size_t>(band.end - 1) * width;
+      std::vector<uint8_t*> stack;
+      if(i > 0)
+        joinSeam(seamRow(parity, i - 1, 1), first, width, stack);
+      if(i + 1 < numBands)
+        joinSeam(seamRow(parity, i + 1, 0), last, width, stack);
+      traceEdges(stack, first, last + width, width);
+      copySeams(1 - parity, i);
+      changed[i] = std::memcmp(seamRow(parity, i, 0), seamRow(1 - parity, i, 0), 2 * static_cast<size_t>(width)) != 0;
+    });
+  }
+
+  // Weak pixels that no strong one reached are not edges
+  parallelForBands(bands, [&](int i)
+  {
+    const RowBand& band = bands[i];
+    MICROCV_STAGE("cannyEdgeDetector labels", 2 * static_cast<uint64_t>(width) * (band.end - band.begin));
+    uint8_t* labels = outPtr + static_cast<size_t>(band.begin) * width;
+    const size_t count = static_cast<size_t>(width) * (band.end - band.begin);
+    for(size_t j = 0; j < count; j++)
+      labels[j] = labels[j] == LABEL_STRONG ? 255 : 0;
+  });
+}
@@ -0,0 +1,29 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+
+#include "ImageProcessing.h"
+#include "Mat.h"
+
+namespace MicroCv
+{
+namespace Kernels
+{
+/*
+ * Canny edges of a gray or RGB view into outPtr (a continuous width * height Mat), 255 on 0.
+ *
+ * Every band streams its rows through a SobelEngine for the int16 Gx and Gy rows, keeps the
+ * magnitudes of the last three of them and thins the middle one to the pixels that are a maximum
+ * across the gradient direction. Those are labeled strong above highThreshold and weak above
+ * lowThreshold in outPtr, and the band then grows its strong pixels into the weak ones they
+ * touch with an explicit stack. Edges that cross band borders are joined by rounds over the
+ * seams: every band looks at copies of the rows just outside it that its neighbours made at the
+ * end of the previous round, and the rounds stop once no seam row changes. So the bands never
+ * read rows another thread is writing, and the edges are the same for any number of threads.
+ */
+void cannyEdges(const MatView& view, int lowThreshold, int highThreshold, SobelMagnitude magnitude, uint8_t* outPtr);
+};
+};
@@ -0,0 +1,44 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <atomic>
+
+#include "CpuFeatures.h"
+
+namespace
+{
+  // -1 means the level has not been detected yet
+  std::atomic<int> currentLevel(-1);
+}
+
+MicroCv::SimdLevel MicroCv::detectSimdLevel()
+{
+#ifdef MICROCV_X86_SIMD
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    return SimdAvx2;
+  if(__builtin_cpu_supports("ssse3"))
+    return SimdSsse3;
+  if(__builtin_cpu_supports("sse2"))
+    return SimdSse2;
+#endif
+  return SimdScalar;
+}
+
+MicroCv::SimdLevel MicroCv::simdLevel()
+{
+  int level = currentLevel.load(std::memory_order_relaxed);
+  if(level < 0)
+  {
+    level = detectSimdLevel();
+    currentLevel.store(level, std::memory_order_relaxed);
+  }
+  return static_cast<SimdLevel>(level);
+}
+
+void MicroCv::setSimdLevel(SimdLevel level)
+{
+  const SimdLevel supported = detectSimdLevel();
+  currentLevel.store(level < supported ? level : supported, std::memory_order_relaxed);
+}
@@ -0,0 +1,80 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+#include "DepthKernels.h"
+
+using namespace MicroCv;
+
+namespace
+{
+  // Rounded half away from zero and saturated to the range of T, NaN saturates to the largest value
+  template<typename T>
+  inline T saturateValue(float v)
+  {
+    const float lowest = static_cast<float>(std::numeric_limits<T>::lowest());
+    const float highest = static_cast<float>(std::numeric_limits<T>::max());
+    v = std::max(lowest, std::min(highest, v));
+    return static_cast<T>(static_cast<int>(v + (v < 0 ? -0.5f : 0.5f)));
+  }
+
+  template<>
+  inline float saturateValue<float>(float v)
+  {
+    return v;
+  }
+
+  // True when every value of Src is also a value of Dst, so an unscaled conversion is a plain cast
+  template<typename Src, typename Dst>
+  struct IsWidening
+  {
+    static const bool value = std::is_same<Dst, float>::value
+        || (std::numeric_limits<Dst>::lowest() <= std::numeric_limits<Src>::lowest()
+            && std::numeric_limits<Dst>::max() >= std::numeric_limits<Src>::max());
+  };
+
+  template<typename Src, typename Dst>
+  void convertValuesAs(const Src* in, Dst* out, int count, float scale, float offset)
+  {
+    if(IsWidening<Src, Dst>::value && scale == 1 && offset == 0)
+    {
+      for(int i = 0; i < count; i++)
+        out[i] = static_cast<Dst>(in[i]);
+      return;
+    }
+    for(int i = 0; i < count; i++)
+      out[i] = saturateValue<Dst>(in[i] * scale + offset);
+  }
+
+  template<typename Src>
+  void convertValuesFrom(const Src* in, uint8_t* out, MatDepth outDepth, int count, float scale, float offset)
+  {
+    if(outDepth == DepthU16)
+      convertValuesAs(in, reinterpret_cast<uint16_t*>(out), count, scale, offset);
+    else if(outDepth == DepthS16)
+      convertValuesAs(in, reinterpret_cast<int16_t*>(out), count, scale, offset);
+    else if(outDepth == DepthF32)
+      convertValuesAs(in, reinterpret_cast<float*>(out), count, scale, offset);
+    else
+      convertValuesAs(in, out, count, scale, offset);
+  }
+}
+
+void Kernels::convertValues(const uint8_t* in, MatDepth inDepth, uint8_t* out, MatDepth outDepth, int count,
+    double scale, double offset)
+{
+  const float scaleF = static_cast<float>(scale);
+  const float offsetF = static_cast<float>(offset);
+  if(inDepth == DepthU16)
+    convertValuesFrom(reinterpret_cast<const uint16_t*>(in), out, outDepth, count, scaleF, offsetF);
+  else if(inDepth == DepthS16)
+    convertValuesFrom(reinterpret_cast<const int16_t*>(in), out, outDepth, count, scaleF, offsetF);
+  else if(inDepth == DepthF32)
+    convertValuesFrom(reinterpret_cast<const float*>(in), out, outDepth, count, scaleF, offsetF);
+  else
+    convertValuesFrom(in, out, outDepth, count, scaleF, offsetF);
+}
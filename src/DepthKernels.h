@@ -0,0 +1,19 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+
+#include "Mat.h"
+
+namespace MicroCv
+{
+namespace Kernels
+{
+  // Convert count values of inDepth to outDepth: value * scale + offset, rounded half away from zero
+  // and saturated when outDepth is an integer depth. Every pair of depths has its own kernel
+  void convertValues(const uint8_t* in, MatDepth inDepth, uint8_t* out, MatDepth outDepth, int count,
+      double scale, double offset);
+};
+};
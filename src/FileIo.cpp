@@ -2,17 +2,20 @@
  *  Micro Computer Vision library
  *  @author Andrei Polzounov
  */
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <boost/filesystem.hpp>
-#include <boost/gil/extension/io/jpeg_io.hpp>
-#include <boost/gil/extension/io/png_io.hpp>
-#include <boost/gil/extension/io/tiff_io.hpp>
-#include <boost/gil/gil_all.hpp>
 
 #include "FileIo.h"
+#include "ImageCodecs.h"
+#include "ImageProcessing.h"
+#include "Instrumentation.h"
+#include "PlanarKernels.h"
 
 using namespace MicroCv;
 
@@ -22,143 +25,301 @@ namespace
   const std::vector<std::string> JPEG_EXTENSIONS = {".jpg", ".jpeg", ".jpe", ".jif", ".jfif", ".jfi"};
   const std::vector<std::string> TIFF_EXTENSIONS = {".tif", ".tiff"};
   const std::string PNG_EXTENSION = ".png";
+  const std::string MCV_EXTENSION = ".mcv";
+  const std::vector<std::string> PNM_EXTENSIONS = {".pgm", ".ppm", ".pnm"};
+  const int MAX_SCALE_DENOMINATOR = 8;
+  // Rows decoded or encoded at a time when converting between the planes and the interleaved rows
+  // of the file, few enough for the chunk to stay in cache
+  const int PLANAR_CHUNK_ROWS = 16;
 
-  struct PixelRgbReader
+  int scaledSize(int size, int denominator)
   {
-    PixelRgbReader(std::vector<uint8_t>* s) : storage(s) {}
-    void operator()(boost::gil::rgb8_pixel_t p) const {
-      using boost::gil::at_c;
-      storage->push_back(at_c<0>(p));
-      storage->push_back(at_c<1>(p));
-      storage->push_back(at_c<2>(p));
+    return (size + denominator - 1) / denominator;
+  }
+
+  // Pick 1, 2, 4 or 8 from the read options for an image of the given size
+  int scaleDenominator(const ReadOptions& options, int width, int height)
+  {
+    int denominator = 1;
+    if(options.targetWidth > 0 || options.targetHeight > 0)
+    {
+      while(denominator < MAX_SCALE_DENOMINATOR
+          && scaledSize(width, denominator * 2) >= options.targetWidth
+          && scaledSize(height, denominator * 2) >= options.targetHeight)
+        denominator *= 2;
+    }
+    else
+    {
+      while(denominator < MAX_SCALE_DENOMINATOR && denominator * 2 <= options.scaleDenominator)
+        denominator *= 2;
     }
-    std::vector<uint8_t>* storage;
-  };
+    return denominator;
+  }
 
-  struct PixelWriter
+  // Decode the full size rows a band at a time and average every denominator x denominator block,
+  // the blocks on the right and bottom edges may be smaller. T is the type of the decoded values
+  template<typename T>
+  bool readRowsAveraged(Codecs::ImageDecoder& decoder, int denominator, Mat& mat)
   {
-    PixelWriter(const uint8_t* pixels) : pixelPtr(pixels) {}
+    const int width = decoder.width();
+    const int height = decoder.height();
+    const int channels = decoder.channels();
+    const size_t rowBytes = static_cast<size_t>(width) * channels * sizeof(T);
+    mat.resize(scaledSize(width, denominator), scaledSize(height, denominator), channels, DepthOf<T>::value);
 
-    void operator()(boost::gil::rgb8_pixel_t& p)
+    std::vector<uint8_t> band(rowBytes * denominator);
+    std::vector<uint32_t> sums(static_cast<size_t>(mat.width()) * channels);
+    for(int y = 0; y < mat.height(); y++)
     {
-      using boost::gil::at_c;
-      at_c<0>(p) = *pixelPtr++;
-      at_c<1>(p) = *pixelPtr++;
-      at_c<2>(p) = *pixelPtr++;
+      const int numRows = std::min(denominator, height - y * denominator);
+      if(!decoder.readRows(band.data(), static_cast<int>(rowBytes), numRows))
+        return false;
+
+      std::fill(sums.begin(), sums.end(), 0);
+      for(int row = 0; row < numRows; row++)
+      {
+        const T* in = reinterpret_cast<const T*>(band.data() + row * rowBytes);
+        uint32_t* sum = sums.data();
+        for(int x = 0; x < width; x += denominator, sum += channels)
+        {
+          const int blockWidth = std::min(denominator, width - x);
+          for(int i = 0; i < blockWidth; i++)
+          {
+            for(int c = 0; c < channels; c++)
+              sum[c] += *in++;
+          }
+        }
+      }
+
+      T* out = mat.row<T>(y);
+      for(int x = 0; x < mat.width(); x++)
+      {
+        const uint32_t count = numRows * std::min(denominator, width - x * denominator);
+        for(int c = 0; c < channels; c++, out++)
+          *out = static_cast<T>((sums[static_cast<size_t>(x) * channels + c] + count / 2) / count);
+      }
     }
+    return true;
+  }
 
-    void operator()(boost::gil::gray8_pixel_t& p)
+  bool isValidRegion(const ReadOptions& options, int width, int height)
+  {
+    return options.regionX1 >= 0 && options.regionX1 < options.regionX2 && options.regionX2 <= width
+        && options.regionY1 >= 0 && options.regionY1 < options.regionY2 && options.regionY2 <= height;
+  }
+
+  // Decode the rows down to the bottom of the region and keep the columns inside it,
+  // the rows below the region are never decoded
+  bool readRowsInRegion(Codecs::ImageDecoder& decoder, const ReadOptions& options, MatDepth depth, Mat& mat)
+  {
+    const int pixelBytes = decoder.channels() * depthSize(depth);
+    std::vector<uint8_t> row(static_cast<size_t>(decoder.width()) * pixelBytes);
+    mat.resize(options.regionX2 - options.regionX1, options.regionY2 - options.regionY1, decoder.channels(), depth);
+    for(int y = 0; y < options.regionY2; y++)
     {
-      using boost::gil::at_c;
-      at_c<0>(p) = *pixelPtr++;
+      if(!decoder.readRows(row.data(), static_cast<int>(row.size()), 1))
+        return false;
+      if(y >= options.regionY1)
+      {
+        std::memcpy(mat.row(y - options.regionY1), row.data() + static_cast<size_t>(options.regionX1) * pixelBytes,
+            static_cast<size_t>(mat.width()) * pixelBytes);
+      }
     }
-    const uint8_t* pixelPtr;
-  };
+    return true;
+  }
 
+  // Decode a chunk of rows at a time and split it into the planes of mat, the interleaved image
+  // never exists at full size
+  bool readRowsPlanar(Codecs::ImageDecoder& decoder, Mat& mat)
+  {
+    const int width = decoder.width();
+    const int height = decoder.height();
+    const int channels = decoder.channels();
+    const size_t rowBytes = static_cast<size_t>(width) * channels;
+    mat.resize(width, height, channels, LayoutPlanar);
+    uint8_t* data = mat.data();
+    std::vector<uint8_t> chunk(rowBytes * PLANAR_CHUNK_ROWS);
+    std::vector<uint8_t*> planeRows(channels);
+    for(int y = 0; y < height; y += PLANAR_CHUNK_ROWS)
+    {
+      const int numRows = std::min(PLANAR_CHUNK_ROWS, height - y);
+      if(!decoder.readRows(chunk.data(), static_cast<int>(rowBytes), numRows))
+        return false;
+      for(int row = 0; row < numRows; row++)
+      {
+        for(int c = 0; c < channels; c++)
+          planeRows[c] = data + c * mat.planeStride() + static_cast<size_t>(y + row) * width;
+        Kernels::deinterleaveRow(chunk.data() + row * rowBytes, planeRows.data(), width, channels);
+      }
+    }
+    return true;
+  }
+
+  // Merge a chunk of rows of a planar view at a time and encode it
+  bool writeRowsPlanar(Codecs::ImageEncoder& encoder, const MatView& view)
+  {
+    const size_t rowBytes = static_cast<size_t>(view.width()) * view.channels();
+    std::vector<uint8_t> chunk(rowBytes * PLANAR_CHUNK_ROWS);
+    for(int y = 0; y < view.height(); y += PLANAR_CHUNK_ROWS)
+    {
+      const int numRows = std::min(PLANAR_CHUNK_ROWS, view.height() - y);
+      for(int row = 0; row < numRows; row++)
+      {
+        uint8_t* out = chunk.data() + row * rowBytes;
+        const uint8_t* in = Kernels::interleavedRow(view, y + row, out);
+        if(in != out)
+          std::memcpy(out, in, rowBytes);
+      }
+      if(!encoder.writeRows(chunk.data(), static_cast<int>(rowBytes), numRows))
+        return false;
+    }
+    return true;
+  }
+}
+
+ReadOptions::ReadOptions()
+: scaleDenominator(1)
+, targetWidth(0)
+, targetHeight(0)
+, regionX1(0)
+, regionY1(0)
+, regionX2(0)
+, regionY2(0)
+, layout(LayoutInterleaved)
+, keep16Bits(false)
+{
 }
 
 Mat MicroCv::readMatFromFile(const std::string& filename, ImageFileType type, bool& readOk)
 {
-  using namespace boost::gil;
+  return readMatFromFile(filename, type, ReadOptions(), readOk);
+}
+
+Mat MicroCv::readMatFromFile(const std::string& filename, ImageFileType type, const ReadOptions& options, bool& readOk)
+{
   Mat mat;
+  readOk = false;
 
   // Check if file exists
   if(!boost::filesystem::exists(filename))
   {
     std::cout << "File: " << filename << " not found" << std::endl;
-    readOk = false;
     return mat;
   }
 
-  // Read into RGB image (unsigned char type)
-  rgb8_image_t image;
-  try
+  std::unique_ptr<Codecs::ImageDecoder> decoder = Codecs::createDecoder(type);
+  if(!decoder)
   {
-    if(type == ImageFileType::Jpeg)
-    {
-      jpeg_read_and_convert_image(filename, image);
-    }
-    else if(type == ImageFileType::Png)
-    {
-      png_read_and_convert_image(filename, image);
-    }
-    else if(type == ImageFileType::Tiff)
-    {
-      tiff_read_and_convert_image(filename, image);
-    }
-    else
+    std::cout << "File format: " << boost::filesystem::extension(filename)
+        << " not supported" << std::endl;
+    return mat;
+  }
+
+  // The decoder writes the scanlines straight into the Mat
+  if(!decoder->open(filename))
+  {
+    return mat;
+  }
+  MICROCV_STAGE("readMatFromFile", static_cast<uint64_t>(decoder->width()) * decoder->height() * decoder->channels());
+
+  // 16 bit values are only kept when asked for, and planar Mats are always 8 bit
+  const MatDepth depth = options.keep16Bits && decoder->setDepth(DepthU16) ? DepthU16 : DepthU8;
+  const bool planar = options.layout == LayoutPlanar && depth == DepthU8;
+
+  // Formats that can decode a reduced image do so, the others are averaged after decoding
+  const int denominator = scaleDenominator(options, decoder->width(), decoder->height());
+  if(denominator > 1 && !decoder->setScale(denominator))
+  {
+    const bool averaged = depth == DepthU16 ? readRowsAveraged<uint16_t>(*decoder, denominator, mat)
+        : readRowsAveraged<uint8_t>(*decoder, denominator, mat);
+    if(!averaged)
+      return Mat();
+    if(isValidRegion(options, mat.width(), mat.height()))
     {
-      readOk = false;
-      std::cout << "File format: " << boost::filesystem::extension(filename)
-          << " not supported" << std::endl;
+      mat = Mat(MatView(mat.row(options.regionY1) + options.regionX1 * mat.channels() * mat.elementSize(),
+          options.regionX2 - options.regionX1, options.regionY2 - options.regionY1, mat.channels(), mat.stride(), depth));
     }
+    // The reduced images are small, they are split into planes at the end
+    if(planar)
+      convertLayout(mat, mat, LayoutPlanar);
+    readOk = true;
+    return mat;
   }
-  catch(std::exception& e)
+
+  // Formats that can skip the pixels outside the region do so, the others stop after its last row
+  if(isValidRegion(options, decoder->width(), decoder->height())
+      && !decoder->setRegion(options.regionX1, options.regionY1, options.regionX2, options.regionY2))
   {
-    std::cerr << "ERROR: " << e.what() << std::endl;
-    readOk = false;
+    if(!readRowsInRegion(*decoder, options, depth, mat))
+      return Mat();
+    if(planar)
+      convertLayout(mat, mat, LayoutPlanar);
+    readOk = true;
+    return mat;
   }
-  auto imageView = boost::gil::view(image);
 
-  mat.reserve(imageView.width(), imageView.height(), imageView.num_channels());
-  std::vector<uint8_t>* data = mat.vectorPtr();
-  boost::gil::for_each_pixel(imageView, PixelRgbReader(data));
+  if(planar && decoder->channels() > 1)
+  {
+    if(!readRowsPlanar(*decoder, mat))
+      return Mat();
+    readOk = true;
+    return mat;
+  }
+  mat.resize(decoder->width(), decoder->height(), decoder->channels(), depth);
+  if(!decoder->readRows(mat.data(), mat.stride(), mat.height()))
+  {
+    return Mat();
+  }
   readOk = true;
   return mat;
 }
 
-bool MicroCv::writeMatToFile(const std::string& filename, const Mat& mat, ImageFileType type)
+bool MicroCv::readImageSize(const std::string& filename, ImageFileType type, int& width, int& height, int& channels)
 {
-  using namespace boost::gil;
-  if(mat.channels() == 3)
-  {
-    rgb8_image_t image(mat.width(), mat.height(), mat.channels());
-    rgb8_view_t viewRgb = boost::gil::view(image);
-    const uint8_t* dataPtr = mat.data();
-    boost::gil::for_each_pixel(viewRgb, PixelWriter(dataPtr));
-    if(type == ImageFileType::Jpeg)
-    {
-      boost::gil::jpeg_write_view(filename, viewRgb);
-    }
-    else if(type == ImageFileType::Png)
-    {
-      boost::gil::png_write_view(filename, viewRgb);
-    }
-    else if(type == ImageFileType::Tiff)
-    {
-      boost::gil::tiff_write_view(filename, viewRgb);
-    }
-    else
-    {
-      std::cout << "File format: " << boost::filesystem::extension(filename)
-          << " not supported" << std::endl;
-      return false;
-    }
+  std::unique_ptr<Codecs::ImageDecoder> decoder = Codecs::createDecoder(type);
+  if(!decoder || !boost::filesystem::exists(filename) || !decoder->open(filename))
+    return false;
+  width = decoder->width();
+  height = decoder->height();
+  channels = decoder->channels();
+  return true;
+}
+
+bool MicroCv::writeMatToFile(const std::string& filename, const MatView& view, ImageFileType type)
+{
+  if(view.channels() != 1 && view.channels() != 3)
+  {
+    std::cout << "Writing " << view.channels() << " channel images is not supported" << std::endl;
+    return false;
   }
-  else if(mat.channels() == 1)
+
+  std::unique_ptr<Codecs::ImageEncoder> encoder = Codecs::createEncoder(type);
+  if(!encoder)
   {
-    gray8_image_t image(mat.width(), mat.height(), mat.channels());
-    gray8_view_t viewGray = boost::gil::view(image);
-    const uint8_t* dataPtr = mat.data();
-    boost::gil::for_each_pixel(viewGray, PixelWriter(dataPtr));
-    if(type == ImageFileType::Jpeg)
-    {
-      boost::gil::jpeg_write_view(filename, viewGray);
-    }
-    else if(type == ImageFileType::Png)
-    {
-      boost::gil::png_write_view(filename, viewGray);
-    }
-    else
-    {
-      boost::gil::tiff_write_view(filename, viewGray);
-    }
+    std::cout << "File format: " << boost::filesystem::extension(filename)
+        << " not supported" << std::endl;
+    return false;
   }
-  else
+  if(!encoder->setDepth(view.depth()))
   {
-    std::cout << "Writing " << mat.channels() << " channel images is not supported" << std::endl;
+    std::cout << "File format: " << boost::filesystem::extension(filename)
+        << " does not support images of this depth" << std::endl;
+    return false;
   }
-  return true;
+
+  // The encoder reads the scanlines straight from the view, no intermediate image is made
+  MICROCV_STAGE("writeMatToFile", static_cast<uint64_t>(view.width()) * view.height() * view.channels() * view.elementSize());
+  bool writeOk = encoder->open(filename, view.width(), view.height(), view.channels())
+      && (view.isPlanar() ? writeRowsPlanar(*encoder, view) : encoder->writeRows(view.data(), view.stride(), view.height()))
+      && encoder->close();
+  if(!writeOk)
+  {
+    // Do not leave a truncated file behind
+    encoder.reset();
+    boost::system::error_code error;
+    boost::filesystem::remove(filename, error);
+  }
+  return writeOk;
 }
 
 MicroCv::ImageFileType MicroCv::imageTypeFromFilename(const std::string& filename)
@@ -190,5 +351,18 @@ MicroCv::ImageFileType MicroCv::imageTypeFromFilename(const std::string& filenam
     }
   }
 
+  // Check the uncompressed formats
+  if(extension == MCV_EXTENSION)
+  {
+    return ImageFileType::Mcv;
+  }
+  for(auto itr = PNM_EXTENSIONS.begin(); itr != PNM_EXTENSIONS.end(); ++itr)
+  {
+    if(extension == std::string(*itr))
+    {
+      return ImageFileType::Pnm;
+    }
+  }
+
   return ImageFileType::Unsupported;
 }
@@ -0,0 +1,763 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "CpuFeatures.h"
+#include "FilterEngine.h"
+#include "FilterTaps.h"
+
+using namespace MicroCv;
+using namespace MicroCv::Kernels;
+
+namespace MicroCv
+{
+namespace Kernels
+{
+  class RowFilter
+  {
+  public:
+    virtual ~RowFilter() {}
+
+    // Take the next row padded by the kernel radius on both sides
+    virtual void pushRow(const uint8_t* paddedRow) = 0;
+    virtual void computeRow(uint8_t* outRow) = 0;
+  };
+};
+};
+
+namespace
+{
+  // The last height rows of rowSize values
+  template<typename T>
+  class RowRing
+  {
+  public:
+    RowRing(int height, int rowSize)
+    : height_(height)
+    , rowSize_(rowSize)
+    , rowsPushed_(0)
+    , data_(static_cast<size_t>(height) * rowSize)
+    , rows_(height)
+    {
+    }
+
+    int rowSize() const { return rowSize_; }
+
+    // Slot of the next pushed row
+    T* next()
+    {
+      T* row = data_.data() + static_cast<size_t>(rowsPushed_ % height_) * rowSize_;
+      rowsPushed_++;
+      return row;
+    }
+
+    // Pointers to the last height rows, oldest first
+    const T* const* rows()
+    {
+      for(int i = 0; i < height_; i++)
+        rows_[i] = data_.data() + static_cast<size_t>((rowsPushed_ + i) % height_) * rowSize_;
+      return rows_.data();
+    }
+
+  private:
+    int height_;
+    int rowSize_;
+    int rowsPushed_;
+    std::vector<T> data_;
+    std::vector<const T*> rows_;
+  };
+
+  // value / divisor + offset rounded half to even and saturated to [0, 255], every kernel below does
+  // the same float math. Half to even is what _mm_cvtps_epi32 does, unlike the half away from zero of
+  // DepthKernels
+  inline uint8_t outputPixel(float value, float divisor, float offset)
+  {
+    const float result = std::min(std::max(value / divisor + offset, 0.0f), 255.0f);
+    return static_cast<uint8_t>(std::nearbyint(result));
+  }
+
+  // Sums of the Taps kernels are int16, or uint16 when no weight is negative
+  void storeRowScalar(const int16_t* sums, uint8_t* out, int x, int end, bool isSigned, float divisor, float offset)
+  {
+    for(; x < end; x++)
+    {
+      const int value = isSigned ? sums[x] : static_cast<uint16_t>(sums[x]);
+      out[x] = outputPixel(static_cast<float>(value), divisor, offset);
+    }
+  }
+
+  void storeRowScalar(const float* sums, uint8_t* out, int x, int end, float divisor, float offset)
+  {
+    for(; x < end; x++)
+      out[x] = outputPixel(sums[x], divisor, offset);
+  }
+
+  // Signed sums with a divisor of 1 and no offset are only saturated
+  void saturateRowScalar(const int16_t* sums, uint8_t* out, int x, int end)
+  {
+    for(; x < end; x++)
+      out[x] = static_cast<uint8_t>(std::min(std::max(static_cast<int>(sums[x]), 0), 255));
+  }
+
+  // sums[x] += weight * in[x]
+  template<typename T>
+  void accumulateRowScalar(float* sums, const T* in, float weight, int x, int end)
+  {
+    for(; x < end; x++)
+      sums[x] += weight * in[x];
+  }
+
+  template<class... Rows>
+  void filterRows2DScalar(const uint8_t* const* rows, int16_t* out, int x, int end, int step)
+  {
+    for(; x < end; x++)
+    {
+      const uint8_t* const* row = rows;
+      int acc = 0;
+      int expand[] = {(acc += sumTapsScalar(Rows(), *row++ + x, step), 0)...};
+      (void)expand;
+      out[x] = static_cast<int16_t>(acc);
+    }
+  }
+
+#ifdef MICROCV_X86_SIMD
+  __attribute__((target("sse2")))
+  inline __m128i outputPixelsSse2(__m128 value, __m128 divisor, __m128 offset)
+  {
+    __m128 result = _mm_add_ps(_mm_div_ps(value, divisor), offset);
+    result = _mm_min_ps(_mm_max_ps(result, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+    // Rounds to nearest even like std::nearbyint() in the default rounding mode
+    return _mm_cvtps_epi32(result);
+  }
+
+  __attribute__((target("sse2")))
+  int storeRowSse2(const int16_t* sums, uint8_t* out, int x, int end, bool isSigned, float divisor, float offset)
+  {
+    const __m128 divisorVec = _mm_set1_ps(divisor);
+    const __m128 offsetVec = _mm_set1_ps(offset);
+    const __m128i zero = _mm_setzero_si128();
+    for(; x + 8 <= end; x += 8)
+    {
+      __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x));
+      __m128i lo = isSigned ? _mm_srai_epi32(_mm_unpacklo_epi16(value, value), 16) : _mm_unpacklo_epi16(value, zero);
+      __m128i hi = isSigned ? _mm_srai_epi32(_mm_unpackhi_epi16(value, value), 16) : _mm_unpackhi_epi16(value, zero);
+      __m128i pixels = _mm_packs_epi32(outputPixelsSse2(_mm_cvtepi32_ps(lo), divisorVec, offsetVec),
+          outputPixelsSse2(_mm_cvtepi32_ps(hi), divisorVec, offsetVec));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(pixels, pixels));
+    }
+    return x;
+  }
+
+  __attribute__((target("sse2")))
+  int storeRowSse2(const float* sums, uint8_t* out, int x, int end, float divisor, float offset)
+  {
+    const __m128 divisorVec = _mm_set1_ps(divisor);
+    const __m128 offsetVec = _mm_set1_ps(offset);
+    for(; x + 8 <= end; x += 8)
+    {
+      __m128i pixels = _mm_packs_epi32(outputPixelsSse2(_mm_loadu_ps(sums + x), divisorVec, offsetVec),
+          outputPixelsSse2(_mm_loadu_ps(sums + x + 4), divisorVec, offsetVec));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(pixels, pixels));
+    }
+    return x;
+  }
+
+  __attribute__((target("sse2")))
+  int saturateRowSse2(const int16_t* sums, uint8_t* out, int x, int end)
+  {
+    for(; x + 16 <= end; x += 16)
+    {
+      __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x));
+      __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x + 8));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(lo, hi));
+    }
+    return x;
+  }
+
+  __attribute__((target("sse2")))
+  int accumulateRowSse2(float* sums, const uint8_t* in, float weight, int x, int end)
+  {
+    const __m128 weightVec = _mm_set1_ps(weight);
+    const __m128i zero = _mm_setzero_si128();
+    for(; x + 8 <= end; x += 8)
+    {
+      __m128i value = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + x)), zero);
+      __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(value, zero));
+      __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(value, zero));
+      _mm_storeu_ps(sums + x, _mm_add_ps(_mm_loadu_ps(sums + x), _mm_mul_ps(lo, weightVec)));
+      _mm_storeu_ps(sums + x + 4, _mm_add_ps(_mm_loadu_ps(sums + x + 4), _mm_mul_ps(hi, weightVec)));
+    }
+    return x;
+  }
+
+  __attribute__((target("sse2")))
+  int accumulateRowSse2(float* sums, const float* in, float weight, int x, int end)
+  {
+    const __m128 weightVec = _mm_set1_ps(weight);
+    for(; x + 4 <= end; x += 4)
+      _mm_storeu_ps(sums + x, _mm_add_ps(_mm_loadu_ps(sums + x), _mm_mul_ps(_mm_loadu_ps(in + x), weightVec)));
+    return x;
+  }
+
+  template<class... Rows>
+  __attribute__((target("sse2")))
+  int filterRows2DSse2(const uint8_t* const* rows, int16_t* out, int x, int end, int step)
+  {
+    for(; x + 8 <= end; x += 8)
+    {
+      const uint8_t* const* row = rows;
+      __m128i acc = _mm_setzero_si128();
+      int expand[] = {(acc = _mm_add_epi16(acc, sumTapsSse2(Rows(), *row++ + x, step)), 0)...};
+      (void)expand;
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), acc);
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i outputPixelsAvx2(__m256 value, __m256 divisor, __m256 offset)
+  {
+    __m256 result = _mm256_add_ps(_mm256_div_ps(value, divisor), offset);
+    result = _mm256_min_ps(_mm256_max_ps(result, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+    return _mm256_cvtps_epi32(result);
+  }
+
+  // Pack 16 int32 pixels already in [0, 255] to bytes
+  __attribute__((target("avx2")))
+  inline void storePixelsAvx2(__m256i lo, __m256i hi, uint8_t* out)
+  {
+    // The pack interleaves the 128 bit lanes of its inputs, put the 64 bit blocks back in order
+    __m256i pixels = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+    __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(pixels), _mm256_extracti128_si256(pixels, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), bytes);
+  }
+
+  __attribute__((target("avx2")))
+  int storeRowAvx2(const int16_t* sums, uint8_t* out, int x, int end, bool isSigned, float divisor, float offset)
+  {
+    const __m256 divisorVec = _mm256_set1_ps(divisor);
+    const __m256 offsetVec = _mm256_set1_ps(offset);
+    for(; x + 16 <= end; x += 16)
+    {
+      __m128i loValue = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x));
+      __m128i hiValue = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x + 8));
+      __m256i lo = isSigned ? _mm256_cvtepi16_epi32(loValue) : _mm256_cvtepu16_epi32(loValue);
+      __m256i hi = isSigned ? _mm256_cvtepi16_epi32(hiValue) : _mm256_cvtepu16_epi32(hiValue);
+      storePixelsAvx2(outputPixelsAvx2(_mm256_cvtepi32_ps(lo), divisorVec, offsetVec),
+          outputPixelsAvx2(_mm256_cvtepi32_ps(hi), divisorVec, offsetVec), out + x);
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  int storeRowAvx2(const float* sums, uint8_t* out, int x, int end, float divisor, float offset)
+  {
+    const __m256 divisorVec = _mm256_set1_ps(divisor);
+    const __m256 offsetVec = _mm256_set1_ps(offset);
+    for(; x + 16 <= end; x += 16)
+    {
+      storePixelsAvx2(outputPixelsAvx2(_mm256_loadu_ps(sums + x), divisorVec, offsetVec),
+          outputPixelsAvx2(_mm256_loadu_ps(sums + x + 8), divisorVec, offsetVec), out + x);
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  int saturateRowAvx2(const int16_t* sums, uint8_t* out, int x, int end)
+  {
+    for(; x + 32 <= end; x += 32)
+    {
+      __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sums + x));
+      __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sums + x + 16));
+      __m256i pixels = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), pixels);
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  int accumulateRowAvx2(float* sums, const uint8_t* in, float weight, int x, int end)
+  {
+    const __m256 weightVec = _mm256_set1_ps(weight);
+    for(; x + 8 <= end; x += 8)
+    {
+      __m256 value = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + x))));
+      _mm256_storeu_ps(sums + x, _mm256_add_ps(_mm256_loadu_ps(sums + x), _mm256_mul_ps(value, weightVec)));
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  int accumulateRowAvx2(float* sums, const float* in, float weight, int x, int end)
+  {
+    const __m256 weightVec = _mm256_set1_ps(weight);
+    for(; x + 8 <= end; x += 8)
+    {
+      _mm256_storeu_ps(sums + x,
+          _mm256_add_ps(_mm256_loadu_ps(sums + x), _mm256_mul_ps(_mm256_loadu_ps(in + x), weightVec)));
+    }
+    return x;
+  }
+
+  template<class... Rows>
+  __attribute__((target("avx2")))
+  int filterRows2DAvx2(const uint8_t* const* rows, int16_t* out, int x, int end, int step)
+  {
+    for(; x + 16 <= end; x += 16)
+    {
+      const uint8_t* const* row = rows;
+      __m256i acc = _mm256_setzero_si256();
+      int expand[] = {(acc = _mm256_add_epi16(acc, sumTapsAvx2(Rows(), *row++ + x, step)), 0)...};
+      (void)expand;
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), acc);
+    }
+    return x;
+  }
+#endif
+
+  void storeRow(const int16_t* sums, uint8_t* out, int count, bool isSigned, int divisor, int offset, SimdLevel level)
+  {
+    int x = 0;
+    if(isSigned && divisor == 1 && offset == 0)
+    {
+#ifdef MICROCV_X86_SIMD
+      if(level >= SimdAvx2)
+        x = saturateRowAvx2(sums, out, x, count);
+      if(level >= SimdSse2)
+        x = saturateRowSse2(sums, out, x, count);
+#endif
+      saturateRowScalar(sums, out, x, count);
+      return;
+    }
+#ifdef MICROCV_X86_SIMD
+    if(level >= SimdAvx2)
+      x = storeRowAvx2(sums, out, x, count, isSigned, static_cast<float>(divisor), static_cast<float>(offset));
+    if(level >= SimdSse2)
+      x = storeRowSse2(sums, out, x, count, isSigned, static_cast<float>(divisor), static_cast<float>(offset));
+#else
+    (void)level;
+#endif
+    storeRowScalar(sums, out, x, count, isSigned, static_cast<float>(divisor), static_cast<float>(offset));
+  }
+
+  void storeRow(const float* sums, uint8_t* out, int count, int divisor, int offset, SimdLevel level)
+  {
+    int x = 0;
+#ifdef MICROCV_X86_SIMD
+    if(level >= SimdAvx2)
+      x = storeRowAvx2(sums, out, x, count, static_cast<float>(divisor), static_cast<float>(offset));
+    if(level >= SimdSse2)
+      x = storeRowSse2(sums, out, x, count, static_cast<float>(divisor), static_cast<float>(offset));
+#else
+    (void)level;
+#endif
+    storeRowScalar(sums, out, x, count, static_cast<float>(divisor), static_cast<float>(offset));
+  }
+
+  template<typename T>
+  void accumulateRow(float* sums, const T* in, float weight, int count, SimdLevel level)
+  {
+    int x = 0;
+#ifdef MICROCV_X86_SIMD
+    if(level >= SimdAvx2)
+      x = accumulateRowAvx2(sums, in, weight, x, count);
+    if(level >= SimdSse2)
+      x = accumulateRowSse2(sums, in, weight, x, count);
+#else
+    (void)level;
+#endif
+    accumulateRowScalar(sums, in, weight, x, count);
+  }
+
+  template<class... Rows>
+  void filterRows2D(const uint8_t* const* rows, int16_t* out, int count, int step, SimdLevel level)
+  {
+    int x = 0;
+#ifdef MICROCV_X86_SIMD
+    if(level >= SimdAvx2)
+      x = filterRows2DAvx2<Rows...>(rows, out, x, count, step);
+    if(level >= SimdSse2)
+      x = filterRows2DSse2<Rows...>(rows, out, x, count, step);
+#else
+    (void)level;
+#endif
+    filterRows2DScalar<Rows...>(rows, out, x, count, step);
+  }
+
+  template<int... W>
+  std::vector<int> tapWeights(Taps<W...>)
+  {
+    return std::vector<int>{W...};
+  }
+
+  // Kernel of RowTaps filtered vertically by ColumnTaps, with 16 bit sums
+  template<class RowTaps, class ColumnTaps>
+  class SeparableTapsFilter : public RowFilter
+  {
+  public:
+    static constexpr bool isSigned = hasNegativeWeight(RowTaps()) || hasNegativeWeight(ColumnTaps());
+    static_assert(tapsFit16Bits(absWeightSum(RowTaps()) * absWeightSum(ColumnTaps()), isSigned),
+        "The sums of a Taps kernel must fit 16 bits");
+
+    SeparableTapsFilter(int count, int channels, int divisor, int offset)
+    : count_(count)
+    , channels_(channels)
+    , divisor_(divisor)
+    , offset_(offset)
+    , level_(simdLevel())
+    , ring_(tapCount(ColumnTaps()), count)
+    , sums_(count)
+    {
+    }
+
+    void pushRow(const uint8_t* paddedRow)
+    {
+      filterRow(RowTaps(), paddedRow, ring_.next(), count_, channels_, level_);
+    }
+
+    void computeRow(uint8_t* outRow)
+    {
+      combineRows(ColumnTaps(), ring_.rows(), sums_.data(), count_, level_);
+      storeRow(sums_.data(), outRow, count_, isSigned, divisor_, offset_, level_);
+    }
+
+  private:
+    int count_;
+    int channels_;
+    int divisor_;
+    int offset_;
+    SimdLevel level_;
+    RowRing<int16_t> ring_;
+    std::vector<int16_t> sums_;
+  };
+
+  // Kernel whose rows are the Taps of Rows, with 16 bit sums
+  template<class... Rows>
+  class TapsFilter2D : public RowFilter
+  {
+  public:
+    static constexpr bool isSigned = hasNegativeWeight((hasNegativeWeight(Rows()) ? -1 : 0)...);
+    static_assert(tapsFit16Bits(absWeightSum(absWeightSum(Rows())...), isSigned),
+        "The sums of a Taps kernel must fit 16 bits");
+
+    TapsFilter2D(int count, int paddedCount, int channels, int divisor, int offset)
+    : count_(count)
+    , channels_(channels)
+    , divisor_(divisor)
+    , offset_(offset)
+    , level_(simdLevel())
+    , ring_(sizeof...(Rows), paddedCount)
+    , sums_(count)
+    {
+    }
+
+    void pushRow(const uint8_t* paddedRow)
+    {
+      std::memcpy(ring_.next(), paddedRow, ring_.rowSize());
+    }
+
+    void computeRow(uint8_t* outRow)
+    {
+      filterRows2D<Rows...>(ring_.rows(), sums_.data(), count_, channels_, level_);
+      storeRow(sums_.data(), outRow, count_, isSigned, divisor_, offset_, level_);
+    }
+
+  private:
+    int count_;
+    int channels_;
+    int divisor_;
+    int offset_;
+    SimdLevel level_;
+    RowRing<uint8_t> ring_;
+    std::vector<int16_t> sums_;
+  };
+
+  // Any separable kernel, with float sums
+  class SeparableFilter : public RowFilter
+  {
+  public:
+    SeparableFilter(const std::vector<int>& rowWeights, const std::vector<int>& columnWeights, int count,
+        int channels, int divisor, int offset)
+    : rowWeights_(rowWeights)
+    , columnWeights_(columnWeights)
+    , count_(count)
+    , channels_(channels)
+    , divisor_(divisor)
+    , offset_(offset)
+    , level_(simdLevel())
+    , ring_(static_cast<int>(columnWeights.size()), count)
+    , sums_(count)
+    {
+    }
+
+    void pushRow(const uint8_t* paddedRow)
+    {
+      float* sums = ring_.next();
+      std::fill(sums, sums + count_, 0.0f);
+      for(size_t t = 0; t < rowWeights_.size(); t++)
+      {
+        if(rowWeights_[t] != 0)
+          accumulateRow(sums, paddedRow + t*channels_, static_cast<float>(rowWeights_[t]), count_, level_);
+      }
+    }
+
+    void computeRow(uint8_t* outRow)
+    {
+      const float* const* rows = ring_.rows();
+      std::fill(sums_.begin(), sums_.end(), 0.0f);
+      for(size_t t = 0; t < columnWeights_.size(); t++)
+      {
+        if(columnWeights_[t] != 0)
+          accumulateRow(sums_.data(), rows[t], static_cast<float>(columnWeights_[t]), count_, level_);
+      }
+      storeRow(sums_.data(), outRow, count_, divisor_, offset_, level_);
+    }
+
+  private:
+    std::vector<int> rowWeights_;
+    std::vector<int> columnWeights_;
+    int count_;
+    int channels_;
+    int divisor_;
+    int offset_;
+    SimdLevel level_;
+    RowRing<float> ring_;
+    std::vector<float> sums_;
+  };
+
+  // Any kernel, with float sums
+  class Filter2D : public RowFilter
+  {
+  public:
+    Filter2D(const FilterKernel& kernel, int count, int paddedCount, int channels)
+    : kernel_(kernel)
+    , count_(count)
+    , channels_(channels)
+    , level_(simdLevel())
+    , ring_(kernel.height, paddedCount)
+    , sums_(count)
+    {
+    }
+
+    void pushRow(const uint8_t* paddedRow)
+    {
+      std::memcpy(ring_.next(), paddedRow, ring_.rowSize());
+    }
+
+    void computeRow(uint8_t* outRow)
+    {
+      const uint8_t* const* rows = ring_.rows();
+      std::fill(sums_.begin(), sums_.end(), 0.0f);
+      for(int ky = 0; ky < kernel_.height; ky++)
+      {
+        for(int kx = 0; kx < kernel_.width; kx++)
+        {
+          const int weight = kernel_.weights[ky*kernel_.width + kx];
+          if(weight != 0)
+            accumulateRow(sums_.data(), rows[ky] + kx*channels_, static_cast<float>(weight), count_, level_);
+        }
+      }
+      storeRow(sums_.data(), outRow, count_, kernel_.divisor, kernel_.offset, level_);
+    }
+
+  private:
+    FilterKernel kernel_;
+    int count_;
+    int channels_;
+    SimdLevel level_;
+    RowRing<uint8_t> ring_;
+    std::vector<float> sums_;
+  };
+
+  template<class RowTaps, class ColumnTaps>
+  bool createSeparableTapsFilter(const FilterKernel& kernel, int count, int channels, std::unique_ptr<RowFilter>& filter)
+  {
+    const std::vector<int> rowWeights = tapWeights(RowTaps());
+    const std::vector<int> columnWeights = tapWeights(ColumnTaps());
+    if(kernel.width != static_cast<int>(rowWeights.size()) || kernel.height != static_cast<int>(columnWeights.size()))
+      return false;
+    for(int ky = 0; ky < kernel.height; ky++)
+    {
+      for(int kx = 0; kx < kernel.width; kx++)
+      {
+        if(kernel.weights[ky*kernel.width + kx] != columnWeights[ky] * rowWeights[kx])
+          return false;
+      }
+    }
+    filter.reset(new SeparableTapsFilter<RowTaps, ColumnTaps>(count, channels, kernel.divisor, kernel.offset));
+    return true;
+  }
+
+  template<class... Rows>
+  bool createTapsFilter2D(const FilterKernel& kernel, int count, int paddedCount, int channels,
+      std::unique_ptr<RowFilter>& filter)
+  {
+    std::vector<int> weights;
+    const std::vector<int> rows[] = {tapWeights(Rows())...};
+    for(const std::vector<int>& row : rows)
+    {
+      if(kernel.width != static_cast<int>(row.size()))
+        return false;
+      weights.insert(weights.end(), row.begin(), row.end());
+    }
+    if(kernel.weights != weights)
+      return false;
+    filter.reset(new TapsFilter2D<Rows...>(count, paddedCount, channels, kernel.divisor, kernel.offset));
+    return true;
+  }
+
+  int greatestCommonDivisor(int a, int b)
+  {
+    while(b != 0)
+    {
+      const int rest = a % b;
+      a = b;
+      b = rest;
+    }
+    return a;
+  }
+
+  // Split the kernel into a column times a row of integers if it is separable. Dividing the row by
+  // the gcd of its weights makes it primitive, so every other row must be an integer multiple of it
+  bool factorKernel(const FilterKernel& kernel, std::vector<int>& rowWeights, std::vector<int>& columnWeights)
+  {
+    const std::vector<int>& weights = kernel.weights;
+    const std::vector<int>::const_iterator pivot = std::find_if(weights.begin(), weights.end(),
+        [](int weight) { return weight != 0; });
+    if(pivot == weights.end())
+      return false;
+    const int pivotRow = static_cast<int>(pivot - weights.begin()) / kernel.width;
+    const int pivotColumn = static_cast<int>(pivot - weights.begin()) % kernel.width;
+
+    rowWeights.assign(weights.begin() + pivotRow*kernel.width, weights.begin() + (pivotRow + 1)*kernel.width);
+    int gcd = 0;
+    for(int weight : rowWeights)
+      gcd = greatestCommonDivisor(std::abs(weight), gcd);
+    for(int& weight : rowWeights)
+      weight /= gcd;
+
+    columnWeights.resize(kernel.height);
+    for(int ky = 0; ky < kernel.height; ky++)
+    {
+      const int weight = weights[ky*kernel.width + pivotColumn];
+      if(weight % rowWeights[pivotColumn] != 0)
+        return false;
+      columnWeights[ky] = weight / rowWeights[pivotColumn];
+      for(int kx = 0; kx < kernel.width; kx++)
+      {
+        if(weights[ky*kernel.width + kx] != columnWeights[ky] * rowWeights[kx])
+          return false;
+      }
+    }
+    return true;
+  }
+
+  std::unique_ptr<RowFilter> createRowFilter(const FilterKernel& kernel, int count, int paddedCount, int channels)
+  {
+    // Kernels with code generated for their weights
+    std::unique_ptr<RowFilter> filter;
+    if(createSeparableTapsFilter<Taps<-1, 0, 1>, Taps<1, 2, 1>>(kernel, count, channels, filter)      // Sobel x
+        || createSeparableTapsFilter<Taps<1, 2, 1>, Taps<-1, 0, 1>>(kernel, count, channels, filter)  // Sobel y
+        || createSeparableTapsFilter<Taps<-1, 0, 1>, Taps<3, 10, 3>>(kernel, count, channels, filter) // Scharr x
+        || createSeparableTapsFilter<Taps<3, 10, 3>, Taps<-1, 0, 1>>(kernel, count, channels, filter) // Scharr y
+        || createTapsFilter2D<Taps<0, 1, 0>, Taps<1, -4, 1>, Taps<0, 1, 0>>(kernel, count, paddedCount, channels, filter)
+        || createSeparableTapsFilter<Taps<1, 1, 1>, Taps<1, 1, 1>>(kernel, count, channels, filter)
+        || createSeparableTapsFilter<Taps<1, 1, 1, 1, 1>, Taps<1, 1, 1, 1, 1>>(kernel, count, channels, filter)
+        || createSeparableTapsFilter<Taps<1, 2, 1>, Taps<1, 2, 1>>(kernel, count, channels, filter)
+        || createSeparableTapsFilter<Taps<1, 4, 6, 4, 1>, Taps<1, 4, 6, 4, 1>>(kernel, count, channels, filter))
+      return filter;
+
+    std::vector<int> rowWeights;
+    std::vector<int> columnWeights;
+    if(factorKernel(kernel, rowWeights, columnWeights))
+      filter.reset(new SeparableFilter(rowWeights, columnWeights, count, channels, kernel.divisor, kernel.offset));
+    else
+      filter.reset(new Filter2D(kernel, count, paddedCount, channels));
+    return filter;
+  }
+}
+
+FilterEngine::FilterEngine(const FilterKernel& kernel, int width, int channels, BorderMode border)
+: width_(width)
+, channels_(channels)
+, radiusX_(kernel.width / 2)
+, border_(border)
+, paddedRow_(static_cast<size_t>(width + 2*radiusX_) * channels)
+, filter_(createRowFilter(kernel, width * channels, static_cast<int>(paddedRow_.size()), channels))
+{
+}
+
+FilterEngine::~FilterEngine()
+{
+}
+
+void FilterEngine::pushRow(const uint8_t* row)
+{
+  if(!row)
+  {
+    std::fill(paddedRow_.begin(), paddedRow_.end(), 0);
+    filter_->pushRow(paddedRow_.data());
+    return;
+  }
+
+  // Only the padding depends on the border mode
+  uint8_t* padded = paddedRow_.data();
+  std::memcpy(padded + radiusX_*channels_, row, static_cast<size_t>(width_) * channels_);
+  auto padPixel = [&](int x, uint8_t* dst)
+  {
+    const int inputX = borderIndex(x, width_, border_);
+    if(inputX < 0)
+      std::memset(dst, 0, channels_);
+    else
+      std::memcpy(dst, row + inputX*channels_, channels_);
+  };
+  for(int i = 0; i < radiusX_; i++)
+  {
+    padPixel(i - radiusX_, padded + i*channels_);
+    padPixel(width_ + i, padded + (radiusX_ + width_ + i)*channels_);
+  }
+  filter_->pushRow(padded);
+}
+
+void FilterEngine::computeRow(uint8_t* outRow)
+{
+  filter_->computeRow(outRow);
+}
+
+bool MicroCv::Kernels::isValidFilterKernel(const FilterKernel& kernel)
+{
+  if(kernel.width <= 0 || kernel.height <= 0 || kernel.width % 2 == 0 || kernel.height % 2 == 0)
+    return false;
+  if(kernel.weights.size() != static_cast<size_t>(kernel.width) * kernel.height || kernel.divisor <= 0)
+    return false;
+
+  // Every partial sum is then an integer below 2^24, which float holds exactly
+  int64_t absSum = 0;
+  for(int weight : kernel.weights)
+    absSum += std::abs(static_cast<int64_t>(weight));
+  return 255 * absSum < (1 << 24);
+}
+
+int MicroCv::Kernels::borderIndex(int i, int n, BorderMode border)
+{
+  if(i >= 0 && i < n)
+    return i;
+  if(border == BorderConstant)
+    return -1;
+  if(border == BorderReplicate)
+    return i < 0 ? 0 : n - 1;
+  if(n == 1)
+    return 0;
+
+  // Reflection repeats every 2n - 2 pixels
+  const int period = 2*n - 2;
+  i %= period;
+  if(i < 0)
+    i += period;
+  return i < n ? i : period - i;
+}
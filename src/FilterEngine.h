@@ -0,0 +1,56 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ImageProcessing.h"
+
+namespace MicroCv
+{
+namespace Kernels
+{
+// Row by row implementation of one kernel, see FilterEngine.cpp
+class RowFilter;
+
+/*
+ * FilterEngine runs a FilterKernel over a stream of rows, keeping only the last kernel height
+ * rows. Every pushed row is padded on both sides according to the border mode, so the row
+ * loops never check bounds.
+ * The common kernels (Sobel, Scharr, Laplacian, box and binomial) run on compile-time Taps
+ * (see FilterTaps.h) in 16 bit lanes. Any other kernel runs on a generic path that sums in
+ * float, which is exact for valid kernels, so both paths give the same pixels. Separable
+ * kernels are filtered horizontally once per pushed row and then combined vertically.
+ * Outputs are rounded half to even, the rounding of the SIMD float to int conversions.
+ */
+class FilterEngine
+{
+public:
+  // The kernel must be valid (see isValidFilterKernel())
+  FilterEngine(const FilterKernel& kernel, int width, int channels, BorderMode border);
+  ~FilterEngine();
+
+  // Feed the next input row (width * channels values), nullptr feeds a row of the constant border
+  void pushRow(const uint8_t* row);
+  // Filter the middle one of the last kernel height pushed rows into outRow
+  void computeRow(uint8_t* outRow);
+
+private:
+  int width_;
+  int channels_;
+  int radiusX_;
+  BorderMode border_;
+  std::vector<uint8_t> paddedRow_;
+  std::unique_ptr<RowFilter> filter_;
+};
+
+// Odd sizes, one weight per tap, a positive divisor and sums that are exact in float
+bool isValidFilterKernel(const FilterKernel& kernel);
+
+// The pixel read for index i of a line of n pixels, or -1 for the constant border
+int borderIndex(int i, int n, BorderMode border);
+};
+};
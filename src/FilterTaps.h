@@ -0,0 +1,270 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+
+#include "CpuFeatures.h"
+
+#ifdef MICROCV_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace MicroCv
+{
+namespace Kernels
+{
+/*
+ * Filter taps known at compile time. The weights of Taps<-1, 0, 1> are template arguments, so
+ * the sums below are expanded tap by tap at compile time: zero taps are never loaded, +1 and -1
+ * taps are a plain add or subtract and only the other weights are multiplied.
+ * A sum reads its taps either along a row (tap t at p[t*step]) or down a column of int16 rows
+ * (tap t at rows[t][x]). The vector sums accumulate in 16 bit lanes, which is exact as long as
+ * 255 * the sum of the absolute weights of the whole kernel fits 16 bits (see tapsFit16Bits()).
+ */
+template<int... W> struct Taps {};
+
+constexpr int absWeightSum()
+{
+  return 0;
+}
+
+template<typename... Rest>
+constexpr int absWeightSum(int weight, Rest... rest)
+{
+  return (weight < 0 ? -weight : weight) + absWeightSum(rest...);
+}
+
+constexpr bool hasNegativeWeight()
+{
+  return false;
+}
+
+template<typename... Rest>
+constexpr bool hasNegativeWeight(int weight, Rest... rest)
+{
+  return weight < 0 || hasNegativeWeight(rest...);
+}
+
+template<int... W>
+constexpr int tapCount(Taps<W...>)
+{
+  return sizeof...(W);
+}
+
+template<int... W>
+constexpr int absWeightSum(Taps<W...>)
+{
+  return absWeightSum(W...);
+}
+
+template<int... W>
+constexpr bool hasNegativeWeight(Taps<W...>)
+{
+  return hasNegativeWeight(W...);
+}
+
+// Sums of the taps of any pixel fit int16, or uint16 when no weight is negative
+constexpr bool tapsFit16Bits(int absSum, bool isSigned)
+{
+  return 255 * absSum <= (isSigned ? 32767 : 65535);
+}
+
+template<int... W>
+inline int sumTapsScalar(Taps<W...>, const uint8_t* p, int step)
+{
+  int acc = 0;
+  int expand[] = {(acc += W * *p, p += step, 0)...};
+  (void)expand;
+  return acc;
+}
+
+template<int... W>
+inline int sumTapsScalar(Taps<W...>, const int16_t* const* rows, int x)
+{
+  int acc = 0;
+  int expand[] = {(acc += W * (*rows)[x], rows++, 0)...};
+  (void)expand;
+  return acc;
+}
+
+#ifdef MICROCV_X86_SIMD
+__attribute__((target("sse2")))
+inline __m128i loadTapSse2(const uint8_t* p)
+{
+  return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+}
+
+__attribute__((target("sse2")))
+inline __m128i loadTapSse2(const int16_t* p)
+{
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+// acc + W * the 8 values at p
+template<int W, typename T>
+__attribute__((target("sse2")))
+inline __m128i addTapSse2(__m128i acc, const T* p)
+{
+  if(W == 0)
+    return acc;
+  const __m128i value = loadTapSse2(p);
+  const __m128i product = (W == 1 || W == -1) ? value : _mm_mullo_epi16(value, _mm_set1_epi16(W < 0 ? -W : W));
+  return W < 0 ? _mm_sub_epi16(acc, product) : _mm_add_epi16(acc, product);
+}
+
+template<int... W>
+__attribute__((target("sse2")))
+inline __m128i sumTapsSse2(Taps<W...>, const uint8_t* p, int step)
+{
+  __m128i acc = _mm_setzero_si128();
+  int expand[] = {(acc = addTapSse2<W>(acc, p), p += step, 0)...};
+  (void)expand;
+  return acc;
+}
+
+template<int... W>
+__attribute__((target("sse2")))
+inline __m128i sumTapsSse2(Taps<W...>, const int16_t* const* rows, int x)
+{
+  __m128i acc = _mm_setzero_si128();
+  int expand[] = {(acc = addTapSse2<W>(acc, *rows + x), rows++, 0)...};
+  (void)expand;
+  return acc;
+}
+
+__attribute__((target("avx2")))
+inline __m256i loadTapAvx2(const uint8_t* p)
+{
+  return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+__attribute__((target("avx2")))
+inline __m256i loadTapAvx2(const int16_t* p)
+{
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+// acc + W * the 16 values at p
+template<int W, typename T>
+__attribute__((target("avx2")))
+inline __m256i addTapAvx2(__m256i acc, const T* p)
+{
+  if(W == 0)
+    return acc;
+  const __m256i value = loadTapAvx2(p);
+  const __m256i product = (W == 1 || W == -1) ? value : _mm256_mullo_epi16(value, _mm256_set1_epi16(W < 0 ? -W : W));
+  return W < 0 ? _mm256_sub_epi16(acc, product) : _mm256_add_epi16(acc, product);
+}
+
+template<int... W>
+__attribute__((target("avx2")))
+inline __m256i sumTapsAvx2(Taps<W...>, const uint8_t* p, int step)
+{
+  __m256i acc = _mm256_setzero_si256();
+  int expand[] = {(acc = addTapAvx2<W>(acc, p), p += step, 0)...};
+  (void)expand;
+  return acc;
+}
+
+template<int... W>
+__attribute__((target("avx2")))
+inline __m256i sumTapsAvx2(Taps<W...>, const int16_t* const* rows, int x)
+{
+  __m256i acc = _mm256_setzero_si256();
+  int expand[] = {(acc = addTapAvx2<W>(acc, *rows + x), rows++, 0)...};
+  (void)expand;
+  return acc;
+}
+#endif
+
+/*
+ * Row loops over the sums above, dispatched on the given SIMD level.
+ * filterRow: out[i] = sum of taps t of in[i + t*step] for i in [0, count)
+ * combineRows: out[i] = sum of taps t of rows[t][i] for i in [0, count)
+ * The sums of filterRow and combineRows are stored as int16, which holds uint16 sums too.
+ */
+template<class RowTaps>
+inline void filterRowScalar(RowTaps taps, const uint8_t* in, int16_t* out, int x, int end, int step)
+{
+  for(; x < end; x++)
+    out[x] = static_cast<int16_t>(sumTapsScalar(taps, in + x, step));
+}
+
+template<class ColumnTaps>
+inline void combineRowsScalar(ColumnTaps taps, const int16_t* const* rows, int16_t* out, int x, int end)
+{
+  for(; x < end; x++)
+    out[x] = static_cast<int16_t>(sumTapsScalar(taps, rows, x));
+}
+
+#ifdef MICROCV_X86_SIMD
+template<class RowTaps>
+__attribute__((target("sse2")))
+int filterRowSse2(RowTaps taps, const uint8_t* in, int16_t* out, int x, int end, int step)
+{
+  for(; x + 8 <= end; x += 8)
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), sumTapsSse2(taps, in + x, step));
+  return x;
+}
+
+template<class ColumnTaps>
+__attribute__((target("sse2")))
+int combineRowsSse2(ColumnTaps taps, const int16_t* const* rows, int16_t* out, int x, int end)
+{
+  for(; x + 8 <= end; x += 8)
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), sumTapsSse2(taps, rows, x));
+  return x;
+}
+
+template<class RowTaps>
+__attribute__((target("avx2")))
+int filterRowAvx2(RowTaps taps, const uint8_t* in, int16_t* out, int x, int end, int step)
+{
+  for(; x + 16 <= end; x += 16)
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), sumTapsAvx2(taps, in + x, step));
+  return x;
+}
+
+template<class ColumnTaps>
+__attribute__((target("avx2")))
+int combineRowsAvx2(ColumnTaps taps, const int16_t* const* rows, int16_t* out, int x, int end)
+{
+  for(; x + 16 <= end; x += 16)
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), sumTapsAvx2(taps, rows, x));
+  return x;
+}
+#endif
+
+template<class RowTaps>
+void filterRow(RowTaps taps, const uint8_t* in, int16_t* out, int count, int step, SimdLevel level)
+{
+  int x = 0;
+#ifdef MICROCV_X86_SIMD
+  if(level >= SimdAvx2)
+    x = filterRowAvx2(taps, in, out, x, count, step);
+  if(level >= SimdSse2)
+    x = filterRowSse2(taps, in, out, x, count, step);
+#else
+  (void)level;
+#endif
+  filterRowScalar(taps, in, out, x, count, step);
+}
+
+template<class ColumnTaps>
+void combineRows(ColumnTaps taps, const int16_t* const* rows, int16_t* out, int count, SimdLevel level)
+{
+  int x = 0;
+#ifdef MICROCV_X86_SIMD
+  if(level >= SimdAvx2)
+    x = combineRowsAvx2(taps, rows, out, x, count);
+  if(level >= SimdSse2)
+    x = combineRowsSse2(taps, rows, out, x, count);
+#else
+  (void)level;
+#endif
+  combineRowsScalar(taps, rows, out, x, count);
+}
+};
+};
@@ -0,0 +1,661 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <cstring>
+
+#include "BufferPool.h"
+#include "FilterEngine.h"
+#include "GaussianEngine.h"
+#include "Instrumentation.h"
+#include "Parallel.h"
+
+#ifdef MICROCV_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace MicroCv;
+using namespace MicroCv::Kernels;
+
+namespace
+{
+  // Fractional bits of the horizontally filtered rows, 255 << 7 still fits int16
+  const int HORIZONTAL_BITS = 7;
+  const int HORIZONTAL_SHIFT = GAUSSIAN_TAP_BITS - HORIZONTAL_BITS;
+  const int VERTICAL_SHIFT = GAUSSIAN_TAP_BITS + HORIZONTAL_BITS;
+
+  /*
+   * Fixed point passes. The horizontal pass adds the two pixels of every symmetric tap first
+   * (at most 510, so int16) and the vector loops multiply pairs of those sums with pmaddwd.
+   * taps holds radius + 2 weights, the last one 0, so the pairs never need a special case.
+   */
+  void filterRowScalar(const uint8_t* padded, const int* taps, int radius, int16_t* out, int x, int end, int step)
+  {
+    for(; x < end; x++)
+    {
+      const uint8_t* p = padded + x + radius*step;
+      int acc = taps[0] * p[0];
+      for(int k = 1; k <= radius; k++)
+        acc += taps[k] * (p[-k*step] + p[k*step]);
+      out[x] = static_cast<int16_t>((acc + (1 << (HORIZONTAL_SHIFT - 1))) >> HORIZONTAL_SHIFT);
+    }
+  }
+
+  // rows are the 2 * radius + 1 horizontally filtered rows, oldest first
+  void combineRowsScalar(const int16_t* const* rows, const int* taps, int radius, uint8_t* out, int x, int end)
+  {
+    for(; x < end; x++)
+    {
+      int acc = 1 << (VERTICAL_SHIFT - 1);
+      for(int j = 0; j <= 2*radius; j++)
+        acc += taps[std::abs(j - radius)] * rows[j][x];
+      // The weights sum to 1, so the result is already in [0, 255]
+      out[x] = static_cast<uint8_t>(acc >> VERTICAL_SHIFT);
+    }
+  }
+
+#ifdef MICROCV_X86_SIMD
+  // The 8 pixels at p + k*step plus the 8 at p - k*step (only once for the center tap)
+  __attribute__((target("sse2")))
+  inline __m128i symmetricTapSse2(const uint8_t* p, int k, int step)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i right = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + k*step)), zero);
+    if(k == 0)
+      return right;
+    return _mm_add_epi16(right, _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p - k*step)), zero));
+  }
+
+  // Two int16 weights for pmaddwd, a for the even and b for the odd lanes
+  inline int weightPair(int a, int b)
+  {
+    return static_cast<int>(static_cast<uint32_t>(b) << 16 | static_cast<uint32_t>(a));
+  }
+
+  __attribute__((target("sse2")))
+  int filterRowSse2(const uint8_t* padded, const int* taps, int radius, int16_t* out, int x, int end, int step)
+  {
+    const __m128i rounding = _mm_set1_epi32(1 << (HORIZONTAL_SHIFT - 1));
+    for(; x + 8 <= end; x += 8)
+    {
+      const uint8_t* p = padded + x + radius*step;
+      __m128i lo = rounding;
+      __m128i hi = rounding;
+      for(int k = 0; k <= radius; k += 2)
+      {
+        const __m128i a = symmetricTapSse2(p, k, step);
+        const __m128i b = k + 1 <= radius ? symmetricTapSse2(p, k + 1, step) : _mm_setzero_si128();
+        const __m128i weights = _mm_set1_epi32(weightPair(taps[k], taps[k + 1]));
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights));
+      }
+      const __m128i result = _mm_packs_epi32(_mm_srai_epi32(lo, HORIZONTAL_SHIFT), _mm_srai_epi32(hi, HORIZONTAL_SHIFT));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), result);
+    }
+    return x;
+  }
+
+  __attribute__((target("sse2")))
+  int combineRowsSse2(const int16_t* const* rows, const int* taps, int radius, uint8_t* out, int x, int end)
+  {
+    const int count = 2*radius + 1;
+    const __m128i rounding = _mm_set1_epi32(1 << (VERTICAL_SHIFT - 1));
+    for(; x + 8 <= end; x += 8)
+    {
+      __m128i lo = rounding;
+      __m128i hi = rounding;
+      for(int j = 0; j < count; j += 2)
+      {
+        const bool hasPair = j + 1 < count;
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[j] + x));
+        const __m128i b = hasPair ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[j + 1] + x)) : _mm_setzero_si128();
+        const __m128i weights = _mm_set1_epi32(weightPair(taps[std::abs(j - radius)], hasPair ? taps[std::abs(j + 1 - radius)] : 0));
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights));
+      }
+      const __m128i result = _mm_packs_epi32(_mm_srai_epi32(lo, VERTICAL_SHIFT), _mm_srai_epi32(hi, VERTICAL_SHIFT));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(result, result));
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i symmetricTapAvx2(const uint8_t* p, int k, int step)
+  {
+    const __m256i right = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k*step)));
+    if(k == 0)
+      return right;
+    return _mm256_add_epi16(right, _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p - k*step))));
+  }
+
+  // The unpacks and packs below all work within 128 bit lanes, so the pixels come out in order
+  __attribute__((target("avx2")))
+  int filterRowAvx2(const uint8_t* padded, const int* taps, int radius, int16_t* out, int x, int end, int step)
+  {
+    const __m256i rounding = _mm256_set1_epi32(1 << (HORIZONTAL_SHIFT - 1));
+    for(; x + 16 <= end; x += 16)
+    {
+      const uint8_t* p = padded + x + radius*step;
+      __m256i lo = rounding;
+      __m256i hi = rounding;
+      for(int k = 0; k <= radius; k += 2)
+      {
+        const __m256i a = symmetricTapAvx2(p, k, step);
+        const __m256i b = k + 1 <= radius ? symmetricTapAvx2(p, k + 1, step) : _mm256_setzero_si256();
+        const __m256i weights = _mm256_set1_epi32(weightPair(taps[k], taps[k + 1]));
+        lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), weights));
+        hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), weights));
+      }
+      const __m256i result = _mm256_packs_epi32(_mm256_srai_epi32(lo, HORIZONTAL_SHIFT), _mm256_srai_epi32(hi, HORIZONTAL_SHIFT));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), result);
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  int combineRowsAvx2(const int16_t* const* rows, const int* taps, int radius, uint8_t* out, int x, int end)
+  {
+    const int count = 2*radius + 1;
+    const __m256i rounding = _mm256_set1_epi32(1 << (VERTICAL_SHIFT - 1));
+    for(; x + 16 <= end; x += 16)
+    {
+      __m256i lo = rounding;
+      __m256i hi = rounding;
+      for(int j = 0; j < count; j += 2)
+      {
+        const bool hasPair = j + 1 < count;
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[j] + x));
+        const __m256i b = hasPair ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[j + 1] + x)) : _mm256_setzero_si256();
+        const __m256i weights = _mm256_set1_epi32(weightPair(taps[std::abs(j - radius)], hasPair ? taps[std::abs(j + 1 - radius)] : 0));
+        lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), weights));
+        hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), weights));
+      }
+      __m256i result = _mm256_packs_epi32(_mm256_srai_epi32(lo, VERTICAL_SHIFT), _mm256_srai_epi32(hi, VERTICAL_SHIFT));
+      // Bytes 0-7 are in the low and 8-15 in the high lane
+      result = _mm256_permute4x64_epi64(_mm256_packus_epi16(result, result), 0x08);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm256_castsi256_si128(result));
+    }
+    return x;
+  }
+#endif
+
+  void filterGaussianRow(const uint8_t* padded, const int* taps, int radius, int16_t* out, int count, int step, SimdLevel level)
+  {
+    int x = 0;
+#ifdef MICROCV_X86_SIMD
+    if(level >= SimdAvx2)
+      x = filterRowAvx2(padded, taps, radius, out, x, count, step);
+    if(level >= SimdSse2)
+      x = filterRowSse2(padded, taps, radius, out, x, count, step);
+#else
+    (void)level;
+#endif
+    filterRowScalar(padded, taps, radius, out, x, count, step);
+  }
+
+  void combineGaussianRows(const int16_t* const* rows, const int* taps, int radius, uint8_t* out, int count, SimdLevel level)
+  {
+    int x = 0;
+#ifdef MICROCV_X86_SIMD
+    if(level >= SimdAvx2)
+      x = combineRowsAvx2(rows, taps, radius, out, x, count);
+    if(level >= SimdSse2)
+      x = combineRowsSse2(rows, taps, radius, out, x, count);
+#else
+    (void)level;
+#endif
+    combineRowsScalar(rows, taps, radius, out, x, count);
+  }
+
+  /*
+   * Recursive filter of Young and van Vliet, "Recursive implementation of the Gaussian filter"
+   * (Signal Processing 44, 1995): a causal pass w[n] = b*x[n] + a1*w[n-1] + a2*w[n-2] + a3*w[n-3]
+   * followed by the same pass backwards, 7 multiplies per pixel and direction for any sigma.
+   *
+   * The weights of the paper are polynomials in sigma with 6 digit constants, and as sigma grows
+   * the poles they put close to 1 drift off with the rounding of those constants (the peak of
+   * the response is 6% off at sigma 100 and useless by 500). So the weights are only taken from
+   * the paper at sigma 32, and the three poles of that filter are stretched to the wanted sigma
+   * (p^(32 / sigma)), which stays within 1.2 - 2.6% of the peak of a true Gaussian from sigma 4
+   * up. Rounding the weights to float moves the poles too: float lines are accurate up to
+   * sigma 32 and larger sigmas recurse in double.
+   */
+  const double RECURSIVE_REFERENCE_SIGMA = 32.0;
+  const double RECURSIVE_FLOAT_MAX_SIGMA = 32.0;
+  // The padding grows with sigma, this keeps it to a few MB per thread
+  const double RECURSIVE_MAX_SIGMA = 4096.0;
+
+  template<typename T>
+  struct RecursiveCoefficients
+  {
+    T b;
+    T a1;
+    T a2;
+    T a3;
+  };
+
+  template<typename T>
+  RecursiveCoefficients<T> recursiveCoefficients(double sigma)
+  {
+    const double q = 0.98711*RECURSIVE_REFERENCE_SIGMA - 0.96330;
+    const double b0 = 1.57825 + 2.44413*q + 1.4281*q*q + 0.422205*q*q*q;
+    const double b1 = 2.44413*q + 2.85619*q*q + 1.26661*q*q*q;
+    const double b2 = -(1.4281*q*q + 1.26661*q*q*q);
+    const double b3 = 0.422205*q*q*q;
+    const double a1 = b1 / b0;
+    const double a2 = b2 / b0;
+    const double a3 = b3 / b0;
+
+    // The real pole by Newton from 1 (the largest root of z^3 - a1 z^2 - a2 z - a3), then the
+    // complex pair from the quadratic left over
+    double realPole = 1.0;
+    for(int i = 0; i < 32; i++)
+      realPole -= (((realPole - a1)*realPole - a2)*realPole - a3) / ((3*realPole - 2*a1)*realPole - a2);
+    const double linear = realPole - a1;
+    const double constant = a3 / realPole;
+    const std::complex<double> pole = (-linear + std::sqrt(std::complex<double>(linear*linear - 4*constant))) / 2.0;
+
+    const double stretch = RECURSIVE_REFERENCE_SIGMA / sigma;
+    const double p = std::pow(realPole, stretch);
+    const std::complex<double> pq = std::pow(pole, stretch);
+    RecursiveCoefficients<T> coeffs;
+    coeffs.a1 = static_cast<T>(p + 2*pq.real());
+    coeffs.a2 = static_cast<T>(-(2*pq.real()*p + std::norm(pq)));
+    coeffs.a3 = static_cast<T>(p * std::norm(pq));
+    // The gain of a pass is 1 for the rounded feedback weights, so flat images stay flat
+    coeffs.b = static_cast<T>(1.0 - coeffs.a1 - coeffs.a2 - coeffs.a3);
+    return coeffs;
+  }
+
+  /*
+   * One recursive pass over entries [begin, end) of a line of lanes floats each, lane by lane:
+   * line[i] = b*line[i] + a1*line[i - d] + a2*line[i - 2d] + a3*line[i - 3d], in order of
+   * increasing i for a positive d and decreasing i for a negative d. The lanes are independent
+   * signals (rows of a horizontal pass, columns of a vertical one) and are what the vector loops
+   * run across, the recursion itself is sequential. Every lane does the same float operations
+   * in the same order, so the SIMD levels give the same results. The term of the previous entry
+   * is added last, which keeps the chain of dependent operations from entry to entry short.
+   */
+  template<typename T>
+  inline void recurseLanesScalar(T* entry, const T* p1, const T* p2, const T* p3, int lane, int lanes,
+      const RecursiveCoefficients<T>& c)
+  {
+    for(; lane < lanes; lane++)
+      entry[lane] = c.b*entry[lane] + c.a3*p3[lane] + c.a2*p2[lane] + c.a1*p1[lane];
+  }
+
+#ifdef MICROCV_X86_SIMD
+  __attribute__((target("sse2")))
+  void recurseSse2(float* line, int lanes, int begin, int end, int d, const RecursiveCoefficients<float>& c)
+  {
+    const __m128 b = _mm_set1_ps(c.b);
+    const __m128 a1 = _mm_set1_ps(c.a1);
+    const __m128 a2 = _mm_set1_ps(c.a2);
+    const __m128 a3 = _mm_set1_ps(c.a3);
+    const ptrdiff_t stride = static_cast<ptrdiff_t>(d) * lanes;
+    for(int n = 0; n < end - begin; n++)
+    {
+      float* entry = line + static_cast<ptrdiff_t>(d > 0 ? begin + n : end - 1 - n) * lanes;
+      int lane = 0;
+      for(; lane + 4 <= lanes; lane += 4)
+      {
+        __m128 value = _mm_mul_ps(b, _mm_loadu_ps(entry + lane));
+        value = _mm_add_ps(value, _mm_mul_ps(a3, _mm_loadu_ps(entry - 3*stride + lane)));
+        value = _mm_add_ps(value, _mm_mul_ps(a2, _mm_loadu_ps(entry - 2*stride + lane)));
+        value = _mm_add_ps(value, _mm_mul_ps(a1, _mm_loadu_ps(entry - stride + lane)));
+        _mm_storeu_ps(entry + lane, value);
+      }
+      recurseLanesScalar(entry, entry - stride, entry - 2*stride, entry - 3*stride, lane, lanes, c);
+    }
+  }
+
+  __attribute__((target("avx2")))
+  void recurseAvx2(float* line, int lanes, int begin, int end, int d, const RecursiveCoefficients<float>& c)
+  {
+    const __m256 b = _mm256_set1_ps(c.b);
+    const __m256 a1 = _mm256_set1_ps(c.a1);
+    const __m256 a2 = _mm256_set1_ps(c.a2);
+    const __m256 a3 = _mm256_set1_ps(c.a3);
+    const ptrdiff_t stride = static_cast<ptrdiff_t>(d) * lanes;
+    for(int n = 0; n < end - begin; n++)
+    {
+      float* entry = line + static_cast<ptrdiff_t>(d > 0 ? begin + n : end - 1 - n) * lanes;
+      int lane = 0;
+      for(; lane + 8 <= lanes; lane += 8)
+      {
+        __m256 value = _mm256_mul_ps(b, _mm256_loadu_ps(entry + lane));
+        value = _mm256_add_ps(value, _mm256_mul_ps(a3, _mm256_loadu_ps(entry - 3*stride + lane)));
+        value = _mm256_add_ps(value, _mm256_mul_ps(a2, _mm256_loadu_ps(entry - 2*stride + lane)));
+        value = _mm256_add_ps(value, _mm256_mul_ps(a1, _mm256_loadu_ps(entry - stride + lane)));
+        _mm256_storeu_ps(entry + lane, value);
+      }
+      recurseLanesScalar(entry, entry - stride, entry - 2*stride, entry - 3*stride, lane, lanes, c);
+    }
+  }
+
+  // The same loops on double lines, for large sigmas
+  __attribute__((target("sse2")))
+  void recurseSse2(double* line, int lanes, int begin, int end, int d, const RecursiveCoefficients<double>& c)
+  {
+    const __m128d b = _mm_set1_pd(c.b);
+    const __m128d a1 = _mm_set1_pd(c.a1);
+    const __m128d a2 = _mm_set1_pd(c.a2);
+    const __m128d a3 = _mm_set1_pd(c.a3);
+    const ptrdiff_t stride = static_cast<ptrdiff_t>(d) * lanes;
+    for(int n = 0; n < end - begin; n++)
+    {
+      double* entry = line + static_cast<ptrdiff_t>(d > 0 ? begin + n : end - 1 - n) * lanes;
+      int lane = 0;
+      for(; lane + 2 <= lanes; lane += 2)
+      {
+        __m128d value = _mm_mul_pd(b, _mm_loadu_pd(entry + lane));
+        value = _mm_add_pd(value, _mm_mul_pd(a3, _mm_loadu_pd(entry - 3*stride + lane)));
+        value = _mm_add_pd(value, _mm_mul_pd(a2, _mm_loadu_pd(entry - 2*stride + lane)));
+        value = _mm_add_pd(value, _mm_mul_pd(a1, _mm_loadu_pd(entry - stride + lane)));
+        _mm_storeu_pd(entry + lane, value);
+      }
+      recurseLanesScalar(entry, entry - stride, entry - 2*stride, entry - 3*stride, lane, lanes, c);
+    }
+  }
+
+  __attribute__((target("avx2")))
+  void recurseAvx2(double* line, int lanes, int begin, int end, int d, const RecursiveCoefficients<double>& c)
+  {
+    const __m256d b = _mm256_set1_pd(c.b);
+    const __m256d a1 = _mm256_set1_pd(c.a1);
+    const __m256d a2 = _mm256_set1_pd(c.a2);
+    const __m256d a3 = _mm256_set1_pd(c.a3);
+    const ptrdiff_t stride = static_cast<ptrdiff_t>(d) * lanes;
+    for(int n = 0; n < end - begin; n++)
+    {
+      double* entry = line + static_cast<ptrdiff_t>(d > 0 ? begin + n : end - 1 - n) * lanes;
+      int lane = 0;
+      for(; lane + 4 <= lanes; lane += 4)
+      {
+        __m256d value = _mm256_mul_pd(b, _mm256_loadu_pd(entry + lane));
+        value = _mm256_add_pd(value, _mm256_mul_pd(a3, _mm256_loadu_pd(entry - 3*stride + lane)));
+        value = _mm256_add_pd(value, _mm256_mul_pd(a2, _mm256_loadu_pd(entry - 2*stride + lane)));
+        value = _mm256_add_pd(value, _mm256_mul_pd(a1, _mm256_loadu_pd(entry - stride + lane)));
+        _mm256_storeu_pd(entry + lane, value);
+      }
+      recurseLanesScalar(entry, entry - stride, entry - 2*stride, entry - 3*stride, lane, lanes, c);
+    }
+  }
+#endif
+
+  template<typename T>
+  void recurse(T* line, int lanes, int begin, int end, int d, const RecursiveCoefficients<T>& c, SimdLevel level)
+  {
+#ifdef MICROCV_X86_SIMD
+    if(level >= SimdAvx2)
+      return recurseAvx2(line, lanes, begin, end, d, c);
+    if(level >= SimdSse2)
+      return recurseSse2(line, lanes, begin, end, d, c);
+#else
+    (void)level;
+#endif
+    const ptrdiff_t stride = static_cast<ptrdiff_t>(d) * lanes;
+    for(int n = 0; n < end - begin; n++)
+    {
+      T* entry = line + static_cast<ptrdiff_t>(d > 0 ? begin + n : end - 1 - n) * lanes;
+      recurseLanesScalar(entry, entry - stride, entry - 2*stride, entry - 3*stride, 0, lanes, c);
+    }
+  }
+
+  /*
+   * Both passes over a line of count entries of lanes floats, entries [3d, count - 3d) hold the
+   * signal. The recursion starts from the steady state of the first entry (which a constant
+   * signal stays in) and the backward pass from that of the last forward output, so the three
+   * entries on either side are set to those.
+   */
+  template<typename T>
+  void recurseLine(T* line, int lanes, int count, int d, const RecursiveCoefficients<T>& c, SimdLevel level)
+  {
+    const size_t laneBytes = static_cast<size_t>(lanes) * sizeof(T);
+    for(int i = 0; i < 3*d; i++)
+      std::memcpy(line + static_cast<size_t>(i) * lanes, line + static_cast<size_t>(i % d + 3*d) * lanes, laneBytes);
+    recurse(line, lanes, 3*d, count - 3*d, d, c, level);
+    for(int i = count - 3*d; i < count; i++)
+      std::memcpy(line + static_cast<size_t>(i) * lanes, line + static_cast<size_t>(count - 4*d + i % d) * lanes, laneBytes);
+    recurse(line, lanes, 3*d, count - 3*d, -d, c, level);
+  }
+
+  // Round to nearest even and saturate, like _mm_cvtps_epi32 and the packs below
+  void storeFloatRowScalar(const float* in, uint8_t* out, int x, int end)
+  {
+    for(; x < end; x++)
+      out[x] = static_cast<uint8_t>(std::nearbyint(std::min(std::max(in[x], 0.0f), 255.0f)));
+  }
+
+#ifdef MICROCV_X86_SIMD
+  __attribute__((target("sse2")))
+  int storeFloatRowSse2(const float* in, uint8_t* out, int x, int end)
+  {
+    for(; x + 8 <= end; x += 8)
+    {
+      const __m128i lo = _mm_cvtps_epi32(_mm_loadu_ps(in + x));
+      const __m128i hi = _mm_cvtps_epi32(_mm_loadu_ps(in + x + 4));
+      const __m128i words = _mm_packs_epi32(lo, hi);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(words, words));
+    }
+    return x;
+  }
+#endif
+
+  void storeFloatRow(const float* in, uint8_t* out, int count, SimdLevel level)
+  {
+    int x = 0;
+#ifdef MICROCV_X86_SIMD
+    if(level >= SimdSse2)
+      x = storeFloatRowSse2(in, out, x, count);
+#else
+    (void)level;
+#endif
+    storeFloatRowScalar(in, out, x, count);
+  }
+
+  // Double lines are narrowed to float first, which keeps them on the vector store
+  void storeFloatRow(const double* in, uint8_t* out, int count, SimdLevel level)
+  {
+    const int CHUNK = 64;
+    float values[CHUNK];
+    for(int x = 0; x < count; x += CHUNK)
+    {
+      const int n = std::min(CHUNK, count - x);
+      std::copy(in + x, in + x + n, values);
+      storeFloatRow(values, out + x, n, level);
+    }
+  }
+
+  /*
+   * Horizontal pass into float rows, then a vertical pass over strips of columns straight into
+   * outPtr. T is the precision of the recursion, the rows in between are float either way.
+   */
+  template<typename T>
+  void recursiveBlur(const MatView& view, double sigma, BorderMode border, uint8_t* outPtr)
+  {
+    const RecursiveCoefficients<T> coeffs = recursiveCoefficients<T>(sigma);
+    const SimdLevel level = simdLevel();
+    const int width = view.width();
+    const int height = view.height();
+    const int channels = view.channels();
+    const int rowSize = width * channels;
+    // The border is filtered from this many padding pixels, by then the start up of the
+    // recursion has decayed like the tail of the Gaussian
+    const int pad = static_cast<int>(std::ceil(4*sigma));
+
+    // Horizontal pass into float rows, 16 rows at a time (8 on double lines) as the lanes of one
+    // line, which gives the vector loops more than one independent recursion to overlap
+    const int LINE_LANES = 64 / sizeof(T);
+    std::vector<float, PixelAllocator<float>> blurredRows(static_cast<size_t>(rowSize) * height);
+    std::vector<int> columns(width + 2*pad);
+    for(int x = 0; x < width + 2*pad; x++)
+      columns[x] = borderIndex(x - pad, width, border);
+    parallelForRows(width, height, 0, [&](const RowBand& band)
+    {
+      MICROCV_STAGE("gaussianBlur rows band", static_cast<uint64_t>(rowSize) * (1 + sizeof(float)) * (band.end - band.begin));
+      // 3 steady state pixels on both sides of the padded row
+      const int count = (width + 2*pad + 6) * channels;
+      std::vector<T> line(static_cast<size_t>(count) * LINE_LANES);
+      const uint8_t* inRows[LINE_LANES];
+      for(int y = band.begin; y < band.end; y += LINE_LANES)
+      {
+        const int lanes = std::min(LINE_LANES, band.end - y);
+        for(int lane = 0; lane < lanes; lane++)
+          inRows[lane] = view.row(y + lane);
+        for(int x = 0; x < width + 2*pad; x++)
+        {
+          T* entry = line.data() + static_cast<size_t>(x + 3) * channels * lanes;
+          for(int c = 0; c < channels; c++)
+            for(int lane = 0; lane < lanes; lane++)
+              entry[c*lanes + lane] = columns[x] < 0 ? T(0) : inRows[lane][columns[x]*channels + c];
+        }
+        recurseLine(line.data(), lanes, count, channels, coeffs, level);
+        for(int lane = 0; lane < lanes; lane++)
+        {
+          float* out = blurredRows.data() + static_cast<size_t>(y + lane) * rowSize;
+          const T* in = line.data() + static_cast<size_t>(pad + 3) * channels * lanes + lane;
+          for(int i = 0; i < rowSize; i++)
+            out[i] = static_cast<float>(in[i*lanes]);
+        }
+      }
+    });
+
+    // Vertical pass over strips of columns, the lanes of a line are the columns of the strip
+    const int STRIP_WIDTH = 64;
+    const int numStrips = (rowSize + STRIP_WIDTH - 1) / STRIP_WIDTH;
+    std::vector<int> rows(height + 2*pad);
+    for(int y = 0; y < height + 2*pad; y++)
+      rows[y] = borderIndex(y - pad, height, border);
+    // The strips are the rows of the transposed image
+    parallelForRows(height * STRIP_WIDTH, numStrips, 0, [&](const RowBand& band)
+    {
+      MICROCV_STAGE("gaussianBlur columns band", static_cast<uint64_t>(height) * STRIP_WIDTH * (1 + sizeof(float)) * (band.end - band.begin));
+      const int count = height + 2*pad + 6;
+      std::vector<T> line(static_cast<size_t>(count) * STRIP_WIDTH);
+      for(int strip = band.begin; strip < band.end; strip++)
+      {
+        const int x1 = strip * STRIP_WIDTH;
+        const int lanes = std::min(STRIP_WIDTH, rowSize - x1);
+        for(int y = 0; y < height + 2*pad; y++)
+        {
+          T* entry = line.data() + static_cast<size_t>(y + 3) * lanes;
+          if(rows[y] < 0)
+            std::fill(entry, entry + lanes, T(0));
+          else
+          {
+            const float* blurred = blurredRows.data() + static_cast<size_t>(rows[y]) * rowSize + x1;
+            std::copy(blurred, blurred + lanes, entry);
+          }
+        }
+        recurseLine(line.data(), lanes, count, 1, coeffs, level);
+        for(int y = 0; y < height; y++)
+        {
+          const T* in = line.data() + static_cast<size_t>(y + pad + 3) * lanes;
+          storeFloatRow(in, outPtr + static_cast<size_t>(y) * rowSize + x1, lanes, level);
+        }
+      }
+    });
+  }
+}
+
+std::vector<int> MicroCv::Kernels::gaussianTaps(double sigma)
+{
+  // Four sigma hold all but 6e-5 of the weight, the size of one fixed point unit
+  const int maxRadius = static_cast<int>(std::ceil(4*sigma));
+  std::vector<double> weights(maxRadius + 1);
+  double sum = 0;
+  for(int k = 0; k <= maxRadius; k++)
+  {
+    weights[k] = std::exp(-k*k / (2*sigma*sigma));
+    sum += k == 0 ? weights[k] : 2*weights[k];
+  }
+
+  // The center takes the rounding error so that the weights sum to exactly 1
+  std::vector<int> taps(maxRadius + 1);
+  int total = 0;
+  for(int k = 1; k <= maxRadius; k++)
+  {
+    taps[k] = static_cast<int>(std::lround(weights[k] / sum * (1 << GAUSSIAN_TAP_BITS)));
+    total += 2*taps[k];
+  }
+  taps[0] = (1 << GAUSSIAN_TAP_BITS) - total;
+  while(taps.size() > 1 && taps.back() == 0)
+    taps.pop_back();
+  return taps;
+}
+
+GaussianEngine::GaussianEngine(double sigma, int width, int channels, BorderMode border)
+: width_(width)
+, channels_(channels)
+, border_(border)
+, taps_(gaussianTaps(sigma))
+, radius_(static_cast<int>(taps_.size()) - 1)
+, level_(simdLevel())
+, paddedRow_(static_cast<size_t>(width + 2*radius_) * channels)
+, ring_(static_cast<size_t>(2*radius_ + 1) * width * channels)
+, rows_(2*radius_ + 1)
+, pushed_(0)
+{
+  // Zero weight for the odd tap of the last pair
+  taps_.push_back(0);
+}
+
+int GaussianEngine::radius() const
+{
+  return radius_;
+}
+
+void GaussianEngine::pushRow(const uint8_t* row)
+{
+  // Same padding as FilterEngine
+  uint8_t* padded = paddedRow_.data();
+  if(!row)
+  {
+    std::fill(paddedRow_.begin(), paddedRow_.end(), 0);
+  }
+  else
+  {
+    std::memcpy(padded + radius_*channels_, row, static_cast<size_t>(width_) * channels_);
+    auto padPixel = [&](int x, uint8_t* dst)
+    {
+      const int inputX = borderIndex(x, width_, border_);
+      if(inputX < 0)
+        std::memset(dst, 0, channels_);
+      else
+        std::memcpy(dst, row + inputX*channels_, channels_);
+    };
+    for(int i = 0; i < radius_; i++)
+    {
+      padPixel(i - radius_, padded + i*channels_);
+      padPixel(width_ + i, padded + (radius_ + width_ + i)*channels_);
+    }
+  }
+
+  const int rowSize = width_ * channels_;
+  int16_t* slot = ring_.data() + static_cast<size_t>(pushed_ % rows_.size()) * rowSize;
+  filterGaussianRow(padded, taps_.data(), radius_, slot, rowSize, channels_, level_);
+  pushed_++;
+}
+
+void GaussianEngine::computeRow(uint8_t* outRow)
+{
+  const int rowSize = width_ * channels_;
+  const int count = static_cast<int>(rows_.size());
+  for(int i = 0; i < count; i++)
+    rows_[i] = ring_.data() + static_cast<size_t>((pushed_ + i) % count) * rowSize;
+  combineGaussianRows(rows_.data(), taps_.data(), radius_, outRow, rowSize, level_);
+}
+
+void MicroCv::Kernels::recursiveGaussianBlur(const MatView& view, double sigma, BorderMode border, uint8_t* outPtr)
+{
+  sigma = std::min(sigma, RECURSIVE_MAX_SIGMA);
+  if(sigma <= RECURSIVE_FLOAT_MAX_SIGMA)
+    recursiveBlur<float>(view, sigma, border, outPtr);
+  else
+    recursiveBlur<double>(view, sigma, border, outPtr);
+}
@@ -0,0 +1,60 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+#include <vector>
+
+#include "CpuFeatures.h"
+#include "ImageProcessing.h"
+
+namespace MicroCv
+{
+namespace Kernels
+{
+// Sigmas above this run on the recursive filter, whose cost does not depend on sigma
+const double GAUSSIAN_FIR_MAX_SIGMA = 4.0;
+
+// One side of a Gaussian kernel in fixed point: taps[0] is the center weight and taps[k] the
+// weight of both pixels k away. The weights sum to 1 << GAUSSIAN_TAP_BITS and zero tails are dropped
+const int GAUSSIAN_TAP_BITS = 14;
+std::vector<int> gaussianTaps(double sigma);
+
+/*
+ * GaussianEngine runs a separable fixed point Gaussian over a stream of rows, like FilterEngine.
+ * Every pushed row is padded for the border mode and filtered horizontally once into int16
+ * values with 7 fractional bits, and only the last 2 * radius + 1 of those are kept in a ring
+ * buffer for the vertical pass. Both passes sum in integers, so the SIMD levels give the same pixels.
+ */
+class GaussianEngine
+{
+public:
+  GaussianEngine(double sigma, int width, int channels, BorderMode border);
+
+  // Rows above and below every output row that have to be pushed
+  int radius() const;
+
+  // Feed the next input row (width * channels values), nullptr feeds a row of the constant border
+  void pushRow(const uint8_t* row);
+  // Blur the middle one of the last 2 * radius + 1 pushed rows into outRow
+  void computeRow(uint8_t* outRow);
+
+private:
+  int width_;
+  int channels_;
+  BorderMode border_;
+  std::vector<int> taps_;
+  int radius_;
+  SimdLevel level_;
+  std::vector<uint8_t> paddedRow_;
+  std::vector<int16_t> ring_;
+  std::vector<const int16_t*> rows_;
+  int pushed_;
+};
+
+// Young - van Vliet recursive Gaussian of a whole image into outPtr (a continuous Mat), one band
+// of rows per thread for the horizontal pass and one strip of columns per thread for the vertical pass
+void recursiveGaussianBlur(const MatView& view, double sigma, BorderMode border, uint8_t* outPtr);
+};
+};
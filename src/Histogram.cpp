@@ -0,0 +1,546 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "CpuFeatures.h"
+#include "Histogram.h"
+#include "HistogramKernels.h"
+#include "ImageProcessing.h"
+#include "Instrumentation.h"
+#include "Parallel.h"
+
+#ifdef MICROCV_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace MicroCv;
+using namespace MicroCv::Kernels;
+
+namespace
+{
+  // Pixels counted into separate tables, a run of equal pixels then spreads over that many tables
+  const int HISTOGRAM_TABLES = 4;
+
+  // Statistics are gathered per byte position of a 48 byte period, which every gray, RGB and RGBA
+  // row repeats, and folded into channels at the end
+  const int STATS_PERIOD = 48;
+  // 16 bit sums of 256 periods can not wrap
+  const int STATS_FLUSH_PERIODS = 256;
+
+  // Counts of the rows [begin, end) in 32 bit tables that are added to histograms before they can wrap
+  template<int CHANNELS>
+  void countRows(const MatView& view, int begin, int end, uint64_t* histograms, int channels)
+  {
+    const int n = CHANNELS > 0 ? CHANNELS : channels;
+    const int groupSize = HISTOGRAM_TABLES * n;
+    const int count = view.width() * n;
+    const int groupEnd = count - count % groupSize;
+    std::vector<uint32_t> tables(static_cast<size_t>(groupSize) * 256, 0);
+    uint32_t* table = tables.data();
+    // Table j counts the channel j % n, since groupSize is a multiple of n
+    auto flush = [&]()
+    {
+      for(int j = 0; j < groupSize; j++)
+      {
+        uint64_t* histogram = histograms + (j % n) * 256;
+        for(int v = 0; v < 256; v++)
+          histogram[v] += table[j*256 + v];
+      }
+      std::fill(tables.begin(), tables.end(), 0);
+    };
+
+    uint64_t counted = 0;
+    for(int y = begin; y < end; y++)
+    {
+      if(counted + count > std::numeric_limits<uint32_t>::max())
+      {
+        flush();
+        counted = 0;
+      }
+      const uint8_t* row = view.row(y);
+      int x = 0;
+      for(; x < groupEnd; x += groupSize)
+      {
+        for(int j = 0; j < groupSize; j++)
+          table[j*256 + row[x + j]]++;
+      }
+      for(; x < count; x++)
+        table[(x - groupEnd)*256 + row[x]]++;
+      counted += count;
+    }
+    flush();
+  }
+
+  // Sums, sums of squares, minimums and maximums of every byte position of the period
+  struct PositionSums
+  {
+    explicit PositionSums(int period)
+    : sums(period, 0)
+    , squares(period, 0)
+    , mins(period, 255)
+    , maxs(period, 0)
+    {
+    }
+
+    std::vector<uint64_t> sums;
+    std::vector<uint64_t> squares;
+    std::vector<uint8_t> mins;
+    std::vector<uint8_t> maxs;
+  };
+
+  void accumulateRowScalar(const uint8_t* row, int x, int count, PositionSums& positions)
+  {
+    const int period = static_cast<int>(positions.sums.size());
+    for(int j = x % period; x < count; x++)
+    {
+      const uint8_t v = row[x];
+      positions.sums[j] += v;
+      positions.squares[j] += v * v;
+      positions.mins[j] = std::min(positions.mins[j], v);
+      positions.maxs[j] = std::max(positions.maxs[j], v);
+      if(++j == period)
+        j = 0;
+    }
+  }
+
+#ifdef MICROCV_X86_SIMD
+  // Add the vector accumulators of the 48 positions to positions
+  void flushPositions(const uint16_t* sums, const uint32_t* squares, const uint8_t* mins, const uint8_t* maxs,
+      PositionSums& positions)
+  {
+    for(int j = 0; j < STATS_PERIOD; j++)
+    {
+      positions.sums[j] += sums[j];
+      positions.squares[j] += squares[j];
+      positions.mins[j] = std::min(positions.mins[j], mins[j]);
+      positions.maxs[j] = std::max(positions.maxs[j], maxs[j]);
+    }
+  }
+
+  // Whole periods of the row from x. Widening keeps the byte order, so lane j is position j
+  __attribute__((target("sse2")))
+  int accumulateRowSse2(const uint8_t* row, int x, int count, PositionSums& positions)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    while(x + STATS_PERIOD <= count)
+    {
+      __m128i sums[6], squares[12], mins[3], maxs[3];
+      for(int i = 0; i < 3; i++)
+      {
+        sums[2*i] = sums[2*i + 1] = zero;
+        squares[4*i] = squares[4*i + 1] = squares[4*i + 2] = squares[4*i + 3] = zero;
+        mins[i] = _mm_set1_epi8(-1);
+        maxs[i] = zero;
+      }
+      const int end = x + STATS_PERIOD * std::min((count - x) / STATS_PERIOD, STATS_FLUSH_PERIODS);
+      for(; x < end; x += STATS_PERIOD)
+      {
+        for(int i = 0; i < 3; i++)
+        {
+          __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 16*i));
+          mins[i] = _mm_min_epu8(mins[i], bytes);
+          maxs[i] = _mm_max_epu8(maxs[i], bytes);
+          __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+          __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+          sums[2*i] = _mm_add_epi16(sums[2*i], lo);
+          sums[2*i + 1] = _mm_add_epi16(sums[2*i + 1], hi);
+          // With a zero upper half pmaddwd squares every 32 bit lane
+          const __m128i values[] = {_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+              _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+          for(int k = 0; k < 4; k++)
+            squares[4*i + k] = _mm_add_epi32(squares[4*i + k], _mm_madd_epi16(values[k], values[k]));
+        }
+      }
+
+      uint16_t sumValues[STATS_PERIOD];
+      uint32_t squareValues[STATS_PERIOD];
+      uint8_t minValues[STATS_PERIOD], maxValues[STATS_PERIOD];
+      for(int i = 0; i < 6; i++)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sumValues + 8*i), sums[i]);
+      for(int i = 0; i < 12; i++)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(squareValues + 4*i), squares[i]);
+      for(int i = 0; i < 3; i++)
+      {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(minValues + 16*i), mins[i]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(maxValues + 16*i), maxs[i]);
+      }
+      flushPositions(sumValues, squareValues, minValues, maxValues, positions);
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  int accumulateRowAvx2(const uint8_t* row, int x, int count, PositionSums& positions)
+  {
+    while(x + STATS_PERIOD <= count)
+    {
+      __m256i sums[3], squares[6];
+      __m128i mins[3], maxs[3];
+      for(int i = 0; i < 3; i++)
+      {
+        sums[i] = squares[2*i] = squares[2*i + 1] = _mm256_setzero_si256();
+        mins[i] = _mm_set1_epi8(-1);
+        maxs[i] = _mm_setzero_si128();
+      }
+      const int end = x + STATS_PERIOD * std::min((count - x) / STATS_PERIOD, STATS_FLUSH_PERIODS);
+      for(; x < end; x += STATS_PERIOD)
+      {
+        for(int i = 0; i < 3; i++)
+        {
+          __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 16*i));
+          mins[i] = _mm_min_epu8(mins[i], bytes);
+          maxs[i] = _mm_max_epu8(maxs[i], bytes);
+          sums[i] = _mm256_add_epi16(sums[i], _mm256_cvtepu8_epi16(bytes));
+          __m256i lo = _mm256_cvtepu8_epi32(bytes);
+          __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8));
+          squares[2*i] = _mm256_add_epi32(squares[2*i], _mm256_madd_epi16(lo, lo));
+          squares[2*i + 1] = _mm256_add_epi32(squares[2*i + 1], _mm256_madd_epi16(hi, hi));
+        }
+      }
+
+      uint16_t sumValues[STATS_PERIOD];
+      uint32_t squareValues[STATS_PERIOD];
+      uint8_t minValues[STATS_PERIOD], maxValues[STATS_PERIOD];
+      for(int i = 0; i < 3; i++)
+      {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sumValues + 16*i), sums[i]);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(squareValues + 16*i), squares[2*i]);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(squareValues + 16*i + 8), squares[2*i + 1]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(minValues + 16*i), mins[i]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(maxValues + 16*i), maxs[i]);
+      }
+      flushPositions(sumValues, squareValues, minValues, maxValues, positions);
+    }
+    return x;
+  }
+#endif
+
+  void accumulateRow(const uint8_t* row, int count, PositionSums& positions, SimdLevel level)
+  {
+    int x = 0;
+#ifdef MICROCV_X86_SIMD
+    if(positions.sums.size() == STATS_PERIOD)
+    {
+      if(level >= SimdAvx2)
+        x = accumulateRowAvx2(row, x, count, positions);
+      if(level >= SimdSse2)
+        x = accumulateRowSse2(row, x, count, positions);
+    }
+#else
+    (void)level;
+#endif
+    accumulateRowScalar(row, x, count, positions);
+  }
+
+  // Equalization table of one channel: the cumulative count scaled so that the least value of the
+  // image maps to 0 and the largest to 255. An image of one value is left as it is
+  void equalizationTable(const uint64_t* histogram, uint8_t* table)
+  {
+    uint64_t total = 0;
+    for(int v = 0; v < 256; v++)
+      total += histogram[v];
+    int first = 0;
+    while(first < 256 && histogram[first] == 0)
+      first++;
+    const uint64_t below = first < 256 ? histogram[first] : 0;
+    if(total == below)
+    {
+      for(int v = 0; v < 256; v++)
+        table[v] = static_cast<uint8_t>(v);
+      return;
+    }
+    const double scale = 255.0 / (total - below);
+    uint64_t cumulative = 0;
+    for(int v = 0; v < 256; v++)
+    {
+      cumulative += histogram[v];
+      table[v] = static_cast<uint8_t>(cumulative <= below ? 0 : std::lround((cumulative - below) * scale));
+    }
+  }
+
+  // Clip the histogram of a tile of area pixels at limit and share the clipped counts out over
+  // all values, then turn it into an equalization table
+  void clippedTable(uint64_t* histogram, uint64_t area, uint64_t limit, uint8_t* table)
+  {
+    uint64_t excess = 0;
+    for(int v = 0; v < 256; v++)
+    {
+      if(histogram[v] > limit)
+      {
+        excess += histogram[v] - limit;
+        histogram[v] = limit;
+      }
+    }
+    const uint64_t share = excess / 256;
+    uint64_t residual = excess % 256;
+    for(int v = 0; v < 256; v++)
+      histogram[v] += share;
+    if(residual > 0)
+    {
+      const int step = std::max(256 / static_cast<int>(residual), 1);
+      for(int v = 0; v < 256 && residual > 0; v += step, residual--)
+        histogram[v]++;
+    }
+
+    uint64_t cumulative = 0;
+    for(int v = 0; v < 256; v++)
+    {
+      cumulative += histogram[v];
+      table[v] = static_cast<uint8_t>(std::min<uint64_t>((cumulative * 255 + area / 2) / area, 255));
+    }
+  }
+
+  // Pixel coordinate to the two surrounding tile centers and the 8 bit weight of the second one
+  struct TileWeight
+  {
+    int first;
+    int second;
+    int weight;
+  };
+
+  TileWeight tileWeight(int x, int size, int tiles)
+  {
+    const double position = (x + 0.5) * tiles / size - 0.5;
+    const int first = static_cast<int>(std::floor(position));
+    TileWeight result;
+    result.first = std::max(first, 0);
+    result.second = std::min(first + 1, tiles - 1);
+    result.weight = static_cast<int>(std::lround((position - first) * 256));
+    return result;
+  }
+}
+
+std::vector<Histogram> MicroCv::computeHistograms(const MatView& view)
+{
+  const int width = view.width();
+  const int height = view.height();
+  const int channels = view.channels();
+  if(view.depth() != DepthU8)
+    return std::vector<Histogram>();
+  std::vector<Histogram> histograms(std::max(channels, 0));
+  for(Histogram& histogram : histograms)
+    histogram.fill(0);
+  if(width <= 0 || height <= 0 || channels <= 0)
+    return histograms;
+  if(view.isPlanar())
+  {
+    // Every plane is counted as a gray image
+    for(int c = 0; c < channels; c++)
+      histograms[c] = computeHistograms(view.plane(c))[0];
+    return histograms;
+  }
+
+  // Every band counts into its own histograms, which are merged once all bands are done
+  const std::vector<RowBand> bands = rowBands(width, height, 0);
+  std::vector<uint64_t> bandCounts(bands.size() * channels * 256, 0);
+  parallelForBands(bands, [&](int i)
+  {
+    MICROCV_STAGE("computeHistograms band", static_cast<uint64_t>(width) * channels * (bands[i].end - bands[i].begin));
+    countHistogramRows(view, bands[i].begin, bands[i].end, bandCounts.data() + static_cast<size_t>(i) * channels * 256);
+  });
+  for(size_t i = 0; i < bands.size(); i++)
+  {
+    const uint64_t* counts = bandCounts.data() + i * channels * 256;
+    for(int c = 0; c < channels; c++)
+      for(int v = 0; v < 256; v++)
+        histograms[c][v] += counts[c*256 + v];
+  }
+  return histograms;
+}
+
+std::vector<ChannelStatistics> MicroCv::channelStatistics(const MatView& view)
+{
+  const int width = view.width();
+  const int height = view.height();
+  const int channels = view.channels();
+  if(width <= 0 || height <= 0 || channels <= 0 || view.depth() != DepthU8)
+    return std::vector<ChannelStatistics>();
+  if(view.isPlanar())
+  {
+    std::vector<ChannelStatistics> statistics(channels);
+    for(int c = 0; c < channels; c++)
+      statistics[c] = channelStatistics(view.plane(c))[0];
+    return statistics;
+  }
+  MICROCV_STAGE("channelStatistics", static_cast<uint64_t>(width) * height * channels);
+
+  const int period = STATS_PERIOD % channels == 0 ? STATS_PERIOD : channels;
+  const SimdLevel level = simdLevel();
+  const std::vector<RowBand> bands = rowBands(width, height, 0);
+  std::vector<PositionSums> bandSums(bands.size(), PositionSums(period));
+  parallelForBands(bands, [&](int i)
+  {
+    MICROCV_STAGE("channelStatistics band", static_cast<uint64_t>(width) * channels * (bands[i].end - bands[i].begin));
+    for(int y = bands[i].begin; y < bands[i].end; y++)
+      accumulateRow(view.row(y), width * channels, bandSums[i], level);
+  });
+
+  // Fold the positions of every band into their channels
+  std::vector<uint64_t> sums(channels, 0);
+  std::vector<uint64_t> squares(channels, 0);
+  std::vector<ChannelStatistics> statistics(channels);
+  for(ChannelStatistics& channel : statistics)
+  {
+    channel.min = 255;
+    channel.max = 0;
+  }
+  for(const PositionSums& positions : bandSums)
+  {
+    for(int j = 0; j < period; j++)
+    {
+      const int c = j % channels;
+      sums[c] += positions.sums[j];
+      squares[c] += positions.squares[j];
+      statistics[c].min = std::min<int>(statistics[c].min, positions.mins[j]);
+      statistics[c].max = std::max<int>(statistics[c].max, positions.maxs[j]);
+    }
+  }
+  const double count = static_cast<double>(width) * height;
+  for(int c = 0; c < channels; c++)
+  {
+    statistics[c].mean = sums[c] / count;
+    const double variance = (squares[c] - sums[c] * statistics[c].mean) / count;
+    statistics[c].stddev = std::sqrt(std::max(variance, 0.0));
+  }
+  return statistics;
+}
+
+void MicroCv::Kernels::countHistogramRows(const MatView& view, int begin, int end, uint64_t* histograms)
+{
+  switch(view.channels())
+  {
+  case 1:
+    countRows<1>(view, begin, end, histograms, 1);
+    break;
+  case 3:
+    countRows<3>(view, begin, end, histograms, 3);
+    break;
+  default:
+    countRows<0>(view, begin, end, histograms, view.channels());
+    break;
+  }
+}
+
+void MicroCv::Kernels::equalizeHistograms(const MatView& view, uint8_t* outPtr)
+{
+  const int width = view.width();
+  const int channels = view.channels();
+  const std::vector<Histogram> histograms = computeHistograms(view);
+  std::vector<uint8_t> tables(static_cast<size_t>(channels) * 256);
+  for(int c = 0; c < channels; c++)
+    equalizationTable(histograms[c].data(), tables.data() + c*256);
+
+  const size_t rowBytes = static_cast<size_t>(width) * channels;
+  parallelForRows(width, view.height(), 0, [&](const RowBand& band)
+  {
+    MICROCV_STAGE("equalizeHistogram band", 2 * rowBytes * (band.end - band.begin));
+    for(int y = band.begin; y < band.end; y++)
+    {
+      const uint8_t* in = view.row(y);
+      uint8_t* out = outPtr + y * rowBytes;
+      if(channels == 1)
+      {
+        for(int x = 0; x < width; x++)
+          out[x] = tables[in[x]];
+      }
+      else
+      {
+        for(size_t i = 0; i < rowBytes; i += channels)
+          for(int c = 0; c < channels; c++)
+            out[i + c] = tables[c*256 + in[i + c]];
+      }
+    }
+  });
+}
+
+void MicroCv::Kernels::claheEqualize(const MatView& view, double clipLimit, int tilesX, int tilesY, uint8_t* outPtr)
+{
+  const int width = view.width();
+  const int height = view.height();
+  const int channels = view.channels();
+  tilesX = std::min(tilesX, width);
+  tilesY = std::min(tilesY, height);
+
+  // Tile t covers [t * size / tiles, (t + 1) * size / tiles), the tables are [tileY][tileX][channel][256]
+  auto tileBegin = [](int t, int size, int tiles) { return static_cast<int>(static_cast<int64_t>(t) * size / tiles); };
+  const size_t tileTables = static_cast<size_t>(channels) * 256;
+  std::vector<uint8_t> tables(static_cast<size_t>(tilesX) * tilesY * tileTables);
+  const std::vector<RowBand> tileBands = partitionRows(tilesY, numThreads(), 0);
+  parallelForBands(tileBands, [&](int i)
+  {
+    const RowBand& band = tileBands[i];
+    std::vector<uint64_t> histograms(tileTables);
+    for(int ty = band.begin; ty < band.end; ty++)
+    {
+      const int y1 = tileBegin(ty, height, tilesY);
+      const int y2 = tileBegin(ty + 1, height, tilesY);
+      for(int tx = 0; tx < tilesX; tx++)
+      {
+        const int x1 = tileBegin(tx, width, tilesX);
+        const int x2 = tileBegin(tx + 1, width, tilesX);
+        MICROCV_STAGE("equalizeHistogramClahe tiles", static_cast<uint64_t>(x2 - x1) * (y2 - y1) * channels);
+        std::fill(histograms.begin(), histograms.end(), 0);
+        const MatView tile(view.row(y1) + static_cast<size_t>(x1) * channels, x2 - x1, y2 - y1, channels, view.stride());
+        countHistogramRows(tile, 0, tile.height(), histograms.data());
+        const uint64_t area = static_cast<uint64_t>(x2 - x1) * (y2 - y1);
+        // A limit of 0 or less does not clip
+        const uint64_t limit = clipLimit > 0 ? std::max<uint64_t>(static_cast<uint64_t>(clipLimit * area / 256), 1) : area;
+        uint8_t* tileTable = tables.data() + (static_cast<size_t>(ty) * tilesX + tx) * tileTables;
+        for(int c = 0; c < channels; c++)
+          clippedTable(histograms.data() + c*256, area, limit, tileTable + c*256);
+      }
+    }
+  });
+
+  std::vector<TileWeight> columns(width);
+  for(int x = 0; x < width; x++)
+    columns[x] = tileWeight(x, width, tilesX);
+  const size_t rowBytes = static_cast<size_t>(width) * channels;
+  parallelForRows(width, height, 0, [&](const RowBand& band)
+  {
+    MICROCV_STAGE("equalizeHistogramClahe band", 2 * rowBytes * (band.end - band.begin));
+    // The tables of the two tile rows around a row blended once for the whole row, the pixels
+    // then only blend two of those. Both steps are exact, so this is the bilinear blend of four tables
+    std::vector<uint16_t> rowTables(tilesX * tileTables);
+    for(int y = band.begin; y < band.end; y++)
+    {
+      const TileWeight row = tileWeight(y, height, tilesY);
+      const uint8_t* topTables = tables.data() + static_cast<size_t>(row.first) * tilesX * tileTables;
+      const uint8_t* bottomTables = tables.data() + static_cast<size_t>(row.second) * tilesX * tileTables;
+      for(size_t i = 0; i < rowTables.size(); i++)
+        rowTables[i] = static_cast<uint16_t>(topTables[i] * (256 - row.weight) + bottomTables[i] * row.weight);
+
+      const uint8_t* in = view.row(y);
+      uint8_t* out = outPtr + y * rowBytes;
+      if(channels == 1)
+      {
+        const uint16_t* blended = rowTables.data();
+        for(int x = 0; x < width; x++)
+        {
+          const TileWeight& column = columns[x];
+          out[x] = static_cast<uint8_t>((blended[column.first*256 + in[x]] * (256 - column.weight)
+              + blended[column.second*256 + in[x]] * column.weight + 32768) >> 16);
+        }
+      }
+      else
+      {
+        for(int x = 0; x < width; x++)
+        {
+          const TileWeight& column = columns[x];
+          const uint16_t* left = rowTables.data() + column.first * tileTables;
+          const uint16_t* right = rowTables.data() + column.second * tileTables;
+          for(int c = 0; c < channels; c++)
+          {
+            const int v = c*256 + in[x*channels + c];
+            out[x*channels + c] = static_cast<uint8_t>((left[v] * (256 - column.weight) + right[v] * column.weight + 32768) >> 16);
+          }
+        }
+      }
+    }
+  });
+}
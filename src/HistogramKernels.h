@@ -0,0 +1,26 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+
+#include "Mat.h"
+
+namespace MicroCv
+{
+namespace Kernels
+{
+// Add the counts of rows [begin, end) of view to channels * 256 histogram entries. Each byte of a
+// group of 4 pixels counts into its own table, so runs of equal pixels do not wait on the
+// increment of the previous one
+void countHistogramRows(const MatView& view, int begin, int end, uint64_t* histograms);
+
+// Equalize every channel into outPtr (a continuous Mat) through a table built from its histogram
+void equalizeHistograms(const MatView& view, uint8_t* outPtr);
+
+// CLAHE of every channel into outPtr: one clipped equalization table per tile, and every pixel
+// blends the tables of the four tiles whose centers surround it
+void claheEqualize(const MatView& view, double clipLimit, int tilesX, int tilesY, uint8_t* outPtr);
+};
+};
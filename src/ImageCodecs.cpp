@@ -0,0 +1,87 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include "ImageCodecs.h"
+
+using namespace MicroCv::Codecs;
+
+ImageDecoder::ImageDecoder()
+: width_(0)
+, height_(0)
+, channels_(0)
+{
+}
+
+ImageDecoder::~ImageDecoder()
+{
+}
+
+bool ImageDecoder::setDepth(MatDepth depth)
+{
+  return depth == DepthU8;
+}
+
+bool ImageDecoder::setScale(int)
+{
+  return false;
+}
+
+bool ImageDecoder::setRegion(int, int, int, int)
+{
+  return false;
+}
+
+int ImageDecoder::width() const
+{
+  return width_;
+}
+
+int ImageDecoder::height() const
+{
+  return height_;
+}
+
+int ImageDecoder::channels() const
+{
+  return channels_;
+}
+
+ImageEncoder::~ImageEncoder()
+{
+}
+
+bool ImageEncoder::setDepth(MatDepth depth)
+{
+  return depth == DepthU8;
+}
+
+std::unique_ptr<ImageDecoder> MicroCv::Codecs::createDecoder(ImageFileType type)
+{
+  if(type == ImageFileType::Jpeg)
+    return createJpegDecoder();
+  if(type == ImageFileType::Png)
+    return createPngDecoder();
+  if(type == ImageFileType::Tiff)
+    return createTiffDecoder();
+  if(type == ImageFileType::Mcv)
+    return createMcvDecoder();
+  if(type == ImageFileType::Pnm)
+    return createPnmDecoder();
+  return std::unique_ptr<ImageDecoder>();
+}
+
+std::unique_ptr<ImageEncoder> MicroCv::Codecs::createEncoder(ImageFileType type)
+{
+  if(type == ImageFileType::Jpeg)
+    return createJpegEncoder();
+  if(type == ImageFileType::Png)
+    return createPngEncoder();
+  if(type == ImageFileType::Tiff)
+    return createTiffEncoder();
+  if(type == ImageFileType::Mcv)
+    return createMcvEncoder();
+  if(type == ImageFileType::Pnm)
+    return createPnmEncoder();
+  return std::unique_ptr<ImageEncoder>();
+}
@@ -0,0 +1,135 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "FileIo.h"
+
+namespace MicroCv
+{
+namespace Codecs
+{
+/*
+ * ImageDecoder reads an image file top to bottom, one scanline at a time, straight into the
+ * caller's memory. Gray sources are decoded as 1 channel and everything else as 3 channel RGB,
+ * with 8 bit values unless 16 bit ones are asked for with setDepth().
+ * Errors are printed to std::cerr and reported by returning false.
+ */
+class ImageDecoder
+{
+public:
+  ImageDecoder();
+  virtual ~ImageDecoder();
+
+  // Open the file and read its header, after which the dimensions are known
+  virtual bool open(const std::string& filename) = 0;
+  // Decode values of depth DepthU8 (the default) or DepthU16, must be called right after open()
+  // Returns false if the source does not have 16 bit samples or the format can not keep them
+  virtual bool setDepth(MatDepth depth);
+  // Decode the image shrunk by 1/denominator (2, 4 or 8), must be called between open() and readRows()
+  // Returns false if the format can not do that cheaply, otherwise the dimensions are updated
+  virtual bool setScale(int denominator);
+  // Decode only the region [x1, x2) x [y1, y2), must be called after setScale() and before readRows()
+  // Returns false if the format can not skip the rest, otherwise the dimensions become those of the region
+  virtual bool setRegion(int x1, int y1, int x2, int y2);
+  // Decode the next numRows rows into dst, consecutive rows are stride bytes apart
+  virtual bool readRows(uint8_t* dst, int stride, int numRows) = 0;
+
+  int width() const;
+  int height() const;
+  int channels() const;
+
+protected:
+  int width_;
+  int height_;
+  int channels_;
+};
+
+/*
+ * ImageEncoder writes an 8 bit (or with setDepth() 16 bit) gray or RGB image file top to bottom,
+ * one scanline at a time, reading the rows straight from the caller's memory.
+ * Errors are printed to std::cerr and reported by returning false.
+ */
+class ImageEncoder
+{
+public:
+  virtual ~ImageEncoder();
+
+  // Write values of depth DepthU8 (the default) or DepthU16 in native byte order, must be called
+  // before open(). Returns false if the format can not store values of that depth
+  virtual bool setDepth(MatDepth depth);
+  // Create the file and write its header
+  virtual bool open(const std::string& filename, int width, int height, int channels) = 0;
+  // Encode the next numRows rows from src, consecutive rows are stride bytes apart
+  virtual bool writeRows(const uint8_t* src, int stride, int numRows) = 0;
+  // Flush and close the file once all rows have been written
+  virtual bool close() = 0;
+};
+
+std::unique_ptr<ImageDecoder> createJpegDecoder();
+std::unique_ptr<ImageDecoder> createPngDecoder();
+std::unique_ptr<ImageDecoder> createTiffDecoder();
+std::unique_ptr<ImageDecoder> createMcvDecoder();
+std::unique_ptr<ImageDecoder> createPnmDecoder();
+
+std::unique_ptr<ImageEncoder> createJpegEncoder();
+std::unique_ptr<ImageEncoder> createPngEncoder();
+std::unique_ptr<ImageEncoder> createTiffEncoder();
+std::unique_ptr<ImageEncoder> createMcvEncoder();
+std::unique_ptr<ImageEncoder> createPnmEncoder();
+
+// Return an empty pointer for unsupported types
+std::unique_ptr<ImageDecoder> createDecoder(ImageFileType type);
+std::unique_ptr<ImageEncoder> createEncoder(ImageFileType type);
+
+// Where the pixels of an uncompressed (.mcv, PGM or PPM) file are
+struct RawLayout
+{
+  int width;
+  int height;
+  int channels;
+  // Bytes between the starts of two rows in the file
+  int stride;
+  // Offset of the first row from the start of the file
+  size_t dataOffset;
+  // Value of white, 255 unless a PGM/PPM uses fewer levels
+  int maxValue;
+};
+
+// Size of the .mcv header, which is also the alignment of its rows
+const size_t MCV_HEADER_SIZE = 64;
+// Enough to hold any PGM/PPM header short of pathological comments
+const size_t MAX_RAW_HEADER_SIZE = 4096;
+
+// Parse the header at the start of a file (header holds the first headerSize bytes of it)
+// Returns false if the header is invalid or the file is too short to hold all the rows
+bool parseMcvHeader(const uint8_t* header, size_t headerSize, uint64_t fileSize, RawLayout& layout);
+bool parsePnmHeader(const uint8_t* header, size_t headerSize, uint64_t fileSize, RawLayout& layout);
+
+// Multiply a color value by an 8 bit alpha value with rounding (c * a / 255)
+inline uint8_t multiplyAlpha(uint8_t c, uint8_t a)
+{
+  const uint32_t t = static_cast<uint32_t>(c) * a + 128;
+  return static_cast<uint8_t>((t + (t >> 8)) >> 8);
+}
+
+// Same for 16 bit values (c * a / 65535)
+inline uint16_t multiplyAlpha(uint16_t c, uint16_t a)
+{
+  const uint32_t t = static_cast<uint32_t>(c) * a + 32768;
+  return static_cast<uint16_t>((t + (t >> 16)) >> 16);
+}
+
+// True when the 16 bit values in memory have their least significant byte first
+inline bool isLittleEndian()
+{
+  const uint16_t one = 1;
+  return *reinterpret_cast<const uint8_t*>(&one) == 1;
+}
+};
+};
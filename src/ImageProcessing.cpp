@@ -2,18 +2,336 @@
  *  Micro Computer Vision library
  *  @author Andrei Polzounov
  */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "CannyEngine.h"
+#include "DepthKernels.h"
+#include "FilterEngine.h"
+#include "GaussianEngine.h"
+#include "HistogramKernels.h"
 #include "ImageProcessing.h"
+#include "Instrumentation.h"
+#include "IntegralRows.h"
+#include "LumaKernels.h"
+#include "MorphologyKernels.h"
+#include "Parallel.h"
+#include "PlanarKernels.h"
+#include "ResizeKernels.h"
+#include "SobelEngine.h"
 
 namespace
 {
-  // Optimized way of setting pixel to 0 < x < 255 range
-  inline uint8_t clampToPixelRange(int val)
+  inline bool isValidCropRegion(int width, int height, int x1, int y1, int x2, int y2)
   {
-    val &= -(val >= 0);
-    return static_cast<uint8_t>(val | ((255 - val) >> 31));
+    if(x1 < 0 || x1 >= x2)
+      return false;
+    if(x2 <= x1 || x2 >= width)
+      return false;
+    if(y1 < 0 || y1 >= y2)
+      return false;
+    if(y2 <= y1 || y2 >= height)
+      return false;
+    return true;
+  }
+
+  // True when writing to mat could overwrite the pixels seen through view
+  inline bool sharesPixels(const MicroCv::MatView& view, const MicroCv::Mat& mat)
+  {
+    const uint8_t* begin = mat.data();
+    const size_t size = mat.isPlanar() ? mat.planeStride() * mat.channels()
+        : static_cast<size_t>(mat.stride()) * mat.height();
+    const uint8_t* end = begin + size;
+    return begin && view.data() >= begin && view.data() < end;
+  }
+
+  // Deep copy of a view into a continuous Mat of the same layout and depth, one band of rows per thread
+  void copyView(const MicroCv::MatView& view, MicroCv::Mat& outputMat)
+  {
+    if(view.depth() != MicroCv::DepthU8)
+      outputMat.resize(view.width(), view.height(), view.channels(), view.depth());
+    else
+      outputMat.resize(view.width(), view.height(), view.channels(), view.layout());
+    const int planes = view.isPlanar() ? view.channels() : 1;
+    const size_t rowBytes = static_cast<size_t>(view.width()) * (view.channels() / planes) * view.elementSize();
+    const size_t planeStride = outputMat.planeStride();
+    uint8_t* outPtr = outputMat.data();
+    MicroCv::parallelForRows(view.width(), view.height(), 0, [&](const MicroCv::RowBand& band)
+    {
+      MICROCV_STAGE("copy band", 2 * rowBytes * planes * (band.end - band.begin));
+      for(int c = 0; c < planes; c++)
+      {
+        const MicroCv::MatView plane = planes > 1 ? view.plane(c) : view;
+        for(int y = band.begin; y < band.end; y++)
+          std::memcpy(outPtr + c*planeStride + y*rowBytes, plane.row(y), rowBytes);
+      }
+    });
+  }
+
+  // Run a function that writes one continuous image into the output pointer on every plane of a
+  // planar view, or once on an interleaved view. The planes of the output are continuous images
+  // as well, so every plane is processed like a gray image without any copies
+  template<typename Function>
+  void forEachPlane(const MicroCv::MatView& view, MicroCv::Mat& outputMat, Function function)
+  {
+    if(!view.isPlanar())
+    {
+      function(view, outputMat.data());
+      return;
+    }
+    for(int c = 0; c < view.channels(); c++)
+      function(view.plane(c), outputMat.plane(c));
+  }
+
+  // Gray rows of a 1 or 3 channel view for the Sobel operator: gray rows are read in place, RGB
+  // rows (interleaved or planar) are converted one at a time into a scratch row
+  class GrayRowReader
+  {
+  public:
+    explicit GrayRowReader(const MicroCv::MatView& view)
+    : view_(view)
+    , r_(view.plane(0))
+    , g_(view.plane(1))
+    , b_(view.plane(2))
+    , coeffs_(MicroCv::Kernels::lumaCoefficients(MicroCv::GrayAverage))
+    , grayRow_(view.channels() == 3 ? view.width() : 0)
+    {
+    }
+
+    const uint8_t* row(int y)
+    {
+      if(view_.channels() == 1)
+        return view_.row(y);
+      if(view_.isPlanar())
+        MicroCv::Kernels::planarRowToGray(r_.row(y), g_.row(y), b_.row(y), grayRow_.data(), view_.width(), coeffs_);
+      else
+        MicroCv::Kernels::rgbRowToGray(view_.row(y), grayRow_.data(), view_.width(), coeffs_);
+      return grayRow_.data();
+    }
+
+  private:
+    const MicroCv::MatView& view_;
+    MicroCv::MatView r_;
+    MicroCv::MatView g_;
+    MicroCv::MatView b_;
+    MicroCv::Kernels::LumaCoefficients coeffs_;
+    std::vector<uint8_t> grayRow_;
+  };
+
+  // Convert the values of every row of a view into outPtr (continuous rows), planar rows are merged first
+  void convertDepthRows(const MicroCv::MatView& view, uint8_t* outPtr, MicroCv::MatDepth depth, double scale,
+      double offset)
+  {
+    const int width = view.width();
+    const int height = view.height();
+    const int count = width * view.channels();
+    const size_t outRowBytes = static_cast<size_t>(count) * MicroCv::depthSize(depth);
+    MicroCv::parallelForRows(count, height, 0, [&](const MicroCv::RowBand& band)
+    {
+      MICROCV_STAGE("convertDepth band", static_cast<uint64_t>(count) * (view.elementSize() + MicroCv::depthSize(depth))
+          * (band.end - band.begin));
+      std::vector<uint8_t> scratch(view.isPlanar() ? count : 0);
+      for(int y = band.begin; y < band.end; y++)
+      {
+        MicroCv::Kernels::convertValues(MicroCv::Kernels::interleavedRow(view, y, scratch.data()), view.depth(),
+            outPtr + y*outRowBytes, depth, count, scale, offset);
+      }
+    });
+  }
+
+  // Column windows [x - radius, x + radius] clipped to the image. Interior columns, whose
+  // windows need no clipping, are [interiorBegin, interiorEnd)
+  struct WindowColumns
+  {
+    WindowColumns(int width, int radius)
+    : interiorBegin(std::min(radius, width))
+    , interiorEnd(std::max(width - radius, interiorBegin))
+    {
+    }
+
+    int interiorBegin;
+    int interiorEnd;
+  };
+
+  // Rounded means of the windows of radius around every pixel, clipped to the image. The
+  // division is a multiplication by 1 / area: (n + 0.5) / area is at least 0.5 / area away
+  // from the next integer, far more than the rounding error of the double product
+  template<typename T>
+  void boxFilterRows(const MicroCv::MatView& view, int radius, uint8_t* outPtr)
+  {
+    const int width = view.width();
+    const int height = view.height();
+    const int channels = view.channels();
+    const WindowColumns columns(width, radius);
+    MicroCv::parallelForRows(width, height, radius, [&](const MicroCv::RowBand& band)
+    {
+      MICROCV_STAGE("boxFilter band", static_cast<uint64_t>(width) * channels * (2*sizeof(T) + 1) * (band.end - band.begin));
+      MicroCv::Kernels::IntegralRows<T> sums(view, band.haloBegin, std::min(2*radius + 2, height + 1));
+      for(int y = band.begin; y < band.end; y++)
+      {
+        const int y1 = std::max(y - radius, 0);
+        const int y2 = std::min(y + radius + 1, height);
+        sums.advanceTo(y2);
+        const T* top = sums.row(y1);
+        const T* bottom = sums.row(y2);
+        uint8_t* out = outPtr + static_cast<size_t>(y) * width * channels;
+        auto meanColumns = [&](int begin, int end)
+        {
+          for(int x = begin; x < end; x++)
+          {
+            const int x1 = std::max(x - radius, 0);
+            const int x2 = std::min(x + radius + 1, width);
+            const int64_t area = static_cast<int64_t>(x2 - x1) * (y2 - y1);
+            const double inverseArea = 1.0 / area;
+            for(int c = 0; c < channels; c++)
+            {
+              const T sum = bottom[x2*channels + c] - bottom[x1*channels + c] - top[x2*channels + c] + top[x1*channels + c];
+              out[x*channels + c] = static_cast<uint8_t>((static_cast<int64_t>(sum) + area/2 + 0.5) * inverseArea);
+            }
+          }
+        };
+        meanColumns(0, columns.interiorBegin);
+        // Same window width in the interior, so the four corners move along with i
+        const int64_t area = static_cast<int64_t>(2*radius + 1) * (y2 - y1);
+        const double inverseArea = 1.0 / area;
+        const double rounding = area/2 + 0.5;
+        const int windowSize = (2*radius + 1) * channels;
+        const int interiorEnd = columns.interiorEnd * channels;
+        for(int i = columns.interiorBegin * channels; i < interiorEnd; i++)
+        {
+          const int i1 = i - radius*channels;
+          const T sum = bottom[i1 + windowSize] - bottom[i1] - top[i1 + windowSize] + top[i1];
+          out[i] = static_cast<uint8_t>((static_cast<int64_t>(sum) + rounding) * inverseArea);
+        }
+        meanColumns(columns.interiorEnd, width);
+      }
+    });
+  }
+
+  // 255 where (pixel + offset) * area >= the window sum, which needs no division
+  template<typename T>
+  void thresholdRows(const MicroCv::MatView& gray, int radius, int offset, uint8_t* outPtr)
+  {
+    const int width = gray.width();
+    const int height = gray.height();
+    const WindowColumns columns(width, radius);
+    MicroCv::parallelForRows(width, height, radius, [&](const MicroCv::RowBand& band)
+    {
+      MICROCV_STAGE("adaptiveThreshold band", static_cast<uint64_t>(width) * (2*sizeof(T) + 2) * (band.end - band.begin));
+      MicroCv::Kernels::IntegralRows<T> sums(gray, band.haloBegin, std::min(2*radius + 2, height + 1));
+      for(int y = band.begin; y < band.end; y++)
+      {
+        const int y1 = std::max(y - radius, 0);
+        const int y2 = std::min(y + radius + 1, height);
+        sums.advanceTo(y2);
+        const T* top = sums.row(y1);
+        const T* bottom = sums.row(y2);
+        const uint8_t* in = gray.row(y);
+        uint8_t* out = outPtr + static_cast<size_t>(y) * width;
+        auto thresholdColumns = [&](int begin, int end)
+        {
+          for(int x = begin; x < end; x++)
+          {
+            const int x1 = std::max(x - radius, 0);
+            const int x2 = std::min(x + radius + 1, width);
+            const int64_t area = static_cast<int64_t>(x2 - x1) * (y2 - y1);
+            const int64_t sum = static_cast<int64_t>(bottom[x2] - bottom[x1] - top[x2] + top[x1]);
+            out[x] = (in[x] + offset) * area >= sum ? 255 : 0;
+          }
+        };
+        thresholdColumns(0, columns.interiorBegin);
+        const int64_t area = static_cast<int64_t>(2*radius + 1) * (y2 - y1);
+        for(int x = columns.interiorBegin; x < columns.interiorEnd; x++)
+        {
+          const int x1 = x - radius;
+          const int x2 = x + radius + 1;
+          const int64_t sum = static_cast<int64_t>(bottom[x2] - bottom[x1] - top[x2] + top[x1]);
+          out[x] = (in[x] + offset) * area >= sum ? 255 : 0;
+        }
+        thresholdColumns(columns.interiorEnd, width);
+      }
+    });
+  }
+
+  // Window sums of 32 bits are exact as long as the window has less than 2^32 / 255 pixels
+  bool fitsIntegral32(int radius)
+  {
+    const int64_t side = 2 * static_cast<int64_t>(radius) + 1;
+    return side * side * 255 <= UINT32_MAX;
+  }
+
+  enum MorphologyOperation
+  {
+    MorphologyErode,
+    MorphologyDilate,
+    MorphologyOpen,
+    MorphologyClose,
+    MorphologyGradient
+  };
+
+  // The morphology functions differ only in the passes they run on every plane
+  void morphology(const MicroCv::MatView& inputView, MicroCv::Mat& outputMat, int radiusX, int radiusY,
+      MorphologyOperation operation)
+  {
+    if(sharesPixels(inputView, outputMat))
+    {
+      MicroCv::Mat morphedMat;
+      morphology(inputView, morphedMat, radiusX, radiusY, operation);
+      outputMat = std::move(morphedMat);
+      return;
+    }
+    const int numChannels = inputView.channels();
+    MICROCV_STAGE("morphology", (operation == MorphologyErode || operation == MorphologyDilate ? 4 : 8) *
+        static_cast<uint64_t>(inputView.width()) * inputView.height() * numChannels);
+
+    if(numChannels <= 0 || inputView.depth() != MicroCv::DepthU8 || radiusX < 0 || radiusY < 0)
+    {
+      outputMat.resize(0, 0, 0);
+      return;
+    }
+    const int width = inputView.width();
+    const int height = inputView.height();
+    outputMat.resize(width, height, numChannels, inputView.layout());
+    if(width == 0 || height == 0)
+    {
+      return;
+    }
+
+    // Windows larger than the image are clipped to it anyway
+    radiusX = std::min(radiusX, width);
+    radiusY = std::min(radiusY, height);
+    const bool dilateFirst = operation == MorphologyDilate || operation == MorphologyClose || operation == MorphologyGradient;
+    forEachPlane(inputView, outputMat, [&](const MicroCv::MatView& view, uint8_t* outPtr)
+    {
+      MicroCv::Kernels::morphologyRows(view, radiusX, radiusY, dilateFirst, outPtr);
+      const int channels = view.channels();
+      const MicroCv::MatView firstPass(outPtr, width, height, channels, width * channels);
+      if(operation == MorphologyOpen || operation == MorphologyClose)
+      {
+        MicroCv::Kernels::morphologyRows(firstPass, radiusX, radiusY, !dilateFirst, outPtr);
+      }
+      else if(operation == MorphologyGradient)
+      {
+        // resize leaves the pixels uninitialized, the erosion writes all of them
+        MicroCv::Mat eroded;
+        eroded.resize(width, height, channels);
+        MicroCv::Kernels::morphologyRows(view, radiusX, radiusY, false, eroded.data());
+        const MicroCv::SimdLevel level = MicroCv::simdLevel();
+        const size_t rowSize = static_cast<size_t>(width) * channels;
+        MicroCv::parallelForRows(width, height, 0, [&](const MicroCv::RowBand& band)
+        {
+          MICROCV_STAGE("morphologyGradient band", 3 * rowSize * (band.end - band.begin));
+          for(int y = band.begin; y < band.end; y++)
+            MicroCv::Kernels::subtractRows(outPtr + y*rowSize, eroded.row(y), outPtr + y*rowSize, rowSize, level);
+        });
+      }
+    });
   }
 }
 
@@ -21,161 +339,923 @@ using namespace MicroCv;
 
 void MicroCv::cropMat(Mat& mat, int x1, int y1, int x2, int y2)
 {
-  const int width = mat.width();
-  const int height = mat.height();
-  const int channels = mat.channels();
-
   // Check bounds
-  if(x1 < 0 || x1 >= x2)
-    return;
-  if(x2 <= x1 || x2 >= width)
-    return;
-  if(y1 < 0 || y1 >= y2)
+  if(!isValidCropRegion(mat.width(), mat.height(), x1, y1, x2, y2))
     return;
-  if(y2 <= y1 || y2 >= height)
-    return;
-
-  // Make a copy
-  Mat inputMat = mat;
 
-  // Resize the original mat
-  mat.resize(x2 - x1, y2 - y1, channels);
+  // Only the pixels in the cropped region are copied
+  cropMat(mat, mat, x1, y1, x2, y2);
+}
 
-  uint8_t* outPtr = mat.data();
-  // Only iterate over the pixels in the cropped region
-  for(int y = y1; y < y2; y++)
+void MicroCv::cropMat(const MatView& inputView, Mat& outputMat, int x1, int y1, int x2, int y2)
+{
+  if(sharesPixels(inputView, outputMat))
   {
-    const uint8_t* inPtr = inputMat.data() + y*width*channels + x1*channels;
-    for(int x = x1*channels; x < x2*channels; x++, inPtr++, outPtr++)
-    {
-      *outPtr = *inPtr;
-    }
+    Mat croppedMat;
+    cropMat(inputView, croppedMat, x1, y1, x2, y2);
+    outputMat = std::move(croppedMat);
+    return;
   }
+  // An invalid region copies the whole input, like the in-place crop leaves it unchanged
+  const MatView regionView = cropView(inputView, x1, y1, x2, y2);
+  MICROCV_STAGE("cropMat", 2 * static_cast<uint64_t>(regionView.width()) * regionView.height() * regionView.channels()
+      * regionView.elementSize());
+  copyView(regionView, outputMat);
+}
+
+MatView MicroCv::cropView(const MatView& view, int x1, int y1, int x2, int y2)
+{
+  // Check bounds
+  if(!isValidCropRegion(view.width(), view.height(), x1, y1, x2, y2))
+    return view;
+
+  // Point at the top-left corner of the region and keep the parent stride
+  if(view.isPlanar())
+    return MatView(view.row(y1) + x1, x2 - x1, y2 - y1, view.channels(), view.stride(), view.planeStride());
+  const uint8_t* regionPtr = view.row(y1) + x1*view.channels()*view.elementSize();
+  return MatView(regionPtr, x2 - x1, y2 - y1, view.channels(), view.stride(), view.depth());
 }
 
-Mat MicroCv::rgbToGray(const Mat& inputMat)
+Mat MicroCv::rgbToGray(const MatView& inputView, GrayConversion conversion)
 {
   Mat outputMat;
-  int numChannels = inputMat.channels();
+  rgbToGray(inputView, outputMat, conversion);
+  return outputMat;
+}
+
+void MicroCv::rgbToGray(const MatView& inputView, Mat& outputMat, GrayConversion conversion)
+{
+  if(sharesPixels(inputView, outputMat))
+  {
+    Mat grayMat;
+    rgbToGray(inputView, grayMat, conversion);
+    outputMat = std::move(grayMat);
+    return;
+  }
+  MICROCV_STAGE("rgbToGray", static_cast<uint64_t>(inputView.width()) * inputView.height() * (inputView.channels() + 1));
+
+  // Only 8 bit images are converted
+  int numChannels = inputView.depth() == DepthU8 ? inputView.channels() : 0;
   // If in RGB mode
   if(numChannels == 3)
   {
-    const int numPixels = inputMat.width() * inputMat.height();
+    const int width = inputView.width();
+    const int height = inputView.height();
 
     // Resize the output data
-    outputMat.resize(inputMat.width(), inputMat.height(), 1);
+    outputMat.resize(width, height, 1);
 
-    // Add up each color from each channel and divide by number of channels
-    const uint8_t* inPtr = inputMat.data();
+    // Weighted sum of the 3 consecutive RGB values (or of the 3 planes), the row kernel picks the
+    // best instruction set
+    const Kernels::LumaCoefficients coeffs = Kernels::lumaCoefficients(conversion);
     uint8_t* outPtr = outputMat.data();
-
-    const double oneThird = 1.0 / 3.0;
-    for(int pixel = 0; pixel < numPixels; pixel++, inPtr+=numChannels, outPtr++)
+    const MatView r = inputView.plane(0);
+    const MatView g = inputView.plane(1);
+    const MatView b = inputView.plane(2);
+    parallelForRows(width, height, 0, [&](const RowBand& band)
     {
-      // Average the 3 consecutive RGB pixels
-      double newVal = static_cast<double>(*inPtr) +
-          static_cast<double>(*(inPtr+1)) + static_cast<double>(*(inPtr+2));
-      *outPtr = static_cast<uint8_t>(newVal * oneThird);
-    }
+      MICROCV_STAGE("rgbToGray band", static_cast<uint64_t>(width) * 4 * (band.end - band.begin));
+      for(int y = band.begin; y < band.end; y++)
+      {
+        if(inputView.isPlanar())
+          Kernels::planarRowToGray(r.row(y), g.row(y), b.row(y), outPtr + static_cast<size_t>(y)*width, width, coeffs);
+        else
+          Kernels::rgbRowToGray(inputView.row(y), outPtr + static_cast<size_t>(y)*width, width, coeffs);
+      }
+    });
   }
   else if(numChannels == 1)
   {
-    outputMat = inputMat;
+    copyView(inputView, outputMat);
+  }
+  else
+  {
+    outputMat.resize(0, 0, 0);
   }
-  return outputMat;
 }
 
-Mat MicroCv::grayToRgb(const Mat& inputMat)
+Mat MicroCv::grayToRgb(const MatView& inputView, MatLayout layout)
 {
   Mat outputMat;
-  if(inputMat.isGrayscale())
+  grayToRgb(inputView, outputMat, layout);
+  return outputMat;
+}
+
+void MicroCv::grayToRgb(const MatView& inputView, Mat& outputMat, MatLayout layout)
+{
+  if(sharesPixels(inputView, outputMat))
+  {
+    Mat rgbMat;
+    grayToRgb(inputView, rgbMat, layout);
+    outputMat = std::move(rgbMat);
+    return;
+  }
+  MICROCV_STAGE("grayToRgb", static_cast<uint64_t>(inputView.width()) * inputView.height() * (inputView.channels() + 3));
+
+  if(inputView.isGrayscale() && inputView.depth() == DepthU8)
   {
     const int numChannels = 3;
-    const int numPixels = inputMat.width() * inputMat.height();
+    const int width = inputView.width();
+    const int height = inputView.height();
 
     // Resize the output data
-    outputMat.resize(inputMat.width(), inputMat.height(), numChannels);
+    outputMat.resize(width, height, numChannels, layout);
 
     // Copy the gray value to all 3 channels
-    const uint8_t* inPtr = inputMat.data();
-    uint8_t* outPtr = outputMat.data();
-    for(int pixel = 0; pixel < numPixels; pixel++, inPtr++, outPtr+=numChannels)
+    uint8_t* outData = outputMat.data();
+    const size_t planeStride = outputMat.planeStride();
+    parallelForRows(width, height, 0, [&](const RowBand& band)
     {
-      *outPtr = *inPtr;
-      *(outPtr+1) = *inPtr;
-      *(outPtr+2) = *inPtr;
-    }
+      MICROCV_STAGE("grayToRgb band", static_cast<uint64_t>(width) * 4 * (band.end - band.begin));
+      for(int y = band.begin; y < band.end; y++)
+      {
+        if(layout == LayoutPlanar)
+        {
+          // Every plane is a copy of the gray image
+          for(int c = 0; c < numChannels; c++)
+            std::memcpy(outData + c*planeStride + static_cast<size_t>(y)*width, inputView.row(y), width);
+          continue;
+        }
+        const uint8_t* inPtr = inputView.row(y);
+        uint8_t* outPtr = outData + static_cast<size_t>(y)*width*numChannels;
+        for(int x = 0; x < width; x++, inPtr++, outPtr+=numChannels)
+        {
+          *outPtr = *inPtr;
+          *(outPtr+1) = *inPtr;
+          *(outPtr+2) = *inPtr;
+        }
+      }
+    });
+  }
+  else if(inputView.channels() == 3 && inputView.depth() == DepthU8)
+  {
+    convertLayout(inputView, outputMat, layout);
   }
-  else if(inputMat.channels() == 3)
+  else
   {
-    outputMat = inputMat;
+    outputMat.resize(0, 0, 0);
   }
+}
+
+Mat MicroCv::convertLayout(const MatView& inputView, MatLayout layout)
+{
+  Mat outputMat;
+  convertLayout(inputView, outputMat, layout);
   return outputMat;
 }
 
-Mat MicroCv::sobelEdgeDetector(const Mat& inputMat)
+void MicroCv::convertLayout(const MatView& inputView, Mat& outputMat, MatLayout layout)
+{
+  if(sharesPixels(inputView, outputMat))
+  {
+    Mat convertedMat;
+    convertLayout(inputView, convertedMat, layout);
+    outputMat = std::move(convertedMat);
+    return;
+  }
+  const int numChannels = inputView.channels();
+  MICROCV_STAGE("convertLayout", 2 * static_cast<uint64_t>(inputView.width()) * inputView.height() * numChannels);
+
+  // Planar Mats only hold 8 bit values
+  if(numChannels <= 0 || (inputView.depth() != DepthU8 && layout == LayoutPlanar && numChannels > 1))
+  {
+    outputMat.resize(0, 0, 0);
+    return;
+  }
+  if(inputView.layout() == layout || numChannels == 1)
+  {
+    copyView(inputView, outputMat);
+    return;
+  }
+
+  const int width = inputView.width();
+  const int height = inputView.height();
+  outputMat.resize(width, height, numChannels, layout);
+  uint8_t* outPtr = outputMat.data();
+  const size_t planeStride = outputMat.planeStride();
+  std::vector<MatView> inputPlanes(inputView.isPlanar() ? numChannels : 0);
+  for(size_t c = 0; c < inputPlanes.size(); c++)
+    inputPlanes[c] = inputView.plane(c);
+
+  // Every row of the interleaved image is split into (or merged from) the same row of every plane
+  parallelForRows(width * numChannels, height, 0, [&](const RowBand& band)
+  {
+    MICROCV_STAGE("convertLayout band", 2 * static_cast<uint64_t>(width) * numChannels * (band.end - band.begin));
+    std::vector<uint8_t*> outRows(numChannels);
+    std::vector<const uint8_t*> inRows(numChannels);
+    for(int y = band.begin; y < band.end; y++)
+    {
+      if(layout == LayoutPlanar)
+      {
+        for(int c = 0; c < numChannels; c++)
+          outRows[c] = outPtr + c*planeStride + static_cast<size_t>(y) * width;
+        Kernels::deinterleaveRow(inputView.row(y), outRows.data(), width, numChannels);
+      }
+      else
+      {
+        for(int c = 0; c < numChannels; c++)
+          inRows[c] = inputPlanes[c].row(y);
+        Kernels::interleaveRow(inRows.data(), outPtr + static_cast<size_t>(y) * width * numChannels, width, numChannels);
+      }
+    }
+  });
+}
+
+Mat MicroCv::convertDepth(const MatView& inputView, MatDepth depth, double scale, double offset)
 {
-  Mat grayMat;
   Mat outputMat;
-  if(!inputMat.isGrayscale())
+  convertDepth(inputView, outputMat, depth, scale, offset);
+  return outputMat;
+}
+
+void MicroCv::convertDepth(const MatView& inputView, Mat& outputMat, MatDepth depth, double scale, double offset)
+{
+  if(sharesPixels(inputView, outputMat))
   {
-    grayMat = rgbToGray(inputMat);
+    Mat convertedMat;
+    convertDepth(inputView, convertedMat, depth, scale, offset);
+    outputMat = std::move(convertedMat);
+    return;
   }
-  else
+  const int numChannels = inputView.channels();
+  MICROCV_STAGE("convertDepth", static_cast<uint64_t>(inputView.width()) * inputView.height() * numChannels
+      * (inputView.elementSize() + depthSize(depth)));
+
+  if(numChannels <= 0 || !std::isfinite(scale) || !std::isfinite(offset))
   {
-    grayMat = inputMat;
+    outputMat.resize(0, 0, 0);
+    return;
   }
 
-  // Resize the output data
-  outputMat.resize(grayMat.width(), grayMat.height(), grayMat.channels());
+  const int width = inputView.width();
+  const int height = inputView.height();
+  if(inputView.isPlanar() && depth == DepthU8)
+  {
+    outputMat.resize(width, height, numChannels, LayoutPlanar);
+    forEachPlane(inputView, outputMat, [&](const MatView& view, uint8_t* outPtr)
+    {
+      convertDepthRows(view, outPtr, depth, scale, offset);
+    });
+    return;
+  }
+  outputMat.resize(width, height, numChannels, depth);
+  convertDepthRows(inputView, outputMat.data(), depth, scale, offset);
+}
 
-  const uint8_t* inPtr = grayMat.data();
-  uint8_t* outPtr = outputMat.data();
+Mat MicroCv::resizeMat(const MatView& inputView, int width, int height, ResizeMethod method)
+{
+  Mat outputMat;
+  resizeMat(inputView, outputMat, width, height, method);
+  return outputMat;
+}
 
-  // Define x and y derivative kernels (fixed kernel size of 3)
-  const int K = 3;
-  const int halfK = K / 2;
-  static const int8_t Gx[9] =
-    {-1, 0, 1,
-     -2, 0, 2,
-     -1, 0, 1};
+void MicroCv::resizeMat(const MatView& inputView, Mat& outputMat, int width, int height, ResizeMethod method)
+{
+  if(sharesPixels(inputView, outputMat))
+  {
+    Mat resizedMat;
+    resizeMat(inputView, resizedMat, width, height, method);
+    outputMat = std::move(resizedMat);
+    return;
+  }
+  const int numChannels = inputView.channels();
+  MICROCV_STAGE("resizeMat", (static_cast<uint64_t>(inputView.width()) * inputView.height()
+      + static_cast<uint64_t>(std::max(width, 0)) * std::max(height, 0)) * numChannels);
 
-  static const int8_t Gy[9] =
-    {1,  2,  1,
-     0,  0,  0,
-    -1, -2, -1};
+  if((numChannels != 1 && numChannels != 3) || inputView.depth() != DepthU8 || width <= 0 || height <= 0
+      || inputView.width() == 0 || inputView.height() == 0)
+  {
+    outputMat.resize(0, 0, 0);
+    return;
+  }
+  if(width == inputView.width() && height == inputView.height())
+  {
+    copyView(inputView, outputMat);
+    return;
+  }
 
-  const int width = grayMat.width();
-  const int height = grayMat.height();
+  const bool resizeX = width != inputView.width();
+  const bool resizeY = height != inputView.height();
+  const Kernels::ResizeCoefficients xCoeffs = Kernels::resizeCoefficients(inputView.width(), width, method);
+  const Kernels::ResizeCoefficients yCoeffs = Kernels::resizeCoefficients(inputView.height(), height, method);
+  outputMat.resize(width, height, numChannels, inputView.layout());
 
-  // Simple 2D convolution - this can be optimized by using CUDA api calls or by consecutive 1D convs
-  for (int y = halfK; y < height - halfK; ++y) // iterate through image
+  // Planes are resized one at a time as gray images
+  forEachPlane(inputView, outputMat, [&](const MatView& view, uint8_t* outPtr)
   {
-    for (int x = halfK; x < width - halfK; ++x)
+    const int channels = view.channels();
+    const int outRowBytes = width * channels;
+    // Separable resampling - every band resizes the input rows under it horizontally into a band
+    // buffer, then blends those vertically into its output rows
+    parallelForRows(std::max(width, view.width()), height, 0, [&](const RowBand& band)
     {
-      int gxSum = 0; // Sum of the convolution:
-      int gySum = 0; // it will be the sum of input data * coeff terms
+      MICROCV_STAGE("resizeMat band", static_cast<uint64_t>(outRowBytes) * (band.end - band.begin));
+      if(!resizeY)
+      {
+        for(int y = band.begin; y < band.end; y++)
+          Kernels::resizeRowHorizontal(view.row(y), outPtr + static_cast<size_t>(y)*outRowBytes, channels, xCoeffs);
+        return;
+      }
 
-      for (int yy = - halfK; yy <= halfK; ++yy) // iterate over kernel
+      // Neighbouring bands share a few input rows, which both of them resize
+      const int inBegin = yCoeffs.starts[band.begin];
+      const int inEnd = yCoeffs.starts[band.end - 1] + yCoeffs.taps;
+      std::vector<uint8_t> bandRows(resizeX ? static_cast<size_t>(inEnd - inBegin) * outRowBytes : 0);
+      std::vector<const uint8_t*> rowPtrs(inEnd - inBegin);
+      for(int y = inBegin; y < inEnd; y++)
       {
-        for (int xx = - halfK; xx <= halfK; ++xx)
+        if(resizeX)
         {
-          int data = *(inPtr + (y+yy)*width + (x+xx));
-          int gxCoeff = *(Gx + (yy + halfK)*K + xx + halfK);
-          int gyCoeff = *(Gy + (yy + halfK)*K + xx + halfK);
-
-          gxSum += data * gxCoeff;
-          gySum += data * gyCoeff;
+          uint8_t* row = bandRows.data() + static_cast<size_t>(y - inBegin) * outRowBytes;
+          Kernels::resizeRowHorizontal(view.row(y), row, channels, xCoeffs);
+          rowPtrs[y - inBegin] = row;
         }
+        else
+        {
+          rowPtrs[y - inBegin] = view.row(y);
+        }
+      }
+
+      for(int y = band.begin; y < band.end; y++)
+      {
+        Kernels::resizeRowVertical(rowPtrs.data() + (yCoeffs.starts[y] - inBegin),
+            yCoeffs.weights.data() + static_cast<size_t>(y) * yCoeffs.taps, yCoeffs.taps,
+            outPtr + static_cast<size_t>(y)*outRowBytes, outRowBytes);
+      }
+    });
+  });
+}
+
+FilterKernel::FilterKernel()
+: width(0)
+, height(0)
+, divisor(1)
+, offset(0)
+{
+}
+
+FilterKernel::FilterKernel(int width, int height, const std::vector<int>& weights, int divisor, int offset)
+: width(width)
+, height(height)
+, weights(weights)
+, divisor(divisor)
+, offset(offset)
+{
+}
+
+FilterKernel MicroCv::sobelXKernel()
+{
+  return FilterKernel(3, 3, {-1, 0, 1, -2, 0, 2, -1, 0, 1});
+}
+
+FilterKernel MicroCv::sobelYKernel()
+{
+  return FilterKernel(3, 3, {-1, -2, -1, 0, 0, 0, 1, 2, 1});
+}
+
+FilterKernel MicroCv::scharrXKernel()
+{
+  return FilterKernel(3, 3, {-3, 0, 3, -10, 0, 10, -3, 0, 3});
+}
+
+FilterKernel MicroCv::scharrYKernel()
+{
+  return FilterKernel(3, 3, {-3, -10, -3, 0, 0, 0, 3, 10, 3});
+}
+
+FilterKernel MicroCv::laplacianKernel()
+{
+  return FilterKernel(3, 3, {0, 1, 0, 1, -4, 1, 0, 1, 0});
+}
+
+FilterKernel MicroCv::boxKernel(int size)
+{
+  if(size <= 0)
+    return FilterKernel();
+  return FilterKernel(size, size, std::vector<int>(size*size, 1), size*size);
+}
+
+FilterKernel MicroCv::binomialKernel(int size)
+{
+  // Larger kernels overflow the divisor (and are too large for filter2D anyway)
+  if(size <= 0 || size > 15)
+    return FilterKernel();
+
+  // Row size - 1 of Pascal's triangle, the kernel is its outer product with itself
+  std::vector<int> row(size, 0);
+  row[0] = 1;
+  for(int n = 1; n < size; n++)
+  {
+    for(int k = n; k > 0; k--)
+      row[k] += row[k-1];
+  }
+  std::vector<int> weights(size*size);
+  for(int y = 0; y < size; y++)
+  {
+    for(int x = 0; x < size; x++)
+      weights[y*size + x] = row[y] * row[x];
+  }
+  return FilterKernel(size, size, weights, 1 << (2*(size - 1)));
+}
+
+Mat MicroCv::filter2D(const MatView& inputView, const FilterKernel& kernel, BorderMode border)
+{
+  Mat outputMat;
+  filter2D(inputView, outputMat, kernel, border);
+  return outputMat;
+}
+
+void MicroCv::filter2D(const MatView& inputView, Mat& outputMat, const FilterKernel& kernel, BorderMode border)
+{
+  if(sharesPixels(inputView, outputMat))
+  {
+    Mat filteredMat;
+    filter2D(inputView, filteredMat, kernel, border);
+    outputMat = std::move(filteredMat);
+    return;
+  }
+  const int numChannels = inputView.channels();
+  MICROCV_STAGE("filter2D", 2 * static_cast<uint64_t>(inputView.width()) * inputView.height() * numChannels);
+
+  if(numChannels <= 0 || inputView.depth() != DepthU8 || !Kernels::isValidFilterKernel(kernel))
+  {
+    outputMat.resize(0, 0, 0);
+    return;
+  }
+
+  const int width = inputView.width();
+  const int height = inputView.height();
+  outputMat.resize(width, height, numChannels, inputView.layout());
+  if(width == 0 || height == 0)
+  {
+    return;
+  }
+  const int radiusY = kernel.height / 2;
+
+  forEachPlane(inputView, outputMat, [&](const MatView& view, uint8_t* outPtr)
+  {
+    const size_t rowBytes = static_cast<size_t>(width) * view.channels();
+    // Every band pushes its halo rows (or the border rows replacing them) before its own rows
+    parallelForRows(width, height, radiusY, [&](const RowBand& band)
+    {
+      MICROCV_STAGE("filter2D band", 2 * rowBytes * (band.end - band.begin));
+      Kernels::FilterEngine engine(kernel, width, view.channels(), border);
+      for(int y = band.begin - radiusY; y < band.end + radiusY; y++)
+      {
+        const int inputY = Kernels::borderIndex(y, height, border);
+        engine.pushRow(inputY < 0 ? nullptr : view.row(inputY));
+        if(y - radiusY >= band.begin)
+          engine.computeRow(outPtr + static_cast<size_t>(y - radiusY) * rowBytes);
+      }
+    });
+  });
+}
+
+Mat MicroCv::gaussianBlur(const MatView& inputView, double sigma, BorderMode border)
+{
+  Mat outputMat;
+  gaussianBlur(inputView, outputMat, sigma, border);
+  return outputMat;
+}
+
+void MicroCv::gaussianBlur(const MatView& inputView, Mat& outputMat, double sigma, BorderMode border)
+{
+  if(sharesPixels(inputView, outputMat))
+  {
+    Mat blurredMat;
+    gaussianBlur(inputView, blurredMat, sigma, border);
+    outputMat = std::move(blurredMat);
+    return;
+  }
+  const int numChannels = inputView.channels();
+  MICROCV_STAGE("gaussianBlur", 2 * static_cast<uint64_t>(inputView.width()) * inputView.height() * numChannels);
+
+  // Also rejects NaN
+  if(numChannels <= 0 || inputView.depth() != DepthU8 || !(sigma >= 0) || std::isinf(sigma))
+  {
+    outputMat.resize(0, 0, 0);
+    return;
+  }
+  if(sigma == 0)
+  {
+    copyView(inputView, outputMat);
+    return;
+  }
+
+  const int width = inputView.width();
+  const int height = inputView.height();
+  outputMat.resize(width, height, numChannels, inputView.layout());
+  if(width == 0 || height == 0)
+  {
+    return;
+  }
+  if(sigma > Kernels::GAUSSIAN_FIR_MAX_SIGMA)
+  {
+    forEachPlane(inputView, outputMat, [&](const MatView& view, uint8_t* outPtr)
+    {
+      Kernels::recursiveGaussianBlur(view, sigma, border, outPtr);
+    });
+    return;
+  }
+
+  // Same band loop as filter2D
+  const int radius = static_cast<int>(Kernels::gaussianTaps(sigma).size()) - 1;
+  forEachPlane(inputView, outputMat, [&](const MatView& view, uint8_t* outPtr)
+  {
+    const size_t rowBytes = static_cast<size_t>(width) * view.channels();
+    parallelForRows(width, height, radius, [&](const RowBand& band)
+    {
+      MICROCV_STAGE("gaussianBlur band", 2 * rowBytes * (band.end - band.begin));
+      Kernels::GaussianEngine engine(sigma, width, view.channels(), border);
+      for(int y = band.begin - radius; y < band.end + radius; y++)
+      {
+        const int inputY = Kernels::borderIndex(y, height, border);
+        engine.pushRow(inputY < 0 ? nullptr : view.row(inputY));
+        if(y - radius >= band.begin)
+          engine.computeRow(outPtr + static_cast<size_t>(y - radius) * rowBytes);
       }
-      // The sobel gradient magnituted is the sum of the absolute magnitudes of
-      // the derivates in x and y (Gx + Gy)
-      // Technically, it is G = sqrt(Gx^2 + Gy^x), but the sum of absval is easier to calculate
-      int gradientMagnitude = abs(gxSum) + abs(gySum);
+    });
+  });
+}
+
+Mat MicroCv::boxFilter(const MatView& inputView, int radius)
+{
+  Mat outputMat;
+  boxFilter(inputView, outputMat, radius);
+  return outputMat;
+}
+
+void MicroCv::boxFilter(const MatView& inputView, Mat& outputMat, int radius)
+{
+  if(sharesPixels(inputView, outputMat))
+  {
+    Mat filteredMat;
+    boxFilter(inputView, filteredMat, radius);
+    outputMat = std::move(filteredMat);
+    return;
+  }
+  const int numChannels = inputView.channels();
+  MICROCV_STAGE("boxFilter", 2 * static_cast<uint64_t>(inputView.width()) * inputView.height() * numChannels);
+
+  if(numChannels <= 0 || inputView.depth() != DepthU8 || radius < 0)
+  {
+    outputMat.resize(0, 0, 0);
+    return;
+  }
+  const int width = inputView.width();
+  const int height = inputView.height();
+  outputMat.resize(width, height, numChannels, inputView.layout());
+  if(width == 0 || height == 0)
+  {
+    return;
+  }
+
+  // Windows larger than the image are clipped to it anyway
+  radius = std::min(radius, std::max(width, height));
+  // Every output pixel reads four sums, whatever the radius
+  forEachPlane(inputView, outputMat, [&](const MatView& view, uint8_t* outPtr)
+  {
+    if(fitsIntegral32(radius))
+      boxFilterRows<uint32_t>(view, radius, outPtr);
+    else
+      boxFilterRows<uint64_t>(view, radius, outPtr);
+  });
+}
+
+Mat MicroCv::adaptiveThreshold(const MatView& inputView, int radius, int offset)
+{
+  Mat outputMat;
+  adaptiveThreshold(inputView, outputMat, radius, offset);
+  return outputMat;
+}
+
+void MicroCv::adaptiveThreshold(const MatView& inputView, Mat& outputMat, int radius, int offset)
+{
+  if(sharesPixels(inputView, outputMat))
+  {
+    Mat binaryMat;
+    adaptiveThreshold(inputView, binaryMat, radius, offset);
+    outputMat = std::move(binaryMat);
+    return;
+  }
+  if(inputView.channels() == 3)
+  {
+    adaptiveThreshold(rgbToGray(inputView), outputMat, radius, offset);
+    return;
+  }
+  MICROCV_STAGE("adaptiveThreshold", 2 * static_cast<uint64_t>(inputView.width()) * inputView.height());
+
+  if(inputView.channels() != 1 || inputView.depth() != DepthU8 || radius < 0)
+  {
+    outputMat.resize(0, 0, 0);
+    return;
+  }
+  const int width = inputView.width();
+  const int height = inputView.height();
+  outputMat.resize(width, height, 1);
+  if(width == 0 || height == 0)
+  {
+    return;
+  }
+
+  // Windows larger than the image are clipped to it anyway
+  radius = std::min(radius, std::max(width, height));
+  if(fitsIntegral32(radius))
+    thresholdRows<uint32_t>(inputView, radius, offset, outputMat.data());
+  else
+    thresholdRows<uint64_t>(inputView, radius, offset, outputMat.data());
+}
+
+Mat MicroCv::erode(const MatView& inputView, int radiusX, int radiusY)
+{
+  Mat outputMat;
+  erode(inputView, outputMat, radiusX, radiusY);
+  return outputMat;
+}
+
+void MicroCv::erode(const MatView& inputView, Mat& outputMat, int radiusX, int radiusY)
+{
+  morphology(inputView, outputMat, radiusX, radiusY, MorphologyErode);
+}
+
+Mat MicroCv::dilate(const MatView& inputView, int radiusX, int radiusY)
+{
+  Mat outputMat;
+  dilate(inputView, outputMat, radiusX, radiusY);
+  return outputMat;
+}
+
+void MicroCv::dilate(const MatView& inputView, Mat& outputMat, int radiusX, int radiusY)
+{
+  morphology(inputView, outputMat, radiusX, radiusY, MorphologyDilate);
+}
+
+Mat MicroCv::morphologyOpen(const MatView& inputView, int radiusX, int radiusY)
+{
+  Mat outputMat;
+  morphologyOpen(inputView, outputMat, radiusX, radiusY);
+  return outputMat;
+}
+
+void MicroCv::morphologyOpen(const MatView& inputView, Mat& outputMat, int radiusX, int radiusY)
+{
+  morphology(inputView, outputMat, radiusX, radiusY, MorphologyOpen);
+}
+
+Mat MicroCv::morphologyClose(const MatView& inputView, int radiusX, int radiusY)
+{
+  Mat outputMat;
+  morphologyClose(inputView, outputMat, radiusX, radiusY);
+  return outputMat;
+}
 
-      // This value may be outside of the pixel range 0 < x < 255, so we clamp it to valid range
-      *(outPtr + y*width + x) = clampToPixelRange(gradientMagnitude);
+void MicroCv::morphologyClose(const MatView& inputView, Mat& outputMat, int radiusX, int radiusY)
+{
+  morphology(inputView, outputMat, radiusX, radiusY, MorphologyClose);
+}
+
+Mat MicroCv::morphologyGradient(const MatView& inputView, int radiusX, int radiusY)
+{
+  Mat outputMat;
+  morphologyGradient(inputView, outputMat, radiusX, radiusY);
+  return outputMat;
+}
+
+void MicroCv::morphologyGradient(const MatView& inputView, Mat& outputMat, int radiusX, int radiusY)
+{
+  morphology(inputView, outputMat, radiusX, radiusY, MorphologyGradient);
+}
+
+Mat MicroCv::equalizeHistogram(const MatView& inputView)
+{
+  Mat outputMat;
+  equalizeHistogram(inputView, outputMat);
+  return outputMat;
+}
+
+void MicroCv::equalizeHistogram(const MatView& inputView, Mat& outputMat)
+{
+  if(sharesPixels(inputView, outputMat))
+  {
+    Mat equalizedMat;
+    equalizeHistogram(inputView, equalizedMat);
+    outputMat = std::move(equalizedMat);
+    return;
+  }
+  const int numChannels = inputView.channels();
+  MICROCV_STAGE("equalizeHistogram", 3 * static_cast<uint64_t>(inputView.width()) * inputView.height() * numChannels);
+
+  if(numChannels <= 0 || inputView.depth() != DepthU8)
+  {
+    outputMat.resize(0, 0, 0);
+    return;
+  }
+
+  const int width = inputView.width();
+  const int height = inputView.height();
+  outputMat.resize(width, height, numChannels, inputView.layout());
+  if(width == 0 || height == 0)
+  {
+    return;
+  }
+  forEachPlane(inputView, outputMat, Kernels::equalizeHistograms);
+}
+
+Mat MicroCv::equalizeHistogramClahe(const MatView& inputView, double clipLimit, int tilesX, int tilesY)
+{
+  Mat outputMat;
+  equalizeHistogramClahe(inputView, outputMat, clipLimit, tilesX, tilesY);
+  return outputMat;
+}
+
+void MicroCv::equalizeHistogramClahe(const MatView& inputView, Mat& outputMat, double clipLimit, int tilesX, int tilesY)
+{
+  if(sharesPixels(inputView, outputMat))
+  {
+    Mat equalizedMat;
+    equalizeHistogramClahe(inputView, equalizedMat, clipLimit, tilesX, tilesY);
+    outputMat = std::move(equalizedMat);
+    return;
+  }
+  const int numChannels = inputView.channels();
+  MICROCV_STAGE("equalizeHistogramClahe", 3 * static_cast<uint64_t>(inputView.width()) * inputView.height() * numChannels);
+
+  // Also rejects NaN
+  if(numChannels <= 0 || inputView.depth() != DepthU8 || tilesX < 1 || tilesY < 1 || !(clipLimit >= 0) || std::isinf(clipLimit))
+  {
+    outputMat.resize(0, 0, 0);
+    return;
+  }
+
+  const int width = inputView.width();
+  const int height = inputView.height();
+  outputMat.resize(width, height, numChannels, inputView.layout());
+  if(width == 0 || height == 0)
+  {
+    return;
+  }
+  forEachPlane(inputView, outputMat, [&](const MatView& view, uint8_t* outPtr)
+  {
+    Kernels::claheEqualize(view, clipLimit, tilesX, tilesY, outPtr);
+  });
+}
+
+Mat MicroCv::sobelEdgeDetector(const MatView& inputView, SobelMagnitude magnitude)
+{
+  Mat outputMat;
+  sobelEdgeDetector(inputView, outputMat, magnitude);
+  return outputMat;
+}
+
+void MicroCv::sobelEdgeDetector(const MatView& inputView, Mat& outputMat, SobelMagnitude magnitude)
+{
+  if(sharesPixels(inputView, outputMat))
+  {
+    Mat edgesMat;
+    sobelEdgeDetector(inputView, edgesMat, magnitude);
+    outputMat = std::move(edgesMat);
+    return;
+  }
+  MICROCV_STAGE("sobelEdgeDetector", static_cast<uint64_t>(inputView.width()) * inputView.height() * (inputView.channels() + 1));
+
+  const int numChannels = inputView.channels();
+  if((numChannels != 1 && numChannels != 3) || inputView.depth() != DepthU8)
+  {
+    outputMat.resize(0, 0, 0);
+    return;
+  }
+
+  const int width = inputView.width();
+  const int height = inputView.height();
+  outputMat.resize(width, height, 1);
+  uint8_t* outPtr = outputMat.data();
+  if(width == 0 || height == 0)
+  {
+    return;
+  }
+
+  // The convolution ignores the border pixels, so the first and last rows stay black
+  std::memset(outPtr, 0, width);
+  std::memset(outPtr + static_cast<size_t>(height-1)*width, 0, width);
+  if(height < 3)
+  {
+    return;
+  }
+
+  // Every band needs one halo row above and below it to fill its three row window
+  parallelForRows(width, height, 1, [&](const RowBand& band)
+  {
+    MICROCV_STAGE("sobelEdgeDetector band", static_cast<uint64_t>(width) * (numChannels + 1) * (band.end - band.begin));
+    const int yBegin = std::max(band.begin, 1);
+    const int yEnd = std::min(band.end, height - 1);
+    if(yBegin >= yEnd)
+      return;
+
+    // Separable Sobel - every input row is reduced once and kept in a three row window
+    GrayRowReader inputRows(inputView);
+    Kernels::SobelEngine engine(width, magnitude);
+    engine.pushRow(inputRows.row(yBegin - 1));
+    engine.pushRow(inputRows.row(yBegin));
+    for(int y = yBegin; y < yEnd; y++)
+    {
+      engine.pushRow(inputRows.row(y + 1));
+      engine.computeRow(outPtr + static_cast<size_t>(y)*width);
     }
+  });
+}
+
+void MicroCv::sobelGradients(const MatView& inputView, Mat& gradientX, Mat& gradientY)
+{
+  if(sharesPixels(inputView, gradientX) || sharesPixels(inputView, gradientY))
+  {
+    Mat gxMat, gyMat;
+    sobelGradients(inputView, gxMat, gyMat);
+    gradientX = std::move(gxMat);
+    gradientY = std::move(gyMat);
+    return;
   }
+  MICROCV_STAGE("sobelGradients", static_cast<uint64_t>(inputView.width()) * inputView.height() * (inputView.channels() + 4));
+
+  const int numChannels = inputView.channels();
+  if((numChannels != 1 && numChannels != 3) || inputView.depth() != DepthU8)
+  {
+    gradientX.resize(0, 0, 0);
+    gradientY.resize(0, 0, 0);
+    return;
+  }
+
+  const int width = inputView.width();
+  const int height = inputView.height();
+  gradientX.resize(width, height, 1, DepthS16);
+  gradientY.resize(width, height, 1, DepthS16);
+  if(width == 0 || height == 0)
+  {
+    return;
+  }
+  int16_t* gxPtr = gradientX.row<int16_t>(0);
+  int16_t* gyPtr = gradientY.row<int16_t>(0);
+
+  // Same band loop as sobelEdgeDetector, the engine writes the Gx and Gy rows instead of their magnitude
+  std::fill(gxPtr, gxPtr + width, 0);
+  std::fill(gyPtr, gyPtr + width, 0);
+  std::fill(gxPtr + static_cast<size_t>(height-1)*width, gxPtr + static_cast<size_t>(height)*width, 0);
+  std::fill(gyPtr + static_cast<size_t>(height-1)*width, gyPtr + static_cast<size_t>(height)*width, 0);
+  if(height < 3)
+  {
+    return;
+  }
+  parallelForRows(width, height, 1, [&](const RowBand& band)
+  {
+    MICROCV_STAGE("sobelGradients band", static_cast<uint64_t>(width) * (numChannels + 4) * (band.end - band.begin));
+    const int yBegin = std::max(band.begin, 1);
+    const int yEnd = std::min(band.end, height - 1);
+    if(yBegin >= yEnd)
+      return;
+
+    GrayRowReader inputRows(inputView);
+    Kernels::SobelEngine engine(width, SobelL1);
+    engine.pushRow(inputRows.row(yBegin - 1));
+    engine.pushRow(inputRows.row(yBegin));
+    for(int y = yBegin; y < yEnd; y++)
+    {
+      engine.pushRow(inputRows.row(y + 1));
+      engine.computeGradients(gxPtr + static_cast<size_t>(y)*width, gyPtr + static_cast<size_t>(y)*width);
+    }
+  });
+}
+
+Mat MicroCv::cannyEdgeDetector(const MatView& inputView, int lowThreshold, int highThreshold, SobelMagnitude magnitude)
+{
+  Mat outputMat;
+  cannyEdgeDetector(inputView, outputMat, lowThreshold, highThreshold, magnitude);
   return outputMat;
 }
+
+void MicroCv::cannyEdgeDetector(const MatView& inputView, Mat& outputMat, int lowThreshold, int highThreshold,
+    SobelMagnitude magnitude)
+{
+  if(sharesPixels(inputView, outputMat))
+  {
+    Mat edgesMat;
+    cannyEdgeDetector(inputView, edgesMat, lowThreshold, highThreshold, magnitude);
+    outputMat = std::move(edgesMat);
+    return;
+  }
+  MICROCV_STAGE("cannyEdgeDetector", static_cast<uint64_t>(inputView.width()) * inputView.height() * (inputView.channels() + 1));
+
+  const int numChannels = inputView.channels();
+  if((numChannels != 1 && numChannels != 3) || inputView.depth() != DepthU8 || lowThreshold < 0 || highThreshold < lowThreshold)
+  {
+    outputMat.resize(0, 0, 0);
+    return;
+  }
+
+  const int width = inputView.width();
+  const int height = inputView.height();
+  outputMat.resize(width, height, 1);
+  if(width == 0 || height == 0)
+  {
+    return;
+  }
+  Kernels::cannyEdges(inputView, lowThreshold, highThreshold, magnitude, outputMat.data());
+}
@@ -0,0 +1,302 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "Instrumentation.h"
+
+namespace
+{
+  // Bounds the memory of a trace, later events are only counted in the totals
+  const size_t MAX_EVENTS_PER_THREAD = 1 << 20;
+
+  struct StageCounters
+  {
+    StageCounters() : calls(0), bytes(0), nanoseconds(0) {}
+    uint64_t calls;
+    uint64_t bytes;
+    int64_t nanoseconds;
+  };
+
+  struct TraceEvent
+  {
+    const char* name;
+    int64_t startNs;
+    int64_t durationNs;
+    uint64_t bytes;
+  };
+
+  // Everything recorded by one thread, only that thread writes to it
+  // The lock is uncontended unless the stats are being read at the same time
+  struct ThreadRecord
+  {
+    explicit ThreadRecord(int index) : thread(index), allocations(0), allocatedBytes(0), poolHits(0) {}
+
+    int thread;
+    std::mutex mutex;
+    // Keyed by the address of the name literal, merged by name when the stats are read
+    std::unordered_map<const char*, StageCounters> stages;
+    std::vector<TraceEvent> events;
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+    uint64_t poolHits;
+  };
+
+  // Records outlive their threads so the stats of finished threads are kept
+  struct Registry
+  {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadRecord>> threads;
+  };
+
+  std::atomic<bool> g_statsEnabled(false);
+  std::atomic<bool> g_traceEnabled(false);
+
+  // Never destroyed, threads may still record while static objects are torn down
+  Registry& registry()
+  {
+    static Registry* instance = new Registry();
+    return *instance;
+  }
+
+  ThreadRecord& threadRecord()
+  {
+    thread_local ThreadRecord* record = nullptr;
+    if(!record)
+    {
+      Registry& reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      reg.threads.emplace_back(new ThreadRecord(static_cast<int>(reg.threads.size())));
+      record = reg.threads.back().get();
+    }
+    return *record;
+  }
+
+  // Nanoseconds since the first call, so trace timestamps start near 0
+  int64_t nowNs()
+  {
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+  }
+
+  std::string escapeJson(const std::string& text)
+  {
+    std::string escaped;
+    for(auto itr = text.begin(); itr != text.end(); ++itr)
+    {
+      if(*itr == '"' || *itr == '\\')
+        escaped += '\\';
+      escaped += *itr;
+    }
+    return escaped;
+  }
+}
+
+using namespace MicroCv;
+
+void MicroCv::setStatsEnabled(bool enabled)
+{
+  g_statsEnabled = enabled;
+  if(!enabled)
+    g_traceEnabled = false;
+}
+
+bool MicroCv::statsEnabled()
+{
+  return g_statsEnabled.load(std::memory_order_relaxed);
+}
+
+void MicroCv::setTraceEnabled(bool enabled)
+{
+  g_traceEnabled = enabled;
+  if(enabled)
+    g_statsEnabled = true;
+}
+
+bool MicroCv::traceEnabled()
+{
+  return g_traceEnabled.load(std::memory_order_relaxed);
+}
+
+std::vector<StageStats> MicroCv::stageStats()
+{
+  std::map<std::string, StageCounters> merged;
+  Registry& reg = registry();
+  std::lock_guard<std::mutex> registryLock(reg.mutex);
+  for(auto record = reg.threads.begin(); record != reg.threads.end(); ++record)
+  {
+    std::lock_guard<std::mutex> lock((*record)->mutex);
+    for(auto stage = (*record)->stages.begin(); stage != (*record)->stages.end(); ++stage)
+    {
+      StageCounters& counters = merged[stage->first];
+      counters.calls += stage->second.calls;
+      counters.bytes += stage->second.bytes;
+      counters.nanoseconds += stage->second.nanoseconds;
+    }
+  }
+
+  std::vector<StageStats> stats;
+  for(auto itr = merged.begin(); itr != merged.end(); ++itr)
+  {
+    StageStats stage = {itr->first, itr->second.calls, itr->second.bytes, itr->second.nanoseconds / 1e9};
+    stats.push_back(stage);
+  }
+  return stats;
+}
+
+std::vector<ThreadStats> MicroCv::threadStats()
+{
+  std::vector<ThreadStats> stats;
+  Registry& reg = registry();
+  std::lock_guard<std::mutex> registryLock(reg.mutex);
+  for(auto record = reg.threads.begin(); record != reg.threads.end(); ++record)
+  {
+    std::lock_guard<std::mutex> lock((*record)->mutex);
+    ThreadStats thread = {(*record)->thread, (*record)->allocations, (*record)->allocatedBytes, (*record)->poolHits};
+    stats.push_back(thread);
+  }
+  return stats;
+}
+
+void MicroCv::resetStats()
+{
+  Registry& reg = registry();
+  std::lock_guard<std::mutex> registryLock(reg.mutex);
+  for(auto record = reg.threads.begin(); record != reg.threads.end(); ++record)
+  {
+    std::lock_guard<std::mutex> lock((*record)->mutex);
+    (*record)->stages.clear();
+    (*record)->events.clear();
+    (*record)->allocations = 0;
+    (*record)->allocatedBytes = 0;
+    (*record)->poolHits = 0;
+  }
+}
+
+void MicroCv::printStats(std::ostream& out)
+{
+  const std::vector<StageStats> stages = stageStats();
+  out << std::left << std::setw(28) << "Stage" << std::right << std::setw(8) << "Calls"
+      << std::setw(12) << "Total ms" << std::setw(12) << "Avg ms" << std::setw(10) << "MB"
+      << std::setw(10) << "MB/s" << std::endl;
+  out << std::fixed << std::setprecision(2);
+  for(auto itr = stages.begin(); itr != stages.end(); ++itr)
+  {
+    const double megabytes = itr->bytes / 1e6;
+    out << std::left << std::setw(28) << itr->name << std::right << std::setw(8) << itr->calls
+        << std::setw(12) << itr->seconds * 1e3 << std::setw(12) << itr->seconds * 1e3 / std::max<uint64_t>(itr->calls, 1)
+        << std::setw(10) << megabytes << std::setw(10) << (itr->seconds > 0.0 ? megabytes / itr->seconds : 0.0)
+        << std::endl;
+  }
+
+  const std::vector<ThreadStats> threads = threadStats();
+  for(auto itr = threads.begin(); itr != threads.end(); ++itr)
+  {
+    if(itr->allocations == 0)
+      continue;
+    out << "Thread " << itr->thread << ": " << itr->allocations << " pixel buffer allocations ("
+        << itr->allocatedBytes / 1e6 << " MB), " << itr->poolHits << " from the buffer pool" << std::endl;
+  }
+  out.unsetf(std::ios::floatfield);
+}
+
+bool MicroCv::writeChromeTrace(const std::string& filename)
+{
+  std::ofstream out(filename);
+  if(!out)
+  {
+    std::cerr << "Could not write trace file: " << filename << std::endl;
+    return false;
+  }
+
+  // Timestamps are in microseconds, written with nanosecond digits: the 6 significant digits of the
+  // default format would round them to 10 us after the first second
+  out << std::fixed << std::setprecision(3);
+  out << "{\"traceEvents\": [";
+  bool first = true;
+  Registry& reg = registry();
+  std::lock_guard<std::mutex> registryLock(reg.mutex);
+  for(auto record = reg.threads.begin(); record != reg.threads.end(); ++record)
+  {
+    std::lock_guard<std::mutex> lock((*record)->mutex);
+    const int thread = (*record)->thread;
+    out << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread
+        << ", \"args\": {\"name\": \"" << (thread == 0 ? "main" : "thread " + std::to_string(thread)) << "\"}}";
+    first = false;
+    for(auto event = (*record)->events.begin(); event != (*record)->events.end(); ++event)
+    {
+      out << ",\n{\"name\": \"" << escapeJson(event->name) << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread
+          << ", \"ts\": " << event->startNs / 1000.0 << ", \"dur\": " << event->durationNs / 1000.0
+          << ", \"args\": {\"bytes\": " << event->bytes << "}}";
+    }
+  }
+  out << "\n]}" << std::endl;
+  return static_cast<bool>(out);
+}
+
+StageTimer::StageTimer(const char* name, uint64_t bytes)
+: name_(name)
+, bytes_(bytes)
+, startNs_(statsEnabled() ? nowNs() : -1)
+{
+}
+
+StageTimer::~StageTimer()
+{
+  if(startNs_ < 0)
+    return;
+  const int64_t durationNs = nowNs() - startNs_;
+  ThreadRecord& record = threadRecord();
+  std::lock_guard<std::mutex> lock(record.mutex);
+  StageCounters& counters = record.stages[name_];
+  counters.calls++;
+  counters.bytes += bytes_;
+  counters.nanoseconds += durationNs;
+  if(traceEnabled() && record.events.size() < MAX_EVENTS_PER_THREAD)
+  {
+    TraceEvent event = {name_, startNs_, durationNs, bytes_};
+    record.events.push_back(event);
+  }
+}
+
+void MicroCv::recordAllocation(size_t bytes, bool fromPool)
+{
+  if(!statsEnabled())
+    return;
+  ThreadRecord& record = threadRecord();
+  std::lock_guard<std::mutex> lock(record.mutex);
+  record.allocations++;
+  record.allocatedBytes += bytes;
+  if(fromPool)
+    record.poolHits++;
+}
+
+StatsSession::StatsSession(bool showStats, const std::string& traceFilename)
+: printStats_(showStats)
+, traceFilename_(traceFilename)
+{
+  // The calling thread registers first so it is shown as the main thread
+  threadRecord();
+  if(printStats_)
+    setStatsEnabled(true);
+  if(!traceFilename_.empty())
+    setTraceEnabled(true);
+}
+
+StatsSession::~StatsSession()
+{
+  if(printStats_)
+    printStats(std::cout);
+  if(!traceFilename_.empty())
+    writeChromeTrace(traceFilename_);
+}
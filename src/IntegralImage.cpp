@@ -0,0 +1,211 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <mutex>
+
+#include "CpuFeatures.h"
+#include "Instrumentation.h"
+#include "IntegralImage.h"
+#include "IntegralRows.h"
+#include "Parallel.h"
+#include "PlanarKernels.h"
+
+#ifdef MICROCV_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace MicroCv;
+
+namespace
+{
+  // out[x] = above[x] + the sum of the pixels left of x in this row, per channel. The first
+  // channels entries of out and above are the zero first column, x counts values of in
+  template<typename T>
+  void integrateRowScalar(const uint8_t* in, const T* above, T* out, int x, int count, int channels)
+  {
+    for(; x < count; x++)
+      out[x + channels] = out[x] - above[x] + above[x + channels] + in[x];
+  }
+
+#ifdef MICROCV_X86_SIMD
+  // Gray rows with 32 bit sums, the prefix sum of 4 pixels takes two shifted adds
+  __attribute__((target("sse2")))
+  int integrateGrayRowSse2(const uint8_t* in, const uint32_t* above, uint32_t* out, int x, int width)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    // Sum of the row so far in every lane
+    __m128i rowSum = zero;
+    for(; x + 16 <= width; x += 16)
+    {
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+      __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+      __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+      const __m128i pixels[] = {_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+          _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+      for(int i = 0; i < 4; i++)
+      {
+        __m128i sums = _mm_add_epi32(pixels[i], _mm_slli_si128(pixels[i], 4));
+        sums = _mm_add_epi32(_mm_add_epi32(sums, _mm_slli_si128(sums, 8)), rowSum);
+        rowSum = _mm_shuffle_epi32(sums, 0xFF);
+        const int offset = x + 4*i + 1;
+        __m128i aboveSums = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + offset));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + offset), _mm_add_epi32(sums, aboveSums));
+      }
+    }
+    return x;
+  }
+#endif
+}
+
+void MicroCv::Kernels::integrateRow(const uint8_t* in, const uint32_t* above, uint32_t* out, int width, int channels, SimdLevel level)
+{
+  std::fill(out, out + channels, 0);
+  int x = 0;
+#ifdef MICROCV_X86_SIMD
+  if(channels == 1 && level >= SimdSse2)
+    x = integrateGrayRowSse2(in, above, out, x, width);
+#else
+  (void)level;
+#endif
+  integrateRowScalar(in, above, out, x, width * channels, channels);
+}
+
+void MicroCv::Kernels::integrateRow(const uint8_t* in, const uint64_t* above, uint64_t* out, int width, int channels, SimdLevel)
+{
+  std::fill(out, out + channels, 0);
+  integrateRowScalar(in, above, out, 0, width * channels, channels);
+}
+
+template<typename T>
+MicroCv::IntegralImage<T>::IntegralImage()
+: width_(0)
+, height_(0)
+, channels_(0)
+{
+}
+
+template<typename T>
+MicroCv::IntegralImage<T>::IntegralImage(const MatView& view)
+: width_(0)
+, height_(0)
+, channels_(0)
+{
+  compute(view);
+}
+
+template<typename T>
+void MicroCv::IntegralImage<T>::compute(const MatView& view)
+{
+  MICROCV_STAGE("integralImage", static_cast<uint64_t>(view.width()) * view.height() * view.channels() * (1 + sizeof(T)));
+  // Only 8 bit pixels are summed
+  const bool isU8 = view.depth() == DepthU8;
+  width_ = isU8 ? view.width() : 0;
+  height_ = isU8 ? view.height() : 0;
+  channels_ = isU8 ? view.channels() : 0;
+  const size_t rowSize = static_cast<size_t>(width_ + 1) * channels_;
+  sums_.resize(rowSize * (height_ + 1));
+  std::fill(sums_.begin(), sums_.begin() + rowSize, 0);
+  if(width_ == 0 || height_ == 0)
+    return;
+
+  // Every band sums its rows as if it was the top of the image, then the sums of the bands
+  // above are carried down, like a parallel prefix sum over the rows
+  const SimdLevel level = simdLevel();
+  const std::vector<T> zeros(rowSize, 0);
+  std::vector<int> bandBegins(height_);
+  std::vector<RowBand> bands;
+  std::mutex bandsMutex;
+  parallelForRows(width_, height_, 0, [&](const RowBand& band)
+  {
+    MICROCV_STAGE("integralImage band", static_cast<uint64_t>(rowSize) * (1 + sizeof(T)) * (band.end - band.begin));
+    // The sums are interleaved, so the rows of planar views are merged first
+    std::vector<uint8_t> scratch(view.isPlanar() ? static_cast<size_t>(width_) * channels_ : 0);
+    for(int y = band.begin; y < band.end; y++)
+    {
+      const T* above = y == band.begin ? zeros.data() : sums_.data() + y*rowSize;
+      const uint8_t* row = Kernels::interleavedRow(view, y, scratch.data());
+      Kernels::integrateRow(row, above, sums_.data() + (y + 1)*rowSize, width_, channels_, level);
+      bandBegins[y] = band.begin;
+    }
+    std::lock_guard<std::mutex> lock(bandsMutex);
+    bands.push_back(band);
+  });
+  if(bands.size() <= 1)
+    return;
+
+  // Table row y + 1 sums image row y, so the last table row of every band above is its carry
+  std::sort(bands.begin(), bands.end(), [](const RowBand& a, const RowBand& b) { return a.begin < b.begin; });
+  for(const RowBand& band : bands)
+  {
+    T* last = sums_.data() + band.end*rowSize;
+    const T* carry = sums_.data() + band.begin*rowSize;
+    for(size_t i = 0; i < rowSize; i++)
+      last[i] += carry[i];
+  }
+  parallelForRows(width_, height_, 0, [&](const RowBand& band)
+  {
+    for(int y = band.begin; y < band.end; y++)
+    {
+      const int begin = bandBegins[y];
+      const bool isLastRow = y + 1 == height_ || bandBegins[y + 1] != begin;
+      if(begin == 0 || isLastRow)
+        continue;
+      T* sums = sums_.data() + (y + 1)*rowSize;
+      const T* carry = sums_.data() + begin*rowSize;
+      for(size_t i = 0; i < rowSize; i++)
+        sums[i] += carry[i];
+    }
+  });
+}
+
+template<typename T>
+int MicroCv::IntegralImage<T>::width() const
+{
+  return width_;
+}
+
+template<typename T>
+int MicroCv::IntegralImage<T>::height() const
+{
+  return height_;
+}
+
+template<typename T>
+int MicroCv::IntegralImage<T>::channels() const
+{
+  return channels_;
+}
+
+template<typename T>
+bool MicroCv::IntegralImage<T>::empty() const
+{
+  return width_ == 0 || height_ == 0;
+}
+
+template<typename T>
+const T* MicroCv::IntegralImage<T>::row(int y) const
+{
+  return sums_.data() + static_cast<size_t>(y) * (width_ + 1) * channels_;
+}
+
+template<typename T>
+T MicroCv::IntegralImage<T>::boxSum(int x1, int y1, int x2, int y2, int channel) const
+{
+  x1 = std::max(x1, 0);
+  y1 = std::max(y1, 0);
+  x2 = std::min(x2, width_);
+  y2 = std::min(y2, height_);
+  if(x1 >= x2 || y1 >= y2 || channel < 0 || channel >= channels_)
+    return 0;
+
+  // Unsigned differences, exact even when the table has wrapped around
+  const T* top = row(y1);
+  const T* bottom = row(y2);
+  return bottom[x2*channels_ + channel] - bottom[x1*channels_ + channel] - top[x2*channels_ + channel]
+      + top[x1*channels_ + channel];
+}
+
+template class MicroCv::IntegralImage<uint32_t>;
+template class MicroCv::IntegralImage<uint64_t>;
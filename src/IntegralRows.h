@@ -0,0 +1,72 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "CpuFeatures.h"
+#include "Mat.h"
+
+namespace MicroCv
+{
+namespace Kernels
+{
+// Table row y + 1 of an integral image: above is table row y and in is image row y
+void integrateRow(const uint8_t* in, const uint32_t* above, uint32_t* out, int width, int channels, SimdLevel level);
+void integrateRow(const uint8_t* in, const uint64_t* above, uint64_t* out, int width, int channels, SimdLevel level);
+
+/*
+ * IntegralRows streams the table rows of an integral image (see IntegralImage.h) from firstRow
+ * down, keeping only the last count rows in a ring buffer. Table row firstRow is zero instead of
+ * the sum of the rows above it, which box sums never notice as long as both of their rows are at
+ * or below firstRow. So a band of a box filter only sums its own rows and halo, and the ring
+ * stays small enough for the cache while the whole table of a large image would not.
+ */
+template<typename T>
+class IntegralRows
+{
+public:
+  IntegralRows(const MatView& view, int firstRow, int count)
+  : view_(view)
+  , rowSize_(static_cast<size_t>(view.width() + 1) * view.channels())
+  , firstRow_(firstRow)
+  , lastRow_(firstRow)
+  , count_(count)
+  , level_(simdLevel())
+  , rows_(rowSize_ * count)
+  {
+    std::fill(rows_.begin(), rows_.begin() + rowSize_, 0);
+  }
+
+  // Compute the table rows up to y, which never goes back
+  void advanceTo(int y)
+  {
+    for(; lastRow_ < y; lastRow_++)
+      integrateRow(view_.row(lastRow_), slot(lastRow_), slot(lastRow_ + 1), view_.width(), view_.channels(), level_);
+  }
+
+  // Table row y, one of the last count computed rows
+  const T* row(int y) const
+  {
+    return rows_.data() + static_cast<size_t>((y - firstRow_) % count_) * rowSize_;
+  }
+
+private:
+  T* slot(int y)
+  {
+    return rows_.data() + static_cast<size_t>((y - firstRow_) % count_) * rowSize_;
+  }
+
+  const MatView& view_;
+  size_t rowSize_;
+  int firstRow_;
+  int lastRow_;
+  int count_;
+  SimdLevel level_;
+  std::vector<T> rows_;
+};
+};
+};
@@ -0,0 +1,307 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <csetjmp>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "ImageCodecs.h"
+
+using namespace MicroCv::Codecs;
+
+namespace
+{
+  // libjpeg calls error_exit on fatal errors, by default that exits the process
+  // so we jump back to the decoder method that made the failing call instead
+  struct JpegErrorManager
+  {
+    jpeg_error_mgr pub;
+    jmp_buf jumpBuffer;
+  };
+
+  void jpegErrorExit(j_common_ptr cinfo)
+  {
+    JpegErrorManager* error = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+    char message[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, message);
+    std::cerr << "ERROR: " << message << std::endl;
+    longjmp(error->jumpBuffer, 1);
+  }
+
+  void jpegSilenceMessage(j_common_ptr)
+  {
+  }
+
+  // Number of scanlines handed to libjpeg per call
+  const int JPEG_ROWS_PER_CALL = 16;
+
+  class JpegDecoder : public ImageDecoder
+  {
+  public:
+    JpegDecoder()
+    : file_(nullptr)
+    , started_(false)
+    , regionX_(0)
+    , regionY_(0)
+    , columnOffset_(0)
+    , rowsRead_(0)
+    {
+      cinfo_.err = jpeg_std_error(&error_.pub);
+      error_.pub.error_exit = jpegErrorExit;
+      error_.pub.output_message = jpegSilenceMessage;
+      jpeg_create_decompress(&cinfo_);
+    }
+
+    ~JpegDecoder()
+    {
+      jpeg_destroy_decompress(&cinfo_);
+      if(file_)
+        fclose(file_);
+    }
+
+    bool open(const std::string& filename)
+    {
+      file_ = fopen(filename.c_str(), "rb");
+      if(!file_)
+      {
+        std::cerr << "ERROR: could not open " << filename << std::endl;
+        return false;
+      }
+      if(setjmp(error_.jumpBuffer))
+        return false;
+
+      jpeg_stdio_src(&cinfo_, file_);
+      jpeg_read_header(&cinfo_, TRUE);
+
+      // Gray JPEGs stay gray, libjpeg converts YCbCr to RGB for everything else
+      if(cinfo_.jpeg_color_space == JCS_GRAYSCALE)
+      {
+        cinfo_.out_color_space = JCS_GRAYSCALE;
+        channels_ = 1;
+      }
+      else if(cinfo_.jpeg_color_space == JCS_CMYK || cinfo_.jpeg_color_space == JCS_YCCK)
+      {
+        std::cerr << "ERROR: CMYK JPEG images are not supported" << std::endl;
+        return false;
+      }
+      else
+      {
+        cinfo_.out_color_space = JCS_RGB;
+        channels_ = 3;
+      }
+
+      // Decompression starts with the first row so that a scale can still be set
+      jpeg_calc_output_dimensions(&cinfo_);
+      width_ = cinfo_.output_width;
+      height_ = cinfo_.output_height;
+      return true;
+    }
+
+    bool setScale(int denominator)
+    {
+      if(started_)
+        return false;
+      if(setjmp(error_.jumpBuffer))
+        return false;
+
+      // The DCT is evaluated at the reduced size, so a 1/8 scale skips most of the decoding work
+      cinfo_.scale_num = 1;
+      cinfo_.scale_denom = denominator;
+      jpeg_calc_output_dimensions(&cinfo_);
+      width_ = cinfo_.output_width;
+      height_ = cinfo_.output_height;
+      return true;
+    }
+
+    bool setRegion(int x1, int y1, int x2, int y2)
+    {
+      if(started_)
+        return false;
+      regionX_ = x1;
+      regionY_ = y1;
+      width_ = x2 - x1;
+      height_ = y2 - y1;
+      return true;
+    }
+
+    bool readRows(uint8_t* dst, int stride, int numRows)
+    {
+      if(rowsRead_ + numRows > height_)
+        return false;
+      if(setjmp(error_.jumpBuffer))
+        return false;
+      if(!started_)
+        start();
+
+      // libjpeg writes the scanlines directly into the destination rows, unless the decoded
+      // columns around a region have to be cut off
+      const bool direct = cinfo_.output_width == static_cast<JDIMENSION>(width_);
+      if(!direct)
+        scratchRows_.resize(static_cast<size_t>(cinfo_.output_width) * channels_ * JPEG_ROWS_PER_CALL);
+      const size_t scratchStride = static_cast<size_t>(cinfo_.output_width) * channels_;
+      JSAMPROW rowPtrs[JPEG_ROWS_PER_CALL];
+      int row = 0;
+      while(row < numRows)
+      {
+        const int batch = numRows - row < JPEG_ROWS_PER_CALL ? numRows - row : JPEG_ROWS_PER_CALL;
+        for(int i = 0; i < batch; i++)
+          rowPtrs[i] = direct ? dst + static_cast<ptrdiff_t>(row + i) * stride : scratchRows_.data() + i * scratchStride;
+        const int rowsDecoded = jpeg_read_scanlines(&cinfo_, rowPtrs, batch);
+        if(rowsDecoded == 0)
+          return false;
+        for(int i = 0; !direct && i < rowsDecoded; i++)
+        {
+          std::memcpy(dst + static_cast<ptrdiff_t>(row + i) * stride, rowPtrs[i] + columnOffset_ * channels_,
+              static_cast<size_t>(width_) * channels_);
+        }
+        row += rowsDecoded;
+      }
+      rowsRead_ += numRows;
+      if(rowsRead_ == height_)
+      {
+        // The rows below a region are never decoded
+        if(cinfo_.output_scanline < cinfo_.output_height)
+          jpeg_abort_decompress(&cinfo_);
+        else
+          jpeg_finish_decompress(&cinfo_);
+      }
+      return true;
+    }
+
+  private:
+    void start()
+    {
+      jpeg_start_decompress(&cinfo_);
+      started_ = true;
+      if(width_ == static_cast<int>(cinfo_.output_width) && height_ == static_cast<int>(cinfo_.output_height))
+        return;
+
+      // Only the iMCU columns that intersect the region are decoded and the rows above it are skipped
+      // The chroma upsampling treats the cropped columns as the image edge, so a margin of one iMCU
+      // (at full scale) is kept on both sides to decode the region exactly like the whole image
+      const int margin = cinfo_.max_h_samp_factor * DCTSIZE;
+      const int x1 = std::max(0, regionX_ - margin);
+      const int x2 = std::min(static_cast<int>(cinfo_.output_width), regionX_ + width_ + margin);
+      JDIMENSION xOffset = x1;
+      JDIMENSION cropWidth = x2 - x1;
+      jpeg_crop_scanline(&cinfo_, &xOffset, &cropWidth);
+      columnOffset_ = regionX_ - static_cast<int>(xOffset);
+      if(regionY_ > 0)
+        jpeg_skip_scanlines(&cinfo_, regionY_);
+    }
+
+    jpeg_decompress_struct cinfo_;
+    JpegErrorManager error_;
+    FILE* file_;
+    bool started_;
+    int regionX_;
+    int regionY_;
+    int columnOffset_;
+    int rowsRead_;
+    std::vector<uint8_t> scratchRows_;
+  };
+
+  // Same quality as the GIL writer used before
+  const int JPEG_QUALITY = 100;
+
+  class JpegEncoder : public ImageEncoder
+  {
+  public:
+    JpegEncoder()
+    : file_(nullptr)
+    , started_(false)
+    {
+      cinfo_.err = jpeg_std_error(&error_.pub);
+      error_.pub.error_exit = jpegErrorExit;
+      error_.pub.output_message = jpegSilenceMessage;
+      jpeg_create_compress(&cinfo_);
+    }
+
+    ~JpegEncoder()
+    {
+      jpeg_destroy_compress(&cinfo_);
+      if(file_)
+        fclose(file_);
+    }
+
+    bool open(const std::string& filename, int width, int height, int channels)
+    {
+      file_ = fopen(filename.c_str(), "wb");
+      if(!file_)
+      {
+        std::cerr << "ERROR: could not create " << filename << std::endl;
+        return false;
+      }
+      if(setjmp(error_.jumpBuffer))
+        return false;
+
+      jpeg_stdio_dest(&cinfo_, file_);
+      cinfo_.image_width = width;
+      cinfo_.image_height = height;
+      cinfo_.input_components = channels;
+      cinfo_.in_color_space = channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+      jpeg_set_defaults(&cinfo_);
+      jpeg_set_quality(&cinfo_, JPEG_QUALITY, TRUE);
+      jpeg_start_compress(&cinfo_, TRUE);
+      started_ = true;
+      return true;
+    }
+
+    bool writeRows(const uint8_t* src, int stride, int numRows)
+    {
+      if(setjmp(error_.jumpBuffer))
+        return false;
+
+      // libjpeg reads the scanlines directly from the source rows (it does not modify them)
+      JSAMPROW rowPtrs[JPEG_ROWS_PER_CALL];
+      int row = 0;
+      while(row < numRows)
+      {
+        const int batch = numRows - row < JPEG_ROWS_PER_CALL ? numRows - row : JPEG_ROWS_PER_CALL;
+        for(int i = 0; i < batch; i++)
+          rowPtrs[i] = const_cast<uint8_t*>(src + static_cast<ptrdiff_t>(row + i) * stride);
+        const int rowsEncoded = jpeg_write_scanlines(&cinfo_, rowPtrs, batch);
+        if(rowsEncoded == 0)
+          return false;
+        row += rowsEncoded;
+      }
+      return true;
+    }
+
+    bool close()
+    {
+      if(!started_)
+        return false;
+      if(setjmp(error_.jumpBuffer))
+        return false;
+
+      jpeg_finish_compress(&cinfo_);
+      const bool ok = fclose(file_) == 0;
+      file_ = nullptr;
+      return ok;
+    }
+
+  private:
+    jpeg_compress_struct cinfo_;
+    JpegErrorManager error_;
+    FILE* file_;
+    bool started_;
+  };
+}
+
+std::unique_ptr<ImageDecoder> MicroCv::Codecs::createJpegDecoder()
+{
+  return std::unique_ptr<ImageDecoder>(new JpegDecoder());
+}
+
+std::unique_ptr<ImageEncoder> MicroCv::Codecs::createJpegEncoder()
+{
+  return std::unique_ptr<ImageEncoder>(new JpegEncoder());
+}
@@ -0,0 +1,249 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include "CpuFeatures.h"
+#include "LumaKernels.h"
+#include "RgbShuffles.h"
+
+#ifdef MICROCV_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace MicroCv;
+
+namespace
+{
+  // 21846 / 2^16 is just above 1/3, which gives floor((r+g+b) / 3) for every possible sum
+  const Kernels::LumaCoefficients AVERAGE_COEFFS = {21846, 21846, 21846, 0, 16};
+  // ITU-R BT.601 (0.299, 0.587, 0.114) and BT.709 (0.2126, 0.7152, 0.0722) scaled by 2^14
+  const Kernels::LumaCoefficients BT601_COEFFS = {4899, 9617, 1868, 8192, 14};
+  const Kernels::LumaCoefficients BT709_COEFFS = {3483, 11718, 1183, 8192, 14};
+
+  void rgbRowToGrayScalar(const uint8_t* in, uint8_t* out, int width, const Kernels::LumaCoefficients& c)
+  {
+    for(int x = 0; x < width; x++, in += 3, out++)
+    {
+      const int32_t sum = in[0]*c.r + in[1]*c.g + in[2]*c.b + c.round;
+      *out = static_cast<uint8_t>(sum >> c.shift);
+    }
+  }
+
+  void planarRowToGrayScalar(const uint8_t* r, const uint8_t* g, const uint8_t* b, uint8_t* out, int x, int width,
+      const Kernels::LumaCoefficients& c)
+  {
+    for(; x < width; x++)
+    {
+      const int32_t sum = r[x]*c.r + g[x]*c.g + b[x]*c.b + c.round;
+      out[x] = static_cast<uint8_t>(sum >> c.shift);
+    }
+  }
+
+#ifdef MICROCV_X86_SIMD
+  // Luma of 4 pixels - rg holds (r, g) int16 pairs and b1 holds (b, 1) pairs
+  __attribute__((target("sse2")))
+  inline __m128i luma4(__m128i rg, __m128i b1, __m128i wRg, __m128i wB1, __m128i shift)
+  {
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(rg, wRg), _mm_madd_epi16(b1, wB1));
+    return _mm_srl_epi32(sum, shift);
+  }
+
+  // Luma of 16 pixels given as planar R, G and B bytes
+  __attribute__((target("sse2")))
+  inline __m128i luma16(__m128i r, __m128i g, __m128i b, __m128i wRg, __m128i wB1, __m128i shift)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i rLo = _mm_unpacklo_epi8(r, zero);
+    const __m128i rHi = _mm_unpackhi_epi8(r, zero);
+    const __m128i gLo = _mm_unpacklo_epi8(g, zero);
+    const __m128i gHi = _mm_unpackhi_epi8(g, zero);
+    const __m128i bLo = _mm_unpacklo_epi8(b, zero);
+    const __m128i bHi = _mm_unpackhi_epi8(b, zero);
+
+    __m128i y0 = luma4(_mm_unpacklo_epi16(rLo, gLo), _mm_unpacklo_epi16(bLo, one), wRg, wB1, shift);
+    __m128i y1 = luma4(_mm_unpackhi_epi16(rLo, gLo), _mm_unpackhi_epi16(bLo, one), wRg, wB1, shift);
+    __m128i y2 = luma4(_mm_unpacklo_epi16(rHi, gHi), _mm_unpacklo_epi16(bHi, one), wRg, wB1, shift);
+    __m128i y3 = luma4(_mm_unpackhi_epi16(rHi, gHi), _mm_unpackhi_epi16(bHi, one), wRg, wB1, shift);
+    return _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3));
+  }
+
+  __attribute__((target("sse2")))
+  void rgbRowToGraySse2(const uint8_t* in, uint8_t* out, int width, const Kernels::LumaCoefficients& c)
+  {
+    const __m128i wRg = _mm_set_epi16(c.g, c.r, c.g, c.r, c.g, c.r, c.g, c.r);
+    const __m128i wB1 = _mm_set_epi16(c.round, c.b, c.round, c.b, c.round, c.b, c.round, c.b);
+    const __m128i shift = _mm_cvtsi32_si128(c.shift);
+
+    int x = 0;
+    for(; x + 16 <= width; x += 16, in += 48, out += 16)
+    {
+      __m128i t00 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+      __m128i t01 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16));
+      __m128i t02 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 32));
+
+      // Without byte shuffles the channels are separated by 4 rounds of interleaving
+      __m128i t10 = _mm_unpacklo_epi8(t00, _mm_unpackhi_epi64(t01, t01));
+      __m128i t11 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t00, t00), t02);
+      __m128i t12 = _mm_unpacklo_epi8(t01, _mm_unpackhi_epi64(t02, t02));
+
+      __m128i t20 = _mm_unpacklo_epi8(t10, _mm_unpackhi_epi64(t11, t11));
+      __m128i t21 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t10, t10), t12);
+      __m128i t22 = _mm_unpacklo_epi8(t11, _mm_unpackhi_epi64(t12, t12));
+
+      __m128i t30 = _mm_unpacklo_epi8(t20, _mm_unpackhi_epi64(t21, t21));
+      __m128i t31 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t20, t20), t22);
+      __m128i t32 = _mm_unpacklo_epi8(t21, _mm_unpackhi_epi64(t22, t22));
+
+      __m128i r = _mm_unpacklo_epi8(t30, _mm_unpackhi_epi64(t31, t31));
+      __m128i g = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t30, t30), t32);
+      __m128i b = _mm_unpacklo_epi8(t31, _mm_unpackhi_epi64(t32, t32));
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), luma16(r, g, b, wRg, wB1, shift));
+    }
+    rgbRowToGrayScalar(in, out, width - x, c);
+  }
+
+  // Planar rows need no shuffles, so SSE2 is as fast as SSSE3 here
+  __attribute__((target("sse2")))
+  int planarRowToGraySse2(const uint8_t* r, const uint8_t* g, const uint8_t* b, uint8_t* out, int x, int width,
+      const Kernels::LumaCoefficients& c)
+  {
+    const __m128i wRg = _mm_set_epi16(c.g, c.r, c.g, c.r, c.g, c.r, c.g, c.r);
+    const __m128i wB1 = _mm_set_epi16(c.round, c.b, c.round, c.b, c.round, c.b, c.round, c.b);
+    const __m128i shift = _mm_cvtsi32_si128(c.shift);
+    for(; x + 16 <= width; x += 16)
+    {
+      const __m128i gray = luma16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r + x)),
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(g + x)),
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x)), wRg, wB1, shift);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), gray);
+    }
+    return x;
+  }
+
+  __attribute__((target("ssse3")))
+  void rgbRowToGraySsse3(const uint8_t* in, uint8_t* out, int width, const Kernels::LumaCoefficients& c)
+  {
+    const __m128i wRg = _mm_set_epi16(c.g, c.r, c.g, c.r, c.g, c.r, c.g, c.r);
+    const __m128i wB1 = _mm_set_epi16(c.round, c.b, c.round, c.b, c.round, c.b, c.round, c.b);
+    const __m128i shift = _mm_cvtsi32_si128(c.shift);
+
+    int x = 0;
+    for(; x + 16 <= width; x += 16, in += 48, out += 16)
+    {
+      __m128i r, g, b;
+      Kernels::splitRgbSsse3(in, r, g, b);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), luma16(r, g, b, wRg, wB1, shift));
+    }
+    rgbRowToGrayScalar(in, out, width - x, c);
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i luma8Avx2(__m256i rg, __m256i b1, __m256i wRg, __m256i wB1, __m128i shift)
+  {
+    __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(rg, wRg), _mm256_madd_epi16(b1, wB1));
+    return _mm256_srl_epi32(sum, shift);
+  }
+
+  // Luma of 32 pixels given as planar R, G and B bytes
+  __attribute__((target("avx2")))
+  inline __m256i luma32Avx2(__m256i r, __m256i g, __m256i b, __m256i wRg, __m256i wB1, __m128i shift)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    // Unpacking and packing are both in-lane, so the pixel order comes back out unchanged
+    const __m256i rLo = _mm256_unpacklo_epi8(r, zero);
+    const __m256i rHi = _mm256_unpackhi_epi8(r, zero);
+    const __m256i gLo = _mm256_unpacklo_epi8(g, zero);
+    const __m256i gHi = _mm256_unpackhi_epi8(g, zero);
+    const __m256i bLo = _mm256_unpacklo_epi8(b, zero);
+    const __m256i bHi = _mm256_unpackhi_epi8(b, zero);
+
+    __m256i y0 = luma8Avx2(_mm256_unpacklo_epi16(rLo, gLo), _mm256_unpacklo_epi16(bLo, one), wRg, wB1, shift);
+    __m256i y1 = luma8Avx2(_mm256_unpackhi_epi16(rLo, gLo), _mm256_unpackhi_epi16(bLo, one), wRg, wB1, shift);
+    __m256i y2 = luma8Avx2(_mm256_unpacklo_epi16(rHi, gHi), _mm256_unpacklo_epi16(bHi, one), wRg, wB1, shift);
+    __m256i y3 = luma8Avx2(_mm256_unpackhi_epi16(rHi, gHi), _mm256_unpackhi_epi16(bHi, one), wRg, wB1, shift);
+    return _mm256_packus_epi16(_mm256_packs_epi32(y0, y1), _mm256_packs_epi32(y2, y3));
+  }
+
+  __attribute__((target("avx2")))
+  void rgbRowToGrayAvx2(const uint8_t* in, uint8_t* out, int width, const Kernels::LumaCoefficients& c)
+  {
+    const __m256i wRg = _mm256_set1_epi32((static_cast<uint16_t>(c.g) << 16) | static_cast<uint16_t>(c.r));
+    const __m256i wB1 = _mm256_set1_epi32((static_cast<uint16_t>(c.round) << 16) | static_cast<uint16_t>(c.b));
+    const __m128i shift = _mm_cvtsi32_si128(c.shift);
+
+    int x = 0;
+    for(; x + 32 <= width; x += 32, in += 96, out += 32)
+    {
+      __m256i r, g, b;
+      Kernels::splitRgbAvx2(in, r, g, b);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), luma32Avx2(r, g, b, wRg, wB1, shift));
+    }
+    rgbRowToGraySsse3(in, out, width - x, c);
+  }
+
+  __attribute__((target("avx2")))
+  int planarRowToGrayAvx2(const uint8_t* r, const uint8_t* g, const uint8_t* b, uint8_t* out, int x, int width,
+      const Kernels::LumaCoefficients& c)
+  {
+    const __m256i wRg = _mm256_set1_epi32((static_cast<uint16_t>(c.g) << 16) | static_cast<uint16_t>(c.r));
+    const __m256i wB1 = _mm256_set1_epi32((static_cast<uint16_t>(c.round) << 16) | static_cast<uint16_t>(c.b));
+    const __m128i shift = _mm_cvtsi32_si128(c.shift);
+    for(; x + 32 <= width; x += 32)
+    {
+      const __m256i gray = luma32Avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + x)),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(g + x)),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + x)), wRg, wB1, shift);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), gray);
+    }
+    return x;
+  }
+
+#endif
+}
+
+Kernels::LumaCoefficients Kernels::lumaCoefficients(GrayConversion conversion)
+{
+  if(conversion == GrayBt601)
+    return BT601_COEFFS;
+  if(conversion == GrayBt709)
+    return BT709_COEFFS;
+  return AVERAGE_COEFFS;
+}
+
+void Kernels::rgbRowToGray(const uint8_t* rgbRow, uint8_t* grayRow, int width, const LumaCoefficients& coeffs)
+{
+#ifdef MICROCV_X86_SIMD
+  switch(simdLevel())
+  {
+    case SimdAvx2:
+      rgbRowToGrayAvx2(rgbRow, grayRow, width, coeffs);
+      return;
+    case SimdSsse3:
+      rgbRowToGraySsse3(rgbRow, grayRow, width, coeffs);
+      return;
+    case SimdSse2:
+      rgbRowToGraySse2(rgbRow, grayRow, width, coeffs);
+      return;
+    default:
+      break;
+  }
+#endif
+  rgbRowToGrayScalar(rgbRow, grayRow, width, coeffs);
+}
+
+void Kernels::planarRowToGray(const uint8_t* rRow, const uint8_t* gRow, const uint8_t* bRow, uint8_t* grayRow, int width,
+    const LumaCoefficients& coeffs)
+{
+  int x = 0;
+#ifdef MICROCV_X86_SIMD
+  const SimdLevel level = simdLevel();
+  if(level >= SimdAvx2)
+    x = planarRowToGrayAvx2(rRow, gRow, bRow, grayRow, x, width, coeffs);
+  if(level >= SimdSse2)
+    x = planarRowToGraySse2(rRow, gRow, bRow, grayRow, x, width, coeffs);
+#endif
+  planarRowToGrayScalar(rRow, gRow, bRow, grayRow, x, width, coeffs);
+}
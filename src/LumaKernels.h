@@ -0,0 +1,33 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+
+#include "ImageProcessing.h"
+
+namespace MicroCv
+{
+namespace Kernels
+{
+  // Fixed point luma weights: gray = (r*r + g*g + b*b + round) >> shift
+  // The scalar and SIMD kernels use the same integer math so they are bit-exact
+  struct LumaCoefficients
+  {
+    int16_t r;
+    int16_t g;
+    int16_t b;
+    int16_t round;
+    int shift;
+  };
+
+  LumaCoefficients lumaCoefficients(GrayConversion conversion);
+
+  // Convert one row of packed RGB pixels to gray, dispatched on simdLevel()
+  void rgbRowToGray(const uint8_t* rgbRow, uint8_t* grayRow, int width, const LumaCoefficients& coeffs);
+  // Same conversion of one row of each of the R, G and B planes of a planar image
+  void planarRowToGray(const uint8_t* rRow, const uint8_t* gRow, const uint8_t* bRow, uint8_t* grayRow, int width,
+      const LumaCoefficients& coeffs);
+};
+};
@@ -0,0 +1,93 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ImageCodecs.h"
+#include "MappedImage.h"
+
+using namespace MicroCv;
+
+MappedImage::MappedImage()
+: mapping_(nullptr)
+, mappingSize_(0)
+{
+}
+
+MappedImage::~MappedImage()
+{
+  close();
+}
+
+bool MappedImage::open(const std::string& filename)
+{
+  close();
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if(fd < 0)
+  {
+    std::cerr << "Could not open " << filename << std::endl;
+    return false;
+  }
+  struct stat fileStat;
+  if(fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0)
+  {
+    std::cerr << "Could not map " << filename << std::endl;
+    ::close(fd);
+    return false;
+  }
+  const size_t fileSize = static_cast<size_t>(fileStat.st_size);
+  void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file
+  ::close(fd);
+  if(mapping == MAP_FAILED)
+  {
+    std::cerr << "Could not map " << filename << std::endl;
+    return false;
+  }
+
+  const uint8_t* data = static_cast<const uint8_t*>(mapping);
+  const size_t headerSize = std::min(fileSize, Codecs::MAX_RAW_HEADER_SIZE);
+  Codecs::RawLayout layout;
+  const bool isRaw = Codecs::parseMcvHeader(data, headerSize, fileSize, layout)
+      || Codecs::parsePnmHeader(data, headerSize, fileSize, layout);
+  // Fewer levels than 255 would need every pixel rescaled, which readMatFromFile() does
+  if(!isRaw || layout.maxValue != 255)
+  {
+    std::cerr << filename << " is not a .mcv or 8 bit binary PGM/PPM file" << std::endl;
+    munmap(mapping, fileSize);
+    return false;
+  }
+  // The rows are read front to back by most image processing functions
+  madvise(mapping, fileSize, MADV_SEQUENTIAL);
+
+  mapping_ = mapping;
+  mappingSize_ = fileSize;
+  view_ = MatView(data + layout.dataOffset, layout.width, layout.height, layout.channels, layout.stride);
+  return true;
+}
+
+void MappedImage::close()
+{
+  if(mapping_)
+    munmap(mapping_, mappingSize_);
+  mapping_ = nullptr;
+  mappingSize_ = 0;
+  view_ = MatView();
+}
+
+bool MappedImage::isOpen() const
+{
+  return mapping_ != nullptr;
+}
+
+MatView MappedImage::view() const
+{
+  return view_;
+}
@@ -2,16 +2,36 @@
  *  Micro Computer Vision library
  *  @author Andrei Polzounov
  */
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <utility>
 
 #include "Mat.h"
 
 using namespace MicroCv;
 
+int MicroCv::depthSize(MatDepth depth)
+{
+  if(depth == DepthF32)
+    return 4;
+  return depth == DepthU8 ? 1 : 2;
+}
+
+int MicroCv::alignedStride(int width, int channels)
+{
+  const int alignment = static_cast<int>(PIXEL_ALIGNMENT);
+  return (width*channels + alignment - 1) / alignment * alignment;
+}
+
 Mat::Mat()
 : width_(0)
 , height_(0)
 , channels_(0)
+, stride_(0)
+, planeStride_(0)
+, depth_(DepthU8)
 {
 }
 
@@ -20,12 +40,90 @@ Mat::Mat(const Mat& rhs)
 , width_(rhs.width_)
 , height_(rhs.height_)
 , channels_(rhs.channels_)
+, stride_(rhs.stride_)
+, planeStride_(rhs.planeStride_)
+, depth_(rhs.depth_)
+{
+}
+
+Mat::Mat(Mat&& rhs) noexcept
+: data_(std::move(rhs.data_))
+, width_(rhs.width_)
+, height_(rhs.height_)
+, channels_(rhs.channels_)
+, stride_(rhs.stride_)
+, planeStride_(rhs.planeStride_)
+, depth_(rhs.depth_)
 {
+  rhs.width_ = rhs.height_ = rhs.channels_ = rhs.stride_ = 0;
+  rhs.planeStride_ = 0;
+  rhs.depth_ = DepthU8;
 }
 
 Mat::Mat(int width, int height, int channels)
+: width_(0)
+, height_(0)
+, channels_(0)
+, stride_(0)
+, planeStride_(0)
+, depth_(DepthU8)
 {
   resize(width, height, channels);
+  std::fill(data_->begin(), data_->end(), 0);
+}
+
+Mat::Mat(int width, int height, int channels, MatLayout layout)
+: width_(0)
+, height_(0)
+, channels_(0)
+, stride_(0)
+, planeStride_(0)
+, depth_(DepthU8)
+{
+  resize(width, height, channels, layout);
+  std::fill(data_->begin(), data_->end(), 0);
+}
+
+Mat::Mat(int width, int height, int channels, MatDepth depth)
+: width_(0)
+, height_(0)
+, channels_(0)
+, stride_(0)
+, planeStride_(0)
+, depth_(DepthU8)
+{
+  resize(width, height, channels, depth);
+  std::fill(data_->begin(), data_->end(), 0);
+}
+
+Mat::Mat(const MatView& view)
+: width_(0)
+, height_(0)
+, channels_(0)
+, stride_(0)
+, planeStride_(0)
+, depth_(DepthU8)
+{
+  if(view.depth() != DepthU8)
+    resize(view.width(), view.height(), view.channels(), view.depth());
+  else
+    resize(view.width(), view.height(), view.channels(), view.layout());
+  // Copy row by row since the view may have gaps between its rows
+  if(isPlanar())
+  {
+    for(int c = 0; c < channels_; c++)
+    {
+      const MatView inPlane = view.plane(c);
+      for(int y = 0; y < height_; y++)
+        std::memcpy(plane(c) + static_cast<size_t>(y) * stride_, inPlane.row(y), width_);
+    }
+    return;
+  }
+  const size_t rowBytes = static_cast<size_t>(width_) * channels_ * elementSize();
+  for(int y = 0; y < height_; y++)
+  {
+    std::memcpy(row(y), view.row(y), rowBytes);
+  }
 }
 
 Mat::~Mat()
@@ -38,13 +136,54 @@ Mat& Mat::operator=(const Mat& rhs)
   width_ = rhs.width_;
   height_ = rhs.height_;
   channels_ = rhs.channels_;
+  stride_ = rhs.stride_;
+  planeStride_ = rhs.planeStride_;
+  depth_ = rhs.depth_;
+  return *this;
+}
+
+Mat& Mat::operator=(Mat&& rhs) noexcept
+{
+  data_ = std::move(rhs.data_);
+  width_ = rhs.width_;
+  height_ = rhs.height_;
+  channels_ = rhs.channels_;
+  stride_ = rhs.stride_;
+  planeStride_ = rhs.planeStride_;
+  depth_ = rhs.depth_;
+  if(this != &rhs)
+  {
+    rhs.width_ = rhs.height_ = rhs.channels_ = rhs.stride_ = 0;
+    rhs.planeStride_ = 0;
+    rhs.depth_ = DepthU8;
+  }
   return *this;
 }
 
 bool Mat::operator==(const Mat& rhs) const
 {
-  return (width_ == rhs.width_) && (height_ == rhs.height_)
-      && (channels_ == rhs.channels_) && (data_ == rhs.data_);
+  if((width_ != rhs.width_) || (height_ != rhs.height_) || (channels_ != rhs.channels_) || (layout() != rhs.layout())
+      || (depth_ != rhs.depth_))
+    return false;
+  if(data() == rhs.data() && stride_ == rhs.stride_)
+    return true;
+  if(isPlanar())
+  {
+    for(int c = 0; c < channels_; c++)
+    {
+      if(std::memcmp(plane(c), rhs.plane(c), static_cast<size_t>(width_) * height_) != 0)
+        return false;
+    }
+    return true;
+  }
+  // Only the pixels are compared, not the padding at the end of the rows
+  const size_t rowBytes = static_cast<size_t>(width_) * channels_ * elementSize();
+  for(int y = 0; y < height_; y++)
+  {
+    if(std::memcmp(row(y), rhs.row(y), rowBytes) != 0)
+      return false;
+  }
+  return true;
 }
 
 bool Mat::isGrayscale() const
@@ -54,12 +193,38 @@ bool Mat::isGrayscale() const
 
 uint8_t* Mat::data()
 {
-  return data_.data();
+  detach();
+  return data_->data();
 }
 
 const uint8_t* Mat::data() const
 {
-  return data_.data();
+  return data_ ? data_->data() : nullptr;
+}
+
+uint8_t* Mat::row(int y)
+{
+  return data() + static_cast<ptrdiff_t>(y) * stride_;
+}
+
+const uint8_t* Mat::row(int y) const
+{
+  return data() + static_cast<ptrdiff_t>(y) * stride_;
+}
+
+uint8_t* Mat::plane(int channel)
+{
+  return data() + static_cast<size_t>(channel) * planeStride_;
+}
+
+const uint8_t* Mat::plane(int channel) const
+{
+  return data() + static_cast<size_t>(channel) * planeStride_;
+}
+
+bool Mat::isShared() const
+{
+  return data_ && data_.use_count() > 1;
 }
 
 int Mat::width() const
@@ -77,25 +242,259 @@ int Mat::channels() const
   return channels_;
 }
 
-std::vector<uint8_t>* Mat::vectorPtr()
+int Mat::stride() const
+{
+  return stride_;
+}
+
+bool Mat::isContinuous() const
+{
+  return stride_ == width_ * (isPlanar() ? 1 : channels_ * elementSize());
+}
+
+MatLayout Mat::layout() const
+{
+  return planeStride_ > 0 ? LayoutPlanar : LayoutInterleaved;
+}
+
+bool Mat::isPlanar() const
+{
+  return planeStride_ > 0;
+}
+
+size_t Mat::planeStride() const
+{
+  return planeStride_;
+}
+
+MatDepth Mat::depth() const
 {
-  return &data_;
+  return depth_;
+}
+
+int Mat::elementSize() const
+{
+  return depthSize(depth_);
+}
+
+PixelBuffer* Mat::vectorPtr()
+{
+  detach();
+  return data_.get();
 }
 
 void Mat::resize(int width, int height, int channels)
 {
-  data_.clear();
+  resize(width, height, channels, width*channels);
+}
+
+void Mat::resize(int width, int height, int channels, int stride)
+{
+  width_ = width;
+  height_ = height;
+  channels_ = channels;
+  stride_ = std::max(stride, width*channels);
+  planeStride_ = 0;
+  depth_ = DepthU8;
+  // A shared buffer is left to its other owners, otherwise the capacity is reused
+  if(!data_ || isShared())
+    data_ = std::make_shared<PixelBuffer>();
+  // Clearing first means a reallocation does not copy the old pixels
+  // and the allocator leaves the new ones uninitialized
+  data_->clear();
+  data_->resize(static_cast<size_t>(stride_) * height_);
+}
+
+void Mat::resize(int width, int height, int channels, MatLayout layout)
+{
+  if(layout == LayoutInterleaved || channels <= 1)
+  {
+    resize(width, height, channels);
+    return;
+  }
+  const size_t alignment = PIXEL_ALIGNMENT;
+  const size_t planeSize = (static_cast<size_t>(width) * height + alignment - 1) / alignment * alignment;
   width_ = width;
   height_ = height;
   channels_ = channels;
-  data_.resize(width_* height_*channels_);
+  stride_ = width;
+  // An empty planar Mat still has to report its layout
+  planeStride_ = std::max(planeSize, alignment);
+  depth_ = DepthU8;
+  if(!data_ || isShared())
+    data_ = std::make_shared<PixelBuffer>();
+  data_->clear();
+  data_->resize(planeStride_ * channels_);
+}
+
+void Mat::resize(int width, int height, int channels, MatDepth depth)
+{
+  resize(width, height, channels, width*channels*depthSize(depth));
+  depth_ = depth;
 }
 
 void Mat::reserve(int width, int height, int channels)
 {
-  data_.clear();
   width_ = width;
   height_ = height;
   channels_ = channels;
-  data_.reserve(width_* height_*channels_);
+  stride_ = width*channels;
+  planeStride_ = 0;
+  depth_ = DepthU8;
+  if(!data_ || isShared())
+    data_ = std::make_shared<PixelBuffer>();
+  data_->clear();
+  data_->reserve(static_cast<size_t>(stride_) * height_);
+}
+
+void Mat::swap(Mat& other)
+{
+  data_.swap(other.data_);
+  std::swap(width_, other.width_);
+  std::swap(height_, other.height_);
+  std::swap(channels_, other.channels_);
+  std::swap(stride_, other.stride_);
+  std::swap(planeStride_, other.planeStride_);
+  std::swap(depth_, other.depth_);
+}
+
+void Mat::detach()
+{
+  if(!data_)
+    data_ = std::make_shared<PixelBuffer>();
+  else if(isShared())
+    data_ = std::make_shared<PixelBuffer>(*data_);
+}
+
+MatView::MatView()
+: data_(nullptr)
+, width_(0)
+, height_(0)
+, channels_(0)
+, stride_(0)
+, planeStride_(0)
+, depth_(DepthU8)
+{
+}
+
+MatView::MatView(const Mat& mat)
+: data_(mat.data())
+, width_(mat.width())
+, height_(mat.height())
+, channels_(mat.channels())
+, stride_(mat.stride())
+, planeStride_(mat.planeStride())
+, depth_(mat.depth())
+{
+}
+
+MatView::MatView(const uint8_t* data, int width, int height, int channels, int stride)
+: data_(data)
+, width_(width)
+, height_(height)
+, channels_(channels)
+, stride_(stride)
+, planeStride_(0)
+, depth_(DepthU8)
+{
+}
+
+MatView::MatView(const uint8_t* data, int width, int height, int channels, int stride, size_t planeStride)
+: data_(data)
+, width_(width)
+, height_(height)
+, channels_(channels)
+, stride_(stride)
+, planeStride_(channels > 1 ? planeStride : 0)
+, depth_(DepthU8)
+{
+}
+
+MatView::MatView(const uint8_t* data, int width, int height, int channels, int stride, MatDepth depth)
+: data_(data)
+, width_(width)
+, height_(height)
+, channels_(channels)
+, stride_(stride)
+, planeStride_(0)
+, depth_(depth)
+{
+}
+
+bool MatView::isGrayscale() const
+{
+  return channels_ == 1;
+}
+
+bool MatView::isContinuous() const
+{
+  return stride_ == width_ * (isPlanar() ? 1 : channels_ * elementSize());
+}
+
+bool MatView::empty() const
+{
+  return width_ == 0 || height_ == 0;
+}
+
+const uint8_t* MatView::data() const
+{
+  return data_;
+}
+
+const uint8_t* MatView::row(int y) const
+{
+  return data_ + static_cast<ptrdiff_t>(y) * stride_;
+}
+
+int MatView::width() const
+{
+  return width_;
+}
+
+int MatView::height() const
+{
+  return height_;
+}
+
+int MatView::channels() const
+{
+  return channels_;
+}
+
+int MatView::stride() const
+{
+  return stride_;
+}
+
+MatLayout MatView::layout() const
+{
+  return planeStride_ > 0 ? LayoutPlanar : LayoutInterleaved;
+}
+
+bool MatView::isPlanar() const
+{
+  return planeStride_ > 0;
+}
+
+size_t MatView::planeStride() const
+{
+  return planeStride_;
+}
+
+MatDepth MatView::depth() const
+{
+  return depth_;
+}
+
+int MatView::elementSize() const
+{
+  return depthSize(depth_);
+}
+
+MatView MatView::plane(int channel) const
+{
+  if(isPlanar())
+    return MatView(data_ + static_cast<size_t>(channel) * planeStride_, width_, height_, 1, stride_);
+  // Interleaved color views have no planes
+  return channels_ == 1 ? *this : MatView();
 }
@@ -0,0 +1,292 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "Instrumentation.h"
+#include "MorphologyKernels.h"
+#include "Parallel.h"
+
+#ifdef MICROCV_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace MicroCv;
+using namespace MicroCv::Kernels;
+
+namespace
+{
+  // Bytes of every row that one task of the column pass works on at most. Rows of 1024 bytes keep
+  // the prefetcher ahead of the strided reads, narrower strips only give every thread one
+  const int MAX_STRIP_WIDTH = 1024;
+  const int MIN_STRIP_WIDTH = 64;
+
+  template<bool Dilate>
+  inline uint8_t minMax(uint8_t a, uint8_t b)
+  {
+    return Dilate ? std::max(a, b) : std::min(a, b);
+  }
+
+  template<bool Dilate>
+  void minMaxRowsScalar(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t i, size_t count)
+  {
+    for(; i < count; i++)
+      out[i] = minMax<Dilate>(a[i], b[i]);
+  }
+
+  void subtractRowsScalar(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t i, size_t count)
+  {
+    for(; i < count; i++)
+      out[i] = a[i] > b[i] ? static_cast<uint8_t>(a[i] - b[i]) : 0;
+  }
+
+#ifdef MICROCV_X86_SIMD
+  template<bool Dilate>
+  __attribute__((target("sse2")))
+  size_t minMaxRowsSse2(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t i, size_t count)
+  {
+    for(; i + 16 <= count; i += 16)
+    {
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), Dilate ? _mm_max_epu8(va, vb) : _mm_min_epu8(va, vb));
+    }
+    return i;
+  }
+
+  template<bool Dilate>
+  __attribute__((target("avx2")))
+  size_t minMaxRowsAvx2(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t i, size_t count)
+  {
+    for(; i + 32 <= count; i += 32)
+    {
+      const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), Dilate ? _mm256_max_epu8(va, vb) : _mm256_min_epu8(va, vb));
+    }
+    return i;
+  }
+
+  __attribute__((target("sse2")))
+  size_t subtractRowsSse2(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t i, size_t count)
+  {
+    for(; i + 16 <= count; i += 16)
+    {
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_subs_epu8(va, vb));
+    }
+    return i;
+  }
+
+  __attribute__((target("avx2")))
+  size_t subtractRowsAvx2(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t i, size_t count)
+  {
+    for(; i + 32 <= count; i += 32)
+    {
+      const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_subs_epu8(va, vb));
+    }
+    return i;
+  }
+#endif
+
+  template<bool Dilate>
+  void minMaxRowsAs(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count, SimdLevel level)
+  {
+    size_t i = 0;
+#ifdef MICROCV_X86_SIMD
+    if(level >= SimdAvx2)
+      i = minMaxRowsAvx2<Dilate>(a, b, out, i, count);
+    if(level >= SimdSse2)
+      i = minMaxRowsSse2<Dilate>(a, b, out, i, count);
+#else
+    (void)level;
+#endif
+    minMaxRowsScalar<Dilate>(a, b, out, i, count);
+  }
+
+  /*
+   * RowFilter takes the min (or max) over the 2 * radius + 1 pixels around each pixel of a row.
+   * The row is copied between radius pixels of the identity on both sides, 255 for a min and 0 for
+   * a max, so the windows at the ends are clipped to the image. Windows of 2, 4, 8... pixels are
+   * then each the min of two shifted windows of half their size, all in SIMD, and the window of
+   * 2 * radius + 1 is the min of two overlapping ones. That is 1 + log2(radius) passes, van Herk/
+   * Gil-Werman would take 3 mins per pixel but its running prefix is serial along the row.
+   */
+  class RowFilter
+  {
+  public:
+    RowFilter(int width, int channels, int radius, bool dilate, SimdLevel level) :
+      width_(width), channels_(channels), radius_(radius), dilate_(dilate), level_(level),
+      padded_(static_cast<size_t>(width + 2*radius) * channels)
+    {
+    }
+
+    void filter(const uint8_t* in, uint8_t* out)
+    {
+      const size_t rowSize = static_cast<size_t>(width_) * channels_;
+      const size_t pad = static_cast<size_t>(radius_) * channels_;
+      if(radius_ == 0)
+      {
+        if(out != in)
+          std::memcpy(out, in, rowSize);
+        return;
+      }
+      // The passes overwrite the padding as well
+      std::memset(padded_.data(), dilate_ ? 0 : 255, pad);
+      std::memcpy(padded_.data() + pad, in, rowSize);
+      std::memset(padded_.data() + pad + rowSize, dilate_ ? 0 : 255, pad);
+
+      // After the pass of span, value x is the min over [x, x + 2 * span)
+      const int size = 2*radius_ + 1;
+      int span = 1;
+      size_t count = padded_.size();
+      for(; 2*span <= size; span *= 2)
+      {
+        count -= static_cast<size_t>(span) * channels_;
+        minMaxRows(padded_.data(), padded_.data() + span*channels_, padded_.data(), count, dilate_, level_);
+      }
+      minMaxRows(padded_.data(), padded_.data() + (size - span)*channels_, out, rowSize, dilate_, level_);
+    }
+
+  private:
+    int width_;
+    int channels_;
+    int radius_;
+    bool dilate_;
+    SimdLevel level_;
+    std::vector<uint8_t> padded_;
+  };
+
+  /*
+   * ColumnFilter takes the min (or max) over the 2 * radius + 1 rows around each row of a strip,
+   * in place, with van Herk/Gil-Werman. The rows are cut into blocks of 2 * radius + 1, so every
+   * window is the min of a suffix of one block and a prefix of the next. The prefix runs along
+   * with the rows of the current block, and the suffixes of a block are computed in place once it
+   * is complete: 3 mins per pixel whatever the radius, each over a whole row of the strip in SIMD.
+   * Rows are copied into the blocks before they are overwritten, row y is written once row y + radius
+   * has been read, and the rows outside the image are the identity.
+   */
+  class ColumnFilter
+  {
+  public:
+    ColumnFilter(int height, int radius, int stripWidth, bool dilate, SimdLevel level) :
+      height_(height), radius_(radius), stripWidth_(stripWidth), dilate_(dilate), level_(level),
+      buffer_(static_cast<size_t>(2*(2*radius + 1) + 1) * stripWidth)
+    {
+    }
+
+    void filter(uint8_t* strip, size_t stride, int lanes)
+    {
+      const int size = 2*radius_ + 1;
+      uint8_t* block = buffer_.data();
+      uint8_t* previous = block + size*stripWidth_;
+      uint8_t* prefix = previous + size*stripWidth_;
+      for(int p = -radius_, i = 0; p < height_ + radius_; p++)
+      {
+        uint8_t* row = block + i*stripWidth_;
+        if(p < 0 || p >= height_)
+          std::memset(row, dilate_ ? 0 : 255, lanes);
+        else
+          std::memcpy(row, strip + p*stride, lanes);
+        const uint8_t* running = row;
+        if(i > 0)
+        {
+          minMaxRows(prefix, row, prefix, lanes, dilate_, level_);
+          running = prefix;
+        }
+        else
+          std::memcpy(prefix, row, lanes);
+
+        // The window of y is [p - 2 * radius, p], which starts at row i + 1 of the previous block
+        const int y = p - radius_;
+        if(i == size - 1)
+        {
+          if(y >= 0)
+            std::memcpy(strip + y*stride, running, lanes);
+          for(int k = size - 2; k >= 0; k--)
+            minMaxRows(block + k*stripWidth_, block + (k + 1)*stripWidth_, block + k*stripWidth_, lanes, dilate_, level_);
+          std::swap(block, previous);
+          i = 0;
+        }
+        else
+        {
+          if(y >= 0)
+            minMaxRows(previous + (i + 1)*stripWidth_, running, strip + y*stride, lanes, dilate_, level_);
+          i++;
+        }
+      }
+    }
+
+  private:
+    int height_;
+    int radius_;
+    int stripWidth_;
+    bool dilate_;
+    SimdLevel level_;
+    std::vector<uint8_t> buffer_;
+  };
+}
+
+void MicroCv::Kernels::minMaxRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count, bool dilate,
+    SimdLevel level)
+{
+  if(dilate)
+    minMaxRowsAs<true>(a, b, out, count, level);
+  else
+    minMaxRowsAs<false>(a, b, out, count, level);
+}
+
+void MicroCv::Kernels::subtractRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count, SimdLevel level)
+{
+  size_t i = 0;
+#ifdef MICROCV_X86_SIMD
+  if(level >= SimdAvx2)
+    i = subtractRowsAvx2(a, b, out, i, count);
+  if(level >= SimdSse2)
+    i = subtractRowsSse2(a, b, out, i, count);
+#else
+  (void)level;
+#endif
+  subtractRowsScalar(a, b, out, i, count);
+}
+
+void MicroCv::Kernels::morphologyRows(const MatView& view, int radiusX, int radiusY, bool dilate, uint8_t* outPtr)
+{
+  const SimdLevel level = simdLevel();
+  const int width = view.width();
+  const int height = view.height();
+  const int channels = view.channels();
+  const size_t rowSize = static_cast<size_t>(width) * channels;
+
+  parallelForRows(width, height, 0, [&](const RowBand& band)
+  {
+    MICROCV_STAGE("morphology rows band", 2 * rowSize * (band.end - band.begin));
+    RowFilter filter(width, channels, radiusX, dilate, level);
+    for(int y = band.begin; y < band.end; y++)
+      filter.filter(view.row(y), outPtr + y*rowSize);
+  });
+  if(radiusY == 0)
+    return;
+
+  const size_t threadWidth = (rowSize + numThreads() - 1) / numThreads();
+  const int stripWidth = static_cast<int>(std::min<size_t>(MAX_STRIP_WIDTH,
+      (threadWidth + MIN_STRIP_WIDTH - 1) / MIN_STRIP_WIDTH * MIN_STRIP_WIDTH));
+  const int numStrips = static_cast<int>((rowSize + stripWidth - 1) / stripWidth);
+  // The strips are the rows of the transposed image
+  parallelForRows(height * stripWidth, numStrips, 0, [&](const RowBand& band)
+  {
+    MICROCV_STAGE("morphology columns band", 2 * static_cast<uint64_t>(height) * stripWidth * (band.end - band.begin));
+    ColumnFilter filter(height, radiusY, stripWidth, dilate, level);
+    for(int strip = band.begin; strip < band.end; strip++)
+    {
+      const size_t x1 = static_cast<size_t>(strip) * stripWidth;
+      filter.filter(outPtr + x1, rowSize, static_cast<int>(std::min<size_t>(stripWidth, rowSize - x1)));
+    }
+  });
+}
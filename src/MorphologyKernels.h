@@ -0,0 +1,28 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstddef>
+#include <cstdint>
+
+#include "CpuFeatures.h"
+#include "Mat.h"
+
+namespace MicroCv
+{
+namespace Kernels
+{
+  // out = min(a, b) (or max(a, b) when dilate is set) over count bytes, out may be a or b
+  void minMaxRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count, bool dilate, SimdLevel level);
+
+  // out = a - b saturated at 0 over count bytes
+  void subtractRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count, SimdLevel level);
+
+  // Erode (minimum) or dilate (maximum) every channel of the view into outPtr (a continuous Mat)
+  // over the (2 * radiusX + 1) x (2 * radiusY + 1) rectangle around each pixel, clipped to the image.
+  // A pass over the rows in bands, then a pass over strips of columns in place. The view may be
+  // outPtr itself, for the second pass of an opening or closing
+  void morphologyRows(const MatView& view, int radiusX, int radiusY, bool dilate, uint8_t* outPtr);
+};
+};
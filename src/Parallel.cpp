@@ -0,0 +1,216 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+
+#include "Parallel.h"
+
+using namespace MicroCv;
+
+namespace
+{
+  // Bands smaller than this are not worth handing to another thread
+  const int MIN_PIXELS_PER_BAND = 64 * 1024;
+  // More bands than threads lets faster threads pick up the slack of slower ones
+  const int BANDS_PER_THREAD = 4;
+
+  thread_local bool insideWorker = false;
+
+  // Shared between the caller of ThreadPool::run() and the workers helping with it
+  struct Batch
+  {
+    explicit Batch(int tasks, const std::function<void(int)>& fn)
+    : task(fn)
+    , numTasks(tasks)
+    , nextTask(0)
+    , remaining(tasks)
+    {
+    }
+
+    // Claim and run tasks until none are left
+    void work()
+    {
+      for(int i = nextTask++; i < numTasks; i = nextTask++)
+      {
+        try
+        {
+          task(i);
+        }
+        catch(...)
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if(!error)
+            error = std::current_exception();
+        }
+        if(--remaining == 0)
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          done.notify_all();
+        }
+      }
+    }
+
+    const std::function<void(int)>& task;
+    const int numTasks;
+    std::atomic<int> nextTask;
+    std::atomic<int> remaining;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+  };
+
+  int defaultNumThreads()
+  {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  std::mutex globalPoolMutex;
+  std::unique_ptr<ThreadPool> globalPool;
+
+  ThreadPool& getGlobalPool()
+  {
+    std::lock_guard<std::mutex> lock(globalPoolMutex);
+    if(!globalPool)
+      globalPool.reset(new ThreadPool(defaultNumThreads() - 1));
+    return *globalPool;
+  }
+}
+
+ThreadPool::ThreadPool(int numWorkers)
+: stopping_(false)
+{
+  for(int i = 0; i < numWorkers; i++)
+  {
+    workers_.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wakeUp_.notify_all();
+  for(auto itr = workers_.begin(); itr != workers_.end(); ++itr)
+  {
+    itr->join();
+  }
+}
+
+int ThreadPool::numWorkers() const
+{
+  return static_cast<int>(workers_.size());
+}
+
+void ThreadPool::run(int numTasks, const std::function<void(int)>& task)
+{
+  // Nothing to share, or we are already inside a task: run inline
+  if(numTasks <= 1 || workers_.empty() || insideWorker)
+  {
+    for(int i = 0; i < numTasks; i++)
+      task(i);
+    return;
+  }
+
+  auto batch = std::make_shared<Batch>(numTasks, task);
+  const int numHelpers = std::min(numTasks - 1, numWorkers());
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(int i = 0; i < numHelpers; i++)
+      queue_.push_back([batch]() { batch->work(); });
+  }
+  wakeUp_.notify_all();
+
+  // The calling thread works on the batch too (as a worker, so nested calls run inline)
+  insideWorker = true;
+  batch->work();
+  insideWorker = false;
+
+  std::unique_lock<std::mutex> lock(batch->mutex);
+  batch->done.wait(lock, [&batch]() { return batch->remaining == 0; });
+  if(batch->error)
+    std::rethrow_exception(batch->error);
+}
+
+bool ThreadPool::isWorkerThread()
+{
+  return insideWorker;
+}
+
+void ThreadPool::workerLoop()
+{
+  insideWorker = true;
+  for(;;)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wakeUp_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      if(queue_.empty())
+        return;
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    job();
+  }
+}
+
+int MicroCv::numThreads()
+{
+  return getGlobalPool().numWorkers() + 1;
+}
+
+void MicroCv::setNumThreads(int threads)
+{
+  if(threads <= 0)
+    threads = defaultNumThreads();
+  std::lock_guard<std::mutex> lock(globalPoolMutex);
+  globalPool.reset(new ThreadPool(threads - 1));
+}
+
+std::vector<RowBand> MicroCv::partitionRows(int height, int numBands, int halo)
+{
+  std::vector<RowBand> bands;
+  numBands = std::max(1, std::min(numBands, height));
+  for(int i = 0; i < numBands; i++)
+  {
+    RowBand band;
+    // Spread the remainder rows over the bands so sizes differ by at most one row
+    band.begin = static_cast<int>(static_cast<int64_t>(height) * i / numBands);
+    band.end = static_cast<int>(static_cast<int64_t>(height) * (i + 1) / numBands);
+    band.haloBegin = std::max(0, band.begin - halo);
+    band.haloEnd = std::min(height, band.end + halo);
+    bands.push_back(band);
+  }
+  return bands;
+}
+
+std::vector<RowBand> MicroCv::rowBands(int width, int height, int halo)
+{
+  if(width <= 0 || height <= 0)
+    return std::vector<RowBand>();
+
+  const int64_t numPixels = static_cast<int64_t>(width) * height;
+  const int64_t maxBandsBySize = std::max<int64_t>(1, numPixels / MIN_PIXELS_PER_BAND);
+  const int threads = numThreads();
+  const int numBands = static_cast<int>(std::min<int64_t>(maxBandsBySize,
+      threads == 1 ? 1 : threads * BANDS_PER_THREAD));
+  return partitionRows(height, numBands, halo);
+}
+
+void MicroCv::parallelForBands(const std::vector<RowBand>& bands, const std::function<void(int)>& fn)
+{
+  getGlobalPool().run(static_cast<int>(bands.size()), fn);
+}
+
+void MicroCv::parallelForRows(int width, int height, int halo, const std::function<void(const RowBand&)>& fn)
+{
+  const std::vector<RowBand> bands = rowBands(width, height, halo);
+  parallelForBands(bands, [&bands, &fn](int i) { fn(bands[i]); });
+}
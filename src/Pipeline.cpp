@@ -0,0 +1,387 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "FilterEngine.h"
+#include "GaussianEngine.h"
+#include "Instrumentation.h"
+#include "LumaKernels.h"
+#include "Parallel.h"
+#include "Pipeline.h"
+#include "PlanarKernels.h"
+#include "SobelEngine.h"
+
+namespace
+{
+  /*
+   * One stage of an evaluated pipeline. Rows are requested from top to bottom and the returned
+   * pointer stays valid until the next call, so every stage only needs a scratch row or a small
+   * window of rows. Each band of the output gets its own chain of nodes.
+   */
+  class Node
+  {
+  public:
+    Node(int width, int height, int channels)
+    : width_(width), height_(height), channels_(channels)
+    {
+    }
+    virtual ~Node() {}
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int channels() const { return channels_; }
+
+    virtual const uint8_t* row(int y) = 0;
+
+  private:
+    int width_;
+    int height_;
+    int channels_;
+  };
+
+  class InputNode : public Node
+  {
+  public:
+    explicit InputNode(const MicroCv::MatView& view)
+    : Node(view.width(), view.height(), view.channels()), view_(view)
+    , row_(view.isPlanar() ? static_cast<size_t>(view.width()) * view.channels() : 0)
+    {
+    }
+
+    // Rows of planar views are merged into a scratch row, the stages all work on interleaved rows
+    const uint8_t* row(int y)
+    {
+      return MicroCv::Kernels::interleavedRow(view_, y, row_.data());
+    }
+
+  private:
+    MicroCv::MatView view_;
+    std::vector<uint8_t> row_;
+  };
+
+  // Rows of the input are returned in place, offset by x1
+  class CropNode : public Node
+  {
+  public:
+    CropNode(Node& input, int x1, int y1, int width, int height)
+    : Node(width, height, input.channels()), input_(input), x1_(x1), y1_(y1)
+    {
+    }
+
+    const uint8_t* row(int y)
+    {
+      return input_.row(y + y1_) + x1_*channels();
+    }
+
+  private:
+    Node& input_;
+    int x1_;
+    int y1_;
+  };
+
+  class GrayNode : public Node
+  {
+  public:
+    GrayNode(Node& input, MicroCv::GrayConversion conversion)
+    : Node(input.width(), input.height(), 1)
+    , input_(input)
+    , coeffs_(MicroCv::Kernels::lumaCoefficients(conversion))
+    , row_(input.width())
+    {
+    }
+
+    const uint8_t* row(int y)
+    {
+      MicroCv::Kernels::rgbRowToGray(input_.row(y), row_.data(), width(), coeffs_);
+      return row_.data();
+    }
+
+  private:
+    Node& input_;
+    MicroCv::Kernels::LumaCoefficients coeffs_;
+    std::vector<uint8_t> row_;
+  };
+
+  // Gaussian blur over a window of 2 * radius + 1 input rows, rows outside the image are read
+  // according to the border mode
+  class BlurNode : public Node
+  {
+  public:
+    BlurNode(Node& input, double sigma, MicroCv::BorderMode border)
+    : Node(input.width(), input.height(), input.channels())
+    , input_(input)
+    , border_(border)
+    , engine_(sigma, input.width(), input.channels(), border)
+    , row_(static_cast<size_t>(input.width()) * input.channels())
+    , lastPushed_(-1)
+    {
+    }
+
+    const uint8_t* row(int y)
+    {
+      const int radius = engine_.radius();
+      // Consecutive rows only push one new input row, the first row of a band fills the whole window
+      if(lastPushed_ != y + radius - 1)
+      {
+        for(int i = y - radius; i < y + radius; i++)
+          pushInputRow(i);
+      }
+      pushInputRow(y + radius);
+      lastPushed_ = y + radius;
+      engine_.computeRow(row_.data());
+      return row_.data();
+    }
+
+  private:
+    void pushInputRow(int y)
+    {
+      const int inputY = MicroCv::Kernels::borderIndex(y, height(), border_);
+      engine_.pushRow(inputY < 0 ? nullptr : input_.row(inputY));
+    }
+
+    Node& input_;
+    MicroCv::BorderMode border_;
+    MicroCv::Kernels::GaussianEngine engine_;
+    std::vector<uint8_t> row_;
+    int lastPushed_;
+  };
+
+  class SobelNode : public Node
+  {
+  public:
+    SobelNode(Node& input, MicroCv::SobelMagnitude magnitude)
+    : Node(input.width(), input.height(), 1)
+    , input_(input)
+    , engine_(input.width(), magnitude)
+    , row_(input.width())
+    , lastPushed_(-1)
+    {
+    }
+
+    const uint8_t* row(int y)
+    {
+      // The convolution ignores the border pixels, so the first and last rows stay black
+      if(y == 0 || y == height() - 1)
+      {
+        std::memset(row_.data(), 0, row_.size());
+        return row_.data();
+      }
+      // Consecutive rows only push one new input row, the first row of a band fills the whole window
+      if(lastPushed_ != y)
+      {
+        engine_.pushRow(input_.row(y - 1));
+        engine_.pushRow(input_.row(y));
+      }
+      engine_.pushRow(input_.row(y + 1));
+      lastPushed_ = y + 1;
+      engine_.computeRow(row_.data());
+      return row_.data();
+    }
+
+  private:
+    Node& input_;
+    MicroCv::Kernels::SobelEngine engine_;
+    std::vector<uint8_t> row_;
+    int lastPushed_;
+  };
+
+  inline bool isValidCropRegion(int width, int height, int x1, int y1, int x2, int y2)
+  {
+    return x1 >= 0 && x1 < x2 && x2 < width && y1 >= 0 && y1 < y2 && y2 < height;
+  }
+}
+
+using namespace MicroCv;
+
+Pipeline::Pipeline(const MatView& input)
+: input_(input)
+, width_(input.width())
+, height_(input.height())
+, channels_(input.channels())
+{
+  // Only 8 bit images are processed, same as the empty results of the functions
+  if(input.depth() != DepthU8)
+    width_ = height_ = channels_ = 0;
+}
+
+Pipeline::Stage& Pipeline::addStage(StageType type)
+{
+  Stage stage;
+  stage.type = type;
+  stage.x1 = 0;
+  stage.y1 = 0;
+  stage.x2 = 0;
+  stage.y2 = 0;
+  stage.conversion = GrayAverage;
+  stage.sigma = 0;
+  stage.border = BorderReflect;
+  stage.magnitude = SobelL1;
+  stages_.push_back(stage);
+  return stages_.back();
+}
+
+Pipeline& Pipeline::crop(int x1, int y1, int x2, int y2)
+{
+  if(!isValidCropRegion(width_, height_, x1, y1, x2, y2))
+    return *this;
+
+  // Point operations commute with a crop, so up to the first neighbourhood operation
+  // the crop is applied to the input and the dropped pixels are never touched
+  bool onlyPointOps = true;
+  for(auto itr = stages_.begin(); itr != stages_.end(); ++itr)
+    onlyPointOps = onlyPointOps && itr->type != StageBlur && itr->type != StageSobel;
+
+  if(onlyPointOps)
+  {
+    input_ = cropView(input_, x1, y1, x2, y2);
+  }
+  else
+  {
+    Stage& stage = addStage(StageCrop);
+    stage.x1 = x1;
+    stage.y1 = y1;
+    stage.x2 = x2;
+    stage.y2 = y2;
+  }
+  width_ = x2 - x1;
+  height_ = y2 - y1;
+  return *this;
+}
+
+Pipeline& Pipeline::gray(GrayConversion conversion)
+{
+  if(channels_ == 3)
+  {
+    addStage(StageGray).conversion = conversion;
+    channels_ = 1;
+  }
+  else if(channels_ != 1)
+  {
+    // Nothing to convert from, same as the empty result of rgbToGray()
+    width_ = height_ = channels_ = 0;
+  }
+  return *this;
+}
+
+Pipeline& Pipeline::blur(double sigma, BorderMode border)
+{
+  if(channels_ <= 0 || !(sigma >= 0) || std::isinf(sigma))
+  {
+    // Same as the empty result of gaussianBlur()
+    width_ = height_ = channels_ = 0;
+    return *this;
+  }
+  // A sigma of 0 leaves the image as it is
+  if(sigma > 0)
+  {
+    Stage& stage = addStage(StageBlur);
+    stage.sigma = sigma;
+    stage.border = border;
+  }
+  return *this;
+}
+
+Pipeline& Pipeline::sobel(SobelMagnitude magnitude)
+{
+  if(channels_ == 3)
+  {
+    addStage(StageGray).conversion = GrayAverage;
+    channels_ = 1;
+  }
+  if(channels_ != 1)
+  {
+    // Same as the empty result of sobelEdgeDetector()
+    width_ = height_ = channels_ = 0;
+    return *this;
+  }
+  addStage(StageSobel).magnitude = magnitude;
+  return *this;
+}
+
+int Pipeline::width() const
+{
+  return width_;
+}
+
+int Pipeline::height() const
+{
+  return height_;
+}
+
+int Pipeline::channels() const
+{
+  return channels_;
+}
+
+Mat Pipeline::evaluate() const
+{
+  Mat outputMat;
+  evaluate(outputMat);
+  return outputMat;
+}
+
+void Pipeline::evaluate(Mat& outputMat) const
+{
+  // Never overwrite the pixels that are still being read
+  const uint8_t* outBegin = static_cast<const Mat&>(outputMat).data();
+  const uint8_t* outEnd = outBegin + (outputMat.isPlanar() ? outputMat.planeStride() * outputMat.channels()
+      : static_cast<size_t>(outputMat.stride()) * outputMat.height());
+  if(outBegin && input_.data() >= outBegin && input_.data() < outEnd)
+  {
+    Mat resultMat;
+    evaluate(resultMat);
+    outputMat = std::move(resultMat);
+    return;
+  }
+
+  if(channels_ == 0)
+  {
+    outputMat.resize(0, 0, 0);
+    return;
+  }
+  MICROCV_STAGE("Pipeline::evaluate", static_cast<uint64_t>(input_.width()) * input_.height() * input_.channels()
+      + static_cast<uint64_t>(width_) * height_ * channels_);
+  outputMat.resize(width_, height_, channels_);
+  if(width_ == 0 || height_ == 0)
+    return;
+
+  const size_t rowBytes = static_cast<size_t>(outputMat.stride());
+  uint8_t* outPtr = outputMat.data();
+  parallelForRows(width_, height_, 0, [&](const RowBand& band)
+  {
+    MICROCV_STAGE("Pipeline band", rowBytes * (band.end - band.begin));
+    // Nodes keep per band state (scratch rows, blur and Sobel windows), so every band builds its own chain
+    std::vector<std::unique_ptr<Node>> nodes;
+    nodes.emplace_back(new InputNode(input_));
+    for(auto itr = stages_.begin(); itr != stages_.end(); ++itr)
+    {
+      Node& input = *nodes.back();
+      if(itr->type == StageCrop)
+      {
+        nodes.emplace_back(new CropNode(input, itr->x1, itr->y1, itr->x2 - itr->x1, itr->y2 - itr->y1));
+      }
+      else if(itr->type == StageGray)
+      {
+        nodes.emplace_back(new GrayNode(input, itr->conversion));
+      }
+      else if(itr->type == StageBlur)
+      {
+        nodes.emplace_back(new BlurNode(input, itr->sigma, itr->border));
+      }
+      else
+      {
+        nodes.emplace_back(new SobelNode(input, itr->magnitude));
+      }
+    }
+
+    Node& output = *nodes.back();
+    for(int y = band.begin; y < band.end; y++)
+      std::memcpy(outPtr + y*rowBytes, output.row(y), rowBytes);
+  });
+}
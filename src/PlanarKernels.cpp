@@ -0,0 +1,373 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstring>
+
+#include "CpuFeatures.h"
+#include "PlanarKernels.h"
+#include "RgbShuffles.h"
+
+#ifdef MICROCV_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace MicroCv;
+
+namespace
+{
+  // The most channels with SIMD kernels
+  const int MAX_FAST_CHANNELS = 4;
+
+  // The kernels below take the first pixel x to convert and return the first one they left over
+  void deinterleaveScalar(const uint8_t* in, uint8_t* const* planes, int x, int width, int channels)
+  {
+    for(; x < width; x++)
+    {
+      for(int c = 0; c < channels; c++)
+        planes[c][x] = in[x*channels + c];
+    }
+  }
+
+  void interleaveScalar(const uint8_t* const* planes, uint8_t* out, int x, int width, int channels)
+  {
+    for(; x < width; x++)
+    {
+      for(int c = 0; c < channels; c++)
+        out[x*channels + c] = planes[c][x];
+    }
+  }
+
+#ifdef MICROCV_X86_SIMD
+  __attribute__((target("sse2")))
+  inline __m128i load(const uint8_t* p)
+  {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  }
+
+  __attribute__((target("sse2")))
+  inline void store(uint8_t* p, __m128i v)
+  {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+  }
+
+  // Same 4 rounds of interleaving as the SSE2 kernel of rgbToGray
+  __attribute__((target("sse2")))
+  int deinterleave3Sse2(const uint8_t* in, uint8_t* const* planes, int x, int width)
+  {
+    for(; x + 16 <= width; x += 16)
+    {
+      const uint8_t* p = in + x*3;
+      __m128i t00 = load(p);
+      __m128i t01 = load(p + 16);
+      __m128i t02 = load(p + 32);
+      for(int round = 0; round < 4; round++)
+      {
+        const __m128i t10 = _mm_unpacklo_epi8(t00, _mm_unpackhi_epi64(t01, t01));
+        const __m128i t11 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t00, t00), t02);
+        const __m128i t12 = _mm_unpacklo_epi8(t01, _mm_unpackhi_epi64(t02, t02));
+        t00 = t10;
+        t01 = t11;
+        t02 = t12;
+      }
+      store(planes[0] + x, t00);
+      store(planes[1] + x, t01);
+      store(planes[2] + x, t02);
+    }
+    return x;
+  }
+
+  // 4 channels interleave with two rounds of unpacking, first the bytes and then the pairs
+  __attribute__((target("sse2")))
+  int interleave4Sse2(const uint8_t* const* planes, uint8_t* out, int x, int width)
+  {
+    for(; x + 16 <= width; x += 16)
+    {
+      const __m128i r = load(planes[0] + x);
+      const __m128i g = load(planes[1] + x);
+      const __m128i b = load(planes[2] + x);
+      const __m128i a = load(planes[3] + x);
+      const __m128i rgLo = _mm_unpacklo_epi8(r, g);
+      const __m128i rgHi = _mm_unpackhi_epi8(r, g);
+      const __m128i baLo = _mm_unpacklo_epi8(b, a);
+      const __m128i baHi = _mm_unpackhi_epi8(b, a);
+      uint8_t* p = out + x*4;
+      store(p, _mm_unpacklo_epi16(rgLo, baLo));
+      store(p + 16, _mm_unpackhi_epi16(rgLo, baLo));
+      store(p + 32, _mm_unpacklo_epi16(rgHi, baHi));
+      store(p + 48, _mm_unpackhi_epi16(rgHi, baHi));
+    }
+    return x;
+  }
+
+  // Byte shuffles that place 16 pixels of one plane into each 16 bytes of packed RGB (-1 zeroes the byte)
+  #define MICROCV_MERGE_SHUFFLES \
+    const __m128i rOut0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5); \
+    const __m128i gOut0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1); \
+    const __m128i bOut0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1); \
+    const __m128i rOut1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1); \
+    const __m128i gOut1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10); \
+    const __m128i bOut1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1); \
+    const __m128i rOut2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1); \
+    const __m128i gOut2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1); \
+    const __m128i bOut2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+  // Gathers the 4 pixels of 16 bytes of packed RGBA as 4 bytes of R, then G, B and A
+  #define MICROCV_QUAD_SHUFFLE \
+    const __m128i quad = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+  __attribute__((target("ssse3")))
+  inline __m128i gather3(__m128i a0, __m128i a1, __m128i a2, __m128i m0, __m128i m1, __m128i m2)
+  {
+    return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, m0), _mm_shuffle_epi8(a1, m1)), _mm_shuffle_epi8(a2, m2));
+  }
+
+  __attribute__((target("ssse3")))
+  int deinterleave3Ssse3(const uint8_t* in, uint8_t* const* planes, int x, int width)
+  {
+    for(; x + 16 <= width; x += 16)
+    {
+      __m128i r, g, b;
+      Kernels::splitRgbSsse3(in + x*3, r, g, b);
+      store(planes[0] + x, r);
+      store(planes[1] + x, g);
+      store(planes[2] + x, b);
+    }
+    return x;
+  }
+
+  __attribute__((target("ssse3")))
+  int interleave3Ssse3(const uint8_t* const* planes, uint8_t* out, int x, int width)
+  {
+    MICROCV_MERGE_SHUFFLES
+    for(; x + 16 <= width; x += 16)
+    {
+      const __m128i r = load(planes[0] + x);
+      const __m128i g = load(planes[1] + x);
+      const __m128i b = load(planes[2] + x);
+      uint8_t* p = out + x*3;
+      store(p, gather3(r, g, b, rOut0, gOut0, bOut0));
+      store(p + 16, gather3(r, g, b, rOut1, gOut1, bOut1));
+      store(p + 32, gather3(r, g, b, rOut2, gOut2, bOut2));
+    }
+    return x;
+  }
+
+  // Every 16 bytes are shuffled into 4 runs of one channel, then 4 of those are transposed as a
+  // 4 x 4 matrix of 32 bit words
+  __attribute__((target("ssse3")))
+  int deinterleave4Ssse3(const uint8_t* in, uint8_t* const* planes, int x, int width)
+  {
+    MICROCV_QUAD_SHUFFLE
+    for(; x + 16 <= width; x += 16)
+    {
+      const uint8_t* p = in + x*4;
+      const __m128i v0 = _mm_shuffle_epi8(load(p), quad);
+      const __m128i v1 = _mm_shuffle_epi8(load(p + 16), quad);
+      const __m128i v2 = _mm_shuffle_epi8(load(p + 32), quad);
+      const __m128i v3 = _mm_shuffle_epi8(load(p + 48), quad);
+      const __m128i rg01 = _mm_unpacklo_epi32(v0, v1);
+      const __m128i ba01 = _mm_unpackhi_epi32(v0, v1);
+      const __m128i rg23 = _mm_unpacklo_epi32(v2, v3);
+      const __m128i ba23 = _mm_unpackhi_epi32(v2, v3);
+      store(planes[0] + x, _mm_unpacklo_epi64(rg01, rg23));
+      store(planes[1] + x, _mm_unpackhi_epi64(rg01, rg23));
+      store(planes[2] + x, _mm_unpacklo_epi64(ba01, ba23));
+      store(planes[3] + x, _mm_unpackhi_epi64(ba01, ba23));
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i load256(const uint8_t* p)
+  {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  }
+
+  __attribute__((target("avx2")))
+  inline void store256(uint8_t* p, __m256i v)
+  {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i gather3Avx2(__m256i a0, __m256i a1, __m256i a2, __m128i m0, __m128i m1, __m128i m2)
+  {
+    return _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a0, _mm256_broadcastsi128_si256(m0)),
+        _mm256_shuffle_epi8(a1, _mm256_broadcastsi128_si256(m1))), _mm256_shuffle_epi8(a2, _mm256_broadcastsi128_si256(m2)));
+  }
+
+  __attribute__((target("avx2")))
+  int deinterleave3Avx2(const uint8_t* in, uint8_t* const* planes, int x, int width)
+  {
+    for(; x + 32 <= width; x += 32)
+    {
+      __m256i r, g, b;
+      Kernels::splitRgbAvx2(in + x*3, r, g, b);
+      store256(planes[0] + x, r);
+      store256(planes[1] + x, g);
+      store256(planes[2] + x, b);
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  int interleave3Avx2(const uint8_t* const* planes, uint8_t* out, int x, int width)
+  {
+    MICROCV_MERGE_SHUFFLES
+    for(; x + 32 <= width; x += 32)
+    {
+      const __m256i r = load256(planes[0] + x);
+      const __m256i g = load256(planes[1] + x);
+      const __m256i b = load256(planes[2] + x);
+      // The lanes hold bytes [0, 48) and [48, 96) of the output, so they are swapped into order
+      const __m256i o0 = gather3Avx2(r, g, b, rOut0, gOut0, bOut0);
+      const __m256i o1 = gather3Avx2(r, g, b, rOut1, gOut1, bOut1);
+      const __m256i o2 = gather3Avx2(r, g, b, rOut2, gOut2, bOut2);
+      uint8_t* p = out + x*3;
+      store256(p, _mm256_permute2x128_si256(o0, o1, 0x20));
+      store256(p + 32, _mm256_permute2x128_si256(o2, o0, 0x30));
+      store256(p + 64, _mm256_permute2x128_si256(o1, o2, 0x31));
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  int deinterleave4Avx2(const uint8_t* in, uint8_t* const* planes, int x, int width)
+  {
+    MICROCV_QUAD_SHUFFLE
+    const __m256i quads = _mm256_broadcastsi128_si256(quad);
+    // Moves the two runs of each channel of a vector next to each other
+    const __m256i runs = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for(; x + 32 <= width; x += 32)
+    {
+      const uint8_t* p = in + x*4;
+      const __m256i v0 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(load256(p), quads), runs);
+      const __m256i v1 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(load256(p + 32), quads), runs);
+      const __m256i v2 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(load256(p + 64), quads), runs);
+      const __m256i v3 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(load256(p + 96), quads), runs);
+      // Every vector holds 8 pixels as the 64 bit words R, G, B and A
+      const __m256i rb01 = _mm256_unpacklo_epi64(v0, v1);
+      const __m256i ga01 = _mm256_unpackhi_epi64(v0, v1);
+      const __m256i rb23 = _mm256_unpacklo_epi64(v2, v3);
+      const __m256i ga23 = _mm256_unpackhi_epi64(v2, v3);
+      store256(planes[0] + x, _mm256_permute2x128_si256(rb01, rb23, 0x20));
+      store256(planes[1] + x, _mm256_permute2x128_si256(ga01, ga23, 0x20));
+      store256(planes[2] + x, _mm256_permute2x128_si256(rb01, rb23, 0x31));
+      store256(planes[3] + x, _mm256_permute2x128_si256(ga01, ga23, 0x31));
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  int interleave4Avx2(const uint8_t* const* planes, uint8_t* out, int x, int width)
+  {
+    for(; x + 32 <= width; x += 32)
+    {
+      const __m256i r = load256(planes[0] + x);
+      const __m256i g = load256(planes[1] + x);
+      const __m256i b = load256(planes[2] + x);
+      const __m256i a = load256(planes[3] + x);
+      const __m256i rgLo = _mm256_unpacklo_epi8(r, g);
+      const __m256i rgHi = _mm256_unpackhi_epi8(r, g);
+      const __m256i baLo = _mm256_unpacklo_epi8(b, a);
+      const __m256i baHi = _mm256_unpackhi_epi8(b, a);
+      // Pixels 0-3 | 16-19, 4-7 | 20-23, 8-11 | 24-27 and 12-15 | 28-31
+      const __m256i o0 = _mm256_unpacklo_epi16(rgLo, baLo);
+      const __m256i o1 = _mm256_unpackhi_epi16(rgLo, baLo);
+      const __m256i o2 = _mm256_unpacklo_epi16(rgHi, baHi);
+      const __m256i o3 = _mm256_unpackhi_epi16(rgHi, baHi);
+      uint8_t* p = out + x*4;
+      store256(p, _mm256_permute2x128_si256(o0, o1, 0x20));
+      store256(p + 32, _mm256_permute2x128_si256(o2, o3, 0x20));
+      store256(p + 64, _mm256_permute2x128_si256(o0, o1, 0x31));
+      store256(p + 96, _mm256_permute2x128_si256(o2, o3, 0x31));
+    }
+    return x;
+  }
+
+  #undef MICROCV_MERGE_SHUFFLES
+  #undef MICROCV_QUAD_SHUFFLE
+#endif
+}
+
+void Kernels::deinterleaveRow(const uint8_t* row, uint8_t* const* planeRows, int width, int channels)
+{
+  if(channels == 1)
+  {
+    std::memcpy(planeRows[0], row, width);
+    return;
+  }
+  int x = 0;
+#ifdef MICROCV_X86_SIMD
+  const SimdLevel level = simdLevel();
+  if(channels == 3)
+  {
+    if(level >= SimdAvx2)
+      x = deinterleave3Avx2(row, planeRows, x, width);
+    if(level >= SimdSsse3)
+      x = deinterleave3Ssse3(row, planeRows, x, width);
+    if(level >= SimdSse2)
+      x = deinterleave3Sse2(row, planeRows, x, width);
+  }
+  else if(channels == 4)
+  {
+    if(level >= SimdAvx2)
+      x = deinterleave4Avx2(row, planeRows, x, width);
+    if(level >= SimdSsse3)
+      x = deinterleave4Ssse3(row, planeRows, x, width);
+  }
+#endif
+  deinterleaveScalar(row, planeRows, x, width, channels);
+}
+
+void Kernels::interleaveRow(const uint8_t* const* planeRows, uint8_t* row, int width, int channels)
+{
+  if(channels == 1)
+  {
+    std::memcpy(row, planeRows[0], width);
+    return;
+  }
+  int x = 0;
+#ifdef MICROCV_X86_SIMD
+  const SimdLevel level = simdLevel();
+  if(channels == 3)
+  {
+    if(level >= SimdAvx2)
+      x = interleave3Avx2(planeRows, row, x, width);
+    if(level >= SimdSsse3)
+      x = interleave3Ssse3(planeRows, row, x, width);
+  }
+  else if(channels == 4)
+  {
+    if(level >= SimdAvx2)
+      x = interleave4Avx2(planeRows, row, x, width);
+    if(level >= SimdSse2)
+      x = interleave4Sse2(planeRows, row, x, width);
+  }
+#endif
+  interleaveScalar(planeRows, row, x, width, channels);
+}
+
+const uint8_t* Kernels::interleavedRow(const MatView& view, int y, uint8_t* scratch)
+{
+  if(!view.isPlanar())
+    return view.row(y);
+  const int channels = view.channels();
+  const uint8_t* row = view.row(y);
+  if(channels > MAX_FAST_CHANNELS)
+  {
+    for(int c = 0; c < channels; c++)
+    {
+      const uint8_t* plane = row + c * view.planeStride();
+      for(int x = 0; x < view.width(); x++)
+        scratch[x*channels + c] = plane[x];
+    }
+    return scratch;
+  }
+  const uint8_t* planeRows[MAX_FAST_CHANNELS];
+  for(int c = 0; c < channels; c++)
+    planeRows[c] = row + c * view.planeStride();
+  interleaveRow(planeRows, scratch, view.width(), channels);
+  return scratch;
+}
@@ -0,0 +1,25 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+
+#include "Mat.h"
+
+namespace MicroCv
+{
+namespace Kernels
+{
+  // Split one row of width interleaved pixels into one row of each of the channels planes,
+  // dispatched on simdLevel() (3 and 4 channel rows have SIMD kernels)
+  void deinterleaveRow(const uint8_t* row, uint8_t* const* planeRows, int width, int channels);
+
+  // Merge one row of each of the channels planes into one row of interleaved pixels
+  void interleaveRow(const uint8_t* const* planeRows, uint8_t* row, int width, int channels);
+
+  // Row y of the view with its pixels interleaved: the row itself, or for a planar view the row
+  // merged from the planes into scratch (width * channels bytes)
+  const uint8_t* interleavedRow(const MatView& view, int y, uint8_t* scratch);
+};
+};
@@ -0,0 +1,377 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <png.h>
+
+#include "ImageCodecs.h"
+
+using namespace MicroCv;
+using namespace MicroCv::Codecs;
+
+namespace
+{
+  const int PNG_SIGNATURE_BYTES = 8;
+
+  // libpng reports fatal errors through this handler, it must not return so we jump
+  // back to the setjmp in the decoder method that made the failing call
+  void pngError(png_structp png, png_const_charp message)
+  {
+    std::cerr << "ERROR: " << message << std::endl;
+    png_longjmp(png, 1);
+  }
+
+  void pngWarning(png_structp, png_const_charp)
+  {
+  }
+
+  class PngDecoder : public ImageDecoder
+  {
+  public:
+    PngDecoder()
+    : png_(nullptr)
+    , info_(nullptr)
+    , file_(nullptr)
+    , bitDepth_(8)
+    , depth_(DepthU8)
+    , hasAlpha_(false)
+    , interlaced_(false)
+    , started_(false)
+    , scale_(1)
+    , rowsRead_(0)
+    {
+    }
+
+    ~PngDecoder()
+    {
+      if(png_)
+        png_destroy_read_struct(&png_, info_ ? &info_ : nullptr, nullptr);
+      if(file_)
+        fclose(file_);
+    }
+
+    bool open(const std::string& filename)
+    {
+      file_ = fopen(filename.c_str(), "rb");
+      png_byte signature[PNG_SIGNATURE_BYTES];
+      if(!file_ || fread(signature, 1, PNG_SIGNATURE_BYTES, file_) != PNG_SIGNATURE_BYTES
+          || png_sig_cmp(signature, 0, PNG_SIGNATURE_BYTES) != 0)
+      {
+        std::cerr << "ERROR: " << filename << " is not a PNG file" << std::endl;
+        return false;
+      }
+
+      png_ = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, pngError, pngWarning);
+      if(png_)
+        info_ = png_create_info_struct(png_);
+      if(!info_)
+        return false;
+      if(setjmp(png_jmpbuf(png_)))
+        return false;
+
+      png_init_io(png_, file_);
+      png_set_sig_bytes(png_, PNG_SIGNATURE_BYTES);
+      png_read_info(png_, info_);
+
+      const int colorType = png_get_color_type(png_, info_);
+      bitDepth_ = png_get_bit_depth(png_, info_);
+
+      // Normalize everything to 8 bit (or 16 bit, see setDepth()) gray or RGB, plus an alpha channel if there is one
+      if(colorType == PNG_COLOR_TYPE_PALETTE)
+        png_set_palette_to_rgb(png_);
+      if(colorType == PNG_COLOR_TYPE_GRAY && bitDepth_ < 8)
+        png_set_expand_gray_1_2_4_to_8(png_);
+      if(png_get_valid(png_, info_, PNG_INFO_tRNS))
+      {
+        png_set_tRNS_to_alpha(png_);
+        hasAlpha_ = true;
+      }
+      if(colorType & PNG_COLOR_MASK_ALPHA)
+        hasAlpha_ = true;
+      interlaced_ = png_get_interlace_type(png_, info_) == PNG_INTERLACE_ADAM7;
+
+      width_ = png_get_image_width(png_, info_);
+      height_ = png_get_image_height(png_, info_);
+      const bool isColor = colorType == PNG_COLOR_TYPE_PALETTE || (colorType & PNG_COLOR_MASK_COLOR);
+      channels_ = isColor ? 3 : 1;
+      return true;
+    }
+
+    bool setDepth(MatDepth depth)
+    {
+      if(depth == DepthU8 || (depth == DepthU16 && bitDepth_ == 16))
+      {
+        depth_ = depth;
+        return true;
+      }
+      return false;
+    }
+
+    bool setScale(int denominator)
+    {
+      // Only interlaced images store a reduced image that can be decoded on its own
+      if(!interlaced_ || started_)
+        return false;
+      scale_ = denominator;
+      width_ = (width_ + denominator - 1) / denominator;
+      height_ = (height_ + denominator - 1) / denominator;
+      return true;
+    }
+
+    bool readRows(uint8_t* dst, int stride, int numRows)
+    {
+      if(rowsRead_ + numRows > height_)
+        return false;
+      if(setjmp(png_jmpbuf(png_)))
+        return false;
+      if(!started_)
+      {
+        // PNG stores 16 bit samples most significant byte first. 8 bit reads round them to value / 257
+        // like convertDepth rather than dropping the low byte
+        if(bitDepth_ == 16 && depth_ == DepthU8)
+          png_set_scale_16(png_);
+        else if(bitDepth_ == 16 && isLittleEndian())
+          png_set_swap(png_);
+        // A scaled read decodes the interlace passes itself
+        if(interlaced_ && scale_ == 1)
+          png_set_interlace_handling(png_);
+        png_read_update_info(png_, info_);
+        started_ = true;
+      }
+
+      const size_t decodedRowBytes = png_get_rowbytes(png_, info_);
+      if(scale_ > 1)
+      {
+        if(image_.empty())
+          decodeReducedImage();
+        const size_t reducedRowBytes = static_cast<size_t>(width_) * png_get_channels(png_, info_) * sampleBytes();
+        for(int row = 0; row < numRows; row++)
+          convertRow(image_.data() + (rowsRead_ + row) * reducedRowBytes, dst + static_cast<ptrdiff_t>(row) * stride);
+      }
+      else if(interlaced_)
+      {
+        // Interlaced rows are only complete after the last pass
+        if(!hasAlpha_ && rowsRead_ == 0 && numRows == height_)
+        {
+          decodeImage(dst, stride);
+        }
+        else
+        {
+          if(image_.empty())
+          {
+            image_.resize(decodedRowBytes * height_);
+            decodeImage(image_.data(), static_cast<int>(decodedRowBytes));
+          }
+          for(int row = 0; row < numRows; row++)
+            convertRow(image_.data() + (rowsRead_ + row) * decodedRowBytes, dst + static_cast<ptrdiff_t>(row) * stride);
+        }
+      }
+      else if(!hasAlpha_)
+      {
+        // libpng writes the scanlines directly into the destination rows
+        for(int row = 0; row < numRows; row++)
+          png_read_row(png_, dst + static_cast<ptrdiff_t>(row) * stride, nullptr);
+      }
+      else
+      {
+        scratchRow_.resize(decodedRowBytes);
+        for(int row = 0; row < numRows; row++)
+        {
+          png_read_row(png_, scratchRow_.data(), nullptr);
+          convertRow(scratchRow_.data(), dst + static_cast<ptrdiff_t>(row) * stride);
+        }
+      }
+
+      rowsRead_ += numRows;
+      // The passes after the reduced image are never read
+      if(rowsRead_ == height_ && scale_ == 1)
+        png_read_end(png_, nullptr);
+      return true;
+    }
+
+  private:
+    void decodeImage(uint8_t* dst, int stride)
+    {
+      rowPtrs_.resize(height_);
+      for(int row = 0; row < height_; row++)
+        rowPtrs_[row] = dst + static_cast<ptrdiff_t>(row) * stride;
+      png_read_image(png_, rowPtrs_.data());
+    }
+
+    // Adam7 passes 1, 1-3 and 1-5 hold exactly the pixels on every 8th, 4th and 2nd row and
+    // column, so the image shrunk by 1/scale_ is decoded without the rest of the data
+    void decodeReducedImage()
+    {
+      const png_uint_32 fullWidth = png_get_image_width(png_, info_);
+      const png_uint_32 fullHeight = png_get_image_height(png_, info_);
+      const size_t pixelBytes = png_get_channels(png_, info_) * sampleBytes();
+      const size_t reducedRowBytes = width_ * pixelBytes;
+      const int numPasses = scale_ == 8 ? 1 : scale_ == 4 ? 3 : 5;
+
+      image_.resize(reducedRowBytes * height_);
+      scratchRow_.resize(png_get_rowbytes(png_, info_));
+      for(int pass = 0; pass < numPasses; pass++)
+      {
+        const png_uint_32 passWidth = PNG_PASS_COLS(fullWidth, pass);
+        const png_uint_32 passHeight = PNG_PASS_ROWS(fullHeight, pass);
+        // libpng skips empty passes, so there are no rows to read for them
+        if(passWidth == 0 || passHeight == 0)
+          continue;
+        for(png_uint_32 passRow = 0; passRow < passHeight; passRow++)
+        {
+          png_read_row(png_, scratchRow_.data(), nullptr);
+          const png_uint_32 y = (PNG_PASS_START_ROW(pass) + (passRow << PNG_PASS_ROW_SHIFT(pass))) / scale_;
+          uint8_t* reducedRow = image_.data() + y * reducedRowBytes;
+          for(png_uint_32 passCol = 0; passCol < passWidth; passCol++)
+          {
+            const png_uint_32 x = (PNG_PASS_START_COL(pass) + (passCol << PNG_PASS_COL_SHIFT(pass))) / scale_;
+            std::memcpy(reducedRow + x * pixelBytes, scratchRow_.data() + passCol * pixelBytes, pixelBytes);
+          }
+        }
+      }
+    }
+
+    size_t sampleBytes() const
+    {
+      return depth_ == DepthU16 ? 2 : 1;
+    }
+
+    // Remove the alpha channel by blending onto black, the same as converting RGBA to RGB in GIL
+    void convertRow(const uint8_t* decoded, uint8_t* dst) const
+    {
+      if(!hasAlpha_)
+        std::memcpy(dst, decoded, static_cast<size_t>(width_) * channels_ * sampleBytes());
+      else if(depth_ == DepthU16)
+        blendAlpha(reinterpret_cast<const uint16_t*>(decoded), reinterpret_cast<uint16_t*>(dst));
+      else
+        blendAlpha(decoded, dst);
+    }
+
+    template<typename T>
+    void blendAlpha(const T* decoded, T* dst) const
+    {
+      for(int x = 0; x < width_; x++, decoded += channels_ + 1, dst += channels_)
+      {
+        for(int c = 0; c < channels_; c++)
+          dst[c] = multiplyAlpha(decoded[c], decoded[channels_]);
+      }
+    }
+
+    png_structp png_;
+    png_infop info_;
+    FILE* file_;
+    int bitDepth_;
+    MatDepth depth_;
+    bool hasAlpha_;
+    bool interlaced_;
+    bool started_;
+    int scale_;
+    int rowsRead_;
+    std::vector<uint8_t> scratchRow_;
+    std::vector<uint8_t> image_;
+    std::vector<png_bytep> rowPtrs_;
+  };
+
+  class PngEncoder : public ImageEncoder
+  {
+  public:
+    PngEncoder()
+    : png_(nullptr)
+    , info_(nullptr)
+    , file_(nullptr)
+    , depth_(DepthU8)
+    {
+    }
+
+    ~PngEncoder()
+    {
+      if(png_)
+        png_destroy_write_struct(&png_, info_ ? &info_ : nullptr);
+      if(file_)
+        fclose(file_);
+    }
+
+    bool setDepth(MatDepth depth)
+    {
+      if(depth != DepthU8 && depth != DepthU16)
+        return false;
+      depth_ = depth;
+      return true;
+    }
+
+    bool open(const std::string& filename, int width, int height, int channels)
+    {
+      file_ = fopen(filename.c_str(), "wb");
+      if(!file_)
+      {
+        std::cerr << "ERROR: could not create " << filename << std::endl;
+        return false;
+      }
+
+      png_ = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, pngError, pngWarning);
+      if(png_)
+        info_ = png_create_info_struct(png_);
+      if(!info_)
+        return false;
+      if(setjmp(png_jmpbuf(png_)))
+        return false;
+
+      png_init_io(png_, file_);
+      const int colorType = channels == 1 ? PNG_COLOR_TYPE_GRAY : PNG_COLOR_TYPE_RGB;
+      const int bitDepth = depth_ == DepthU16 ? 16 : 8;
+      png_set_IHDR(png_, info_, width, height, bitDepth, colorType, PNG_INTERLACE_NONE,
+          PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+      png_write_info(png_, info_);
+      // The rows hold 16 bit values in native byte order, PNG stores them most significant byte first
+      if(bitDepth == 16 && isLittleEndian())
+        png_set_swap(png_);
+      return true;
+    }
+
+    bool writeRows(const uint8_t* src, int stride, int numRows)
+    {
+      if(setjmp(png_jmpbuf(png_)))
+        return false;
+
+      // libpng reads the scanlines directly from the source rows
+      for(int row = 0; row < numRows; row++)
+        png_write_row(png_, src + static_cast<ptrdiff_t>(row) * stride);
+      return true;
+    }
+
+    bool close()
+    {
+      if(!png_)
+        return false;
+      if(setjmp(png_jmpbuf(png_)))
+        return false;
+
+      png_write_end(png_, nullptr);
+      const bool ok = fclose(file_) == 0;
+      file_ = nullptr;
+      return ok;
+    }
+
+  private:
+    png_structp png_;
+    png_infop info_;
+    FILE* file_;
+    MatDepth depth_;
+  };
+}
+
+std::unique_ptr<ImageDecoder> MicroCv::Codecs::createPngDecoder()
+{
+  return std::unique_ptr<ImageDecoder>(new PngDecoder());
+}
+
+std::unique_ptr<ImageEncoder> MicroCv::Codecs::createPngEncoder()
+{
+  return std::unique_ptr<ImageEncoder>(new PngEncoder());
+}
@@ -0,0 +1,311 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ImageCodecs.h"
+#include "Mat.h"
+
+using namespace MicroCv::Codecs;
+
+/*
+ * .mcv layout (all integers little endian):
+ *   0  "MICROCV1" magic
+ *   8  uint32 width, height, channels, stride
+ *   24 uint32 offset of the first row (64)
+ *   28 zero padding up to 64 bytes
+ * followed by height rows of stride bytes. The stride is a multiple of 64, so every row of a file
+ * mapped into memory (which is page aligned) starts on a cache line.
+ */
+namespace
+{
+  const char MCV_MAGIC[8] = {'M', 'I', 'C', 'R', 'O', 'C', 'V', '1'};
+
+  uint32_t readUint32(const uint8_t* ptr)
+  {
+    return static_cast<uint32_t>(ptr[0]) | (static_cast<uint32_t>(ptr[1]) << 8)
+        | (static_cast<uint32_t>(ptr[2]) << 16) | (static_cast<uint32_t>(ptr[3]) << 24);
+  }
+
+  void writeUint32(uint8_t* ptr, uint32_t value)
+  {
+    ptr[0] = static_cast<uint8_t>(value);
+    ptr[1] = static_cast<uint8_t>(value >> 8);
+    ptr[2] = static_cast<uint8_t>(value >> 16);
+    ptr[3] = static_cast<uint8_t>(value >> 24);
+  }
+
+  // Reads the next decimal number of a PGM/PPM header, skipping whitespace and # comments
+  bool readPnmNumber(const uint8_t* header, size_t headerSize, size_t& pos, int& value)
+  {
+    while(pos < headerSize)
+    {
+      if(header[pos] == '#')
+      {
+        while(pos < headerSize && header[pos] != '\n')
+          pos++;
+      }
+      else if(std::isspace(header[pos]))
+      {
+        pos++;
+      }
+      else
+      {
+        break;
+      }
+    }
+    int64_t number = 0;
+    const size_t start = pos;
+    for(; pos < headerSize && std::isdigit(header[pos]) && number <= INT32_MAX; pos++)
+      number = number*10 + (header[pos] - '0');
+    value = static_cast<int>(number);
+    return pos > start && pos < headerSize && number <= INT32_MAX;
+  }
+
+  bool fitsInFile(const RawLayout& layout, uint64_t fileSize)
+  {
+    if(layout.width <= 0 || layout.height <= 0)
+      return false;
+    const uint64_t rowBytes = static_cast<uint64_t>(layout.width) * layout.channels;
+    return layout.dataOffset + static_cast<uint64_t>(layout.stride) * (layout.height - 1) + rowBytes <= fileSize;
+  }
+
+  // Reads the rows of an uncompressed file with fread, the header is parsed by one of the parse functions
+  class RawDecoder : public ImageDecoder
+  {
+  public:
+    typedef bool (*ParseHeader)(const uint8_t*, size_t, uint64_t, RawLayout&);
+
+    RawDecoder(ParseHeader parseHeader, const char* formatName)
+    : parseHeader_(parseHeader)
+    , formatName_(formatName)
+    , file_(nullptr)
+    {
+    }
+
+    ~RawDecoder()
+    {
+      if(file_)
+        std::fclose(file_);
+    }
+
+    bool open(const std::string& filename)
+    {
+      file_ = std::fopen(filename.c_str(), "rb");
+      if(!file_)
+      {
+        std::cerr << "Could not open " << filename << std::endl;
+        return false;
+      }
+      std::fseek(file_, 0, SEEK_END);
+      const uint64_t fileSize = static_cast<uint64_t>(ftello(file_));
+      std::rewind(file_);
+
+      std::vector<uint8_t> header(static_cast<size_t>(std::min<uint64_t>(fileSize, MAX_RAW_HEADER_SIZE)));
+      if(std::fread(header.data(), 1, header.size(), file_) != header.size()
+          || !parseHeader_(header.data(), header.size(), fileSize, layout_))
+      {
+        std::cerr << filename << " is not a valid " << formatName_ << " file" << std::endl;
+        return false;
+      }
+      width_ = layout_.width;
+      height_ = layout_.height;
+      channels_ = layout_.channels;
+      return fseeko(file_, static_cast<off_t>(layout_.dataOffset), SEEK_SET) == 0;
+    }
+
+    bool setRegion(int x1, int y1, int x2, int y2)
+    {
+      // Start at the first pixel of the region, readRows() then skips the rest of every row
+      const uint64_t offset = layout_.dataOffset + static_cast<uint64_t>(y1) * layout_.stride + static_cast<uint64_t>(x1) * channels_;
+      if(fseeko(file_, static_cast<off_t>(offset), SEEK_SET) != 0)
+        return false;
+      width_ = x2 - x1;
+      height_ = y2 - y1;
+      return true;
+    }
+
+    bool readRows(uint8_t* dst, int stride, int numRows)
+    {
+      const size_t rowBytes = static_cast<size_t>(width_) * channels_;
+      const long padding = static_cast<long>(layout_.stride - static_cast<int>(rowBytes));
+      for(int row = 0; row < numRows; row++)
+      {
+        uint8_t* rowPtr = dst + static_cast<ptrdiff_t>(row) * stride;
+        if(std::fread(rowPtr, 1, rowBytes, file_) != rowBytes)
+        {
+          std::cerr << "Unexpected end of " << formatName_ << " file" << std::endl;
+          return false;
+        }
+        if(padding > 0 && std::fseek(file_, padding, SEEK_CUR) != 0)
+          return false;
+        // Stretch PGM/PPM files with fewer levels to the full 8 bit range
+        if(layout_.maxValue != 255)
+        {
+          const int maxValue = layout_.maxValue;
+          for(size_t i = 0; i < rowBytes; i++)
+            rowPtr[i] = static_cast<uint8_t>(std::min(255, (rowPtr[i]*255 + maxValue/2) / maxValue));
+        }
+      }
+      return true;
+    }
+
+  private:
+    ParseHeader parseHeader_;
+    const char* formatName_;
+    FILE* file_;
+    RawLayout layout_;
+  };
+
+  // Writes a header followed by the rows, each row is followed by zero padding up to stride bytes
+  class RawEncoder : public ImageEncoder
+  {
+  public:
+    explicit RawEncoder(bool mcv)
+    : mcv_(mcv)
+    , file_(nullptr)
+    , rowBytes_(0)
+    {
+    }
+
+    ~RawEncoder()
+    {
+      if(file_)
+        std::fclose(file_);
+    }
+
+    bool open(const std::string& filename, int width, int height, int channels)
+    {
+      file_ = std::fopen(filename.c_str(), "wb");
+      if(!file_)
+      {
+        std::cerr << "Could not create " << filename << std::endl;
+        return false;
+      }
+      rowBytes_ = static_cast<size_t>(width) * channels;
+
+      std::string header;
+      if(mcv_)
+      {
+        const int stride = MicroCv::alignedStride(width, channels);
+        padding_.assign(stride - rowBytes_, 0);
+        uint8_t mcvHeader[MCV_HEADER_SIZE] = {0};
+        std::memcpy(mcvHeader, MCV_MAGIC, sizeof(MCV_MAGIC));
+        writeUint32(mcvHeader + 8, width);
+        writeUint32(mcvHeader + 12, height);
+        writeUint32(mcvHeader + 16, channels);
+        writeUint32(mcvHeader + 20, stride);
+        writeUint32(mcvHeader + 24, MCV_HEADER_SIZE);
+        header.assign(reinterpret_cast<char*>(mcvHeader), MCV_HEADER_SIZE);
+      }
+      else
+      {
+        header = (channels == 1 ? "P5\n" : "P6\n") + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+      }
+      return std::fwrite(header.data(), 1, header.size(), file_) == header.size();
+    }
+
+    bool writeRows(const uint8_t* src, int stride, int numRows)
+    {
+      for(int row = 0; row < numRows; row++)
+      {
+        if(std::fwrite(src + static_cast<ptrdiff_t>(row) * stride, 1, rowBytes_, file_) != rowBytes_)
+          return false;
+        if(!padding_.empty() && std::fwrite(padding_.data(), 1, padding_.size(), file_) != padding_.size())
+          return false;
+      }
+      return true;
+    }
+
+    bool close()
+    {
+      if(!file_)
+        return false;
+      const bool ok = std::fflush(file_) == 0 && !std::ferror(file_);
+      const bool closed = std::fclose(file_) == 0;
+      file_ = nullptr;
+      return ok && closed;
+    }
+
+  private:
+    bool mcv_;
+    FILE* file_;
+    size_t rowBytes_;
+    std::vector<uint8_t> padding_;
+  };
+}
+
+bool MicroCv::Codecs::parseMcvHeader(const uint8_t* header, size_t headerSize, uint64_t fileSize, RawLayout& layout)
+{
+  if(headerSize < MCV_HEADER_SIZE || std::memcmp(header, MCV_MAGIC, sizeof(MCV_MAGIC)) != 0)
+    return false;
+  const uint32_t width = readUint32(header + 8);
+  const uint32_t height = readUint32(header + 12);
+  const uint32_t channels = readUint32(header + 16);
+  const uint32_t stride = readUint32(header + 20);
+  const uint32_t dataOffset = readUint32(header + 24);
+  if(width > INT32_MAX || height > INT32_MAX || (channels != 1 && channels != 3) || dataOffset < MCV_HEADER_SIZE
+      || stride > INT32_MAX || static_cast<uint64_t>(stride) < static_cast<uint64_t>(width) * channels)
+    return false;
+
+  layout.width = static_cast<int>(width);
+  layout.height = static_cast<int>(height);
+  layout.channels = static_cast<int>(channels);
+  layout.stride = static_cast<int>(stride);
+  layout.dataOffset = dataOffset;
+  layout.maxValue = 255;
+  return fitsInFile(layout, fileSize);
+}
+
+bool MicroCv::Codecs::parsePnmHeader(const uint8_t* header, size_t headerSize, uint64_t fileSize, RawLayout& layout)
+{
+  // Only the binary variants: P5 is gray and P6 is RGB
+  if(headerSize < 2 || header[0] != 'P' || (header[1] != '5' && header[1] != '6'))
+    return false;
+  size_t pos = 2;
+  int width, height, maxValue;
+  if(!readPnmNumber(header, headerSize, pos, width) || !readPnmNumber(header, headerSize, pos, height)
+      || !readPnmNumber(header, headerSize, pos, maxValue))
+    return false;
+  // 16 bit samples are not supported
+  if(maxValue < 1 || maxValue > 255 || !std::isspace(header[pos]))
+    return false;
+
+  layout.width = width;
+  layout.height = height;
+  layout.channels = header[1] == '5' ? 1 : 3;
+  if(static_cast<int64_t>(width) * layout.channels > INT32_MAX)
+    return false;
+  layout.stride = width * layout.channels;
+  // A single whitespace character separates the header from the pixels
+  layout.dataOffset = pos + 1;
+  layout.maxValue = maxValue;
+  return fitsInFile(layout, fileSize);
+}
+
+std::unique_ptr<ImageDecoder> MicroCv::Codecs::createMcvDecoder()
+{
+  return std::unique_ptr<ImageDecoder>(new RawDecoder(parseMcvHeader, "MicroCv raw"));
+}
+
+std::unique_ptr<ImageDecoder> MicroCv::Codecs::createPnmDecoder()
+{
+  return std::unique_ptr<ImageDecoder>(new RawDecoder(parsePnmHeader, "binary PGM/PPM"));
+}
+
+std::unique_ptr<ImageEncoder> MicroCv::Codecs::createMcvEncoder()
+{
+  return std::unique_ptr<ImageEncoder>(new RawEncoder(true));
+}
+
+std::unique_ptr<ImageEncoder> MicroCv::Codecs::createPnmEncoder()
+{
+  return std::unique_ptr<ImageEncoder>(new RawEncoder(false));
+}
@@ -0,0 +1,309 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "CpuFeatures.h"
+#include "ResizeKernels.h"
+
+#ifdef MICROCV_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace MicroCv;
+using Kernels::RESIZE_COEFF_BITS;
+
+namespace
+{
+  const int32_t RESIZE_ROUND = 1 << (RESIZE_COEFF_BITS - 1);
+  const double PI = 3.14159265358979323846;
+
+  double triangleFilter(double x)
+  {
+    x = std::fabs(x);
+    return x < 1.0 ? 1.0 - x : 0.0;
+  }
+
+  double sinc(double x)
+  {
+    if(x == 0.0)
+      return 1.0;
+    x *= PI;
+    return std::sin(x) / x;
+  }
+
+  double lanczos3Filter(double x)
+  {
+    return std::fabs(x) < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+  }
+
+  inline uint8_t clampPixel(int32_t sum)
+  {
+    const int32_t value = (sum + RESIZE_ROUND) >> RESIZE_COEFF_BITS;
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+  }
+
+  void horizontalScalar(const uint8_t* in, uint8_t* out, int channels, const Kernels::ResizeCoefficients& c)
+  {
+    const int outWidth = static_cast<int>(c.starts.size());
+    for(int x = 0; x < outWidth; x++)
+    {
+      const uint8_t* src = in + c.starts[x] * channels;
+      const int16_t* w = c.weights.data() + static_cast<size_t>(x) * c.taps;
+      for(int ch = 0; ch < channels; ch++)
+      {
+        int32_t sum = 0;
+        for(int t = 0; t < c.taps; t++)
+          sum += src[t * channels + ch] * w[t];
+        out[x * channels + ch] = clampPixel(sum);
+      }
+    }
+  }
+
+  void verticalScalar(const uint8_t* const* rows, const int16_t* w, int taps, uint8_t* out, int x, int rowBytes)
+  {
+    for(; x < rowBytes; x++)
+    {
+      int32_t sum = 0;
+      for(int t = 0; t < taps; t++)
+        sum += rows[t][x] * w[t];
+      out[x] = clampPixel(sum);
+    }
+  }
+
+#ifdef MICROCV_X86_SIMD
+  // Two int16 weights in every int32 lane, for madds of interleaved pixel pairs
+  inline int32_t weightPair(int16_t w0, int16_t w1)
+  {
+    return static_cast<int32_t>(static_cast<uint16_t>(w0) | (static_cast<uint32_t>(static_cast<uint16_t>(w1)) << 16));
+  }
+
+  // Gray output pixels are dot products of 8 taps at a time
+  __attribute__((target("sse2")))
+  void horizontalGraySse2(const uint8_t* in, uint8_t* out, const Kernels::ResizeCoefficients& c)
+  {
+    const int outWidth = static_cast<int>(c.starts.size());
+    const __m128i zero = _mm_setzero_si128();
+    for(int x = 0; x < outWidth; x++)
+    {
+      const uint8_t* src = in + c.starts[x];
+      const int16_t* w = c.weights.data() + static_cast<size_t>(x) * c.taps;
+      __m128i acc = zero;
+      int t = 0;
+      for(; t + 8 <= c.taps; t += 8)
+      {
+        const __m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + t)), zero);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(pixels, _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + t))));
+      }
+      acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+      acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+      int32_t sum = _mm_cvtsi128_si32(acc);
+      for(; t < c.taps; t++)
+        sum += src[t] * w[t];
+      out[x] = clampPixel(sum);
+    }
+  }
+
+  // RGB taps are taken two pixels at a time, shuffled into (p0, p1) pairs of every channel
+  __attribute__((target("ssse3")))
+  void horizontalRgbSsse3(const uint8_t* in, uint8_t* out, const Kernels::ResizeCoefficients& c, int inRowBytes)
+  {
+    const __m128i pairMask = _mm_setr_epi8(0, -1, 3, -1, 1, -1, 4, -1, 2, -1, 5, -1, -1, -1, -1, -1);
+    const int outWidth = static_cast<int>(c.starts.size());
+    int32_t sums[4];
+    for(int x = 0; x < outWidth; x++)
+    {
+      const uint8_t* src = in + c.starts[x] * 3;
+      const int16_t* w = c.weights.data() + static_cast<size_t>(x) * c.taps;
+      // The 8 byte loads read 2 bytes past the pair, which must still be inside the row
+      const int srcBytes = inRowBytes - c.starts[x] * 3;
+      __m128i acc = _mm_setzero_si128();
+      int t = 0;
+      for(; t + 2 <= c.taps && t * 3 + 8 <= srcBytes; t += 2)
+      {
+        const __m128i pixels = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + t * 3)), pairMask);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(pixels, _mm_set1_epi32(weightPair(w[t], w[t + 1]))));
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), acc);
+      for(; t < c.taps; t++)
+      {
+        sums[0] += src[t * 3] * w[t];
+        sums[1] += src[t * 3 + 1] * w[t];
+        sums[2] += src[t * 3 + 2] * w[t];
+      }
+      out[x * 3] = clampPixel(sums[0]);
+      out[x * 3 + 1] = clampPixel(sums[1]);
+      out[x * 3 + 2] = clampPixel(sums[2]);
+    }
+  }
+
+  // Every madd multiplies a pixel of two rows by their weights, 16 output bytes per iteration
+  __attribute__((target("sse2")))
+  void verticalSse2(const uint8_t* const* rows, const int16_t* w, int taps, uint8_t* out, int x, int rowBytes)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(RESIZE_ROUND);
+    for(; x + 16 <= rowBytes; x += 16)
+    {
+      __m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+      for(int t = 0; t < taps; t += 2)
+      {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[t] + x));
+        const __m128i b = t + 1 < taps ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[t + 1] + x)) : zero;
+        const __m128i weights = _mm_set1_epi32(weightPair(w[t], t + 1 < taps ? w[t + 1] : 0));
+        const __m128i lo = _mm_unpacklo_epi8(a, b);
+        const __m128i hi = _mm_unpackhi_epi8(a, b);
+        acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), weights));
+        acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), weights));
+        acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), weights));
+        acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), weights));
+      }
+      const __m128i lo16 = _mm_packs_epi32(_mm_srai_epi32(acc0, RESIZE_COEFF_BITS), _mm_srai_epi32(acc1, RESIZE_COEFF_BITS));
+      const __m128i hi16 = _mm_packs_epi32(_mm_srai_epi32(acc2, RESIZE_COEFF_BITS), _mm_srai_epi32(acc3, RESIZE_COEFF_BITS));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(lo16, hi16));
+    }
+    verticalScalar(rows, w, taps, out, x, rowBytes);
+  }
+
+  __attribute__((target("avx2")))
+  void verticalAvx2(const uint8_t* const* rows, const int16_t* w, int taps, uint8_t* out, int rowBytes)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi32(RESIZE_ROUND);
+    int x = 0;
+    for(; x + 32 <= rowBytes; x += 32)
+    {
+      __m256i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+      for(int t = 0; t < taps; t += 2)
+      {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[t] + x));
+        const __m256i b = t + 1 < taps ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[t + 1] + x)) : zero;
+        const __m256i weights = _mm256_set1_epi32(weightPair(w[t], t + 1 < taps ? w[t + 1] : 0));
+        const __m256i lo = _mm256_unpacklo_epi8(a, b);
+        const __m256i hi = _mm256_unpackhi_epi8(a, b);
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), weights));
+        acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), weights));
+        acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), weights));
+        acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), weights));
+      }
+      // Unpacking and packing are both in-lane, so the pixel order comes back out unchanged
+      const __m256i lo16 = _mm256_packs_epi32(_mm256_srai_epi32(acc0, RESIZE_COEFF_BITS), _mm256_srai_epi32(acc1, RESIZE_COEFF_BITS));
+      const __m256i hi16 = _mm256_packs_epi32(_mm256_srai_epi32(acc2, RESIZE_COEFF_BITS), _mm256_srai_epi32(acc3, RESIZE_COEFF_BITS));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_packus_epi16(lo16, hi16));
+    }
+    verticalSse2(rows, w, taps, out, x, rowBytes);
+  }
+#endif
+}
+
+Kernels::ResizeCoefficients Kernels::resizeCoefficients(int inSize, int outSize, ResizeMethod method)
+{
+  // Unquantized weights of every output pixel, starting at input pixel firsts[i]
+  std::vector<int> firsts(outSize);
+  std::vector<std::vector<double>> weights(outSize);
+  const double scale = static_cast<double>(inSize) / outSize;
+  for(int i = 0; i < outSize; i++)
+  {
+    if(method == ResizeArea)
+    {
+      // Output pixel i covers [i*inSize, (i+1)*inSize) and input pixel j [j*outSize, (j+1)*outSize),
+      // the weights are their exact overlaps
+      const int64_t begin = static_cast<int64_t>(i) * inSize;
+      const int64_t end = begin + inSize;
+      firsts[i] = static_cast<int>(begin / outSize);
+      for(int j = firsts[i]; static_cast<int64_t>(j) * outSize < end; j++)
+      {
+        const int64_t overlap = std::min(end, static_cast<int64_t>(j + 1) * outSize) - std::max(begin, static_cast<int64_t>(j) * outSize);
+        weights[i].push_back(static_cast<double>(overlap));
+      }
+    }
+    else
+    {
+      // Shrinking stretches the filter so that every input pixel contributes (no aliasing)
+      const double filterScale = std::max(scale, 1.0);
+      const double support = (method == ResizeBilinear ? 1.0 : 3.0) * filterScale;
+      const double center = (i + 0.5) * scale;
+      firsts[i] = std::max(0, static_cast<int>(std::floor(center - support + 0.5)));
+      const int last = std::min(inSize, static_cast<int>(std::floor(center + support + 0.5)));
+      for(int j = firsts[i]; j < last; j++)
+      {
+        const double x = (j + 0.5 - center) / filterScale;
+        weights[i].push_back(method == ResizeBilinear ? triangleFilter(x) : lanczos3Filter(x));
+      }
+    }
+  }
+
+  ResizeCoefficients coeffs;
+  coeffs.taps = 1;
+  for(int i = 0; i < outSize; i++)
+    coeffs.taps = std::max(coeffs.taps, static_cast<int>(weights[i].size()));
+  coeffs.taps = std::min(coeffs.taps, inSize);
+  coeffs.starts.resize(outSize);
+  coeffs.weights.assign(static_cast<size_t>(outSize) * coeffs.taps, 0);
+
+  for(int i = 0; i < outSize; i++)
+  {
+    double sum = 0.0;
+    for(double w : weights[i])
+      sum += w;
+
+    // Windows near the end are moved left so they stay inside the input
+    coeffs.starts[i] = std::min(firsts[i], inSize - coeffs.taps);
+    int16_t* w = coeffs.weights.data() + static_cast<size_t>(i) * coeffs.taps + (firsts[i] - coeffs.starts[i]);
+    // The running sum of the weights is rounded rather than every weight on its own: each weight is
+    // then within 1 of its exact value and they add up to exactly 1 << RESIZE_COEFF_BITS, so that
+    // flat areas keep their exact value even when thousands of taps are each below 1
+    double cumulative = 0.0;
+    long rounded = 0;
+    for(size_t t = 0; t < weights[i].size(); t++)
+    {
+      cumulative += weights[i][t];
+      const long next = std::lround(cumulative / sum * (1 << RESIZE_COEFF_BITS));
+      w[t] = static_cast<int16_t>(next - rounded);
+      rounded = next;
+    }
+  }
+  return coeffs;
+}
+
+void Kernels::resizeRowHorizontal(const uint8_t* inRow, uint8_t* outRow, int channels, const ResizeCoefficients& coeffs)
+{
+#ifdef MICROCV_X86_SIMD
+  const SimdLevel level = simdLevel();
+  if(channels == 1 && level >= SimdSse2)
+  {
+    horizontalGraySse2(inRow, outRow, coeffs);
+    return;
+  }
+  if(channels == 3 && level >= SimdSsse3)
+  {
+    // The taps of the last output pixel end at the last input pixel
+    const int inRowBytes = (coeffs.starts.back() + coeffs.taps) * 3;
+    horizontalRgbSsse3(inRow, outRow, coeffs, inRowBytes);
+    return;
+  }
+#endif
+  horizontalScalar(inRow, outRow, channels, coeffs);
+}
+
+void Kernels::resizeRowVertical(const uint8_t* const* inRows, const int16_t* weights, int taps, uint8_t* outRow, int rowBytes)
+{
+#ifdef MICROCV_X86_SIMD
+  switch(simdLevel())
+  {
+    case SimdAvx2:
+      verticalAvx2(inRows, weights, taps, outRow, rowBytes);
+      return;
+    case SimdSsse3:
+    case SimdSse2:
+      verticalSse2(inRows, weights, taps, outRow, 0, rowBytes);
+      return;
+    default:
+      break;
+  }
+#endif
+  verticalScalar(inRows, weights, taps, outRow, 0, rowBytes);
+}
@@ -0,0 +1,36 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+#include <vector>
+
+#include "ImageProcessing.h"
+
+namespace MicroCv
+{
+namespace Kernels
+{
+  // Resampling weights are fixed point with this many fractional bits, small enough for int16 madds
+  const int RESIZE_COEFF_BITS = 14;
+
+  // Precomputed taps of a 1D resampling from inSize to outSize pixels. Output pixel i is
+  // (sum of in[starts[i] + t] * weights[i*taps + t] + round) >> RESIZE_COEFF_BITS clamped to [0, 255]
+  // Every output pixel has the same number of taps (the unused ones are 0) and the taps never
+  // reach past the input, so the kernels need no bounds checks
+  struct ResizeCoefficients
+  {
+    int taps;
+    std::vector<int> starts;
+    std::vector<int16_t> weights;
+  };
+
+  ResizeCoefficients resizeCoefficients(int inSize, int outSize, ResizeMethod method);
+
+  // Resample one row of packed 1 or 3 channel pixels horizontally, dispatched on simdLevel()
+  void resizeRowHorizontal(const uint8_t* inRow, uint8_t* outRow, int channels, const ResizeCoefficients& coeffs);
+  // Blend taps input rows into one output row of rowBytes bytes, dispatched on simdLevel()
+  void resizeRowVertical(const uint8_t* const* inRows, const int16_t* weights, int taps, uint8_t* outRow, int rowBytes);
+};
+};
@@ -0,0 +1,74 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+
+#ifdef MICROCV_X86_SIMD
+#include <immintrin.h>
+
+namespace MicroCv
+{
+namespace Kernels
+{
+  // Split 16 pixels of packed RGB (48 bytes) into 16 bytes of each channel. Every channel is
+  // gathered out of the three vectors with byte shuffles (-1 zeroes the byte) and or-ed together
+  __attribute__((target("ssse3")))
+  inline void splitRgbSsse3(const uint8_t* in, __m128i& r, __m128i& g, __m128i& b)
+  {
+    const __m128i rMask0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i rMask1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+    const __m128i rMask2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+    const __m128i gMask0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i gMask1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+    const __m128i gMask2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+    const __m128i bMask0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i bMask1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+    const __m128i bMask2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+
+    const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16));
+    const __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 32));
+    r = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, rMask0), _mm_shuffle_epi8(a1, rMask1)), _mm_shuffle_epi8(a2, rMask2));
+    g = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, gMask0), _mm_shuffle_epi8(a1, gMask1)), _mm_shuffle_epi8(a2, gMask2));
+    b = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, bMask0), _mm_shuffle_epi8(a1, bMask1)), _mm_shuffle_epi8(a2, bMask2));
+  }
+
+  // 32 bytes out of two 16 byte halves
+  __attribute__((target("avx2")))
+  inline __m256i loadLanes(const uint8_t* lo, const uint8_t* hi)
+  {
+    const __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lo));
+    const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(l), h, 1);
+  }
+
+  // Split 32 pixels of packed RGB (96 bytes) with the same shuffles. AVX2 shuffles work within 128
+  // bit lanes, so the low lane handles pixels 0-15 and the high lane 16-31
+  __attribute__((target("avx2")))
+  inline void splitRgbAvx2(const uint8_t* in, __m256i& r, __m256i& g, __m256i& b)
+  {
+    const __m256i rMask0 = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+    const __m256i rMask1 = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1));
+    const __m256i rMask2 = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13));
+    const __m256i gMask0 = _mm256_broadcastsi128_si256(_mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+    const __m256i gMask1 = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1));
+    const __m256i gMask2 = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14));
+    const __m256i bMask0 = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+    const __m256i bMask1 = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1));
+    const __m256i bMask2 = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15));
+
+    const __m256i a0 = loadLanes(in, in + 48);
+    const __m256i a1 = loadLanes(in + 16, in + 64);
+    const __m256i a2 = loadLanes(in + 32, in + 80);
+    r = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a0, rMask0), _mm256_shuffle_epi8(a1, rMask1)),
+        _mm256_shuffle_epi8(a2, rMask2));
+    g = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a0, gMask0), _mm256_shuffle_epi8(a1, gMask1)),
+        _mm256_shuffle_epi8(a2, gMask2));
+    b = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a0, bMask0), _mm256_shuffle_epi8(a1, bMask1)),
+        _mm256_shuffle_epi8(a2, bMask2));
+  }
+};
+};
+#endif
@@ -0,0 +1,252 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "FilterTaps.h"
+#include "SobelEngine.h"
+
+using namespace MicroCv;
+using namespace MicroCv::Kernels;
+
+namespace
+{
+  // Gx = [1 2 1]^T * [-1 0 1] and Gy = [-1 0 1]^T * [1 2 1]
+  typedef Taps<-1, 0, 1> DiffTaps;
+  typedef Taps<1, 2, 1> SmoothTaps;
+  typedef Taps<-1, 0, 1> DiffColumnTaps;
+  typedef Taps<1, 2, 1> SmoothColumnTaps;
+
+  // L1 is the sum of absolute values saturated to 255, L2 is the rounded euclidean norm
+  inline uint8_t magnitudeScalar(int gx, int gy, SobelMagnitude magnitude)
+  {
+    if(magnitude == SobelL2)
+    {
+      const float norm = std::sqrt(static_cast<float>(gx*gx + gy*gy));
+      return static_cast<uint8_t>(std::min(static_cast<int>(norm + 0.5f), 255));
+    }
+    return static_cast<uint8_t>(std::min(std::abs(gx) + std::abs(gy), 255));
+  }
+
+  // diffRows and smoothRows are the above, middle and below rows of the three row window
+  void computeRowScalar(const int16_t* const* diffRows, const int16_t* const* smoothRows, uint8_t* out, int x, int end,
+      SobelMagnitude magnitude)
+  {
+    for(; x < end; x++)
+    {
+      const int gx = sumTapsScalar(SmoothColumnTaps(), diffRows, x);
+      const int gy = sumTapsScalar(DiffColumnTaps(), smoothRows, x);
+      out[x] = magnitudeScalar(gx, gy, magnitude);
+    }
+  }
+
+  void computeGradientsScalar(const int16_t* const* diffRows, const int16_t* const* smoothRows, int16_t* gx, int16_t* gy,
+      int x, int end)
+  {
+    for(; x < end; x++)
+    {
+      gx[x] = static_cast<int16_t>(sumTapsScalar(SmoothColumnTaps(), diffRows, x));
+      gy[x] = static_cast<int16_t>(sumTapsScalar(DiffColumnTaps(), smoothRows, x));
+    }
+  }
+
+#ifdef MICROCV_X86_SIMD
+  __attribute__((target("sse2")))
+  int computeGradientsSse2(const int16_t* const* diffRows, const int16_t* const* smoothRows, int16_t* gx, int16_t* gy,
+      int x, int end)
+  {
+    for(; x + 8 <= end; x += 8)
+    {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(gx + x), sumTapsSse2(SmoothColumnTaps(), diffRows, x));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(gy + x), sumTapsSse2(DiffColumnTaps(), smoothRows, x));
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  int computeGradientsAvx2(const int16_t* const* diffRows, const int16_t* const* smoothRows, int16_t* gx, int16_t* gy,
+      int x, int end)
+  {
+    for(; x + 16 <= end; x += 16)
+    {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(gx + x), sumTapsAvx2(SmoothColumnTaps(), diffRows, x));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(gy + x), sumTapsAvx2(DiffColumnTaps(), smoothRows, x));
+    }
+    return x;
+  }
+
+  __attribute__((target("sse2")))
+  inline __m128i absSse2(__m128i v)
+  {
+    return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+  }
+
+  // Rounded sqrt(gx^2 + gy^2) of 8 pixels as int16, the same float math as magnitudeScalar()
+  __attribute__((target("sse2")))
+  inline __m128i l2NormSse2(__m128i gx, __m128i gy)
+  {
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128i lo = _mm_unpacklo_epi16(gx, gy);
+    __m128i hi = _mm_unpackhi_epi16(gx, gy);
+    __m128 normLo = _mm_add_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(lo, lo))), half);
+    __m128 normHi = _mm_add_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(hi, hi))), half);
+    return _mm_packs_epi32(_mm_cvttps_epi32(normLo), _mm_cvttps_epi32(normHi));
+  }
+
+  __attribute__((target("sse2")))
+  inline __m128i magnitude8Sse2(const int16_t* const* diffRows, const int16_t* const* smoothRows, int x,
+      SobelMagnitude magnitude)
+  {
+    __m128i gx = sumTapsSse2(SmoothColumnTaps(), diffRows, x);
+    __m128i gy = sumTapsSse2(DiffColumnTaps(), smoothRows, x);
+    if(magnitude == SobelL2)
+      return l2NormSse2(gx, gy);
+    return _mm_adds_epi16(absSse2(gx), absSse2(gy));
+  }
+
+  __attribute__((target("sse2")))
+  int computeRowSse2(const int16_t* const* diffRows, const int16_t* const* smoothRows, uint8_t* out, int x, int end,
+      SobelMagnitude magnitude)
+  {
+    for(; x + 16 <= end; x += 16)
+    {
+      // Packing with unsigned saturation clamps to 255
+      __m128i mag = _mm_packus_epi16(magnitude8Sse2(diffRows, smoothRows, x, magnitude),
+          magnitude8Sse2(diffRows, smoothRows, x + 8, magnitude));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), mag);
+    }
+    return x;
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i magnitude16Avx2(const int16_t* const* diffRows, const int16_t* const* smoothRows, int x,
+      SobelMagnitude magnitude)
+  {
+    __m256i gx = sumTapsAvx2(SmoothColumnTaps(), diffRows, x);
+    __m256i gy = sumTapsAvx2(DiffColumnTaps(), smoothRows, x);
+    if(magnitude == SobelL2)
+    {
+      // Unpacking and packing are both in-lane so the pixel order is preserved
+      const __m256 half = _mm256_set1_ps(0.5f);
+      __m256i lo = _mm256_unpacklo_epi16(gx, gy);
+      __m256i hi = _mm256_unpackhi_epi16(gx, gy);
+      __m256 normLo = _mm256_add_ps(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(lo, lo))), half);
+      __m256 normHi = _mm256_add_ps(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(hi, hi))), half);
+      return _mm256_packs_epi32(_mm256_cvttps_epi32(normLo), _mm256_cvttps_epi32(normHi));
+    }
+    return _mm256_adds_epi16(_mm256_abs_epi16(gx), _mm256_abs_epi16(gy));
+  }
+
+  __attribute__((target("avx2")))
+  int computeRowAvx2(const int16_t* const* diffRows, const int16_t* const* smoothRows, uint8_t* out, int x, int end,
+      SobelMagnitude magnitude)
+  {
+    for(; x + 32 <= end; x += 32)
+    {
+      __m256i mag = _mm256_packus_epi16(magnitude16Avx2(diffRows, smoothRows, x, magnitude),
+          magnitude16Avx2(diffRows, smoothRows, x + 16, magnitude));
+      // The pack interleaves the 128 bit lanes of its inputs, put the 64 bit blocks back in order
+      mag = _mm256_permute4x64_epi64(mag, 0xD8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), mag);
+    }
+    return x;
+  }
+#endif
+}
+
+SobelEngine::SobelEngine(int width, SobelMagnitude magnitude)
+: width_(width)
+, magnitude_(magnitude)
+, level_(simdLevel())
+, rowsPushed_(0)
+, ring_(6 * static_cast<size_t>(std::max(width, 0)))
+{
+}
+
+int16_t* SobelEngine::diffRow(int slot)
+{
+  return ring_.data() + 2*slot*width_;
+}
+
+int16_t* SobelEngine::smoothRow(int slot)
+{
+  return ring_.data() + (2*slot + 1)*width_;
+}
+
+const int16_t* SobelEngine::diffRow(int slot) const
+{
+  return ring_.data() + 2*slot*width_;
+}
+
+const int16_t* SobelEngine::smoothRow(int slot) const
+{
+  return ring_.data() + (2*slot + 1)*width_;
+}
+
+void SobelEngine::pushRow(const uint8_t* grayRow)
+{
+  const int slot = rowsPushed_ % 3;
+  rowsPushed_++;
+  // Only the interior columns have a full neighbourhood, tap 0 of column x is grayRow[x-1]
+  const int count = width_ - 2;
+  if(count <= 0)
+    return;
+  filterRow(DiffTaps(), grayRow, diffRow(slot) + 1, count, 1, level_);
+  filterRow(SmoothTaps(), grayRow, smoothRow(slot) + 1, count, 1, level_);
+}
+
+bool SobelEngine::ready() const
+{
+  return rowsPushed_ >= 3;
+}
+
+void SobelEngine::computeRow(uint8_t* outRow) const
+{
+  if(width_ <= 0)
+    return;
+  outRow[0] = 0;
+  outRow[width_-1] = 0;
+
+  const int above = (rowsPushed_ - 3) % 3;
+  const int middle = (rowsPushed_ - 2) % 3;
+  const int below = (rowsPushed_ - 1) % 3;
+  const int16_t* const diffRows[] = {diffRow(above), diffRow(middle), diffRow(below)};
+  const int16_t* const smoothRows[] = {smoothRow(above), smoothRow(middle), smoothRow(below)};
+
+  const int end = width_ - 1;
+  int x = 1;
+#ifdef MICROCV_X86_SIMD
+  if(level_ >= SimdAvx2)
+    x = computeRowAvx2(diffRows, smoothRows, outRow, x, end, magnitude_);
+  if(level_ >= SimdSse2)
+    x = computeRowSse2(diffRows, smoothRows, outRow, x, end, magnitude_);
+#endif
+  computeRowScalar(diffRows, smoothRows, outRow, x, end, magnitude_);
+}
+
+void SobelEngine::computeGradients(int16_t* gxRow, int16_t* gyRow) const
+{
+  if(width_ <= 0)
+    return;
+  gxRow[0] = gyRow[0] = 0;
+  gxRow[width_-1] = gyRow[width_-1] = 0;
+
+  const int above = (rowsPushed_ - 3) % 3;
+  const int middle = (rowsPushed_ - 2) % 3;
+  const int below = (rowsPushed_ - 1) % 3;
+  const int16_t* const diffRows[] = {diffRow(above), diffRow(middle), diffRow(below)};
+  const int16_t* const smoothRows[] = {smoothRow(above), smoothRow(middle), smoothRow(below)};
+
+  const int end = width_ - 1;
+  int x = 1;
+#ifdef MICROCV_X86_SIMD
+  if(level_ >= SimdAvx2)
+    x = computeGradientsAvx2(diffRows, smoothRows, gxRow, gyRow, x, end);
+  if(level_ >= SimdSse2)
+    x = computeGradientsSse2(diffRows, smoothRows, gxRow, gyRow, x, end);
+#endif
+  computeGradientsScalar(diffRows, smoothRows, gxRow, gyRow, x, end);
+}
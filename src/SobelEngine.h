@@ -0,0 +1,52 @@
+#pragma once
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+#include <vector>
+
+#include "CpuFeatures.h"
+#include "ImageProcessing.h"
+
+namespace MicroCv
+{
+namespace Kernels
+{
+/*
+ * SobelEngine runs the separable Sobel operator over a stream of gray rows.
+ * Gx = [1 2 1]^T * [-1 0 1] and Gy = [-1 0 1]^T * [1 2 1], so every input row is reduced once
+ * to a horizontal difference and a horizontal smoothing row (int16), and only the last three
+ * of those are kept in a ring buffer, which is small enough to stay in L1 cache.
+ * Both passes are compile-time Taps (see FilterTaps.h), the code filter2D runs for its Sobel kernels.
+ */
+class SobelEngine
+{
+public:
+  SobelEngine(int width, SobelMagnitude magnitude);
+
+  // Feed the next gray input row (width pixels)
+  void pushRow(const uint8_t* grayRow);
+  // True once three rows have been pushed and computeRow() can be called
+  bool ready() const;
+  // Edge magnitude of the middle one of the last three pushed rows, border columns are set to 0
+  void computeRow(uint8_t* outRow) const;
+  // The Gx and Gy rows themselves (width values each) for detectors that need the gradient
+  // direction, border columns are set to 0
+  void computeGradients(int16_t* gxRow, int16_t* gyRow) const;
+
+private:
+  int16_t* diffRow(int slot);
+  int16_t* smoothRow(int slot);
+  const int16_t* diffRow(int slot) const;
+  const int16_t* smoothRow(int slot) const;
+
+  int width_;
+  SobelMagnitude magnitude_;
+  SimdLevel level_;
+  int rowsPushed_;
+  // 3 slots, each holding a difference row followed by a smoothing row
+  std::vector<int16_t> ring_;
+};
+};
+};
@@ -0,0 +1,303 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "ImageCodecs.h"
+#include "Instrumentation.h"
+#include "LumaKernels.h"
+#include "PlanarKernels.h"
+#include "SobelEngine.h"
+#include "Streaming.h"
+
+using namespace MicroCv;
+
+RowSource::~RowSource()
+{
+}
+
+FileRowSource::FileRowSource()
+: rowsRead_(0)
+{
+}
+
+FileRowSource::~FileRowSource()
+{
+}
+
+bool FileRowSource::open(const std::string& filename, ImageFileType type)
+{
+  decoder_ = Codecs::createDecoder(type);
+  if(!decoder_)
+  {
+    std::cout << "File format of " << filename << " not supported" << std::endl;
+    return false;
+  }
+  if(!decoder_->open(filename))
+  {
+    decoder_.reset();
+    return false;
+  }
+  row_.resize(static_cast<size_t>(decoder_->width()) * decoder_->channels());
+  rowsRead_ = 0;
+  return true;
+}
+
+int FileRowSource::width() const
+{
+  return decoder_ ? decoder_->width() : 0;
+}
+
+int FileRowSource::height() const
+{
+  return decoder_ ? decoder_->height() : 0;
+}
+
+int FileRowSource::channels() const
+{
+  return decoder_ ? decoder_->channels() : 0;
+}
+
+const uint8_t* FileRowSource::nextRow()
+{
+  if(!decoder_ || rowsRead_ >= decoder_->height())
+    return nullptr;
+  if(!decoder_->readRows(row_.data(), static_cast<int>(row_.size()), 1))
+  {
+    decoder_.reset();
+    return nullptr;
+  }
+  rowsRead_++;
+  return row_.data();
+}
+
+ViewRowSource::ViewRowSource(const MatView& view)
+: view_(view)
+, row_(view.isPlanar() ? static_cast<size_t>(view.width()) * view.channels() : 0)
+, rowsRead_(0)
+{
+}
+
+int ViewRowSource::width() const
+{
+  return view_.width();
+}
+
+int ViewRowSource::height() const
+{
+  return view_.height();
+}
+
+int ViewRowSource::channels() const
+{
+  // Only 8 bit rows are streamed
+  return view_.depth() == DepthU8 ? view_.channels() : 0;
+}
+
+const uint8_t* ViewRowSource::nextRow()
+{
+  if(rowsRead_ >= view_.height() || view_.depth() != DepthU8)
+    return nullptr;
+  return Kernels::interleavedRow(view_, rowsRead_++, row_.data());
+}
+
+GrayRowFilter::GrayRowFilter(RowSource& input, GrayConversion conversion)
+: input_(input)
+, conversion_(conversion)
+, row_(input.channels() == 3 ? input.width() : 0)
+{
+}
+
+int GrayRowFilter::width() const
+{
+  return input_.width();
+}
+
+int GrayRowFilter::height() const
+{
+  return input_.height();
+}
+
+int GrayRowFilter::channels() const
+{
+  return 1;
+}
+
+const uint8_t* GrayRowFilter::nextRow()
+{
+  const uint8_t* inRow = input_.nextRow();
+  if(!inRow || input_.channels() == 1)
+    return inRow;
+  Kernels::rgbRowToGray(inRow, row_.data(), input_.width(), Kernels::lumaCoefficients(conversion_));
+  return row_.data();
+}
+
+CropRowFilter::CropRowFilter(RowSource& input, int x1, int y1, int x2, int y2)
+: input_(input)
+, x1_(0)
+, y1_(0)
+, width_(input.width())
+, height_(input.height())
+, rowsRead_(0)
+{
+  // Same bounds checks as cropMat(), an invalid region leaves the image as it is
+  const bool valid = x1 >= 0 && x1 < x2 && x2 < input.width() && y1 >= 0 && y1 < y2 && y2 < input.height();
+  if(valid)
+  {
+    x1_ = x1;
+    y1_ = y1;
+    width_ = x2 - x1;
+    height_ = y2 - y1;
+  }
+}
+
+int CropRowFilter::width() const
+{
+  return width_;
+}
+
+int CropRowFilter::height() const
+{
+  return height_;
+}
+
+int CropRowFilter::channels() const
+{
+  return input_.channels();
+}
+
+const uint8_t* CropRowFilter::nextRow()
+{
+  if(rowsRead_ >= height_)
+    return nullptr;
+  // Skip the rows above the region on the first call
+  for(; y1_ > 0; y1_--)
+  {
+    if(!input_.nextRow())
+      return nullptr;
+  }
+  const uint8_t* inRow = input_.nextRow();
+  if(!inRow)
+    return nullptr;
+  rowsRead_++;
+  return inRow + x1_ * input_.channels();
+}
+
+SobelRowFilter::SobelRowFilter(RowSource& input, SobelMagnitude magnitude)
+: input_(input)
+, engine_(new Kernels::SobelEngine(input.width(), magnitude))
+, grayRow_(input.channels() == 3 ? input.width() : 0)
+, row_(input.width(), 0)
+, rowsRead_(0)
+{
+}
+
+SobelRowFilter::~SobelRowFilter()
+{
+}
+
+int SobelRowFilter::width() const
+{
+  return input_.width();
+}
+
+int SobelRowFilter::height() const
+{
+  return input_.height();
+}
+
+int SobelRowFilter::channels() const
+{
+  return 1;
+}
+
+bool SobelRowFilter::pushInputRow()
+{
+  const uint8_t* inRow = input_.nextRow();
+  if(!inRow)
+    return false;
+  if(input_.channels() == 3)
+  {
+    Kernels::rgbRowToGray(inRow, grayRow_.data(), input_.width(), Kernels::lumaCoefficients(GrayAverage));
+    inRow = grayRow_.data();
+  }
+  engine_->pushRow(inRow);
+  return true;
+}
+
+const uint8_t* SobelRowFilter::nextRow()
+{
+  const int numChannels = input_.channels();
+  const int y = rowsRead_;
+  if(y >= height() || (numChannels != 1 && numChannels != 3))
+    return nullptr;
+  rowsRead_++;
+
+  // Output row y needs input rows y-1, y and y+1 in the window
+  if(y == 0)
+  {
+    if(!pushInputRow())
+      return nullptr;
+    if(height() > 1 && !pushInputRow())
+      return nullptr;
+  }
+  // The first and last rows are borders and stay black
+  if(y == 0 || y == height() - 1)
+  {
+    std::memset(row_.data(), 0, row_.size());
+    return row_.data();
+  }
+  if(!pushInputRow())
+    return nullptr;
+  engine_->computeRow(row_.data());
+  return row_.data();
+}
+
+bool MicroCv::writeRowsToFile(const std::string& filename, RowSource& source, ImageFileType type)
+{
+  if(source.channels() != 1 && source.channels() != 3)
+  {
+    std::cout << "Writing " << source.channels() << " channel images is not supported" << std::endl;
+    return false;
+  }
+  std::unique_ptr<Codecs::ImageEncoder> encoder = Codecs::createEncoder(type);
+  if(!encoder)
+  {
+    std::cout << "File format of " << filename << " not supported" << std::endl;
+    return false;
+  }
+
+  const int stride = source.width() * source.channels();
+  MICROCV_STAGE("writeRowsToFile", static_cast<uint64_t>(stride) * source.height());
+  bool writeOk = encoder->open(filename, source.width(), source.height(), source.channels());
+  for(int y = 0; writeOk && y < source.height(); y++)
+  {
+    const uint8_t* row = source.nextRow();
+    writeOk = row && encoder->writeRows(row, stride, 1);
+  }
+  writeOk = writeOk && encoder->close();
+  if(!writeOk)
+  {
+    // Do not leave a truncated file behind
+    encoder.reset();
+    std::remove(filename.c_str());
+  }
+  return writeOk;
+}
+
+bool MicroCv::readRowsIntoMat(RowSource& source, Mat& mat)
+{
+  mat.resize(source.width(), source.height(), source.channels());
+  const size_t rowBytes = static_cast<size_t>(mat.stride());
+  for(int y = 0; y < mat.height(); y++)
+  {
+    const uint8_t* row = source.nextRow();
+    if(!row)
+      return false;
+    std::memcpy(mat.data() + y*rowBytes, row, rowBytes);
+  }
+  return true;
+}
@@ -0,0 +1,394 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdarg>
+#include <cstddef>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include <tiffio.h>
+
+#include "ImageCodecs.h"
+
+using namespace MicroCv;
+using namespace MicroCv::Codecs;
+
+namespace
+{
+  void tiffError(const char* module, const char* format, va_list args)
+  {
+    char message[512];
+    vsnprintf(message, sizeof(message), format, args);
+    std::cerr << "ERROR: " << (module ? module : "libtiff") << ": " << message << std::endl;
+  }
+
+  void installTiffHandlers()
+  {
+    TIFFSetErrorHandler(tiffError);
+    TIFFSetWarningHandler(nullptr);
+  }
+
+  class TiffDecoder : public ImageDecoder
+  {
+  public:
+    TiffDecoder()
+    : tif_(nullptr)
+    , imageWidth_(0)
+    , imageHeight_(0)
+    , regionX_(0)
+    , regionY_(0)
+    , samplesPerPixel_(0)
+    , bitsPerSample_(0)
+    , depth_(DepthU8)
+    , minIsWhite_(false)
+    , scanlineAccess_(false)
+    , rowsRead_(0)
+    {
+      installTiffHandlers();
+    }
+
+    ~TiffDecoder()
+    {
+      if(tif_)
+        TIFFClose(tif_);
+    }
+
+    bool open(const std::string& filename)
+    {
+      tif_ = TIFFOpen(filename.c_str(), "r");
+      if(!tif_)
+        return false;
+      readDirectoryInfo();
+      return true;
+    }
+
+    bool setDepth(MatDepth depth)
+    {
+      // 16 bit values are only kept for the images that are read scanline by scanline
+      const MatDepth previous = depth_;
+      depth_ = depth;
+      readDirectoryInfo();
+      if(depth == DepthU8 || (depth == DepthU16 && bitsPerSample_ == 16 && scanlineAccess_))
+        return true;
+      depth_ = previous;
+      readDirectoryInfo();
+      return false;
+    }
+
+    bool setScale(int denominator)
+    {
+      // Pyramidal TIFFs store reduced resolution copies of the image in the following directories
+      const int minWidth = width_ / denominator;
+      const int maxWidth = (width_ + denominator - 1) / denominator;
+      const int minHeight = height_ / denominator;
+      const int maxHeight = (height_ + denominator - 1) / denominator;
+      while(TIFFReadDirectory(tif_))
+      {
+        uint32_t subfileType = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        TIFFGetFieldDefaulted(tif_, TIFFTAG_SUBFILETYPE, &subfileType);
+        TIFFGetField(tif_, TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tif_, TIFFTAG_IMAGELENGTH, &height);
+        if((subfileType & FILETYPE_REDUCEDIMAGE) && static_cast<int>(width) >= minWidth && static_cast<int>(width) <= maxWidth
+            && static_cast<int>(height) >= minHeight && static_cast<int>(height) <= maxHeight)
+        {
+          readDirectoryInfo();
+          return true;
+        }
+      }
+
+      TIFFSetDirectory(tif_, 0);
+      readDirectoryInfo();
+      return false;
+    }
+
+    bool setRegion(int x1, int y1, int x2, int y2)
+    {
+      // Strips above the region are never read, the scanlines are cut after decoding
+      regionX_ = x1;
+      regionY_ = y1;
+      width_ = x2 - x1;
+      height_ = y2 - y1;
+      return true;
+    }
+
+    bool readRows(uint8_t* dst, int stride, int numRows)
+    {
+      if(rowsRead_ + numRows > height_)
+        return false;
+      // libtiff's RGBA conversion only makes 8 bit values
+      if(depth_ == DepthU16 && !scanlineAccess_)
+        return false;
+      bool ok = scanlineAccess_ ? readScanlines(dst, stride, numRows) : readRgbaRows(dst, stride, numRows);
+      rowsRead_ += numRows;
+      return ok;
+    }
+
+  private:
+    // Read the layout of the current directory
+    void readDirectoryInfo()
+    {
+      uint32_t width = 0;
+      uint32_t height = 0;
+      uint16_t bitsPerSample = 1;
+      uint16_t samplesPerPixel = 1;
+      uint16_t photometric = PHOTOMETRIC_MINISBLACK;
+      uint16_t planarConfig = PLANARCONFIG_CONTIG;
+      TIFFGetField(tif_, TIFFTAG_IMAGEWIDTH, &width);
+      TIFFGetField(tif_, TIFFTAG_IMAGELENGTH, &height);
+      TIFFGetFieldDefaulted(tif_, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+      TIFFGetFieldDefaulted(tif_, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+      TIFFGetFieldDefaulted(tif_, TIFFTAG_PLANARCONFIG, &planarConfig);
+      TIFFGetField(tif_, TIFFTAG_PHOTOMETRIC, &photometric);
+
+      imageWidth_ = static_cast<int>(width);
+      imageHeight_ = static_cast<int>(height);
+      width_ = imageWidth_;
+      height_ = imageHeight_;
+      samplesPerPixel_ = samplesPerPixel;
+      bitsPerSample_ = bitsPerSample;
+      minIsWhite_ = photometric == PHOTOMETRIC_MINISWHITE;
+      const bool isGray = photometric == PHOTOMETRIC_MINISBLACK || photometric == PHOTOMETRIC_MINISWHITE;
+      channels_ = isGray ? 1 : 3;
+
+      // 8 bit (or 16 bit, see setDepth()) gray and RGB strips are decoded scanline by scanline straight into
+      // the destination. Anything else (tiles, palettes, YCbCr, other bit depths) goes through libtiff's RGBA conversion
+      const bool isRgb = photometric == PHOTOMETRIC_RGB && samplesPerPixel >= 3;
+      scanlineAccess_ = bitsPerSample == (depth_ == DepthU16 ? 16 : 8) && planarConfig == PLANARCONFIG_CONTIG
+          && !TIFFIsTiled(tif_) && (isGray || isRgb);
+    }
+
+    bool readScanlines(uint8_t* dst, int stride, int numRows)
+    {
+      // Scanlines with extra samples (e.g. alpha) or columns outside the region are read into a scratch row first
+      const bool direct = samplesPerPixel_ == channels_ && width_ == imageWidth_;
+      scratchRow_.resize(TIFFScanlineSize(tif_));
+
+      // Compressed strips can only be decoded from their start, so the rows above the region
+      // in its first strip are decoded and dropped, the strips above it are never read
+      if(rowsRead_ == 0 && regionY_ > 0)
+      {
+        uint32_t rowsPerStrip = imageHeight_;
+        TIFFGetFieldDefaulted(tif_, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+        for(uint32_t y = regionY_ / rowsPerStrip * rowsPerStrip; y < static_cast<uint32_t>(regionY_); y++)
+        {
+          if(TIFFReadScanline(tif_, scratchRow_.data(), y, 0) < 0)
+            return false;
+        }
+      }
+
+      for(int row = 0; row < numRows; row++)
+      {
+        uint8_t* dstRow = dst + static_cast<ptrdiff_t>(row) * stride;
+        uint8_t* decoded = direct ? dstRow : scratchRow_.data();
+        if(TIFFReadScanline(tif_, decoded, regionY_ + rowsRead_ + row, 0) < 0)
+          return false;
+
+        // libtiff returns the 16 bit samples in native byte order
+        if(depth_ == DepthU16)
+          convertScanline(reinterpret_cast<const uint16_t*>(decoded), reinterpret_cast<uint16_t*>(dstRow), direct);
+        else
+          convertScanline(decoded, dstRow, direct);
+      }
+      return true;
+    }
+
+    // Keep the region columns and color channels of a decoded scanline and make white the largest value
+    template<typename T>
+    void convertScanline(const T* decoded, T* dstRow, bool direct) const
+    {
+      if(!direct)
+      {
+        const T* in = decoded + static_cast<ptrdiff_t>(regionX_) * samplesPerPixel_;
+        T* out = dstRow;
+        for(int x = 0; x < width_; x++, in += samplesPerPixel_, out += channels_)
+        {
+          for(int c = 0; c < channels_; c++)
+            out[c] = in[c];
+        }
+      }
+      if(minIsWhite_)
+      {
+        const T white = std::numeric_limits<T>::max();
+        for(int x = 0; x < width_; x++)
+          dstRow[x] = static_cast<T>(white - dstRow[x]);
+      }
+    }
+
+    bool readRgbaRows(uint8_t* dst, int stride, int numRows)
+    {
+      // libtiff can only convert whole images, so the RGBA raster is decoded on the first call
+      if(raster_.empty())
+      {
+        raster_.resize(static_cast<size_t>(width_) * height_);
+        const bool wholeImage = width_ == imageWidth_ && height_ == imageHeight_;
+        if(wholeImage && !TIFFReadRGBAImageOriented(tif_, width_, height_, raster_.data(), ORIENTATION_TOPLEFT, 1))
+          return false;
+        if(!wholeImage && !readRgbaRegion())
+          return false;
+      }
+
+      for(int row = 0; row < numRows; row++)
+      {
+        const uint32_t* in = raster_.data() + static_cast<size_t>(rowsRead_ + row) * width_;
+        uint8_t* out = dst + static_cast<ptrdiff_t>(row) * stride;
+        for(int x = 0; x < width_; x++, in++, out += channels_)
+        {
+          out[0] = static_cast<uint8_t>(TIFFGetR(*in));
+          if(channels_ == 3)
+          {
+            out[1] = static_cast<uint8_t>(TIFFGetG(*in));
+            out[2] = static_cast<uint8_t>(TIFFGetB(*in));
+          }
+        }
+      }
+      return true;
+    }
+
+    // Convert only the tiles or strips that intersect the region into the RGBA raster
+    bool readRgbaRegion()
+    {
+      const bool tiled = TIFFIsTiled(tif_) != 0;
+      uint32_t blockWidth = imageWidth_;
+      uint32_t blockHeight = imageHeight_;
+      if(tiled)
+      {
+        TIFFGetField(tif_, TIFFTAG_TILEWIDTH, &blockWidth);
+        TIFFGetField(tif_, TIFFTAG_TILELENGTH, &blockHeight);
+      }
+      else
+      {
+        TIFFGetFieldDefaulted(tif_, TIFFTAG_ROWSPERSTRIP, &blockHeight);
+        blockHeight = std::min(blockHeight, static_cast<uint32_t>(imageHeight_));
+      }
+
+      std::vector<uint32_t> block(static_cast<size_t>(blockWidth) * blockHeight);
+      const int regionX2 = regionX_ + width_;
+      const int regionY2 = regionY_ + height_;
+      for(int blockY = regionY_ / blockHeight * blockHeight; blockY < regionY2; blockY += blockHeight)
+      {
+        for(int blockX = regionX_ / blockWidth * blockWidth; blockX < regionX2; blockX += blockWidth)
+        {
+          const int ok = tiled ? TIFFReadRGBATile(tif_, blockX, blockY, block.data())
+              : TIFFReadRGBAStrip(tif_, blockY, block.data());
+          if(!ok)
+            return false;
+
+          // Blocks are stored bottom-up, tiles are always full size but the last strip only has the remaining rows
+          const int blockRows = tiled ? static_cast<int>(blockHeight) : std::min<int>(blockHeight, imageHeight_ - blockY);
+          const int x1 = std::max(blockX, regionX_);
+          const int x2 = std::min<int>(blockX + blockWidth, regionX2);
+          for(int y = std::max(blockY, regionY_); y < std::min<int>(blockY + blockHeight, regionY2); y++)
+          {
+            const uint32_t* in = block.data() + static_cast<size_t>(blockRows - 1 - (y - blockY)) * blockWidth;
+            std::copy(in + (x1 - blockX), in + (x2 - blockX),
+                raster_.begin() + static_cast<size_t>(y - regionY_) * width_ + (x1 - regionX_));
+          }
+        }
+      }
+      return true;
+    }
+
+    TIFF* tif_;
+    int imageWidth_;
+    int imageHeight_;
+    int regionX_;
+    int regionY_;
+    int samplesPerPixel_;
+    int bitsPerSample_;
+    MatDepth depth_;
+    bool minIsWhite_;
+    bool scanlineAccess_;
+    int rowsRead_;
+    std::vector<uint8_t> scratchRow_;
+    std::vector<uint32_t> raster_;
+  };
+
+  class TiffEncoder : public ImageEncoder
+  {
+  public:
+    TiffEncoder()
+    : tif_(nullptr)
+    , depth_(DepthU8)
+    , rowsWritten_(0)
+    {
+      installTiffHandlers();
+    }
+
+    ~TiffEncoder()
+    {
+      if(tif_)
+        TIFFClose(tif_);
+    }
+
+    bool setDepth(MatDepth depth)
+    {
+      if(depth != DepthU8 && depth != DepthU16)
+        return false;
+      depth_ = depth;
+      return true;
+    }
+
+    bool open(const std::string& filename, int width, int height, int channels)
+    {
+      tif_ = TIFFOpen(filename.c_str(), "w");
+      if(!tif_)
+        return false;
+
+      TIFFSetField(tif_, TIFFTAG_IMAGEWIDTH, static_cast<uint32_t>(width));
+      TIFFSetField(tif_, TIFFTAG_IMAGELENGTH, static_cast<uint32_t>(height));
+      // The file is written in native byte order, which readers swap if they need to
+      TIFFSetField(tif_, TIFFTAG_BITSPERSAMPLE, depth_ == DepthU16 ? 16 : 8);
+      TIFFSetField(tif_, TIFFTAG_SAMPLESPERPIXEL, channels);
+      TIFFSetField(tif_, TIFFTAG_PHOTOMETRIC, channels == 1 ? PHOTOMETRIC_MINISBLACK : PHOTOMETRIC_RGB);
+      TIFFSetField(tif_, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+      TIFFSetField(tif_, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+      TIFFSetField(tif_, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+      TIFFSetField(tif_, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif_, 0));
+      return true;
+    }
+
+    bool writeRows(const uint8_t* src, int stride, int numRows)
+    {
+      // Without compression or a predictor libtiff does not modify native byte order scanlines,
+      // so they are handed over directly from the source rows
+      for(int row = 0; row < numRows; row++, rowsWritten_++)
+      {
+        void* rowPtr = const_cast<uint8_t*>(src + static_cast<ptrdiff_t>(row) * stride);
+        if(TIFFWriteScanline(tif_, rowPtr, rowsWritten_, 0) < 0)
+          return false;
+      }
+      return true;
+    }
+
+    bool close()
+    {
+      if(!tif_)
+        return false;
+      const bool ok = TIFFFlush(tif_) == 1;
+      TIFFClose(tif_);
+      tif_ = nullptr;
+      return ok;
+    }
+
+  private:
+    TIFF* tif_;
+    MatDepth depth_;
+    int rowsWritten_;
+  };
+}
+
+std::unique_ptr<ImageDecoder> MicroCv::Codecs::createTiffDecoder()
+{
+  return std::unique_ptr<ImageDecoder>(new TiffDecoder());
+}
+
+std::unique_ptr<ImageEncoder> MicroCv::Codecs::createTiffEncoder()
+{
+  return std::unique_ptr<ImageEncoder>(new TiffEncoder());
+}
@@ -0,0 +1,350 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "FileIo.h"
+#include "ImageProcessing.h"
+#include "Instrumentation.h"
+#include "Mat.h"
+#include "Parallel.h"
+
+namespace
+{
+  // One line of the manifest: <operation> <in_file> <out_file> [x1 y1 x2 y2]
+  struct Job
+  {
+    int index;
+    std::string operation;
+    std::string inFilename;
+    std::string outFilename;
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+  };
+
+  /*
+   * Every worker owns a deque of jobs. Workers take jobs from the front of their own deque
+   * and when it runs dry they steal from the back of the others, so one slow job never holds
+   * up the jobs queued behind it.
+   */
+  class WorkStealingQueues
+  {
+  public:
+    explicit WorkStealingQueues(int numWorkers)
+    : queues_(numWorkers)
+    , locks_(numWorkers)
+    , nextQueue_(0)
+    , pending_(0)
+    , closed_(false)
+    {
+    }
+
+    // Jobs are dealt to the workers round robin
+    void push(const Job& job)
+    {
+      const size_t queue = nextQueue_++ % queues_.size();
+      {
+        std::lock_guard<std::mutex> lock(locks_[queue]);
+        queues_[queue].push_back(job);
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_++;
+      jobAvailable_.notify_one();
+    }
+
+    // No more jobs will be pushed
+    void close()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+      jobAvailable_.notify_all();
+    }
+
+    // Blocks until a job is available, returns false once the queues are closed and empty
+    bool pop(int worker, Job& job)
+    {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        jobAvailable_.wait(lock, [this]() { return pending_ > 0 || closed_; });
+        if(pending_ == 0)
+          return false;
+        pending_--;
+      }
+      // A job is reserved for us, find it starting with our own queue
+      const size_t numQueues = queues_.size();
+      for(size_t i = 0; ; i++)
+      {
+        const size_t queue = (worker + i) % numQueues;
+        std::lock_guard<std::mutex> lock(locks_[queue]);
+        if(queues_[queue].empty())
+          continue;
+        if(i % numQueues == 0)
+        {
+          job = queues_[queue].front();
+          queues_[queue].pop_front();
+        }
+        else
+        {
+          job = queues_[queue].back();
+          queues_[queue].pop_back();
+        }
+        return true;
+      }
+    }
+
+  private:
+    std::vector<std::deque<Job>> queues_;
+    std::vector<std::mutex> locks_;
+    std::atomic<size_t> nextQueue_;
+    std::mutex mutex_;
+    std::condition_variable jobAvailable_;
+    int pending_;
+    bool closed_;
+  };
+
+  struct BatchStats
+  {
+    BatchStats() : jobsOk(0), jobsFailed(0), pixels(0) {}
+    std::atomic<int> jobsOk;
+    std::atomic<int> jobsFailed;
+    std::atomic<int64_t> pixels;
+  };
+
+  void getCmdProgramOptions(int argc, char** argv, std::string& manifest, int& workers, int& threads,
+      bool& showStats, std::string& traceFilename)
+  {
+    namespace po = boost::program_options;
+    po::options_description description("Options");
+
+    try
+    {
+      description.add_options()
+          ("help", "Print help message and exit")
+          ("manifest", po::value<std::string>()->default_value(""),
+              "File with one job per line (reads jobs from stdin when not given)")
+          ("workers", po::value<int>()->default_value(0), "Number of images processed at once (0 uses all cores)")
+          ("threads", po::value<int>()->default_value(1), "Number of threads used within each image")
+          ("stats", "Print the time spent in every stage and the allocations of every thread")
+          ("trace", po::value<std::string>()->default_value(""), "Write a Chrome trace (chrome://tracing) to this file");
+
+      po::variables_map vm;
+      po::store(po::parse_command_line(argc, argv, description), vm);
+
+      if(vm.count("help"))
+      {
+        std::cout << description << std::endl
+            << "Job lines: <operation> <in_file> <out_file> [x1 y1 x2 y2]" << std::endl
+            << "Operations: crop, rgb2gray, gray2rgb, sobel_edges" << std::endl;
+        exit(1);
+      }
+      po::notify(vm);
+      manifest = vm["manifest"].as<std::string>();
+      workers = vm["workers"].as<int>();
+      threads = vm["threads"].as<int>();
+      showStats = vm.count("stats") > 0;
+      traceFilename = vm["trace"].as<std::string>();
+    }
+    catch(po::error& e)
+    {
+      std::cerr << e.what() << std::endl << description << std::endl;
+      exit(1);
+    }
+  }
+
+  // Returns false for lines that are not a valid job, blank lines and # comments are skipped by the caller
+  bool parseJob(const std::string& line, Job& job)
+  {
+    std::istringstream stream(line);
+    job.x1 = 0;
+    job.y1 = 0;
+    job.x2 = -1;
+    job.y2 = -1;
+    if(!(stream >> job.operation >> job.inFilename >> job.outFilename))
+      return false;
+    if(job.operation == "crop")
+    {
+      stream >> job.x1 >> job.y1 >> job.x2 >> job.y2;
+      return !stream.fail();
+    }
+    return job.operation == "rgb2gray" || job.operation == "gray2rgb" || job.operation == "sobel_edges";
+  }
+
+  inline int clampToRange(int val, int min, int max)
+  {
+    return std::max(min, std::min(val, max));
+  }
+
+  bool runJob(const Job& job, std::string& error, int64_t& pixels)
+  {
+    MICROCV_STAGE("batch job", 0);
+    MicroCv::ImageFileType inFileType = MicroCv::imageTypeFromFilename(job.inFilename);
+    MicroCv::ImageFileType outFileType = MicroCv::imageTypeFromFilename(job.outFilename);
+    if(inFileType == MicroCv::Unsupported || outFileType == MicroCv::Unsupported)
+    {
+      error = "unsupported file type";
+      return false;
+    }
+
+    int width, height, channels;
+    if(!MicroCv::readImageSize(job.inFilename, inFileType, width, height, channels))
+    {
+      error = "could not read input file";
+      return false;
+    }
+
+    MicroCv::ReadOptions options;
+    if(job.operation == "crop")
+    {
+      // Same conventions as microcv_crop: -1 crops to the last pixel, only the region is decoded
+      options.regionX1 = clampToRange(job.x1, 0, width-1);
+      options.regionY1 = clampToRange(job.y1, 0, height-1);
+      options.regionX2 = clampToRange(job.x2 == -1 ? width-1 : job.x2, 0, width-1);
+      options.regionY2 = clampToRange(job.y2 == -1 ? height-1 : job.y2, 0, height-1);
+    }
+    bool readOk;
+    MicroCv::Mat mat = MicroCv::readMatFromFile(job.inFilename, inFileType, options, readOk);
+    if(!readOk)
+    {
+      error = "could not read input file";
+      return false;
+    }
+    // Crop jobs decode only their region, so count the pixels read rather than those of the file
+    pixels = static_cast<int64_t>(mat.width()) * mat.height();
+
+    bool writeOk;
+    if(job.operation == "crop")
+    {
+      writeOk = MicroCv::writeMatToFile(job.outFilename, mat, outFileType);
+    }
+    else if(job.operation == "rgb2gray")
+    {
+      writeOk = MicroCv::writeMatToFile(job.outFilename, MicroCv::rgbToGray(mat), outFileType);
+    }
+    else if(job.operation == "gray2rgb")
+    {
+      writeOk = MicroCv::writeMatToFile(job.outFilename, MicroCv::grayToRgb(mat), outFileType);
+    }
+    else
+    {
+      writeOk = MicroCv::writeMatToFile(job.outFilename, MicroCv::sobelEdgeDetector(mat), outFileType);
+    }
+
+    if(!writeOk)
+      error = "could not write output file";
+    return writeOk;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  std::string manifest;
+  int workers, threads;
+  bool showStats;
+  std::string traceFilename;
+  getCmdProgramOptions(argc, argv, manifest, workers, threads, showStats, traceFilename);
+  if(workers <= 0)
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  // The workers already keep every core busy, so by default each image is processed on one thread
+  MicroCv::setNumThreads(threads);
+  // Prints the stats and writes the trace when main returns
+  MicroCv::StatsSession statsSession(showStats, traceFilename);
+
+  std::ifstream manifestFile;
+  if(!manifest.empty())
+  {
+    manifestFile.open(manifest);
+    if(!manifestFile)
+    {
+      std::cerr << "Could not open manifest: " << manifest << std::endl;
+      return 1;
+    }
+  }
+  std::istream& input = manifest.empty() ? std::cin : manifestFile;
+
+  WorkStealingQueues queues(workers);
+  BatchStats stats;
+  std::mutex outputMutex;
+  const auto batchStart = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> pool;
+  for(int worker = 0; worker < workers; worker++)
+  {
+    pool.emplace_back([&, worker]()
+    {
+      Job job;
+      while(queues.pop(worker, job))
+      {
+        const auto jobStart = std::chrono::steady_clock::now();
+        std::string error;
+        int64_t pixels = 0;
+        const bool ok = runJob(job, error, pixels);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - jobStart).count();
+
+        if(ok)
+        {
+          stats.jobsOk++;
+          stats.pixels += pixels;
+        }
+        else
+        {
+          stats.jobsFailed++;
+        }
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << "[" << job.index << "] " << (ok ? "OK     " : "FAILED ") << job.operation << " "
+            << job.inFilename << " -> " << job.outFilename << " (" << std::fixed << std::setprecision(1)
+            << ms << " ms)" << (ok ? "" : ": " + error) << std::endl;
+      }
+    });
+  }
+
+  // Jobs are handed out as soon as they are read, so a daemon can keep feeding stdin
+  std::string line;
+  int lineNumber = 0;
+  int numJobs = 0;
+  while(std::getline(input, line))
+  {
+    lineNumber++;
+    const size_t first = line.find_first_not_of(" \t\r");
+    if(first == std::string::npos || line[first] == '#')
+      continue;
+
+    Job job;
+    if(!parseJob(line, job))
+    {
+      stats.jobsFailed++;
+      std::lock_guard<std::mutex> lock(outputMutex);
+      std::cerr << "Invalid job on line " << lineNumber << ": " << line << std::endl;
+      continue;
+    }
+    job.index = numJobs++;
+    queues.push(job);
+  }
+  queues.close();
+  for(auto itr = pool.begin(); itr != pool.end(); ++itr)
+    itr->join();
+
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+  std::cout << std::fixed << std::setprecision(2)
+      << "Processed " << stats.jobsOk << " jobs (" << stats.jobsFailed << " failed) with "
+      << workers << " workers in " << seconds << " s: "
+      << stats.jobsOk / seconds << " images/s, " << stats.pixels / seconds / 1e6 << " MPix/s" << std::endl;
+  return stats.jobsFailed > 0 ? 1 : 0;
+}
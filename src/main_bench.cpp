@@ -0,0 +1,586 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "CpuFeatures.h"
+#include "FileIo.h"
+#include "Histogram.h"
+#include "ImageProcessing.h"
+#include "Mat.h"
+#include "Parallel.h"
+#include "Pipeline.h"
+
+namespace
+{
+  struct ImageSize
+  {
+    std::string name;
+    int width;
+    int height;
+  };
+
+  struct BenchOptions
+  {
+    std::vector<ImageSize> sizes;
+    std::vector<int> threads;
+    std::vector<std::string> ops;
+    int minIterations;
+    double minSeconds;
+    std::string outFilename;
+  };
+
+  // Timing of one operation on one image size with one thread count
+  struct BenchResult
+  {
+    std::string op;
+    std::string format;
+    ImageSize size;
+    int channels;
+    int threads;
+    // Pixels produced and bytes read plus bytes written by one call
+    double pixels;
+    double bytesMoved;
+    std::vector<double> seconds;
+  };
+
+  // Thumbnail to 100 megapixels
+  const ImageSize DEFAULT_SIZES[] = {
+    {"thumbnail", 160, 120},
+    {"vga", 640, 480},
+    {"1080p", 1920, 1080},
+    {"12mp", 4000, 3000},
+    {"100mp", 10000, 10000}
+  };
+
+  const char* ALL_OPS[] = {"cropMat", "rgbToGray", "grayToRgb", "convertLayoutPlanar", "convertLayoutInterleaved",
+      "sobelEdgeDetector", "sobelGradients", "convertDepthFloat", "cannyEdgeDetector", "resizeMatArea", "resizeMatBilinear", "resizeMatLanczos3",
+      "filter2DBinomial5", "filter2DGeneric5x5", "gaussianBlurSigma2", "gaussianBlurSigma2Planar", "gaussianBlurSigma10",
+      "blurSobel", "boxFilter", "adaptiveThreshold", "erode3x3", "morphologyClose31", "computeHistograms",
+      "channelStatistics", "equalizeHistogram", "equalizeHistogramClahe", "readMatFromFile", "readMatFromFileScaled",
+      "writeMatToFile"};
+
+  std::vector<std::string> splitList(const std::string& list)
+  {
+    std::vector<std::string> items;
+    std::istringstream stream(list);
+    std::string item;
+    while(std::getline(stream, item, ','))
+    {
+      if(!item.empty())
+        items.push_back(item);
+    }
+    return items;
+  }
+
+  // Sizes are given as WIDTHxHEIGHT or by the name of one of the default sizes
+  bool parseSizes(const std::string& list, std::vector<ImageSize>& sizes)
+  {
+    std::vector<std::string> items = splitList(list);
+    for(auto itr = items.begin(); itr != items.end(); ++itr)
+    {
+      bool found = false;
+      for(const ImageSize& size : DEFAULT_SIZES)
+      {
+        if(size.name == *itr)
+        {
+          sizes.push_back(size);
+          found = true;
+        }
+      }
+      int width, height;
+      char separator;
+      std::istringstream stream(*itr);
+      if(!found && stream >> width >> separator >> height && separator == 'x' && width > 0 && height > 0)
+      {
+        sizes.push_back(ImageSize{*itr, width, height});
+        found = true;
+      }
+      if(!found)
+      {
+        std::cerr << "Invalid image size: " << *itr << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void getCmdProgramOptions(int argc, char** argv, BenchOptions& options)
+  {
+    namespace po = boost::program_options;
+    po::options_description description("Options");
+
+    try
+    {
+      description.add_options()
+          ("help", "Print help message and exit")
+          ("sizes", po::value<std::string>()->default_value("thumbnail,vga,1080p,12mp,100mp"),
+              "Comma separated image sizes, WIDTHxHEIGHT or one of thumbnail, vga, 1080p, 12mp, 100mp")
+          ("threads", po::value<std::string>()->default_value(""),
+              "Comma separated thread counts (defaults to 1 and all cores)")
+          ("ops", po::value<std::string>()->default_value(""),
+              "Comma separated operations to run (defaults to all)")
+          ("min_iterations", po::value<int>()->default_value(5), "Least number of timed calls per benchmark")
+          ("min_time", po::value<double>()->default_value(0.5), "Least number of seconds spent per benchmark")
+          ("out_file", po::value<std::string>()->default_value(""), "Write the JSON report here instead of stdout");
+
+      po::variables_map vm;
+      po::store(po::parse_command_line(argc, argv, description), vm);
+
+      if(vm.count("help"))
+      {
+        std::cout << description << std::endl;
+        exit(1);
+      }
+      po::notify(vm);
+
+      if(!parseSizes(vm["sizes"].as<std::string>(), options.sizes))
+        exit(1);
+
+      std::vector<std::string> threads = splitList(vm["threads"].as<std::string>());
+      for(auto itr = threads.begin(); itr != threads.end(); ++itr)
+        options.threads.push_back(std::max(0, std::atoi(itr->c_str())));
+      if(options.threads.empty())
+      {
+        options.threads.push_back(1);
+        if(std::thread::hardware_concurrency() > 1)
+          options.threads.push_back(0);
+      }
+
+      options.ops = splitList(vm["ops"].as<std::string>());
+      if(options.ops.empty())
+        options.ops.assign(std::begin(ALL_OPS), std::end(ALL_OPS));
+      for(auto itr = options.ops.begin(); itr != options.ops.end(); ++itr)
+      {
+        if(std::find(std::begin(ALL_OPS), std::end(ALL_OPS), *itr) == std::end(ALL_OPS))
+        {
+          std::cerr << "Unknown operation: " << *itr << std::endl;
+          exit(1);
+        }
+      }
+
+      options.minIterations = std::max(1, vm["min_iterations"].as<int>());
+      options.minSeconds = vm["min_time"].as<double>();
+      options.outFilename = vm["out_file"].as<std::string>();
+    }
+    catch(po::error& e)
+    {
+      std::cerr << e.what() << std::endl << description << std::endl;
+      exit(1);
+    }
+  }
+
+  bool isSelected(const BenchOptions& options, const std::string& op)
+  {
+    return std::find(options.ops.begin(), options.ops.end(), op) != options.ops.end();
+  }
+
+  // Smooth gradients with a little noise, so the codecs see something closer to a photo than white noise
+  MicroCv::Mat syntheticImage(int width, int height, int channels)
+  {
+    MicroCv::Mat mat(width, height, channels);
+    uint32_t noise = 12345;
+    for(int y = 0; y < height; y++)
+    {
+      uint8_t* row = mat.row(y);
+      for(int x = 0; x < width; x++)
+      {
+        noise = noise * 1664525u + 1013904223u;
+        for(int c = 0; c < channels; c++)
+        {
+          const int value = (x * 255 / width + y * 255 / height * (c + 1) / 2 + (noise >> (27 - c))) & 0xFF;
+          row[x*channels + c] = static_cast<uint8_t>(value);
+        }
+      }
+    }
+    return mat;
+  }
+
+  // Call fn until both minIterations calls and minSeconds have passed, every call is timed on its own
+  std::vector<double> timeCalls(const BenchOptions& options, const std::function<void()>& fn)
+  {
+    // One untimed call to warm up the caches and the buffer pool
+    fn();
+    std::vector<double> seconds;
+    double total = 0.0;
+    while(static_cast<int>(seconds.size()) < options.minIterations || total < options.minSeconds)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      fn();
+      const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      seconds.push_back(elapsed);
+      total += elapsed;
+    }
+    return seconds;
+  }
+
+  // Nearest rank percentile of sorted samples
+  double percentile(const std::vector<double>& sorted, double p)
+  {
+    const size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.999999);
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+  }
+
+  const char* simdLevelName(MicroCv::SimdLevel level)
+  {
+    switch(level)
+    {
+      case MicroCv::SimdSse2:
+        return "sse2";
+      case MicroCv::SimdSsse3:
+        return "ssse3";
+      case MicroCv::SimdAvx2:
+        return "avx2";
+      default:
+        return "scalar";
+    }
+  }
+
+  void writeJson(std::ostream& out, const std::vector<BenchResult>& results)
+  {
+    out << "{\n"
+        << "  \"simd\": \"" << simdLevelName(MicroCv::simdLevel()) << "\",\n"
+        << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+        << "  \"results\": [";
+    for(size_t i = 0; i < results.size(); i++)
+    {
+      const BenchResult& result = results[i];
+      std::vector<double> sorted = result.seconds;
+      std::sort(sorted.begin(), sorted.end());
+      double total = 0.0;
+      for(auto itr = sorted.begin(); itr != sorted.end(); ++itr)
+        total += *itr;
+      const double median = percentile(sorted, 50.0);
+      const double megapixels = result.pixels / 1e6;
+
+      out << (i == 0 ? "\n" : ",\n")
+          << "    {\"op\": \"" << result.op << "\", "
+          << "\"format\": " << (result.format.empty() ? "null" : "\"" + result.format + "\"") << ", "
+          << "\"size\": \"" << result.size.name << "\", "
+          << "\"width\": " << result.size.width << ", "
+          << "\"height\": " << result.size.height << ", "
+          << "\"channels\": " << result.channels << ", "
+          << "\"threads\": " << result.threads << ", "
+          << "\"iterations\": " << sorted.size() << ", "
+          << "\"mpix_per_s\": " << megapixels / median << ", "
+          << "\"gb_per_s\": " << result.bytesMoved / median / 1e9 << ", "
+          << "\"ms\": {\"min\": " << sorted.front() * 1e3
+          << ", \"mean\": " << total / sorted.size() * 1e3
+          << ", \"p50\": " << median * 1e3
+          << ", \"p90\": " << percentile(sorted, 90.0) * 1e3
+          << ", \"p99\": " << percentile(sorted, 99.0) * 1e3
+          << ", \"max\": " << sorted.back() * 1e3 << "}}";
+    }
+    out << "\n  ]\n}" << std::endl;
+  }
+
+  void addResult(std::vector<BenchResult>& results, const std::string& op, const std::string& format,
+      const ImageSize& size, int channels, int threads, double pixels, double bytesMoved,
+      const std::vector<double>& seconds)
+  {
+    BenchResult result = {op, format, size, channels, threads, pixels, bytesMoved, seconds};
+    results.push_back(result);
+    std::cerr << op << (format.empty() ? "" : " " + format) << " " << size.name << " threads=" << threads
+        << ": " << std::min_element(seconds.begin(), seconds.end())[0] * 1e3 << " ms" << std::endl;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  BenchOptions options;
+  getCmdProgramOptions(argc, argv, options);
+
+  const boost::filesystem::path tempDir =
+      boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("microcv_bench_%%%%%%%%");
+  boost::filesystem::create_directories(tempDir);
+
+  std::vector<BenchResult> results;
+  for(auto size = options.sizes.begin(); size != options.sizes.end(); ++size)
+  {
+    const int width = size->width;
+    const int height = size->height;
+    const double pixels = static_cast<double>(width) * height;
+    const MicroCv::Mat rgbMat = syntheticImage(width, height, 3);
+    const MicroCv::Mat grayMat = MicroCv::rgbToGray(rgbMat);
+    const MicroCv::Mat planarMat = MicroCv::convertLayout(rgbMat, MicroCv::LayoutPlanar);
+    MicroCv::Mat outputMat;
+
+    // The processing functions are timed at every thread count
+    for(auto threads = options.threads.begin(); threads != options.threads.end(); ++threads)
+    {
+      MicroCv::setNumThreads(*threads);
+      const int numThreads = MicroCv::numThreads();
+
+      if(isSelected(options, "cropMat") && width > 2 && height > 2)
+      {
+        // Center region with half the width and height
+        const int x1 = width / 4, y1 = height / 4;
+        const int x2 = x1 + std::max(1, width / 2), y2 = y1 + std::max(1, height / 2);
+        const double cropPixels = static_cast<double>(x2 - x1) * (y2 - y1);
+        addResult(results, "cropMat", "", *size, 3, numThreads, cropPixels, 6.0 * cropPixels, timeCalls(options, [&]()
+        {
+          MicroCv::cropMat(rgbMat, outputMat, x1, y1, x2, y2);
+        }));
+      }
+      if(isSelected(options, "rgbToGray"))
+      {
+        addResult(results, "rgbToGray", "", *size, 3, numThreads, pixels, 4.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::rgbToGray(rgbMat, outputMat);
+        }));
+      }
+      if(isSelected(options, "grayToRgb"))
+      {
+        addResult(results, "grayToRgb", "", *size, 1, numThreads, pixels, 4.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::grayToRgb(grayMat, outputMat);
+        }));
+      }
+      if(isSelected(options, "convertLayoutPlanar"))
+      {
+        addResult(results, "convertLayoutPlanar", "", *size, 3, numThreads, pixels, 6.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::convertLayout(rgbMat, outputMat, MicroCv::LayoutPlanar);
+        }));
+      }
+      if(isSelected(options, "convertLayoutInterleaved"))
+      {
+        addResult(results, "convertLayoutInterleaved", "", *size, 3, numThreads, pixels, 6.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::convertLayout(planarMat, outputMat, MicroCv::LayoutInterleaved);
+        }));
+      }
+      if(isSelected(options, "sobelEdgeDetector"))
+      {
+        addResult(results, "sobelEdgeDetector", "", *size, 3, numThreads, pixels, 4.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::sobelEdgeDetector(rgbMat, outputMat);
+        }));
+        addResult(results, "sobelEdgeDetector", "", *size, 1, numThreads, pixels, 2.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::sobelEdgeDetector(grayMat, outputMat);
+        }));
+      }
+      if(isSelected(options, "sobelGradients"))
+      {
+        MicroCv::Mat gradientY;
+        addResult(results, "sobelGradients", "", *size, 1, numThreads, pixels, 5.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::sobelGradients(grayMat, outputMat, gradientY);
+        }));
+      }
+      if(isSelected(options, "convertDepthFloat"))
+      {
+        addResult(results, "convertDepthFloat", "", *size, 3, numThreads, pixels, 15.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::convertDepth(rgbMat, outputMat, MicroCv::DepthF32, 1.0 / 255);
+        }));
+      }
+      if(isSelected(options, "cannyEdgeDetector"))
+      {
+        addResult(results, "cannyEdgeDetector", "", *size, 1, numThreads, pixels, 2.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::cannyEdgeDetector(grayMat, outputMat, 50, 150);
+        }));
+      }
+      // Downscaling to half the width and height
+      const std::pair<std::string, MicroCv::ResizeMethod> resizeMethods[] = {
+        {"resizeMatArea", MicroCv::ResizeArea}, {"resizeMatBilinear", MicroCv::ResizeBilinear},
+        {"resizeMatLanczos3", MicroCv::ResizeLanczos3}
+      };
+      for(const auto& method : resizeMethods)
+      {
+        if(!isSelected(options, method.first))
+          continue;
+        const int resizedWidth = std::max(1, width / 2), resizedHeight = std::max(1, height / 2);
+        const double bytes = 3.0 * (pixels + static_cast<double>(resizedWidth) * resizedHeight);
+        addResult(results, method.first, "", *size, 3, numThreads, pixels, bytes, timeCalls(options, [&]()
+        {
+          MicroCv::resizeMat(rgbMat, outputMat, resizedWidth, resizedHeight, method.second);
+        }));
+      }
+      // A kernel with compile-time Taps and a non-separable one that runs on the generic path
+      const std::pair<std::string, MicroCv::FilterKernel> filterKernels[] = {
+        {"filter2DBinomial5", MicroCv::binomialKernel(5)},
+        {"filter2DGeneric5x5", MicroCv::FilterKernel(5, 5, {0, 0, -1, 0, 0, 0, -1, -2, -1, 0, -1, -2, 17, -2, -1,
+            0, -1, -2, -1, 0, 0, 0, -1, 0, 0}, 1)}
+      };
+      for(const auto& filter : filterKernels)
+      {
+        if(!isSelected(options, filter.first))
+          continue;
+        addResult(results, filter.first, "", *size, 3, numThreads, pixels, 6.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::filter2D(rgbMat, outputMat, filter.second);
+        }));
+      }
+      // One sigma on the fixed point kernel and one on the recursive filter
+      const std::pair<std::string, double> gaussianSigmas[] = {{"gaussianBlurSigma2", 2.0}, {"gaussianBlurSigma10", 10.0}};
+      for(const auto& sigma : gaussianSigmas)
+      {
+        if(!isSelected(options, sigma.first))
+          continue;
+        addResult(results, sigma.first, "", *size, 3, numThreads, pixels, 6.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::gaussianBlur(rgbMat, outputMat, sigma.second);
+        }));
+      }
+      // Same blur plane by plane, every plane runs the gray kernel
+      if(isSelected(options, "gaussianBlurSigma2Planar"))
+      {
+        addResult(results, "gaussianBlurSigma2Planar", "", *size, 3, numThreads, pixels, 6.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::gaussianBlur(planarMat, outputMat, 2.0);
+        }));
+      }
+      // The blurred frame only lives as a window of rows between the two stages
+      if(isSelected(options, "blurSobel"))
+      {
+        addResult(results, "blurSobel", "", *size, 1, numThreads, pixels, 2.0 * pixels, timeCalls(options, [&]()
+        {
+          outputMat = MicroCv::Pipeline(grayMat).blur(1.5).sobel().evaluate();
+        }));
+      }
+      // Radius 50 is about a 1/4 inch window on a 600 dpi scan, the cost does not depend on it
+      if(isSelected(options, "boxFilter"))
+      {
+        addResult(results, "boxFilter", "", *size, 3, numThreads, pixels, 6.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::boxFilter(rgbMat, outputMat, 50);
+        }));
+      }
+      if(isSelected(options, "adaptiveThreshold"))
+      {
+        addResult(results, "adaptiveThreshold", "", *size, 1, numThreads, pixels, 2.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::adaptiveThreshold(grayMat, outputMat, 50);
+        }));
+      }
+      if(isSelected(options, "erode3x3"))
+      {
+        addResult(results, "erode3x3", "", *size, 1, numThreads, pixels, 2.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::erode(grayMat, outputMat, 1, 1);
+        }));
+      }
+      // 31x31 closings are routine on scans, the cost does not depend on the size
+      if(isSelected(options, "morphologyClose31"))
+      {
+        addResult(results, "morphologyClose31", "", *size, 1, numThreads, pixels, 8.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::morphologyClose(grayMat, outputMat, 15, 15);
+        }));
+      }
+      if(isSelected(options, "computeHistograms"))
+      {
+        addResult(results, "computeHistograms", "", *size, 3, numThreads, pixels, 3.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::computeHistograms(rgbMat);
+        }));
+        addResult(results, "computeHistograms", "", *size, 1, numThreads, pixels, 1.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::computeHistograms(grayMat);
+        }));
+      }
+      if(isSelected(options, "channelStatistics"))
+      {
+        addResult(results, "channelStatistics", "", *size, 3, numThreads, pixels, 3.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::channelStatistics(rgbMat);
+        }));
+        addResult(results, "channelStatistics", "", *size, 1, numThreads, pixels, 1.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::channelStatistics(grayMat);
+        }));
+      }
+      if(isSelected(options, "equalizeHistogram"))
+      {
+        addResult(results, "equalizeHistogram", "", *size, 1, numThreads, pixels, 3.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::equalizeHistogram(grayMat, outputMat);
+        }));
+      }
+      if(isSelected(options, "equalizeHistogramClahe"))
+      {
+        addResult(results, "equalizeHistogramClahe", "", *size, 1, numThreads, pixels, 3.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::equalizeHistogramClahe(grayMat, outputMat);
+        }));
+      }
+    }
+
+    // The codecs run on the calling thread, so file I/O is timed once per format
+    MicroCv::setNumThreads(0);
+    const std::pair<std::string, MicroCv::ImageFileType> formats[] = {
+      {"jpeg", MicroCv::Jpeg}, {"png", MicroCv::Png}, {"tiff", MicroCv::Tiff},
+      {"mcv", MicroCv::Mcv}, {"ppm", MicroCv::Pnm}
+    };
+    for(const auto& format : formats)
+    {
+      const std::string filename = (tempDir / ("bench_" + size->name + "." + format.first)).string();
+      if(!MicroCv::writeMatToFile(filename, rgbMat, format.second))
+      {
+        std::cerr << "Could not write " << filename << std::endl;
+        continue;
+      }
+      if(isSelected(options, "writeMatToFile"))
+      {
+        addResult(results, "writeMatToFile", format.first, *size, 3, 1, pixels, 3.0 * pixels, timeCalls(options, [&]()
+        {
+          MicroCv::writeMatToFile(filename, rgbMat, format.second);
+        }));
+      }
+      if(isSelected(options, "readMatFromFile"))
+      {
+        addResult(results, "readMatFromFile", format.first, *size, 3, 1, pixels, 3.0 * pixels, timeCalls(options, [&]()
+        {
+          bool readOk;
+          outputMat = MicroCv::readMatFromFile(filename, format.second, readOk);
+        }));
+      }
+      if(isSelected(options, "readMatFromFileScaled"))
+      {
+        // Thumbnail read at 1/8 size, the throughput is of the full size image
+        MicroCv::ReadOptions readOptions;
+        readOptions.scaleDenominator = 8;
+        addResult(results, "readMatFromFileScaled", format.first, *size, 3, 1, pixels, 3.0 * pixels, timeCalls(options, [&]()
+        {
+          bool readOk;
+          outputMat = MicroCv::readMatFromFile(filename, format.second, readOptions, readOk);
+        }));
+      }
+      std::remove(filename.c_str());
+    }
+  }
+  boost::filesystem::remove_all(tempDir);
+
+  if(options.outFilename.empty())
+  {
+    writeJson(std::cout, results);
+  }
+  else
+  {
+    std::ofstream outFile(options.outFilename);
+    writeJson(outFile, results);
+    if(!outFile)
+    {
+      std::cerr << "Could not write " << options.outFilename << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
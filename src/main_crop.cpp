@@ -9,10 +9,14 @@
 
 #include "FileIo.h"
 #include "ImageProcessing.h"
+#include "Instrumentation.h"
 #include "Mat.h"
+#include "Parallel.h"
+#include "Streaming.h"
 
 void getCmdProgramOptions(int argc, char** argv,
-    std::string& inFilename, std::string& outFilename, int& x1, int& y1, int& x2, int& y2)
+    std::string& inFilename, std::string& outFilename, int& x1, int& y1, int& x2, int& y2, int& threads, bool& stream,
+    bool& stats, std::string& traceFilename)
 {
   namespace po = boost::program_options;
   po::options_description description("Options");
@@ -23,6 +27,10 @@ void getCmdProgramOptions(int argc, char** argv,
         ("help", "Print help message and exit")
         ("in_file", po::value<std::string>()->required(), "Image input filename")
         ("out_file", po::value<std::string>()->required(), "Image output filename")
+        ("threads", po::value<int>()->default_value(0), "Number of threads to use (0 uses all cores)")
+        ("stream", "Decode, process and encode row by row so memory use only depends on the image width")
+        ("stats", "Print the time spent in every stage and the allocations of every thread")
+        ("trace", po::value<std::string>()->default_value(""), "Write a Chrome trace (chrome://tracing) to this file")
         ("x1", po::value<int>()->default_value(0),
             "X coordinate from which to crop")
         ("y1", po::value<int>()->default_value(0),
@@ -44,6 +52,10 @@ void getCmdProgramOptions(int argc, char** argv,
     po::notify(vm);
     inFilename = vm["in_file"].as<std::string>();
     outFilename = vm["out_file"].as<std::string>();
+    threads = vm["threads"].as<int>();
+    stream = vm.count("stream") > 0;
+    stats = vm.count("stats") > 0;
+    traceFilename = vm["trace"].as<std::string>();
     x1 = vm["x1"].as<int>();
     y1 = vm["y1"].as<int>();
     x2 = vm["x2"].as<int>();
@@ -68,11 +80,32 @@ inline void clampIntToRange(int& val, int min, int max)
   }
 }
 
+// Fix invalid crop input values
+void fixCropPoints(int width, int height, int& x1, int& y1, int& x2, int& y2)
+{
+  if(x2 == -1)
+    x2 = width-1;
+  if(y2 == -1)
+    y2 = height-1;
+  clampIntToRange(x1, 0, width-1);
+  clampIntToRange(y1, 0, height-1);
+  clampIntToRange(x2, 0, width-1);
+  clampIntToRange(y2, 0, height-1);
+
+  std::cout << "Crop points - top-left: (" << x1 << ", " << y1 << ") bottom-right: ("
+      << x2 << ", " << y2 << ")" << std::endl;
+}
+
 int main(int argc, char** argv)
 {
   std::string inFilename, outFilename;
-  int x1, x2, y1, y2;
-  getCmdProgramOptions(argc, argv, inFilename, outFilename, x1, y1, x2, y2);
+  int x1, x2, y1, y2, threads;
+  bool stream, stats;
+  std::string traceFilename;
+  getCmdProgramOptions(argc, argv, inFilename, outFilename, x1, y1, x2, y2, threads, stream, stats, traceFilename);
+  MicroCv::setNumThreads(threads);
+  // Prints the stats and writes the trace when main returns
+  MicroCv::StatsSession statsSession(stats, traceFilename);
 
   // Check if file exists
   if(!boost::filesystem::exists(inFilename))
@@ -95,27 +128,43 @@ int main(int argc, char** argv)
     return 1;
   }
 
-  bool readOk;
-  MicroCv::Mat inputMat = MicroCv::readMatFromFile(inFilename, inFileType, readOk);
+  if(stream)
+  {
+    // Rows above the region are skipped and only one row is in memory at any time
+    MicroCv::FileRowSource source;
+    if(!source.open(inFilename, inFileType))
+    {
+      std::cerr << "Could not read input file: " << inFilename << std::endl;
+      return 1;
+    }
+    fixCropPoints(source.width(), source.height(), x1, y1, x2, y2);
+    MicroCv::CropRowFilter cropped(source, x1, y1, x2, y2);
+    if(!MicroCv::writeRowsToFile(outFilename, cropped, MicroCv::imageTypeFromFilename(outFilename)))
+    {
+      std::cerr << "Could not write output file: " << outFilename << std::endl;
+      return 1;
+    }
+    std::cout << outFilename << " successfully cropped!" << std::endl;
+    return 0;
+  }
 
+  // Only the region is decoded, the size is read from the header first to place it
+  int width, height, channels;
+  bool readOk = MicroCv::readImageSize(inFilename, inFileType, width, height, channels);
+  MicroCv::Mat croppedMat;
   if(readOk)
   {
-    // Fix invalid crop input values
-    if(x2 == -1)
-      x2 = inputMat.width()-1;
-    if(y2 == -1)
-      y2 = inputMat.height()-1;
-    clampIntToRange(x1, 0, inputMat.width()-1);
-    clampIntToRange(y1, 0, inputMat.height()-1);
-    clampIntToRange(x2, 0, inputMat.width()-1);
-    clampIntToRange(y2, 0, inputMat.height()-1);
-
-    std::cout << "Crop points - top-left: (" << x1 << ", " << y1 << ") bottom-right: ("
-        << x2 << ", " << y2 << ")" << std::endl;
-
-    MicroCv::Mat croppedMat = inputMat;
-    MicroCv::cropMat(croppedMat, x1, y1, x2, y2);
+    fixCropPoints(width, height, x1, y1, x2, y2);
+    MicroCv::ReadOptions options;
+    options.regionX1 = x1;
+    options.regionY1 = y1;
+    options.regionX2 = x2;
+    options.regionY2 = y2;
+    croppedMat = MicroCv::readMatFromFile(inFilename, inFileType, options, readOk);
+  }
 
+  if(readOk)
+  {
     bool writeOk = MicroCv::writeMatToFile(outFilename, croppedMat, MicroCv::imageTypeFromFilename(outFilename));
     if(writeOk)
     {
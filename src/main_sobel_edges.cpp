@@ -9,9 +9,13 @@
 
 #include "FileIo.h"
 #include "ImageProcessing.h"
+#include "Instrumentation.h"
 #include "Mat.h"
+#include "Parallel.h"
+#include "Streaming.h"
 
-void getCmdProgramOptions(int argc, char** argv, std::string& inFilename, std::string& outFilename)
+void getCmdProgramOptions(int argc, char** argv, std::string& inFilename, std::string& outFilename, int& threads, bool& stream,
+    bool& stats, std::string& traceFilename)
 {
   namespace po = boost::program_options;
   po::options_description description("Options");
@@ -21,7 +25,11 @@ void getCmdProgramOptions(int argc, char** argv, std::string& inFilename, std::s
     description.add_options()
         ("help", "Print help message and exit")
         ("in_file", po::value<std::string>()->required(), "Image input filename")
-        ("out_file", po::value<std::string>()->required(), "Image output filename");
+        ("out_file", po::value<std::string>()->required(), "Image output filename")
+        ("threads", po::value<int>()->default_value(0), "Number of threads to use (0 uses all cores)")
+        ("stream", "Decode, process and encode row by row so memory use only depends on the image width")
+        ("stats", "Print the time spent in every stage and the allocations of every thread")
+        ("trace", po::value<std::string>()->default_value(""), "Write a Chrome trace (chrome://tracing) to this file");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, description), vm);
@@ -34,6 +42,10 @@ void getCmdProgramOptions(int argc, char** argv, std::string& inFilename, std::s
     po::notify(vm);
     inFilename = vm["in_file"].as<std::string>();
     outFilename = vm["out_file"].as<std::string>();
+    threads = vm["threads"].as<int>();
+    stream = vm.count("stream") > 0;
+    stats = vm.count("stats") > 0;
+    traceFilename = vm["trace"].as<std::string>();
   }
   catch(po::error& e)
   {
@@ -45,7 +57,13 @@ void getCmdProgramOptions(int argc, char** argv, std::string& inFilename, std::s
 int main(int argc, char** argv)
 {
   std::string inFilename, outFilename;
-  getCmdProgramOptions(argc, argv, inFilename, outFilename);
+  int threads;
+  bool stream, stats;
+  std::string traceFilename;
+  getCmdProgramOptions(argc, argv, inFilename, outFilename, threads, stream, stats, traceFilename);
+  MicroCv::setNumThreads(threads);
+  // Prints the stats and writes the trace when main returns
+  MicroCv::StatsSession statsSession(stats, traceFilename);
 
   // Check if file exists
   if(!boost::filesystem::exists(inFilename))
@@ -68,6 +86,25 @@ int main(int argc, char** argv)
     return 1;
   }
 
+  if(stream)
+  {
+    // Only a few rows are in memory at any time
+    MicroCv::FileRowSource source;
+    if(!source.open(inFilename, inFileType))
+    {
+      std::cerr << "Could not read input file: " << inFilename << std::endl;
+      return 1;
+    }
+    MicroCv::SobelRowFilter edges(source);
+    if(!MicroCv::writeRowsToFile(outFilename, edges, MicroCv::imageTypeFromFilename(outFilename)))
+    {
+      std::cerr << "Could not write output file: " << outFilename << std::endl;
+      return 1;
+    }
+    std::cout << outFilename << " saved successfully." << std::endl;
+    return 0;
+  }
+
   bool readOk;
   MicroCv::Mat mat = MicroCv::readMatFromFile(inFilename, inFileType, readOk);
 
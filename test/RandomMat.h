@@ -35,4 +35,30 @@ private:
   }
 };
 
+/*
+ * Helper used for testing - it fills a DepthU8 or DepthU16 Mat with hash noise over the whole range
+ * of the depth. The pixels are the same on every run and fast to make for large Mats, so results at
+ * different thread counts can be compared
+ */
+class NoiseMat : public Mat
+{
+public:
+  NoiseMat(int width, int height, int channels, MatDepth depth = DepthU8)
+  : Mat(width, height, channels, depth)
+  {
+    const size_t rowSize = static_cast<size_t>(width) * channels;
+    for(int y = 0; y < height; y++)
+    {
+      for(size_t i = 0; i < rowSize; i++)
+      {
+        const uint32_t hash = static_cast<uint32_t>((y * rowSize + i) * 2654435761u);
+        if(depth == DepthU16)
+          row<uint16_t>(y)[i] = static_cast<uint16_t>(hash >> 16);
+        else
+          row(y)[i] = static_cast<uint8_t>(hash >> 24);
+      }
+    }
+  }
+};
+
 };
@@ -0,0 +1,21 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <gtest/gtest.h>
+
+#include "CpuFeatures.h"
+
+using namespace MicroCv;
+
+TEST(TestCpuFeatures, willClampSimdLevelToWhatTheCpuSupports)
+{
+  const SimdLevel bestLevel = detectSimdLevel();
+  EXPECT_EQ(simdLevel(), bestLevel);
+
+  setSimdLevel(SimdScalar);
+  EXPECT_EQ(simdLevel(), SimdScalar);
+
+  setSimdLevel(SimdAvx2);
+  EXPECT_EQ(simdLevel(), bestLevel);
+}
@@ -2,19 +2,157 @@
  *  Micro Computer Vision library
  *  @author Andrei Polzounov
  */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <boost/filesystem.hpp>
+#include <png.h>
+#include <tiffio.h>
 
 #include <gtest/gtest.h>
 
 #include "FileIo.h"
 #include "ImageProcessing.h"
+#include "MappedImage.h"
 #include "Mat.h"
 #include "RandomMat.h"
 
 using namespace MicroCv;
 
+namespace
+{
+  // The library only writes progressive PNGs and single image TIFFs, so these are made directly
+  void writeInterlacedPng(const std::string& filename, const Mat& mat)
+  {
+    FILE* file = fopen(filename.c_str(), "wb");
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png_create_info_struct(png);
+    png_init_io(png, file);
+    png_set_IHDR(png, info, mat.width(), mat.height(), 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_ADAM7,
+        PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    std::vector<png_bytep> rows;
+    for(int y = 0; y < mat.height(); y++)
+      rows.push_back(const_cast<png_bytep>(mat.row(y)));
+    png_write_image(png, rows.data());
+    png_write_end(png, nullptr);
+    png_destroy_write_struct(&png, &info);
+    fclose(file);
+  }
+
+  // A gray TIFF whose second directory is a half size reduced image filled with reducedValue
+  void writePyramidTiff(const std::string& filename, int width, int height, uint8_t reducedValue)
+  {
+    TIFF* tif = TIFFOpen(filename.c_str(), "w");
+    for(int level = 0; level < 2; level++)
+    {
+      const int levelWidth = width >> level;
+      const int levelHeight = height >> level;
+      TIFFSetField(tif, TIFFTAG_SUBFILETYPE, level == 0 ? 0 : FILETYPE_REDUCEDIMAGE);
+      TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, levelWidth);
+      TIFFSetField(tif, TIFFTAG_IMAGELENGTH, levelHeight);
+      TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+      TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+      TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+      TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+      TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, levelHeight);
+      std::vector<uint8_t> row(levelWidth);
+      for(int y = 0; y < levelHeight; y++)
+      {
+        for(int x = 0; x < levelWidth; x++)
+          row[x] = level == 0 ? static_cast<uint8_t>(x * 10 + y) : reducedValue;
+        TIFFWriteScanline(tif, row.data(), y, 0);
+      }
+      TIFFWriteDirectory(tif);
+    }
+    TIFFClose(tif);
+  }
+
+  // Tiled TIFFs and 16 bit TIFFs are decoded through libtiff's RGBA conversion
+  void writeRgbaConvertedTiff(const std::string& filename, const Mat& mat, bool tiled)
+  {
+    const int blockSize = 16;
+    TIFF* tif = TIFFOpen(filename.c_str(), "w");
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, mat.width());
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, mat.height());
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, tiled ? 8 : 16);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 3);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    if(!tiled)
+    {
+      // Strips of 16 bit samples that convert back to exactly the 8 bit values
+      TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, blockSize);
+      std::vector<uint16_t> row(mat.width() * 3);
+      for(int y = 0; y < mat.height(); y++)
+      {
+        for(int x = 0; x < mat.width() * 3; x++)
+          row[x] = static_cast<uint16_t>(mat.row(y)[x] * 257);
+        TIFFWriteScanline(tif, row.data(), y, 0);
+      }
+      TIFFClose(tif);
+      return;
+    }
+
+    TIFFSetField(tif, TIFFTAG_TILEWIDTH, blockSize);
+    TIFFSetField(tif, TIFFTAG_TILELENGTH, blockSize);
+    std::vector<uint8_t> tile(blockSize * blockSize * 3);
+    for(int tileY = 0; tileY < mat.height(); tileY += blockSize)
+    {
+      for(int tileX = 0; tileX < mat.width(); tileX += blockSize)
+      {
+        std::fill(tile.begin(), tile.end(), 0);
+        const int tileWidth = std::min(blockSize, mat.width() - tileX);
+        for(int y = tileY; y < std::min(tileY + blockSize, mat.height()); y++)
+          std::copy(mat.row(y) + tileX * 3, mat.row(y) + (tileX + tileWidth) * 3, tile.begin() + (y - tileY) * blockSize * 3);
+        TIFFWriteTile(tif, tile.data(), tileX, tileY, 0, 0);
+      }
+    }
+    TIFFClose(tif);
+  }
+
+  // A 16 bit RGBA PNG, the samples are stored most significant byte first
+  void writeRgba16Png(const std::string& filename, int width, int height, const std::vector<uint16_t>& samples)
+  {
+    FILE* file = fopen(filename.c_str(), "wb");
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png_create_info_struct(png);
+    png_init_io(png, file);
+    png_set_IHDR(png, info, width, height, 16, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
+        PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    std::vector<png_byte> row(width * 8);
+    for(int y = 0; y < height; y++)
+    {
+      for(int i = 0; i < width * 4; i++)
+      {
+        row[2*i] = static_cast<png_byte>(samples[y*width*4 + i] >> 8);
+        row[2*i + 1] = static_cast<png_byte>(samples[y*width*4 + i] & 0xFF);
+      }
+      png_write_row(png, row.data());
+    }
+    png_write_end(png, nullptr);
+    png_destroy_write_struct(&png, &info);
+    fclose(file);
+  }
+
+  ReadOptions regionOptions(int x1, int y1, int x2, int y2)
+  {
+    ReadOptions options;
+    options.regionX1 = x1;
+    options.regionY1 = y1;
+    options.regionX2 = x2;
+    options.regionY2 = y2;
+    return options;
+  }
+}
+
 TEST(TestFileIo, willReadValidJpeg)
 {
   bool ok;
@@ -79,10 +217,8 @@ TEST(TestFileIo, willWritePng)
   bool readOk;
   Mat readMat = readMatFromFile(filename, ImageFileType::Png, readOk);
   ASSERT_TRUE(readOk);
-  // PNG is lossless, but MicroCv always reads in RGB images
-  // so convert the original from grayscale before comparison
-  Mat originalRgb = MicroCv::grayToRgb(randMat);
-  EXPECT_EQ(readMat, originalRgb);
+  // PNG is lossless and grayscale images are read back as 1 channel
+  EXPECT_EQ(readMat, randMat);
 
   boost::filesystem::remove(filename);
 }
@@ -103,6 +239,471 @@ TEST(TestFileIo, willWriteTiff)
   boost::filesystem::remove(filename);
 }
 
+TEST(TestFileIo, willReadGrayJpegAsOneChannel)
+{
+  std::string filename = "../images/test_gray.jpg";
+  RandomMat randMat(64, 33, 1);
+  ASSERT_TRUE(writeMatToFile(filename, randMat, ImageFileType::Jpeg));
+
+  bool readOk;
+  Mat readMat = readMatFromFile(filename, ImageFileType::Jpeg, readOk);
+  ASSERT_TRUE(readOk);
+  EXPECT_EQ(readMat.width(), 64);
+  EXPECT_EQ(readMat.height(), 33);
+  EXPECT_EQ(readMat.channels(), 1);
+
+  boost::filesystem::remove(filename);
+}
+
+TEST(TestFileIo, willNotReadCorruptFile)
+{
+  std::string filename = "../images/test_corrupt.png";
+  std::ofstream(filename) << "not really a png";
+
+  bool readOk;
+  Mat readMat = readMatFromFile(filename, ImageFileType::Png, readOk);
+  EXPECT_FALSE(readOk);
+  EXPECT_EQ(readMat.width(), 0);
+
+  boost::filesystem::remove(filename);
+}
+
+TEST(TestFileIo, willReportWriteFailures)
+{
+  RandomMat randMat(16, 16, 3);
+  EXPECT_FALSE(writeMatToFile("../images/no_such_dir/test.png", randMat, ImageFileType::Png));
+  EXPECT_FALSE(writeMatToFile("../images/test.bmp", randMat, ImageFileType::Unsupported));
+
+  RandomMat twoChannelMat(16, 16, 2);
+  EXPECT_FALSE(writeMatToFile("../images/test.png", twoChannelMat, ImageFileType::Png));
+  EXPECT_FALSE(boost::filesystem::exists("../images/test.png"));
+}
+
+TEST(TestFileIo, willWriteCroppedView)
+{
+  std::string filename = "../images/test_view.png";
+  RandomMat randMat(90, 70, 3);
+  MatView view(randMat.data() + 10*randMat.stride() + 5*3, 40, 30, 3, randMat.stride());
+  ASSERT_TRUE(writeMatToFile(filename, view, ImageFileType::Png));
+
+  bool readOk;
+  Mat readMat = readMatFromFile(filename, ImageFileType::Png, readOk);
+  ASSERT_TRUE(readOk);
+  EXPECT_EQ(readMat, Mat(view));
+
+  boost::filesystem::remove(filename);
+}
+
+TEST(TestFileIo, willReadAndWritePlanarImages)
+{
+  // More rows than fit in one chunk of the planar reads and writes
+  RandomMat randMat(45, 37, 3);
+  const Mat planar = convertLayout(randMat, LayoutPlanar);
+  const std::vector<std::string> filenames = {"../images/test_planar.png", "../images/test_planar.mcv"};
+  for(auto itr = filenames.begin(); itr != filenames.end(); ++itr)
+  {
+    const ImageFileType type = imageTypeFromFilename(*itr);
+    ASSERT_TRUE(writeMatToFile(*itr, planar, type));
+
+    bool readOk;
+    EXPECT_EQ(readMatFromFile(*itr, type, readOk), randMat);
+    ReadOptions options;
+    options.layout = LayoutPlanar;
+    Mat readMat = readMatFromFile(*itr, type, options, readOk);
+    ASSERT_TRUE(readOk);
+    EXPECT_EQ(readMat, planar);
+
+    // Reduced and region reads are split into planes after reading
+    options.scaleDenominator = 2;
+    Mat scaled = readMatFromFile(*itr, type, options, readOk);
+    ASSERT_TRUE(readOk);
+    options.layout = LayoutInterleaved;
+    EXPECT_EQ(scaled, convertLayout(readMatFromFile(*itr, type, options, readOk), LayoutPlanar));
+    options.scaleDenominator = 1;
+    options.regionX1 = 3;
+    options.regionY1 = 5;
+    options.regionX2 = 40;
+    options.regionY2 = 30;
+    Mat expected = readMatFromFile(*itr, type, options, readOk);
+    options.layout = LayoutPlanar;
+    Mat region = readMatFromFile(*itr, type, options, readOk);
+    ASSERT_TRUE(readOk);
+    EXPECT_TRUE(region.isPlanar());
+    EXPECT_EQ(convertLayout(region, LayoutInterleaved), expected);
+    boost::filesystem::remove(*itr);
+  }
+
+  // Cropped planar views are written too
+  std::string filename = "../images/test_planar_view.png";
+  const MatView region = cropView(planar, 5, 10, 40, 30);
+  ASSERT_TRUE(writeMatToFile(filename, region, ImageFileType::Png));
+  bool readOk;
+  EXPECT_EQ(readMatFromFile(filename, ImageFileType::Png, readOk), convertLayout(region, LayoutInterleaved));
+  boost::filesystem::remove(filename);
+}
+
+TEST(TestFileIo, willReadAndWrite16BitPngAndTiff)
+{
+  const std::vector<std::string> filenames = {"../images/test16.png", "../images/test16.tiff"};
+  for(auto itr = filenames.begin(); itr != filenames.end(); ++itr)
+  {
+    for(int channels : {1, 3})
+    {
+      SCOPED_TRACE(*itr + " channels " + std::to_string(channels));
+      const Mat wide = NoiseMat(45, 37, channels, DepthU16);
+      const ImageFileType type = imageTypeFromFilename(*itr);
+      ASSERT_TRUE(writeMatToFile(*itr, wide, type));
+
+      ReadOptions options;
+      options.keep16Bits = true;
+      bool readOk;
+      Mat readMat = readMatFromFile(*itr, type, options, readOk);
+      ASSERT_TRUE(readOk);
+      EXPECT_EQ(readMat, wide);
+
+      // Without the option the values are reduced to 8 bits, PNG rounds them like convertDepth
+      readMat = readMatFromFile(*itr, type, readOk);
+      ASSERT_TRUE(readOk);
+      ASSERT_EQ(readMat.depth(), DepthU8);
+      const Mat expected = convertDepth(wide, DepthU8, 1.0 / 257);
+      if(type == ImageFileType::Png)
+      {
+        EXPECT_EQ(readMat, expected);
+      }
+      for(size_t i = 0; i < static_cast<size_t>(expected.stride()) * expected.height(); i++)
+        ASSERT_LE(std::abs(readMat.data()[i] - expected.data()[i]), 1) << "index " << i;
+
+      // Reduced reads average the 16 bit values, region reads keep them, planar layouts are ignored
+      options.layout = LayoutPlanar;
+      options.scaleDenominator = 2;
+      readMat = readMatFromFile(*itr, type, options, readOk);
+      ASSERT_TRUE(readOk);
+      ASSERT_EQ(readMat.depth(), DepthU16);
+      EXPECT_EQ(readMat.width(), 23);
+      const int c = channels - 1;
+      const uint32_t sum = wide.row<uint16_t>(8)[6*channels + c] + wide.row<uint16_t>(8)[7*channels + c]
+          + wide.row<uint16_t>(9)[6*channels + c] + wide.row<uint16_t>(9)[7*channels + c];
+      EXPECT_EQ(readMat.row<uint16_t>(4)[3*channels + c], (sum + 2) / 4);
+      options = regionOptions(3, 5, 40, 30);
+      options.keep16Bits = true;
+      readMat = readMatFromFile(*itr, type, options, readOk);
+      ASSERT_TRUE(readOk);
+      EXPECT_EQ(readMat, Mat(cropView(wide, 3, 5, 40, 30)));
+      boost::filesystem::remove(*itr);
+    }
+  }
+
+  // The 16 bit TIFFs that the RGBA conversion reads as 8 bits are read as they are
+  std::string filename = "../images/test16_strips.tiff";
+  RandomMat randMat(40, 35, 3);
+  writeRgbaConvertedTiff(filename, randMat, false);
+  ReadOptions options;
+  options.keep16Bits = true;
+  bool readOk;
+  EXPECT_EQ(readMatFromFile(filename, ImageFileType::Tiff, options, readOk), convertDepth(randMat, DepthU16, 257));
+  boost::filesystem::remove(filename);
+
+  // The alpha channel is blended onto black in 16 bits too
+  filename = "../images/test16_alpha.png";
+  writeRgba16Png(filename, 2, 1, {65535, 0, 32768, 65535, 65535, 65535, 1000, 32768});
+  const Mat blended = readMatFromFile(filename, ImageFileType::Png, options, readOk);
+  ASSERT_TRUE(readOk);
+  const uint16_t expected[] = {65535, 0, 32768, 32768, 32768, 500};
+  for(int i = 0; i < 6; i++)
+    EXPECT_EQ(blended.row<uint16_t>(0)[i], expected[i]) << "index " << i;
+
+  // 8 bit files are still read as 8 bits, other formats and depths can not be written
+  RandomMat gray(20, 10, 1);
+  ASSERT_TRUE(writeMatToFile(filename, gray, ImageFileType::Png));
+  EXPECT_EQ(readMatFromFile(filename, ImageFileType::Png, options, readOk), gray);
+  boost::filesystem::remove(filename);
+  EXPECT_FALSE(writeMatToFile("../images/test16.jpg", NoiseMat(8, 8, 3, DepthU16), ImageFileType::Jpeg));
+  EXPECT_FALSE(writeMatToFile("../images/test16.mcv", NoiseMat(8, 8, 1, DepthU16), ImageFileType::Mcv));
+  EXPECT_FALSE(writeMatToFile("../images/test_s16.png", convertDepth(gray, DepthS16), ImageFileType::Png));
+  EXPECT_FALSE(boost::filesystem::exists("../images/test_s16.png"));
+}
+
+TEST(TestFileIo, willWriteMcvAndPnm)
+{
+  RandomMat rgbMat(37, 29, 3);
+  RandomMat grayMat(64, 17, 1);
+  const std::vector<std::string> filenames = {"../images/test.mcv", "../images/test.ppm", "../images/test.pgm"};
+
+  for(auto itr = filenames.begin(); itr != filenames.end(); ++itr)
+  {
+    const ImageFileType type = imageTypeFromFilename(*itr);
+    const Mat& mat = *itr == filenames.back() ? static_cast<Mat&>(grayMat) : static_cast<Mat&>(rgbMat);
+    ASSERT_TRUE(writeMatToFile(*itr, mat, type));
+
+    // Both are lossless
+    bool readOk;
+    Mat readMat = readMatFromFile(*itr, type, readOk);
+    ASSERT_TRUE(readOk);
+    EXPECT_EQ(readMat, mat);
+    boost::filesystem::remove(*itr);
+  }
+}
+
+TEST(TestFileIo, willMapMcvAndPnmWithoutCopying)
+{
+  std::string mcvFilename = "../images/test_mapped.mcv";
+  std::string ppmFilename = "../images/test_mapped.ppm";
+  RandomMat randMat(37, 29, 3);
+  ASSERT_TRUE(writeMatToFile(mcvFilename, randMat, ImageFileType::Mcv));
+  ASSERT_TRUE(writeMatToFile(ppmFilename, randMat, ImageFileType::Pnm));
+
+  MappedImage mapped;
+  ASSERT_TRUE(mapped.open(mcvFilename));
+  MatView view = mapped.view();
+  EXPECT_EQ(Mat(view), randMat);
+  // Rows of .mcv files are cache line aligned
+  EXPECT_EQ(view.stride(), 128);
+  for(int y = 0; y < view.height(); y++)
+  {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(view.row(y)) % 64, 0u);
+  }
+  // Views of the mapping work like any other input
+  EXPECT_EQ(sobelEdgeDetector(view), sobelEdgeDetector(randMat));
+
+  ASSERT_TRUE(mapped.open(ppmFilename));
+  EXPECT_EQ(Mat(mapped.view()), randMat);
+  mapped.close();
+  EXPECT_FALSE(mapped.isOpen());
+  EXPECT_TRUE(mapped.view().empty());
+
+  // Compressed files can not be mapped
+  EXPECT_FALSE(mapped.open("../images/tux.png"));
+
+  boost::filesystem::remove(mcvFilename);
+  boost::filesystem::remove(ppmFilename);
+}
+
+TEST(TestFileIo, willReadPnmHeadersWithCommentsAndFewerLevels)
+{
+  std::string filename = "../images/test_levels.pgm";
+  {
+    std::ofstream file(filename, std::ios::binary);
+    file << "P5\n# made by hand\n3 2\n# 4 bit\n15\n";
+    const char pixels[] = {0, 1, 7, 8, 14, 15};
+    file.write(pixels, sizeof(pixels));
+  }
+
+  bool readOk;
+  Mat readMat = readMatFromFile(filename, ImageFileType::Pnm, readOk);
+  ASSERT_TRUE(readOk);
+  ASSERT_EQ(readMat.width(), 3);
+  ASSERT_EQ(readMat.height(), 2);
+  ASSERT_EQ(readMat.channels(), 1);
+  const uint8_t expected[] = {0, 17, 119, 136, 238, 255};
+  EXPECT_TRUE(std::equal(expected, expected + 6, readMat.data()));
+
+  // Truncated pixel data is rejected
+  std::ofstream(filename, std::ios::binary) << "P6\n4 4\n255\nabc";
+  readMatFromFile(filename, ImageFileType::Pnm, readOk);
+  EXPECT_FALSE(readOk);
+
+  boost::filesystem::remove(filename);
+}
+
+TEST(TestFileIo, willReadScaledJpeg)
+{
+  std::string filename = "../images/lena.jpg";
+  bool readOk;
+  Mat lena = readMatFromFile(filename, ImageFileType::Jpeg, readOk);
+  ASSERT_TRUE(readOk);
+
+  ReadOptions options;
+  options.scaleDenominator = 2;
+  Mat half = readMatFromFile(filename, ImageFileType::Jpeg, options, readOk);
+  ASSERT_TRUE(readOk);
+  EXPECT_EQ(half.width(), 256);
+  EXPECT_EQ(half.height(), 256);
+  EXPECT_EQ(half.channels(), 3);
+
+  // The reduced DCT is close to averaging the full size image
+  long totalDifference = 0;
+  for(int y = 0; y < half.height(); y++)
+  {
+    for(int x = 0; x < half.width() * 3; x++)
+    {
+      const int c = x % 3;
+      const int fullX = (x / 3) * 2 * 3 + c;
+      const int average = (lena.row(2 * y)[fullX] + lena.row(2 * y)[fullX + 3]
+          + lena.row(2 * y + 1)[fullX] + lena.row(2 * y + 1)[fullX + 3] + 2) / 4;
+      totalDifference += std::abs(half.row(y)[x] - average);
+    }
+  }
+  EXPECT_LT(totalDifference, 256L * 256 * 3 * 4);
+
+  // 1/8 would be smaller than the target, so 1/4 is used
+  options.targetWidth = 100;
+  options.targetHeight = 100;
+  Mat thumbnail = readMatFromFile(filename, ImageFileType::Jpeg, options, readOk);
+  ASSERT_TRUE(readOk);
+  EXPECT_EQ(thumbnail.width(), 128);
+  EXPECT_EQ(thumbnail.height(), 128);
+}
+
+TEST(TestFileIo, willAverageBlocksWhenFormatCannotScale)
+{
+  std::string filename = "../images/test_scaled.ppm";
+  RandomMat randMat(11, 7, 3);
+  ASSERT_TRUE(writeMatToFile(filename, randMat, ImageFileType::Pnm));
+
+  ReadOptions options;
+  options.scaleDenominator = 4;
+  bool readOk;
+  Mat scaled = readMatFromFile(filename, ImageFileType::Pnm, options, readOk);
+  ASSERT_TRUE(readOk);
+  ASSERT_EQ(scaled.width(), 3);
+  ASSERT_EQ(scaled.height(), 2);
+  for(int y = 0; y < 2; y++)
+  {
+    for(int x = 0; x < 3; x++)
+    {
+      for(int c = 0; c < 3; c++)
+      {
+        // The blocks on the right and bottom edges are smaller
+        int sum = 0;
+        int count = 0;
+        for(int fullY = y * 4; fullY < std::min(y * 4 + 4, 7); fullY++)
+        {
+          for(int fullX = x * 4; fullX < std::min(x * 4 + 4, 11); fullX++, count++)
+            sum += randMat.row(fullY)[fullX * 3 + c];
+        }
+        EXPECT_EQ(scaled.row(y)[x * 3 + c], (sum + count / 2) / count);
+      }
+    }
+  }
+  boost::filesystem::remove(filename);
+}
+
+TEST(TestFileIo, willReadReducedImagesOfInterlacedPngAndPyramidTiff)
+{
+  std::string pngFilename = "../images/test_interlaced.png";
+  RandomMat randMat(13, 11, 3);
+  writeInterlacedPng(pngFilename, randMat);
+
+  bool readOk;
+  ASSERT_EQ(readMatFromFile(pngFilename, ImageFileType::Png, readOk), randMat);
+  ASSERT_TRUE(readOk);
+  const int denominators[] = {2, 4, 8};
+  for(int denominator : denominators)
+  {
+    // The first interlace passes hold every denominator-th pixel
+    ReadOptions options;
+    options.scaleDenominator = denominator;
+    Mat scaled = readMatFromFile(pngFilename, ImageFileType::Png, options, readOk);
+    ASSERT_TRUE(readOk);
+    ASSERT_EQ(scaled.width(), (13 + denominator - 1) / denominator);
+    ASSERT_EQ(scaled.height(), (11 + denominator - 1) / denominator);
+    for(int y = 0; y < scaled.height(); y++)
+    {
+      for(int x = 0; x < scaled.width() * 3; x++)
+        EXPECT_EQ(scaled.row(y)[x], randMat.row(y * denominator)[(x / 3) * denominator * 3 + x % 3]);
+    }
+  }
+  boost::filesystem::remove(pngFilename);
+
+  std::string tiffFilename = "../images/test_pyramid.tiff";
+  writePyramidTiff(tiffFilename, 20, 12, 77);
+  ReadOptions options;
+  options.scaleDenominator = 2;
+  Mat reduced = readMatFromFile(tiffFilename, ImageFileType::Tiff, options, readOk);
+  ASSERT_TRUE(readOk);
+  ASSERT_EQ(reduced.width(), 10);
+  ASSERT_EQ(reduced.height(), 6);
+  EXPECT_TRUE(std::all_of(reduced.data(), reduced.data() + 60, [](uint8_t pixel) { return pixel == 77; }));
+
+  // There is no quarter size level, so the full image is averaged
+  options.scaleDenominator = 4;
+  Mat averaged = readMatFromFile(tiffFilename, ImageFileType::Tiff, options, readOk);
+  ASSERT_TRUE(readOk);
+  ASSERT_EQ(averaged.width(), 5);
+  ASSERT_EQ(averaged.height(), 3);
+  // The sum of 10 * x + y over the 4x4 block is 264
+  EXPECT_EQ(averaged.row(0)[0], (264 + 8) / 16);
+  boost::filesystem::remove(tiffFilename);
+}
+
+TEST(TestFileIo, willReadRegionOfJpegAndCompressedTiff)
+{
+  std::string filename = "../images/lena.jpg";
+  bool readOk;
+  Mat lena = readMatFromFile(filename, ImageFileType::Jpeg, readOk);
+  ASSERT_TRUE(readOk);
+
+  // Only the blocks around the region are decoded, with the same result as cropping the whole image
+  const int regions[][4] = {{37, 45, 301, 211}, {13, 21, 250, 199}, {16, 16, 32, 48}, {0, 33, 511, 511}};
+  for(const auto& r : regions)
+  {
+    Mat region = readMatFromFile(filename, ImageFileType::Jpeg, regionOptions(r[0], r[1], r[2], r[3]), readOk);
+    ASSERT_TRUE(readOk);
+    EXPECT_EQ(region, Mat(cropView(lena, r[0], r[1], r[2], r[3])));
+  }
+
+  // LZW strips have to be decoded from their start
+  Mat square = readMatFromFile("../images/square.tiff", ImageFileType::Tiff, readOk);
+  Mat squareRegion = readMatFromFile("../images/square.tiff", ImageFileType::Tiff, regionOptions(40, 7, 299, 299), readOk);
+  ASSERT_TRUE(readOk);
+  EXPECT_EQ(squareRegion, Mat(cropView(square, 40, 7, 299, 299)));
+
+  // Regions of the scaled image
+  ReadOptions options = regionOptions(16, 8, 64, 100);
+  options.scaleDenominator = 4;
+  ReadOptions scaledOptions;
+  scaledOptions.scaleDenominator = 4;
+  Mat scaled = readMatFromFile(filename, ImageFileType::Jpeg, scaledOptions, readOk);
+  ASSERT_TRUE(readOk);
+  Mat region = readMatFromFile(filename, ImageFileType::Jpeg, options, readOk);
+  ASSERT_TRUE(readOk);
+  EXPECT_EQ(region, Mat(cropView(scaled, 16, 8, 64, 100)));
+}
+
+TEST(TestFileIo, willReadRegionOfEveryFormat)
+{
+  RandomMat randMat(75, 53, 3);
+  const std::vector<std::string> filenames = {
+      "../images/test_region.png", "../images/test_region.tiff", "../images/test_region.mcv",
+      "../images/test_region.ppm", "../images/test_region_tiled.tiff", "../images/test_region_16bit.tiff"};
+  for(auto itr = filenames.begin(); itr != filenames.end(); ++itr)
+  {
+    const ImageFileType type = imageTypeFromFilename(*itr);
+    if(itr - filenames.begin() >= 4)
+      writeRgbaConvertedTiff(*itr, randMat, *itr == filenames[4]);
+    else
+      ASSERT_TRUE(writeMatToFile(*itr, randMat, type));
+
+    bool readOk;
+    Mat region = readMatFromFile(*itr, type, regionOptions(20, 17, 75, 40), readOk);
+    ASSERT_TRUE(readOk) << *itr;
+    // The region reaches the last column, which cropView() never includes
+    EXPECT_EQ(region, Mat(MatView(randMat.row(17) + 20 * 3, 55, 23, 3, randMat.stride()))) << *itr;
+
+    // Regions that do not fit read the whole image
+    EXPECT_EQ(readMatFromFile(*itr, type, regionOptions(20, 17, 76, 40), readOk), randMat) << *itr;
+    boost::filesystem::remove(*itr);
+  }
+}
+
+TEST(TestFileIo, willReadImageSizeFromHeader)
+{
+  int width, height, channels;
+  ASSERT_TRUE(readImageSize("../images/tux.png", ImageFileType::Png, width, height, channels));
+  EXPECT_EQ(width, 400);
+  EXPECT_EQ(height, 479);
+  EXPECT_EQ(channels, 3);
+  EXPECT_FALSE(readImageSize("../images/none.png", ImageFileType::Png, width, height, channels));
+}
+
+TEST(TestFileIo, willRecognizeUncompressedFileExtensions)
+{
+  EXPECT_EQ(imageTypeFromFilename("never.mcv"), ImageFileType::Mcv);
+  EXPECT_EQ(imageTypeFromFilename("gonna.pgm"), ImageFileType::Pnm);
+  EXPECT_EQ(imageTypeFromFilename("run.ppm"), ImageFileType::Pnm);
+  EXPECT_EQ(imageTypeFromFilename("around.pnm"), ImageFileType::Pnm);
+}
+
 TEST(TestFileIo, willRecognizeFileExtensions)
 {
   const std::vector<std::string> filenames = {
@@ -0,0 +1,166 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+#include "CpuFeatures.h"
+#include "Histogram.h"
+#include "ImageProcessing.h"
+#include "Mat.h"
+#include "Parallel.h"
+#include "RandomMat.h"
+
+using namespace MicroCv;
+
+namespace
+{
+  std::vector<Histogram> referenceHistograms(const MatView& view)
+  {
+    std::vector<Histogram> histograms(view.channels());
+    for(Histogram& histogram : histograms)
+      histogram.fill(0);
+    for(int y = 0; y < view.height(); y++)
+      for(int x = 0; x < view.width(); x++)
+        for(int c = 0; c < view.channels(); c++)
+          histograms[c][view.row(y)[x*view.channels() + c]]++;
+    return histograms;
+  }
+
+  // Same rounding as the library, from sums taken pixel by pixel
+  void expectStatisticsMatch(const MatView& view)
+  {
+    const std::vector<ChannelStatistics> statistics = channelStatistics(view);
+    ASSERT_EQ(static_cast<int>(statistics.size()), view.channels());
+    const double count = static_cast<double>(view.width()) * view.height();
+    for(int c = 0; c < view.channels(); c++)
+    {
+      uint64_t sum = 0, squares = 0;
+      int min = 255, max = 0;
+      for(int y = 0; y < view.height(); y++)
+      {
+        for(int x = 0; x < view.width(); x++)
+        {
+          const int v = view.row(y)[x*view.channels() + c];
+          sum += v;
+          squares += v*v;
+          min = std::min(min, v);
+          max = std::max(max, v);
+        }
+      }
+      const double mean = sum / count;
+      EXPECT_EQ(statistics[c].min, min) << "channel " << c;
+      EXPECT_EQ(statistics[c].max, max) << "channel " << c;
+      EXPECT_DOUBLE_EQ(statistics[c].mean, mean) << "channel " << c;
+      EXPECT_DOUBLE_EQ(statistics[c].stddev, std::sqrt(std::max((squares - sum * mean) / count, 0.0))) << "channel " << c;
+    }
+  }
+}
+
+TEST(TestHistogram, computeHistogramsWillCountEveryChannel)
+{
+  for(int channels = 1; channels <= 4; channels++)
+  {
+    // Widths that do not fill the last group of 4 pixels
+    Mat original = RandomMat(37, 11, channels);
+    EXPECT_EQ(computeHistograms(original), referenceHistograms(original)) << "channels " << channels;
+  }
+
+  // Runs of one value and a view with gaps between its rows
+  Mat white(64, 9, 3);
+  std::fill(white.vectorPtr()->begin(), white.vectorPtr()->end(), 255);
+  EXPECT_EQ(computeHistograms(white)[2][255], 64u * 9);
+  Mat original = RandomMat(50, 40, 3);
+  const MatView region = cropView(original, 3, 5, 41, 33);
+  EXPECT_EQ(computeHistograms(region), referenceHistograms(region));
+}
+
+TEST(TestHistogram, computeHistogramsWillMatchForAnyNumberOfThreads)
+{
+  Mat original = NoiseMat(613, 401, 3);
+  const std::vector<Histogram> expected = referenceHistograms(original);
+  for(int threads : {1, 4, 7})
+  {
+    setNumThreads(threads);
+    EXPECT_EQ(computeHistograms(original), expected) << "threads " << threads;
+  }
+  setNumThreads(0);
+}
+
+TEST(TestHistogram, channelStatisticsSimdKernelsAreBitExactWithScalar)
+{
+  const SimdLevel bestLevel = detectSimdLevel();
+  for(int level = SimdScalar; level <= bestLevel; level++)
+  {
+    setSimdLevel(static_cast<SimdLevel>(level));
+    for(int channels = 1; channels <= 5; channels++)
+    {
+      // Odd width so the scalar tails after the vector loops are exercised too
+      Mat original = RandomMat(83, 7, channels);
+      SCOPED_TRACE(testing::Message() << "level " << level << " channels " << channels);
+      expectStatisticsMatch(original);
+    }
+    // Rows longer than the 256 periods between flushes of the 16 bit sums
+    SCOPED_TRACE(testing::Message() << "level " << level);
+    Mat white(13000, 3, 1);
+    std::fill(white.vectorPtr()->begin(), white.vectorPtr()->end(), 255);
+    expectStatisticsMatch(white);
+    expectStatisticsMatch(NoiseMat(4507, 5, 3));
+    Mat original = RandomMat(50, 40, 3);
+    expectStatisticsMatch(cropView(original, 1, 2, 48, 30));
+  }
+  setSimdLevel(bestLevel);
+}
+
+TEST(TestHistogram, channelStatisticsWillMatchForAnyNumberOfThreads)
+{
+  Mat original = NoiseMat(613, 401, 3);
+  setNumThreads(1);
+  const std::vector<ChannelStatistics> expected = channelStatistics(original);
+  for(int threads : {4, 7})
+  {
+    setNumThreads(threads);
+    const std::vector<ChannelStatistics> statistics = channelStatistics(original);
+    ASSERT_EQ(statistics.size(), expected.size());
+    for(size_t c = 0; c < expected.size(); c++)
+    {
+      EXPECT_EQ(statistics[c].min, expected[c].min);
+      EXPECT_EQ(statistics[c].max, expected[c].max);
+      EXPECT_DOUBLE_EQ(statistics[c].mean, expected[c].mean);
+      EXPECT_DOUBLE_EQ(statistics[c].stddev, expected[c].stddev);
+    }
+  }
+  setNumThreads(0);
+  expectStatisticsMatch(original);
+}
+
+TEST(TestHistogram, willCountPlanarMatsPlaneByPlane)
+{
+  Mat original = RandomMat(53, 29, 3);
+  const Mat planar = convertLayout(original, LayoutPlanar);
+  EXPECT_EQ(computeHistograms(planar), referenceHistograms(original));
+  const std::vector<ChannelStatistics> expected = channelStatistics(original);
+  const std::vector<ChannelStatistics> statistics = channelStatistics(planar);
+  ASSERT_EQ(statistics.size(), expected.size());
+  for(size_t c = 0; c < expected.size(); c++)
+  {
+    EXPECT_EQ(statistics[c].min, expected[c].min);
+    EXPECT_EQ(statistics[c].max, expected[c].max);
+    EXPECT_DOUBLE_EQ(statistics[c].mean, expected[c].mean);
+    EXPECT_DOUBLE_EQ(statistics[c].stddev, expected[c].stddev);
+  }
+}
+
+TEST(TestHistogram, willHandleEmptyMats)
+{
+  EXPECT_TRUE(computeHistograms(Mat()).empty());
+  EXPECT_TRUE(channelStatistics(Mat()).empty());
+  const std::vector<Histogram> histograms = computeHistograms(Mat(0, 5, 3));
+  ASSERT_EQ(histograms.size(), 3u);
+  EXPECT_EQ(histograms[1][0], 0u);
+  EXPECT_TRUE(channelStatistics(Mat(0, 5, 3)).empty());
+}
@@ -2,12 +2,18 @@
  *  Micro Computer Vision library
  *  @author Andrei Polzounov
  */
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <vector>
 
 #include <gtest/gtest.h>
 
+#include "CpuFeatures.h"
 #include "ImageProcessing.h"
 #include "Mat.h"
+#include "Parallel.h"
 #include "RandomMat.h"
 
 using namespace MicroCv;
@@ -39,6 +45,359 @@ namespace
         *(mat.data() + y*mat.width() + mat.width()-1) = 0;
   }
 
+  // Direct 3x3 convolution used as the reference for the separable implementation
+  Mat referenceSobel(const Mat& gray, SobelMagnitude magnitude)
+  {
+    Mat out(gray.width(), gray.height(), 1);
+    const int w = gray.width();
+    for(int y = 1; y < gray.height() - 1; y++)
+    {
+      for(int x = 1; x < w - 1; x++)
+      {
+        const uint8_t* p = gray.data() + y*w + x;
+        int gx = -p[-w-1] + p[-w+1] - 2*p[-1] + 2*p[1] - p[w-1] + p[w+1];
+        int gy = p[-w-1] + 2*p[-w] + p[-w+1] - p[w-1] - 2*p[w] - p[w+1];
+        int mag = std::abs(gx) + std::abs(gy);
+        if(magnitude == SobelL2)
+          mag = static_cast<int>(std::sqrt(static_cast<float>(gx*gx + gy*gy)) + 0.5f);
+        out.data()[y*w + x] = static_cast<uint8_t>(std::min(mag, 255));
+      }
+    }
+    return out;
+  }
+
+  // Pixel read for index i of a line of n pixels, -1 for the constant border
+  int referenceBorderIndex(int i, int n, BorderMode border)
+  {
+    if(border == BorderConstant && (i < 0 || i >= n))
+      return -1;
+    while(i < 0 || i >= n)
+    {
+      if(border == BorderReplicate || n == 1)
+        i = i < 0 ? 0 : n - 1;
+      else
+        i = i < 0 ? -i : 2*n - 2 - i;
+    }
+    return i;
+  }
+
+  // Direct convolution with the border looked up pixel by pixel, the reference for filter2D
+  Mat referenceFilter(const Mat& mat, const FilterKernel& kernel, BorderMode border)
+  {
+    auto borderIndex = [&](int i, int n) { return referenceBorderIndex(i, n, border); };
+
+    const int channels = mat.channels();
+    Mat out(mat.width(), mat.height(), channels);
+    for(int y = 0; y < mat.height(); y++)
+    {
+      for(int x = 0; x < mat.width(); x++)
+      {
+        for(int c = 0; c < channels; c++)
+        {
+          int sum = 0;
+          for(int ky = 0; ky < kernel.height; ky++)
+          {
+            for(int kx = 0; kx < kernel.width; kx++)
+            {
+              const int inY = borderIndex(y + ky - kernel.height/2, mat.height());
+              const int inX = borderIndex(x + kx - kernel.width/2, mat.width());
+              if(inY >= 0 && inX >= 0)
+                sum += kernel.weights[ky*kernel.width + kx] * mat.data()[(inY*mat.width() + inX)*channels + c];
+            }
+          }
+          const float value = static_cast<float>(sum) / kernel.divisor + kernel.offset;
+          out.data()[(y*mat.width() + x)*channels + c] =
+              static_cast<uint8_t>(std::nearbyint(std::min(std::max(value, 0.0f), 255.0f)));
+        }
+      }
+    }
+    return out;
+  }
+
+  // Separable Gaussian in double precision, truncated at 5 sigma, the reference for gaussianBlur
+  Mat referenceGaussian(const Mat& mat, double sigma, BorderMode border)
+  {
+    const int radius = static_cast<int>(std::ceil(5*sigma));
+    std::vector<double> weights(2*radius + 1);
+    double sum = 0;
+    for(int k = -radius; k <= radius; k++)
+      sum += weights[k + radius] = std::exp(-k*k / (2*sigma*sigma));
+
+    const int width = mat.width();
+    const int height = mat.height();
+    const int channels = mat.channels();
+    std::vector<double> rows(static_cast<size_t>(width) * height * channels);
+    for(int y = 0; y < height; y++)
+      for(int x = 0; x < width; x++)
+        for(int c = 0; c < channels; c++)
+        {
+          double value = 0;
+          for(int k = -radius; k <= radius; k++)
+          {
+            const int inX = referenceBorderIndex(x + k, width, border);
+            if(inX >= 0)
+              value += weights[k + radius] / sum * mat.data()[(y*width + inX)*channels + c];
+          }
+          rows[(y*width + x)*channels + c] = value;
+        }
+
+    Mat out(width, height, channels);
+    for(int y = 0; y < height; y++)
+      for(int x = 0; x < width; x++)
+        for(int c = 0; c < channels; c++)
+        {
+          double value = 0;
+          for(int k = -radius; k <= radius; k++)
+          {
+            const int inY = referenceBorderIndex(y + k, height, border);
+            if(inY >= 0)
+              value += weights[k + radius] / sum * rows[(inY*width + x)*channels + c];
+          }
+          out.data()[(y*width + x)*channels + c] = static_cast<uint8_t>(std::lround(value));
+        }
+    return out;
+  }
+
+  // Largest difference of any pixel value
+  int maxDifference(const Mat& a, const Mat& b)
+  {
+    int difference = 0;
+    for(size_t i = 0; i < static_cast<size_t>(a.width()) * a.height() * a.channels(); i++)
+      difference = std::max(difference, std::abs(a.data()[i] - b.data()[i]));
+    return difference;
+  }
+
+  // Canny from the Sobel definition with a breadth first hysteresis over the whole image, the
+  // directions are quantized with the same fixed point tangents as the library
+  Mat referenceCanny(const Mat& mat, int low, int high, SobelMagnitude magnitude)
+  {
+    const Mat gray = mat.channels() == 3 ? rgbToGray(mat) : mat;
+    const int width = gray.width();
+    const int height = gray.height();
+    auto p = [&](int x, int y) -> int { return gray.data()[y*width + x]; };
+    std::vector<int> gx(width*height, 0), gy(width*height, 0), m(width*height, 0);
+    for(int y = 1; y < height - 1; y++)
+      for(int x = 1; x < width - 1; x++)
+      {
+        const int i = y*width + x;
+        gx[i] = (p(x+1, y-1) - p(x-1, y-1)) + 2*(p(x+1, y) - p(x-1, y)) + (p(x+1, y+1) - p(x-1, y+1));
+        gy[i] = (p(x-1, y-1) + 2*p(x, y-1) + p(x+1, y-1)) - (p(x-1, y+1) + 2*p(x, y+1) + p(x+1, y+1));
+        m[i] = magnitude == SobelL2 ? gx[i]*gx[i] + gy[i]*gy[i] : std::abs(gx[i]) + std::abs(gy[i]);
+      }
+    if(magnitude == SobelL2)
+    {
+      low *= low;
+      high *= high;
+    }
+
+    std::vector<int> labels(width*height, 0);
+    std::vector<int> queue;
+    for(int y = 1; y < height - 1; y++)
+      for(int x = 1; x < width - 1; x++)
+      {
+        const int i = y*width + x;
+        if(m[i] <= low)
+          continue;
+        const long ax = std::abs(gx[i]), ay = static_cast<long>(std::abs(gy[i])) << 15;
+        bool isMaximum;
+        if(ay < ax * 13573)
+          isMaximum = m[i] > m[i-1] && m[i] >= m[i+1];
+        else if(ay > ax * 13573 + (ax << 16))
+          isMaximum = m[i] > m[i-width] && m[i] >= m[i+width];
+        else
+        {
+          // The gradient points along (gx, -gy) with y down
+          const int d = (gx[i] < 0) != (gy[i] < 0) ? 1 : -1;
+          isMaximum = m[i] > m[i-width-d] && m[i] > m[i+width+d];
+        }
+        if(isMaximum)
+          labels[i] = m[i] > high ? 2 : 1;
+        if(labels[i] == 2)
+          queue.push_back(i);
+      }
+    for(size_t head = 0; head < queue.size(); head++)
+    {
+      const int i = queue[head];
+      for(int dy = -1; dy <= 1; dy++)
+        for(int dx = -1; dx <= 1; dx++)
+        {
+          const int j = i + dy*width + dx;
+          if(labels[j] == 1)
+          {
+            labels[j] = 2;
+            queue.push_back(j);
+          }
+        }
+    }
+
+    Mat edges(width, height, 1);
+    for(int i = 0; i < width*height; i++)
+      edges.data()[i] = labels[i] == 2 ? 255 : 0;
+    return edges;
+  }
+
+  // Sum and size of the window of radius around (x, y), clipped to the mat
+  uint64_t referenceWindowSum(const Mat& mat, int x, int y, int radius, int channel, uint64_t& area)
+  {
+    const int x1 = std::max(x - radius, 0);
+    const int x2 = std::min(x + radius + 1, mat.width());
+    const int y1 = std::max(y - radius, 0);
+    const int y2 = std::min(y + radius + 1, mat.height());
+    uint64_t sum = 0;
+    for(int wy = y1; wy < y2; wy++)
+      for(int wx = x1; wx < x2; wx++)
+        sum += mat.data()[(wy*mat.width() + wx)*mat.channels() + channel];
+    area = static_cast<uint64_t>(x2 - x1) * (y2 - y1);
+    return sum;
+  }
+
+  // Rounded mean of every clipped window, the reference for boxFilter
+  Mat referenceBoxFilter(const Mat& mat, int radius)
+  {
+    Mat out(mat.width(), mat.height(), mat.channels());
+    for(int y = 0; y < mat.height(); y++)
+      for(int x = 0; x < mat.width(); x++)
+        for(int c = 0; c < mat.channels(); c++)
+        {
+          uint64_t area = 0;
+          const uint64_t sum = referenceWindowSum(mat, x, y, radius, c, area);
+          out.data()[(y*mat.width() + x)*mat.channels() + c] = static_cast<uint8_t>((sum + area/2) / area);
+        }
+    return out;
+  }
+
+  // 255 where the pixel + offset is at least the mean of its clipped window, the reference for adaptiveThreshold
+  Mat referenceThreshold(const Mat& gray, int radius, int offset)
+  {
+    Mat out(gray.width(), gray.height(), 1);
+    for(int y = 0; y < gray.height(); y++)
+      for(int x = 0; x < gray.width(); x++)
+      {
+        uint64_t area = 0;
+        const int64_t sum = static_cast<int64_t>(referenceWindowSum(gray, x, y, radius, 0, area));
+        out.data()[y*gray.width() + x] = (gray.data()[y*gray.width() + x] + offset) * static_cast<int64_t>(area) >= sum ? 255 : 0;
+      }
+    return out;
+  }
+
+  // Equalization table of every channel from a histogram counted pixel by pixel
+  Mat referenceEqualize(const Mat& mat)
+  {
+    const int channels = mat.channels();
+    const int count = mat.width() * mat.height();
+    Mat out(mat.width(), mat.height(), channels);
+    for(int c = 0; c < channels; c++)
+    {
+      std::vector<int> cumulative(256, 0);
+      for(int i = 0; i < count; i++)
+        cumulative[mat.data()[i*channels + c]]++;
+      for(int v = 1; v < 256; v++)
+        cumulative[v] += cumulative[v-1];
+      int least = 0;
+      while(cumulative[least] == 0)
+        least++;
+      const int first = cumulative[least];
+      for(int i = 0; i < count; i++)
+      {
+        const int v = mat.data()[i*channels + c];
+        out.data()[i*channels + c] = first == count ? v
+            : static_cast<uint8_t>(std::lround((cumulative[v] - first) * (255.0 / (count - first))));
+      }
+    }
+    return out;
+  }
+
+  // CLAHE with the tables of every tile built pixel by pixel and blended with the same 8 bit weights
+  Mat referenceClahe(const Mat& mat, double clipLimit, int tilesX, int tilesY)
+  {
+    const int width = mat.width();
+    const int height = mat.height();
+    const int channels = mat.channels();
+    tilesX = std::min(tilesX, width);
+    tilesY = std::min(tilesY, height);
+    std::vector<std::vector<int>> tables(tilesX * tilesY * channels, std::vector<int>(256));
+    for(int ty = 0; ty < tilesY; ty++)
+      for(int tx = 0; tx < tilesX; tx++)
+        for(int c = 0; c < channels; c++)
+        {
+          const int x1 = tx * width / tilesX, x2 = (tx + 1) * width / tilesX;
+          const int y1 = ty * height / tilesY, y2 = (ty + 1) * height / tilesY;
+          const int area = (x2 - x1) * (y2 - y1);
+          std::vector<int> histogram(256, 0);
+          for(int y = y1; y < y2; y++)
+            for(int x = x1; x < x2; x++)
+              histogram[mat.data()[(y*width + x)*channels + c]]++;
+          const int limit = clipLimit > 0 ? std::max(static_cast<int>(clipLimit * area / 256), 1) : area;
+          int excess = 0;
+          for(int& n : histogram)
+          {
+            excess += std::max(n - limit, 0);
+            n = std::min(n, limit);
+          }
+          int residual = excess % 256;
+          for(int v = 0; v < 256; v++)
+            histogram[v] += excess / 256;
+          for(int v = 0; residual > 0; v += std::max(256 / (excess % 256), 1), residual--)
+            histogram[v]++;
+          int cumulative = 0;
+          std::vector<int>& table = tables[(ty*tilesX + tx)*channels + c];
+          for(int v = 0; v < 256; v++)
+          {
+            cumulative += histogram[v];
+            table[v] = std::min((cumulative * 255 + area / 2) / area, 255);
+          }
+        }
+
+    auto weight = [](int x, int size, int tiles, int& first, int& second)
+    {
+      const double position = (x + 0.5) * tiles / size - 0.5;
+      const int below = static_cast<int>(std::floor(position));
+      first = std::max(below, 0);
+      second = std::min(below + 1, tiles - 1);
+      return static_cast<int>(std::lround((position - below) * 256));
+    };
+    Mat out(width, height, channels);
+    for(int y = 0; y < height; y++)
+      for(int x = 0; x < width; x++)
+      {
+        int tx1, tx2, ty1, ty2;
+        const int wx = weight(x, width, tilesX, tx1, tx2);
+        const int wy = weight(y, height, tilesY, ty1, ty2);
+        for(int c = 0; c < channels; c++)
+        {
+          const int v = mat.data()[(y*width + x)*channels + c];
+          auto lookup = [&](int tx, int ty) { return tables[(ty*tilesX + tx)*channels + c][v]; };
+          const int sum = lookup(tx1, ty1)*(256 - wx)*(256 - wy) + lookup(tx2, ty1)*wx*(256 - wy)
+              + lookup(tx1, ty2)*(256 - wx)*wy + lookup(tx2, ty2)*wx*wy;
+          out.data()[(y*width + x)*channels + c] = static_cast<uint8_t>((sum + 32768) >> 16);
+        }
+      }
+    return out;
+  }
+
+  // Minimum (or maximum) of every clipped window, the reference for erode and dilate
+  Mat referenceMorphology(const Mat& mat, int radiusX, int radiusY, bool dilate)
+  {
+    const int width = mat.width();
+    const int height = mat.height();
+    const int channels = mat.channels();
+    Mat out(width, height, channels);
+    for(int y = 0; y < height; y++)
+      for(int x = 0; x < width; x++)
+        for(int c = 0; c < channels; c++)
+        {
+          int value = dilate ? 0 : 255;
+          for(int wy = std::max(y - radiusY, 0); wy < std::min(y + radiusY + 1, height); wy++)
+            for(int wx = std::max(x - radiusX, 0); wx < std::min(x + radiusX + 1, width); wx++)
+            {
+              const int v = mat.data()[(wy*width + wx)*channels + c];
+              value = dilate ? std::max(value, v) : std::min(value, v);
+            }
+          out.data()[(y*width + x)*channels + c] = static_cast<uint8_t>(value);
+        }
+    return out;
+  }
+
   protected:
     Mat mat_;
   };
@@ -90,6 +449,51 @@ TEST_F(TestImageProcessing, willNotCropMatWithInvalidIndices)
   EXPECT_EQ(mat_, original);
 }
 
+TEST_F(TestImageProcessing, willCropViewWithoutCopying)
+{
+  Mat original = RandomMat(127, 88, 3);
+  const int x1 = 37;
+  const int x2 = 92;
+  const int y1 = 12;
+  const int y2 = 71;
+  MatView view = cropView(original, x1, y1, x2, y2);
+
+  ASSERT_EQ(view.width(), x2 - x1);
+  ASSERT_EQ(view.height(), y2 - y1);
+  ASSERT_EQ(view.channels(), 3);
+  // The view points into the original pixels
+  EXPECT_EQ(view.stride(), original.stride());
+  EXPECT_EQ(view.data(), original.data() + y1*original.stride() + x1*3);
+
+  mat_ = original;
+  cropMat(mat_, x1, y1, x2, y2);
+  EXPECT_EQ(Mat(view), mat_);
+}
+
+TEST_F(TestImageProcessing, willNotCropViewWithInvalidIndices)
+{
+  Mat original = RandomMat(96, 121, 1);
+  MatView view = cropView(original, 37, 12, 35, 2);
+
+  EXPECT_EQ(view.data(), original.data());
+  EXPECT_EQ(view.width(), original.width());
+  EXPECT_EQ(view.height(), original.height());
+}
+
+TEST_F(TestImageProcessing, willProcessCroppedViews)
+{
+  Mat original = RandomMat(64, 48, 3);
+  MatView view = cropView(original, 5, 7, 50, 40);
+  Mat cropped(view);
+
+  EXPECT_EQ(rgbToGray(view), rgbToGray(cropped));
+  EXPECT_EQ(sobelEdgeDetector(view), sobelEdgeDetector(cropped));
+
+  Mat gray = rgbToGray(original);
+  MatView grayView = cropView(gray, 3, 3, 30, 30);
+  EXPECT_EQ(grayToRgb(grayView), grayToRgb(Mat(grayView)));
+}
+
 TEST_F(TestImageProcessing, willConvertRgbToGray)
 {
   Mat original = RandomMat(177, 45, 3);
@@ -111,6 +515,49 @@ TEST_F(TestImageProcessing, willConvertRgbToGray)
   }
 }
 
+TEST_F(TestImageProcessing, rgbToGraySimdKernelsAreBitExactWithScalar)
+{
+  // Odd width so the scalar tail after the vector loop is exercised too
+  Mat original = RandomMat(211, 9, 3);
+  const Mat planar = convertLayout(original, LayoutPlanar);
+  const SimdLevel bestLevel = detectSimdLevel();
+  const GrayConversion conversions[] = {GrayAverage, GrayBt601, GrayBt709};
+
+  for(GrayConversion conversion : conversions)
+  {
+    setSimdLevel(SimdScalar);
+    Mat expected = rgbToGray(original, conversion);
+    EXPECT_EQ(rgbToGray(planar, conversion), expected);
+    for(int level = SimdSse2; level <= bestLevel; level++)
+    {
+      setSimdLevel(static_cast<SimdLevel>(level));
+      EXPECT_EQ(rgbToGray(original, conversion), expected) << "level " << level;
+      EXPECT_EQ(rgbToGray(planar, conversion), expected) << "planar level " << level;
+    }
+  }
+  setSimdLevel(bestLevel);
+}
+
+TEST_F(TestImageProcessing, willConvertRgbToGrayWithLumaWeights)
+{
+  Mat original(3, 1, 3);
+  uint8_t* ptr = original.data();
+  // Pure red, green and blue pixels
+  ptr[0] = 255;
+  ptr[4] = 255;
+  ptr[8] = 255;
+
+  mat_ = rgbToGray(original, GrayBt601);
+  EXPECT_EQ(mat_.data()[0], 76);
+  EXPECT_EQ(mat_.data()[1], 150);
+  EXPECT_EQ(mat_.data()[2], 29);
+
+  mat_ = rgbToGray(original, GrayBt709);
+  EXPECT_EQ(mat_.data()[0], 54);
+  EXPECT_EQ(mat_.data()[1], 182);
+  EXPECT_EQ(mat_.data()[2], 18);
+}
+
 TEST_F(TestImageProcessing, rgbToGrayWillReturnGrayMatWhenCalledOn1ChannelMat)
 {
   Mat original = RandomMat(177, 45, 1);
@@ -259,3 +706,941 @@ TEST_F(TestImageProcessing, sobelEdgeDetectorWillDetectGradientInX)
 
   EXPECT_EQ(mat_, expectedX);
 }
+
+TEST_F(TestImageProcessing, sobelSimdKernelsMatchDirectConvolution)
+{
+  // Odd width so the scalar tail after the vector loops is exercised too
+  Mat original = RandomMat(203, 23, 1);
+  const SimdLevel bestLevel = detectSimdLevel();
+  const SobelMagnitude magnitudes[] = {SobelL1, SobelL2};
+
+  for(SobelMagnitude magnitude : magnitudes)
+  {
+    Mat expected = referenceSobel(original, magnitude);
+    for(int level = SimdScalar; level <= bestLevel; level++)
+    {
+      setSimdLevel(static_cast<SimdLevel>(level));
+      EXPECT_EQ(sobelEdgeDetector(original, magnitude), expected) << "level " << level;
+    }
+  }
+  setSimdLevel(bestLevel);
+}
+
+TEST_F(TestImageProcessing, sobelEdgeDetectorOnRgbMatWillMatchSobelOfGrayMat)
+{
+  Mat original = RandomMat(77, 31, 3);
+  EXPECT_EQ(sobelEdgeDetector(original), sobelEdgeDetector(rgbToGray(original)));
+}
+
+TEST_F(TestImageProcessing, sobelEdgeDetectorWillHandleTinyMats)
+{
+  Mat original = RandomMat(2, 2, 1);
+  mat_ = sobelEdgeDetector(original);
+
+  EXPECT_EQ(mat_, Mat(2, 2, 1));
+}
+
+TEST_F(TestImageProcessing, outputOverloadsWillReuseTheOutputBuffer)
+{
+  Mat original = RandomMat(97, 61, 3);
+  Mat outputMat;
+
+  rgbToGray(original, outputMat, GrayBt601);
+  EXPECT_EQ(outputMat, rgbToGray(original, GrayBt601));
+  const uint8_t* buffer = outputMat.data();
+
+  // Same sized results land in the same buffer
+  sobelEdgeDetector(original, outputMat);
+  EXPECT_EQ(outputMat, sobelEdgeDetector(original));
+  EXPECT_EQ(outputMat.data(), buffer);
+
+  cropMat(original, outputMat, 10, 10, 50, 40);
+  Mat expected = original;
+  cropMat(expected, 10, 10, 50, 40);
+  EXPECT_EQ(outputMat, expected);
+
+  grayToRgb(rgbToGray(original), outputMat);
+  EXPECT_EQ(outputMat, grayToRgb(rgbToGray(original)));
+}
+
+TEST_F(TestImageProcessing, outputOverloadsWillAcceptTheInputAsOutput)
+{
+  Mat original = RandomMat(97, 61, 3);
+  const Mat pixels(static_cast<MatView>(original));
+  Mat expected = sobelEdgeDetector(original);
+
+  Mat mat = original;
+  sobelEdgeDetector(mat, mat);
+  EXPECT_EQ(mat, expected);
+
+  mat = original;
+  rgbToGray(mat, mat);
+  EXPECT_EQ(mat, rgbToGray(original));
+  grayToRgb(mat, mat);
+  EXPECT_EQ(mat, grayToRgb(rgbToGray(original)));
+
+  // The Mat that shared its buffer with the input is not touched
+  EXPECT_EQ(original, pixels);
+}
+
+TEST_F(TestImageProcessing, resizeMatWillAverageAreas)
+{
+  Mat original = RandomMat(10, 6, 3);
+
+  // Pairs of pixels, rounded half up
+  mat_ = resizeMat(original, 5, 6, ResizeArea);
+  ASSERT_EQ(mat_.width(), 5);
+  ASSERT_EQ(mat_.height(), 6);
+  ASSERT_EQ(mat_.channels(), 3);
+  for(int y = 0; y < 6; y++)
+  {
+    for(int x = 0; x < 15; x++)
+    {
+      const int xIn = (x / 3) * 6 + x % 3;
+      EXPECT_EQ(mat_.row(y)[x], (original.row(y)[xIn] + original.row(y)[xIn + 3] + 1) / 2);
+    }
+  }
+
+  // 2x2 blocks, the horizontal pass is rounded to 8 bits before the vertical one
+  mat_ = resizeMat(original, 5, 3, ResizeArea);
+  ASSERT_EQ(mat_.width(), 5);
+  ASSERT_EQ(mat_.height(), 3);
+  for(int y = 0; y < 3; y++)
+  {
+    for(int x = 0; x < 15; x++)
+    {
+      const int xIn = (x / 3) * 6 + x % 3;
+      const int sum = original.row(2*y)[xIn] + original.row(2*y)[xIn + 3]
+          + original.row(2*y + 1)[xIn] + original.row(2*y + 1)[xIn + 3];
+      EXPECT_LE(std::abs(mat_.row(y)[x] - (sum + 2) / 4), 1);
+    }
+  }
+}
+
+TEST_F(TestImageProcessing, resizeMatWillAverageLargeAreas)
+{
+  // Thousands of input pixels per output pixel, where every weight is a fraction of one fixed point unit
+  const int sizes[][2] = {{4000, 16}, {16000, 16}, {20000, 1}, {40000, 1}};
+  for(const auto& size : sizes)
+  {
+    const int inSize = size[0];
+    const int outSize = size[1];
+    SCOPED_TRACE(testing::Message() << inSize << " to " << outSize);
+    Mat row(inSize, 1, 1);
+    for(int x = 0; x < inSize; x++)
+      row.data()[x] = static_cast<uint8_t>(static_cast<int64_t>(x) * 256 / inSize);
+    Mat column(1, inSize, 1);
+    std::copy(row.data(), row.data() + inSize, column.data());
+
+    const Mat shrunkRow = resizeMat(row, outSize, 1, ResizeArea);
+    const Mat shrunkColumn = resizeMat(column, 1, outSize, ResizeArea);
+    for(int i = 0; i < outSize; i++)
+    {
+      const int begin = i * (inSize / outSize);
+      double sum = 0;
+      for(int x = begin; x < begin + inSize / outSize; x++)
+        sum += row.data()[x];
+      const double mean = sum / (inSize / outSize);
+      EXPECT_LE(std::abs(shrunkRow.data()[i] - mean), 1.0) << "pixel " << i;
+      EXPECT_LE(std::abs(shrunkColumn.data()[i] - mean), 1.0) << "pixel " << i;
+    }
+  }
+}
+
+TEST_F(TestImageProcessing, resizeMatWillInterpolateBilinearly)
+{
+  Mat original(2, 1, 1);
+  original.data()[1] = 255;
+  mat_ = resizeMat(original, 4, 1, ResizeBilinear);
+
+  ASSERT_EQ(mat_.width(), 4);
+  const uint8_t expected[] = {0, 64, 191, 255};
+  EXPECT_TRUE(std::equal(expected, expected + 4, mat_.data()));
+}
+
+TEST_F(TestImageProcessing, resizeMatWillKeepFlatImagesFlat)
+{
+  // The fixed point weights of every output pixel add up to exactly one
+  Mat flat(123, 77, 3);
+  std::fill(flat.data(), flat.data() + 123*77*3, 137);
+  const ResizeMethod methods[] = {ResizeArea, ResizeBilinear, ResizeLanczos3};
+  const int sizes[][2] = {{41, 26}, {17, 99}, {250, 8}, {1, 1}};
+
+  for(ResizeMethod method : methods)
+  {
+    for(const auto& size : sizes)
+    {
+      mat_ = resizeMat(flat, size[0], size[1], method);
+      ASSERT_EQ(mat_.width(), size[0]);
+      ASSERT_EQ(mat_.height(), size[1]);
+      EXPECT_TRUE(std::all_of(mat_.data(), mat_.data() + size[0]*size[1]*3, [](uint8_t pixel) { return pixel == 137; }))
+          << "method " << method << " size " << size[0] << "x" << size[1];
+    }
+  }
+}
+
+TEST_F(TestImageProcessing, resizeSimdKernelsAreBitExactWithScalar)
+{
+  const SimdLevel bestLevel = detectSimdLevel();
+  const ResizeMethod methods[] = {ResizeArea, ResizeBilinear, ResizeLanczos3};
+  const int sizes[][2] = {{97, 19}, {300, 50}, {211, 5}, {7, 37}};
+
+  for(int channels = 1; channels <= 3; channels += 2)
+  {
+    // Odd widths so the scalar tails after the vector loops are exercised too
+    Mat original = RandomMat(211, 37, channels);
+    for(ResizeMethod method : methods)
+    {
+      for(const auto& size : sizes)
+      {
+        setSimdLevel(SimdScalar);
+        Mat expected = resizeMat(original, size[0], size[1], method);
+        for(int level = SimdSse2; level <= bestLevel; level++)
+        {
+          setSimdLevel(static_cast<SimdLevel>(level));
+          EXPECT_EQ(resizeMat(original, size[0], size[1], method), expected)
+              << "level " << level << " method " << method << " channels " << channels;
+        }
+      }
+    }
+  }
+  setSimdLevel(bestLevel);
+}
+
+TEST_F(TestImageProcessing, resizeMatWillReturnEmptyMatWhenCalledWithInvalidInput)
+{
+  Mat original = RandomMat(20, 10, 3);
+  EXPECT_EQ(resizeMat(original, 0, 5), Mat());
+  EXPECT_EQ(resizeMat(Mat(), 5, 5), Mat());
+  EXPECT_EQ(resizeMat(original, 20, 10), original);
+
+  // The output may be the input
+  Mat mat = original;
+  resizeMat(mat, mat, 10, 5);
+  EXPECT_EQ(mat, resizeMat(original, 10, 5));
+}
+
+TEST_F(TestImageProcessing, filter2DWillMatchDirectConvolution)
+{
+  FilterKernel offsetSobel = sobelXKernel();
+  offsetSobel.offset = 128;
+  FilterKernel darkerBox = boxKernel(3);
+  darkerBox.offset = -10;
+  const std::vector<FilterKernel> kernels = {
+    // Compile-time Taps kernels
+    sobelXKernel(), sobelYKernel(), scharrXKernel(), scharrYKernel(), laplacianKernel(),
+    boxKernel(3), boxKernel(5), binomialKernel(3), binomialKernel(5), offsetSobel, darkerBox,
+    // Generic separable kernels
+    boxKernel(7), binomialKernel(7), FilterKernel(5, 1, {1, -3, 0, 3, -1}, 3), FilterKernel(1, 3, {2, 5, 2}, 9, 7),
+    FilterKernel(3, 3, {2, 0, -2, 4, 0, -4, 2, 0, -2}, 5, 100),
+    // Generic non-separable kernels
+    FilterKernel(3, 3, {0, 2, 0, 2, -8, 2, 0, 2, 0}, 1, 128), FilterKernel(5, 3, {3, -1, 7, 0, 2, -5, 11, 4, -2, 1, 0, 9, -6, 3, 8}, 17)
+  };
+  const BorderMode borders[] = {BorderConstant, BorderReplicate, BorderReflect};
+  const SimdLevel bestLevel = detectSimdLevel();
+
+  for(int channels = 1; channels <= 3; channels += 2)
+  {
+    // Odd width so the scalar tails after the vector loops are exercised too
+    Mat original = RandomMat(67, 19, channels);
+    for(size_t k = 0; k < kernels.size(); k++)
+    {
+      for(BorderMode border : borders)
+      {
+        Mat expected = referenceFilter(original, kernels[k], border);
+        for(int level = SimdScalar; level <= bestLevel; level++)
+        {
+          setSimdLevel(static_cast<SimdLevel>(level));
+          EXPECT_EQ(filter2D(original, kernels[k], border), expected)
+              << "level " << level << " kernel " << k << " border " << border << " channels " << channels;
+        }
+      }
+    }
+  }
+  setSimdLevel(bestLevel);
+}
+
+TEST_F(TestImageProcessing, filter2DWillHandleMatsSmallerThanTheKernel)
+{
+  const BorderMode borders[] = {BorderConstant, BorderReplicate, BorderReflect};
+  for(BorderMode border : borders)
+  {
+    Mat original = RandomMat(2, 1, 3);
+    EXPECT_EQ(filter2D(original, binomialKernel(5), border), referenceFilter(original, binomialKernel(5), border));
+    original = RandomMat(1, 3, 1);
+    EXPECT_EQ(filter2D(original, laplacianKernel(), border), referenceFilter(original, laplacianKernel(), border));
+  }
+}
+
+TEST_F(TestImageProcessing, filter2DWillReturnEmptyMatWhenCalledWithInvalidKernel)
+{
+  Mat original = RandomMat(20, 10, 1);
+  EXPECT_EQ(filter2D(original, FilterKernel()), Mat());
+  EXPECT_EQ(filter2D(original, boxKernel(4)), Mat());
+  EXPECT_EQ(filter2D(original, FilterKernel(3, 1, {1, 2})), Mat());
+  EXPECT_EQ(filter2D(original, FilterKernel(1, 1, {1}, 0)), Mat());
+  // Sums this large would not be exact
+  EXPECT_EQ(filter2D(original, FilterKernel(1, 1, {70000})), Mat());
+
+  // The output may be the input
+  Mat mat = original;
+  filter2D(mat, mat, boxKernel(3));
+  EXPECT_EQ(mat, filter2D(original, boxKernel(3)));
+}
+
+TEST_F(TestImageProcessing, boxFilterWillAverageTheClippedWindows)
+{
+  const int radii[] = {0, 1, 4, 9, 20, 100};
+  for(int channels = 1; channels <= 3; channels += 2)
+  {
+    Mat original = RandomMat(41, 23, channels);
+    for(int radius : radii)
+      EXPECT_EQ(boxFilter(original, radius), referenceBoxFilter(original, radius)) << "radius " << radius << " channels " << channels;
+  }
+
+  // A flat image stays flat
+  Mat flat(30, 20, 3);
+  std::fill(flat.vectorPtr()->begin(), flat.vectorPtr()->end(), 77);
+  EXPECT_EQ(boxFilter(flat, 6), flat);
+}
+
+TEST_F(TestImageProcessing, boxFilterWillMatchForAnyNumberOfThreads)
+{
+  // Large enough to be split into bands, which each need the rows of their halo
+  Mat original = NoiseMat(401, 613, 3);
+  Mat gray = rgbToGray(original);
+  setNumThreads(1);
+  Mat expected = boxFilter(original, 15);
+  Mat expectedBinary = adaptiveThreshold(gray, 15, 5);
+  setNumThreads(4);
+  EXPECT_EQ(boxFilter(original, 15), expected);
+  EXPECT_EQ(boxFilter(original, 2), referenceBoxFilter(original, 2));
+  EXPECT_EQ(adaptiveThreshold(gray, 15, 5), expectedBinary);
+  setNumThreads(0);
+}
+
+TEST_F(TestImageProcessing, boxFilterWillSumLargeWindowsIn64Bits)
+{
+  // Windows of more than 2^32 / 255 pixels do not fit 32 bit sums
+  Mat original = RandomMat(2100, 3, 1);
+  EXPECT_EQ(boxFilter(original, 2100), referenceBoxFilter(original, 2100));
+  EXPECT_EQ(adaptiveThreshold(original, 2100, 0), referenceThreshold(original, 2100, 0));
+}
+
+TEST_F(TestImageProcessing, adaptiveThresholdWillCompareWithTheLocalMean)
+{
+  const int radii[] = {0, 2, 7, 50};
+  const int offsets[] = {-300, -20, 0, 10, 300};
+  Mat original = RandomMat(53, 29, 1);
+  for(int radius : radii)
+    for(int offset : offsets)
+      EXPECT_EQ(adaptiveThreshold(original, radius, offset), referenceThreshold(original, radius, offset))
+          << "radius " << radius << " offset " << offset;
+
+  // Dark text on an uneven background: the ink is 0 and the paper is 255 on both sides
+  Mat page(20, 60, 1);
+  for(int y = 0; y < page.height(); y++)
+    for(int x = 0; x < page.width(); x++)
+      page.data()[y*page.width() + x] = static_cast<uint8_t>((x == 10 ? 40 : 100) + 2*y);
+  Mat binary = adaptiveThreshold(page, 3, 5);
+  EXPECT_EQ(binary.data()[30*page.width() + 10], 0);
+  EXPECT_EQ(binary.data()[30*page.width() + 5], 255);
+  EXPECT_EQ(binary.data()[50*page.width() + 15], 255);
+
+  // RGB input is converted to gray first
+  Mat rgb = RandomMat(31, 17, 3);
+  EXPECT_EQ(adaptiveThreshold(rgb, 4), adaptiveThreshold(rgbToGray(rgb), 4));
+}
+
+TEST_F(TestImageProcessing, boxFilterAndAdaptiveThresholdWillReturnEmptyMatWhenCalledWithInvalidInput)
+{
+  Mat original = RandomMat(20, 10, 1);
+  EXPECT_EQ(boxFilter(original, -1), Mat());
+  EXPECT_EQ(adaptiveThreshold(original, -1), Mat());
+  EXPECT_EQ(adaptiveThreshold(RandomMat(20, 10, 4), 3), Mat());
+  EXPECT_EQ(boxFilter(Mat(), 3), Mat());
+
+  // The output may be the input
+  Mat mat = original;
+  boxFilter(mat, mat, 2);
+  EXPECT_EQ(mat, boxFilter(original, 2));
+  mat = original;
+  adaptiveThreshold(mat, mat, 2);
+  EXPECT_EQ(mat, adaptiveThreshold(original, 2));
+}
+
+TEST_F(TestImageProcessing, erodeAndDilateWillMatchAReferenceMorphology)
+{
+  // Radii that are and are not powers of 2 apart, and some larger than the image
+  const int radii[][2] = {{0, 0}, {1, 1}, {2, 0}, {0, 3}, {4, 4}, {5, 2}, {7, 9}, {15, 15}, {40, 3}, {3, 90}};
+  for(int channels = 1; channels <= 4; channels++)
+  {
+    Mat original = RandomMat(97, 43, channels);
+    for(const auto& radius : radii)
+    {
+      SCOPED_TRACE(testing::Message() << "radius " << radius[0] << "x" << radius[1] << " channels " << channels);
+      EXPECT_EQ(erode(original, radius[0], radius[1]), referenceMorphology(original, radius[0], radius[1], false));
+      EXPECT_EQ(dilate(original, radius[0], radius[1]), referenceMorphology(original, radius[0], radius[1], true));
+    }
+  }
+
+  // A view with gaps between its rows
+  Mat original = RandomMat(60, 50, 3);
+  const MatView region = cropView(original, 3, 5, 51, 40);
+  EXPECT_EQ(erode(region, 6, 2), referenceMorphology(Mat(region), 6, 2, false));
+}
+
+TEST_F(TestImageProcessing, morphologySimdKernelsAreBitExactWithScalar)
+{
+  // Odd row sizes so the scalar tails after the vector loops are exercised too
+  Mat original = RandomMat(211, 37, 3);
+  Mat dilated = referenceMorphology(original, 2, 2, true);
+  Mat eroded = referenceMorphology(original, 2, 2, false);
+  Mat expectedGradient(original.width(), original.height(), original.channels());
+  for(size_t i = 0; i < original.vectorPtr()->size(); i++)
+    (*expectedGradient.vectorPtr())[i] = static_cast<uint8_t>((*dilated.vectorPtr())[i] - (*eroded.vectorPtr())[i]);
+
+  const SimdLevel bestLevel = detectSimdLevel();
+  for(int level = SimdScalar; level <= bestLevel; level++)
+  {
+    setSimdLevel(static_cast<SimdLevel>(level));
+    SCOPED_TRACE(testing::Message() << "level " << level);
+    EXPECT_EQ(erode(original, 1, 2), referenceMorphology(original, 1, 2, false));
+    EXPECT_EQ(dilate(original, 9, 6), referenceMorphology(original, 9, 6, true));
+    EXPECT_EQ(morphologyGradient(original, 2, 2), expectedGradient);
+  }
+  setSimdLevel(bestLevel);
+}
+
+TEST_F(TestImageProcessing, morphologyWillMatchForAnyNumberOfThreads)
+{
+  // Large enough to be split into bands of rows and many strips of columns
+  Mat original = NoiseMat(613, 401, 3);
+  setNumThreads(1);
+  const Mat expectedClose = morphologyClose(original, 15, 15);
+  const Mat expectedErode = erode(original, 1, 1);
+  for(int threads : {4, 7})
+  {
+    setNumThreads(threads);
+    EXPECT_EQ(morphologyClose(original, 15, 15), expectedClose) << "threads " << threads;
+    EXPECT_EQ(erode(original, 1, 1), expectedErode) << "threads " << threads;
+  }
+  setNumThreads(0);
+  EXPECT_EQ(expectedErode, referenceMorphology(original, 1, 1, false));
+}
+
+TEST_F(TestImageProcessing, openCloseAndGradientWillCombineErodeAndDilate)
+{
+  Mat original = RandomMat(71, 39, 3);
+  for(int radius : {1, 6})
+  {
+    SCOPED_TRACE(testing::Message() << "radius " << radius);
+    Mat opened = morphologyOpen(original, radius, radius + 1);
+    Mat closed = morphologyClose(original, radius, radius + 1);
+    EXPECT_EQ(opened, dilate(erode(original, radius, radius + 1), radius, radius + 1));
+    EXPECT_EQ(closed, erode(dilate(original, radius, radius + 1), radius, radius + 1));
+
+    // Opening only darkens, closing only brightens, and both are idempotent
+    for(size_t i = 0; i < original.vectorPtr()->size(); i++)
+    {
+      ASSERT_LE((*opened.vectorPtr())[i], (*original.vectorPtr())[i]);
+      ASSERT_GE((*closed.vectorPtr())[i], (*original.vectorPtr())[i]);
+    }
+    EXPECT_EQ(morphologyOpen(opened, radius, radius + 1), opened);
+    EXPECT_EQ(morphologyClose(closed, radius, radius + 1), closed);
+
+    Mat gradient = morphologyGradient(original, radius, radius + 1);
+    Mat dilated = dilate(original, radius, radius + 1);
+    Mat eroded = erode(original, radius, radius + 1);
+    for(size_t i = 0; i < original.vectorPtr()->size(); i++)
+      ASSERT_EQ((*gradient.vectorPtr())[i], (*dilated.vectorPtr())[i] - (*eroded.vectorPtr())[i]);
+  }
+
+  // Closing fills a dark line narrower than the rectangle, opening removes a bright one
+  Mat page(40, 30, 1);
+  std::fill(page.vectorPtr()->begin(), page.vectorPtr()->end(), 200);
+  for(int y = 0; y < page.height(); y++)
+    page.data()[y*page.width() + 20] = 10;
+  EXPECT_EQ(morphologyClose(page, 1, 0).data()[7*page.width() + 20], 200);
+  EXPECT_EQ(morphologyOpen(page, 1, 0).data()[7*page.width() + 20], 10);
+  EXPECT_EQ(morphologyGradient(page, 1, 0).data()[7*page.width() + 21], 190);
+  EXPECT_EQ(morphologyGradient(page, 1, 0).data()[7*page.width() + 5], 0);
+}
+
+TEST_F(TestImageProcessing, morphologyWillReturnEmptyMatWhenCalledWithInvalidInput)
+{
+  Mat original = RandomMat(20, 10, 3);
+  EXPECT_EQ(erode(original, -1, 2), Mat());
+  EXPECT_EQ(dilate(original, 2, -1), Mat());
+  EXPECT_EQ(morphologyClose(Mat(), 3, 3), Mat());
+  EXPECT_EQ(morphologyGradient(convertDepth(original, DepthU16), 1, 1), Mat());
+
+  // The output may be the input
+  Mat mat = original;
+  morphologyOpen(mat, mat, 2, 3);
+  EXPECT_EQ(mat, morphologyOpen(original, 2, 3));
+  mat = original;
+  morphologyGradient(mat, mat, 5, 1);
+  EXPECT_EQ(mat, morphologyGradient(original, 5, 1));
+}
+
+TEST_F(TestImageProcessing, equalizeHistogramWillStretchTheCumulativeHistogram)
+{
+  for(int channels = 1; channels <= 3; channels += 2)
+  {
+    Mat original = RandomMat(67, 23, channels);
+    EXPECT_EQ(equalizeHistogram(original), referenceEqualize(original)) << "channels " << channels;
+  }
+
+  // A dark low contrast image spreads over the whole range
+  Mat dark(40, 30, 1);
+  for(int i = 0; i < 40 * 30; i++)
+    dark.data()[i] = static_cast<uint8_t>(20 + i % 11);
+  const Mat equalized = equalizeHistogram(dark);
+  EXPECT_EQ(*std::min_element(equalized.data(), equalized.data() + 40 * 30), 0);
+  EXPECT_EQ(*std::max_element(equalized.data(), equalized.data() + 40 * 30), 255);
+
+  // An image of one value is left as it is
+  Mat flat(16, 8, 1);
+  std::fill(flat.vectorPtr()->begin(), flat.vectorPtr()->end(), 77);
+  EXPECT_EQ(equalizeHistogram(flat), flat);
+}
+
+TEST_F(TestImageProcessing, equalizeHistogramClaheWillMatchAReferenceClahe)
+{
+  for(int channels = 1; channels <= 3; channels += 2)
+  {
+    Mat original = gaussianBlur(RandomMat(97, 61, channels), 2.0);
+    EXPECT_EQ(equalizeHistogramClahe(original), referenceClahe(original, 2.0, 8, 8)) << "channels " << channels;
+    EXPECT_EQ(equalizeHistogramClahe(original, 0, 3, 5), referenceClahe(original, 0, 3, 5)) << "channels " << channels;
+    EXPECT_EQ(equalizeHistogramClahe(original, 40.0, 1, 1), referenceClahe(original, 40.0, 1, 1)) << "channels " << channels;
+  }
+
+  // More tiles than pixels leave one pixel per tile
+  Mat small = RandomMat(5, 3, 1);
+  EXPECT_EQ(equalizeHistogramClahe(small, 2.0, 8, 8), referenceClahe(small, 2.0, 8, 8));
+}
+
+TEST_F(TestImageProcessing, equalizeHistogramClaheWillMatchForAnyNumberOfThreads)
+{
+  Mat noise = NoiseMat(613, 401, 1);
+  Mat original = gaussianBlur(noise, 3.0);
+  const Mat expected = referenceClahe(original, 3.0, 8, 6);
+  for(int threads : {1, 4, 7})
+  {
+    setNumThreads(threads);
+    EXPECT_EQ(equalizeHistogramClahe(original, 3.0, 8, 6), expected) << "threads " << threads;
+    EXPECT_EQ(equalizeHistogram(original), referenceEqualize(original)) << "threads " << threads;
+  }
+  setNumThreads(0);
+}
+
+TEST_F(TestImageProcessing, equalizeHistogramWillReturnEmptyMatWhenCalledWithInvalidInput)
+{
+  Mat original = RandomMat(20, 10, 1);
+  EXPECT_EQ(equalizeHistogram(Mat()), Mat());
+  EXPECT_EQ(equalizeHistogramClahe(original, -1.0), Mat());
+  EXPECT_EQ(equalizeHistogramClahe(original, std::nan("")), Mat());
+  EXPECT_EQ(equalizeHistogramClahe(original, 2.0, 0, 8), Mat());
+  EXPECT_EQ(equalizeHistogramClahe(original, 2.0, 8, -1), Mat());
+
+  // In place
+  Mat mat = original;
+  equalizeHistogram(mat, mat);
+  EXPECT_EQ(mat, equalizeHistogram(original));
+  mat = original;
+  equalizeHistogramClahe(mat, mat);
+  EXPECT_EQ(mat, equalizeHistogramClahe(original));
+}
+
+TEST_F(TestImageProcessing, gaussianBlurWillMatchAReferenceGaussian)
+{
+  const BorderMode borders[] = {BorderConstant, BorderReplicate, BorderReflect};
+  for(int channels = 1; channels <= 3; channels += 2)
+  {
+    Mat original = RandomMat(61, 27, channels);
+    for(BorderMode border : borders)
+    {
+      // Fixed point path, only the last bit may be rounded differently
+      for(double sigma : {0.3, 0.8, 1.0, 1.5, 2.5, 4.0})
+      {
+        Mat blurred = gaussianBlur(original, sigma, border);
+        ASSERT_EQ(blurred.width(), original.width());
+        ASSERT_EQ(blurred.channels(), channels);
+        EXPECT_LE(maxDifference(blurred, referenceGaussian(original, sigma, border)), 1)
+            << "sigma " << sigma << " border " << border << " channels " << channels;
+      }
+      // The recursive filter approximates the Gaussian within a few percent of the peak
+      for(double sigma : {4.5, 7.0, 12.0, 40.0})
+        EXPECT_LE(maxDifference(gaussianBlur(original, sigma, border), referenceGaussian(original, sigma, border)), 3)
+            << "sigma " << sigma << " border " << border << " channels " << channels;
+    }
+  }
+}
+
+TEST_F(TestImageProcessing, gaussianBlurWillKeepFlatImagesFlat)
+{
+  Mat flat(45, 30, 3);
+  std::fill(flat.vectorPtr()->begin(), flat.vectorPtr()->end(), 201);
+  for(double sigma : {0.7, 3.0, 6.0, 25.0, 1000.0})
+    EXPECT_EQ(gaussianBlur(flat, sigma, BorderReplicate), flat) << "sigma " << sigma;
+
+  // A sigma of 0 is a copy
+  Mat original = RandomMat(20, 10, 3);
+  EXPECT_EQ(gaussianBlur(original, 0), original);
+}
+
+TEST_F(TestImageProcessing, gaussianBlurSimdKernelsAreBitExactWithScalar)
+{
+  const SimdLevel bestLevel = detectSimdLevel();
+  for(int channels = 1; channels <= 3; channels += 2)
+  {
+    // Odd width so the scalar tails after the vector loops are exercised too
+    Mat original = RandomMat(83, 21, channels);
+    for(double sigma : {0.6, 2.0, 3.7, 5.0, 16.0, 50.0})
+    {
+      setSimdLevel(SimdScalar);
+      Mat expected = gaussianBlur(original, sigma);
+      for(int level = SimdSse2; level <= bestLevel; level++)
+      {
+        setSimdLevel(static_cast<SimdLevel>(level));
+        EXPECT_EQ(gaussianBlur(original, sigma), expected) << "level " << level << " sigma " << sigma << " channels " << channels;
+      }
+    }
+  }
+  setSimdLevel(bestLevel);
+}
+
+TEST_F(TestImageProcessing, gaussianBlurWillMatchForAnyNumberOfThreads)
+{
+  // Large enough to be split into bands (and strips of columns for the recursive filter)
+  Mat original = NoiseMat(401, 613, 3);
+  for(double sigma : {1.2, 9.0, 40.0})
+  {
+    setNumThreads(1);
+    Mat expected = gaussianBlur(original, sigma);
+    setNumThreads(4);
+    EXPECT_EQ(gaussianBlur(original, sigma), expected) << "sigma " << sigma;
+  }
+  setNumThreads(0);
+}
+
+TEST_F(TestImageProcessing, gaussianBlurWillReturnEmptyMatWhenCalledWithInvalidInput)
+{
+  Mat original = RandomMat(20, 10, 1);
+  EXPECT_EQ(gaussianBlur(original, -1), Mat());
+  EXPECT_EQ(gaussianBlur(original, std::nan("")), Mat());
+  EXPECT_EQ(gaussianBlur(original, INFINITY), Mat());
+  EXPECT_EQ(gaussianBlur(Mat(), 2), Mat());
+
+  // Images smaller than the kernel
+  Mat tiny = RandomMat(2, 1, 3);
+  EXPECT_LE(maxDifference(gaussianBlur(tiny, 3.0), referenceGaussian(tiny, 3.0, BorderReflect)), 1);
+
+  // The output may be the input
+  Mat mat = original;
+  gaussianBlur(mat, mat, 1.5);
+  EXPECT_EQ(mat, gaussianBlur(original, 1.5));
+}
+
+TEST_F(TestImageProcessing, cannyEdgeDetectorWillMatchAReferenceCanny)
+{
+  for(int channels = 1; channels <= 3; channels += 2)
+  {
+    // Blurred noise has edges of every direction that branch and break up
+    Mat original = gaussianBlur(RandomMat(97, 61, channels), 1.5);
+    for(SobelMagnitude magnitude : {SobelL1, SobelL2})
+    {
+      EXPECT_EQ(cannyEdgeDetector(original, 20, 60, magnitude), referenceCanny(original, 20, 60, magnitude))
+          << "channels " << channels << " magnitude " << magnitude;
+      EXPECT_EQ(cannyEdgeDetector(original, 50, 50, magnitude), referenceCanny(original, 50, 50, magnitude))
+          << "channels " << channels << " magnitude " << magnitude;
+    }
+  }
+}
+
+TEST_F(TestImageProcessing, cannyEdgeDetectorWillFindAOnePixelWideStepEdge)
+{
+  // 50 left of column 20 and 200 from it on, both columns next to the step have a gradient of 600
+  Mat step(40, 30, 1);
+  for(int y = 0; y < 30; y++)
+    for(int x = 0; x < 40; x++)
+      step.data()[y*40 + x] = x < 20 ? 50 : 200;
+
+  Mat edges = cannyEdgeDetector(step, 100, 300);
+  for(int y = 0; y < 30; y++)
+    for(int x = 0; x < 40; x++)
+      EXPECT_EQ(edges.data()[y*40 + x], (x == 19 && y > 0 && y < 29) ? 255 : 0) << "x " << x << " y " << y;
+
+  // Below the low threshold nothing is an edge
+  Mat none = cannyEdgeDetector(step, 600, 700);
+  EXPECT_EQ(std::count(none.vectorPtr()->begin(), none.vectorPtr()->end(), 0), 40 * 30);
+}
+
+TEST_F(TestImageProcessing, cannyEdgeDetectorSimdKernelsAreBitExactWithScalar)
+{
+  const SimdLevel bestLevel = detectSimdLevel();
+  // Odd width so the scalar tails after the vector loops are exercised too
+  Mat original = gaussianBlur(RandomMat(83, 21, 3), 1.0);
+  for(SobelMagnitude magnitude : {SobelL1, SobelL2})
+  {
+    setSimdLevel(SimdScalar);
+    Mat expected = cannyEdgeDetector(original, 30, 90, magnitude);
+    for(int level = SimdSse2; level <= bestLevel; level++)
+    {
+      setSimdLevel(static_cast<SimdLevel>(level));
+      EXPECT_EQ(cannyEdgeDetector(original, 30, 90, magnitude), expected) << "level " << level;
+    }
+  }
+  setSimdLevel(bestLevel);
+}
+
+TEST_F(TestImageProcessing, cannyEdgeDetectorWillMatchForAnyNumberOfThreads)
+{
+  // Large enough to be split into bands, the edges of blurred noise cross the band borders
+  // back and forth and are only joined by the rounds over the seams
+  Mat noise = NoiseMat(401, 613, 1);
+  Mat original = gaussianBlur(noise, 2.0);
+  const Mat expected = referenceCanny(original, 4, 12, SobelL1);
+  for(int threads : {1, 4, 7})
+  {
+    setNumThreads(threads);
+    EXPECT_EQ(cannyEdgeDetector(original, 4, 12), expected) << "threads " << threads;
+  }
+  setNumThreads(0);
+}
+
+TEST_F(TestImageProcessing, cannyEdgeDetectorWillReturnEmptyMatWhenCalledWithInvalidInput)
+{
+  Mat original = RandomMat(20, 10, 3);
+  EXPECT_EQ(cannyEdgeDetector(original, -1, 10), Mat());
+  EXPECT_EQ(cannyEdgeDetector(original, 20, 10), Mat());
+  EXPECT_EQ(cannyEdgeDetector(Mat(20, 10, 2), 10, 20), Mat());
+
+  // Images without interior pixels have no edges
+  for(Mat tiny : {RandomMat(2, 9, 1), RandomMat(9, 2, 3), RandomMat(1, 1, 1)})
+  {
+    Mat edges = cannyEdgeDetector(tiny, 0, 0);
+    ASSERT_EQ(edges.width(), tiny.width());
+    ASSERT_EQ(edges.height(), tiny.height());
+    EXPECT_EQ(std::count(edges.vectorPtr()->begin(), edges.vectorPtr()->end(), 0), tiny.width() * tiny.height());
+  }
+
+  // The output may be the input
+  Mat mat = original;
+  cannyEdgeDetector(mat, mat, 10, 30);
+  EXPECT_EQ(mat, cannyEdgeDetector(original, 10, 30));
+}
+
+TEST_F(TestImageProcessing, convertLayoutWillSplitAndMergeThePlanes)
+{
+  const SimdLevel bestLevel = detectSimdLevel();
+  for(int level = SimdScalar; level <= bestLevel; level++)
+  {
+    setSimdLevel(static_cast<SimdLevel>(level));
+    for(int channels = 1; channels <= 5; channels++)
+    {
+      // Wider than the 32 pixels of the AVX2 kernels and not a multiple of 16
+      Mat original = RandomMat(83, 7, channels);
+      SCOPED_TRACE(testing::Message() << "level " << level << " channels " << channels);
+      Mat planar = convertLayout(original, LayoutPlanar);
+      ASSERT_EQ(planar.isPlanar(), channels > 1);
+      for(int c = 0; c < channels; c++)
+        for(int y = 0; y < original.height(); y++)
+          for(int x = 0; x < original.width(); x++)
+            ASSERT_EQ(planar.plane(c)[y*original.width() + x], original.row(y)[x*channels + c]);
+      EXPECT_EQ(convertLayout(planar, LayoutInterleaved), original);
+    }
+  }
+  setSimdLevel(bestLevel);
+
+  // Cropped views of either layout
+  Mat original = RandomMat(90, 40, 3);
+  Mat planar = convertLayout(original, LayoutPlanar);
+  const MatView planarRegion = cropView(planar, 5, 3, 80, 33);
+  EXPECT_TRUE(planarRegion.isPlanar());
+  Mat expected;
+  cropMat(original, expected, 5, 3, 80, 33);
+  EXPECT_EQ(convertLayout(planarRegion, LayoutInterleaved), expected);
+  EXPECT_EQ(convertLayout(cropView(original, 5, 3, 80, 33), LayoutPlanar), Mat(planarRegion));
+  cropMat(planar, 5, 3, 80, 33);
+  EXPECT_EQ(planar, Mat(planarRegion));
+}
+
+TEST_F(TestImageProcessing, willProcessPlanarImagesLikeInterleavedOnes)
+{
+  Mat original = RandomMat(97, 41, 3);
+  const Mat planar = convertLayout(original, LayoutPlanar);
+  auto expectPlanarMatch = [&](const Mat& result, const Mat& expected)
+  {
+    EXPECT_TRUE(result.isPlanar());
+    EXPECT_EQ(convertLayout(result, LayoutInterleaved), expected);
+  };
+
+  // Gray results are the same whatever the layout of the input
+  EXPECT_EQ(rgbToGray(planar, GrayBt709), rgbToGray(original, GrayBt709));
+  EXPECT_EQ(sobelEdgeDetector(planar, SobelL2), sobelEdgeDetector(original, SobelL2));
+  EXPECT_EQ(cannyEdgeDetector(planar, 30, 90), cannyEdgeDetector(original, 30, 90));
+  EXPECT_EQ(adaptiveThreshold(planar, 5), adaptiveThreshold(original, 5));
+  const Mat gray = rgbToGray(original);
+  EXPECT_EQ(grayToRgb(gray, LayoutPlanar), convertLayout(grayToRgb(gray), LayoutPlanar));
+  EXPECT_EQ(grayToRgb(planar), original);
+
+  // Filters keep the layout of their input
+  expectPlanarMatch(filter2D(planar, sobelXKernel(), BorderReplicate), filter2D(original, sobelXKernel(), BorderReplicate));
+  expectPlanarMatch(gaussianBlur(planar, 1.5), gaussianBlur(original, 1.5));
+  expectPlanarMatch(gaussianBlur(planar, 6.0), gaussianBlur(original, 6.0));
+  expectPlanarMatch(boxFilter(planar, 4), boxFilter(original, 4));
+  expectPlanarMatch(resizeMat(planar, 51, 70, ResizeLanczos3), resizeMat(original, 51, 70, ResizeLanczos3));
+  expectPlanarMatch(equalizeHistogram(planar), equalizeHistogram(original));
+  expectPlanarMatch(equalizeHistogramClahe(planar, 3.0, 4, 3), equalizeHistogramClahe(original, 3.0, 4, 3));
+  expectPlanarMatch(morphologyClose(planar, 7, 3), morphologyClose(original, 7, 3));
+  expectPlanarMatch(morphologyGradient(planar, 1, 1), morphologyGradient(original, 1, 1));
+
+  // Planar outputs whose buffer holds the input
+  Mat mat = planar;
+  gaussianBlur(mat, mat, 2.0);
+  expectPlanarMatch(mat, gaussianBlur(original, 2.0));
+  mat = planar;
+  convertLayout(mat, mat, LayoutInterleaved);
+  EXPECT_EQ(mat, original);
+}
+
+TEST_F(TestImageProcessing, convertDepthWillScaleRoundAndSaturate)
+{
+  Mat original = RandomMat(29, 13, 3);
+  const Mat widened = convertDepth(original, DepthS16, 300, -20000);
+  ASSERT_EQ(widened.depth(), DepthS16);
+  ASSERT_EQ(widened.channels(), 3);
+  const Mat floats = convertDepth(original, DepthF32, 0.5);
+  for(int y = 0; y < original.height(); y++)
+  {
+    for(int i = 0; i < original.width() * 3; i++)
+    {
+      const int v = original.row(y)[i];
+      EXPECT_EQ(widened.row<int16_t>(y)[i], std::max(-32768, std::min(v*300 - 20000, 32767)));
+      EXPECT_EQ(floats.row<float>(y)[i], v * 0.5f);
+    }
+  }
+
+  // Back to 8 bits, halves round away from zero and values out of range saturate
+  EXPECT_EQ(convertDepth(floats, DepthU8, 2), original);
+  Mat values(6, 1, 1, DepthF32);
+  const float inputs[] = {-3.0f, 0.5f, 1.49f, 2.5f, 254.5f, 1e9f};
+  std::copy(inputs, inputs + 6, values.row<float>(0));
+  const Mat bytes = convertDepth(values, DepthU8);
+  const uint8_t expectedBytes[] = {0, 1, 1, 3, 255, 255};
+  const Mat shorts = convertDepth(values, DepthS16, -1);
+  const int16_t expectedShorts[] = {3, -1, -1, -3, -255, -32768};
+  for(int x = 0; x < 6; x++)
+  {
+    EXPECT_EQ(bytes.row(0)[x], expectedBytes[x]) << "x " << x;
+    EXPECT_EQ(shorts.row<int16_t>(0)[x], expectedShorts[x]) << "x " << x;
+  }
+
+  // 16 bit images map to 8 bits with a scale of 1 / 257, crops of any depth are views
+  const Mat wide = convertDepth(original, DepthU16, 257);
+  EXPECT_EQ(wide.row<uint16_t>(5)[7], original.row(5)[7] * 257);
+  EXPECT_EQ(convertDepth(wide, DepthU8, 1.0 / 257), original);
+  EXPECT_EQ(convertDepth(cropView(wide, 3, 2, 20, 11), DepthU8, 1.0 / 257), Mat(cropView(original, 3, 2, 20, 11)));
+
+  // Planar images stay planar in 8 bits
+  const Mat planar = convertLayout(original, LayoutPlanar);
+  EXPECT_EQ(convertDepth(planar, DepthU16, 257), wide);
+  const Mat inverted = convertDepth(planar, DepthU8, -1, 255);
+  EXPECT_TRUE(inverted.isPlanar());
+  EXPECT_EQ(inverted.plane(2)[40], 255 - original.data()[40*3 + 2]);
+  EXPECT_TRUE(convertDepth(original, DepthF32, NAN).vectorPtr()->empty());
+}
+
+TEST_F(TestImageProcessing, sobelGradientsWillMatchAReferenceSobel)
+{
+  Mat original = RandomMat(143, 61, 1);
+  const int w = original.width();
+  Mat expectedX(w, original.height(), 1, DepthS16);
+  Mat expectedY(w, original.height(), 1, DepthS16);
+  for(int y = 1; y < original.height() - 1; y++)
+  {
+    for(int x = 1; x < w - 1; x++)
+    {
+      const uint8_t* p = original.data() + y*w + x;
+      expectedX.row<int16_t>(y)[x] = static_cast<int16_t>(-p[-w-1] + p[-w+1] - 2*p[-1] + 2*p[1] - p[w-1] + p[w+1]);
+      expectedY.row<int16_t>(y)[x] = static_cast<int16_t>(-p[-w-1] - 2*p[-w] - p[-w+1] + p[w-1] + 2*p[w] + p[w+1]);
+    }
+  }
+
+  const SimdLevel bestLevel = detectSimdLevel();
+  for(int level = SimdScalar; level <= bestLevel; level++)
+  {
+    setSimdLevel(static_cast<SimdLevel>(level));
+    for(int threads : {1, 4, 7})
+    {
+      setNumThreads(threads);
+      Mat gx, gy;
+      sobelGradients(original, gx, gy);
+      EXPECT_EQ(gx, expectedX) << "level " << level << " threads " << threads;
+      EXPECT_EQ(gy, expectedY) << "level " << level << " threads " << threads;
+    }
+  }
+  setSimdLevel(bestLevel);
+  setNumThreads(0);
+
+  // RGB images give the gradients of their gray image, which are not clamped like the magnitude
+  Mat rgb = RandomMat(64, 20, 3);
+  Mat gx, gy, grayX, grayY;
+  sobelGradients(convertLayout(rgb, LayoutPlanar), gx, gy);
+  sobelGradients(rgbToGray(rgb), grayX, grayY);
+  EXPECT_EQ(gx, grayX);
+  EXPECT_EQ(gy, grayY);
+  Mat step(10, 5, 1);
+  for(int y = 0; y < 5; y++)
+    std::fill(step.row(y) + 5, step.row(y) + 10, 255);
+  sobelGradients(step, gx, gy);
+  EXPECT_EQ(gx.row<int16_t>(2)[4], 1020);
+  EXPECT_EQ(gx.row<int16_t>(2)[0], 0);
+  EXPECT_EQ(gy.row<int16_t>(2)[4], 0);
+  // Gy has the sign of sobelYKernel, positive where the image gets brighter downwards
+  Mat bottom(6, 10, 1);
+  for(int y = 5; y < 10; y++)
+    std::fill(bottom.row(y), bottom.row(y) + 6, 255);
+  sobelGradients(bottom, gx, gy);
+  EXPECT_EQ(gy.row<int16_t>(4)[2], 1020);
+  EXPECT_EQ(filter2D(bottom, sobelYKernel()).row(4)[2], 255);
+
+  // The output may be the input
+  Mat mat = rgb;
+  sobelGradients(mat, mat, gy);
+  EXPECT_EQ(mat, grayX);
+  sobelGradients(Mat(4, 4, 2), gx, gy);
+  EXPECT_TRUE(gx.vectorPtr()->empty());
+  EXPECT_TRUE(gy.vectorPtr()->empty());
+}
+
+TEST_F(TestImageProcessing, willReturnEmptyMatForOtherDepths)
+{
+  const Mat wide = convertDepth(RandomMat(31, 17, 3), DepthU16, 257);
+  const Mat gray = convertDepth(RandomMat(31, 17, 1), DepthF32);
+  for(const Mat* input : {&wide, &gray})
+  {
+    EXPECT_TRUE(rgbToGray(*input).vectorPtr()->empty());
+    EXPECT_TRUE(grayToRgb(*input).vectorPtr()->empty());
+    EXPECT_TRUE(resizeMat(*input, 10, 10).vectorPtr()->empty());
+    EXPECT_TRUE(filter2D(*input, boxKernel(3)).vectorPtr()->empty());
+    EXPECT_TRUE(gaussianBlur(*input, 1.0).vectorPtr()->empty());
+    EXPECT_TRUE(boxFilter(*input, 2).vectorPtr()->empty());
+    EXPECT_TRUE(adaptiveThreshold(*input, 2).vectorPtr()->empty());
+    EXPECT_TRUE(equalizeHistogram(*input).vectorPtr()->empty());
+    EXPECT_TRUE(equalizeHistogramClahe(*input).vectorPtr()->empty());
+    EXPECT_TRUE(sobelEdgeDetector(*input).vectorPtr()->empty());
+    EXPECT_TRUE(cannyEdgeDetector(*input, 10, 30).vectorPtr()->empty());
+    EXPECT_TRUE(erode(*input, 1, 1).vectorPtr()->empty());
+  }
+  EXPECT_TRUE(convertLayout(wide, LayoutPlanar).vectorPtr()->empty());
+
+  // Copies keep the depth
+  EXPECT_EQ(convertLayout(wide, LayoutInterleaved), wide);
+  Mat cropped;
+  cropMat(wide, cropped, 2, 3, 12, 9);
+  EXPECT_EQ(cropped.depth(), DepthU16);
+  EXPECT_EQ(cropped.row<uint16_t>(1)[4], wide.row<uint16_t>(4)[10]);
+}
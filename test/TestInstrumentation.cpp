@@ -0,0 +1,139 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "ImageProcessing.h"
+#include "Instrumentation.h"
+#include "Mat.h"
+#include "RandomMat.h"
+
+using namespace MicroCv;
+
+#ifndef MICROCV_DISABLE_INSTRUMENTATION
+namespace
+{
+  const StageStats* findStage(const std::vector<StageStats>& stats, const std::string& name)
+  {
+    for(auto itr = stats.begin(); itr != stats.end(); ++itr)
+    {
+      if(itr->name == name)
+        return &*itr;
+    }
+    return nullptr;
+  }
+
+  // The text of a number field of the first trace event with that name
+  std::string traceField(const std::string& trace, const std::string& name, const std::string& field)
+  {
+    const size_t event = trace.find("\"name\": \"" + name + "\"");
+    if(event == std::string::npos)
+      return "";
+    const size_t begin = trace.find("\"" + field + "\": ", event) + field.size() + 4;
+    return trace.substr(begin, trace.find(',', begin) - begin);
+  }
+}
+
+TEST(TestInstrumentation, willOnlyRecordWhenEnabled)
+{
+  Mat original = RandomMat(64, 48, 3);
+  setStatsEnabled(false);
+  resetStats();
+  sobelEdgeDetector(original);
+  EXPECT_EQ(findStage(stageStats(), "sobelEdgeDetector"), nullptr);
+
+  setStatsEnabled(true);
+  sobelEdgeDetector(original);
+  sobelEdgeDetector(original);
+  rgbToGray(original);
+  setStatsEnabled(false);
+
+  std::vector<StageStats> stats = stageStats();
+  const StageStats* sobel = findStage(stats, "sobelEdgeDetector");
+  ASSERT_NE(sobel, nullptr);
+  EXPECT_EQ(sobel->calls, 2u);
+  // RGB input plus gray output of both calls
+  EXPECT_EQ(sobel->bytes, 2u * 64 * 48 * 4);
+  EXPECT_GE(sobel->seconds, 0.0);
+  ASSERT_NE(findStage(stats, "rgbToGray"), nullptr);
+  EXPECT_EQ(findStage(stats, "rgbToGray")->calls, 1u);
+
+  // Every output Mat was allocated by the calling thread
+  uint64_t allocations = 0;
+  std::vector<ThreadStats> threads = threadStats();
+  for(auto itr = threads.begin(); itr != threads.end(); ++itr)
+    allocations += itr->allocations;
+  EXPECT_GE(allocations, 3u);
+
+  resetStats();
+  EXPECT_EQ(findStage(stageStats(), "sobelEdgeDetector"), nullptr);
+}
+
+TEST(TestInstrumentation, willWriteChromeTrace)
+{
+  std::string filename = "../images/test_trace.json";
+  Mat original = RandomMat(64, 48, 3);
+  resetStats();
+  setTraceEnabled(true);
+  EXPECT_TRUE(statsEnabled());
+  sobelEdgeDetector(original);
+  setStatsEnabled(false);
+  EXPECT_FALSE(traceEnabled());
+
+  ASSERT_TRUE(writeChromeTrace(filename));
+  std::ifstream traceFile(filename);
+  std::stringstream trace;
+  trace << traceFile.rdbuf();
+  EXPECT_EQ(trace.str().find("{\"traceEvents\": ["), 0u);
+  EXPECT_NE(trace.str().find("\"name\": \"sobelEdgeDetector\", \"ph\": \"X\""), std::string::npos);
+  EXPECT_NE(trace.str().find("\"name\": \"sobelEdgeDetector band\""), std::string::npos);
+  resetStats();
+  std::remove(filename.c_str());
+}
+
+TEST(TestInstrumentation, willWriteTraceTimestampsToTheNanosecond)
+{
+  std::string filename = "../images/test_trace_timestamps.json";
+  resetStats();
+  setTraceEnabled(true);
+  {
+    StageTimer timer("first stage");
+  }
+  // Timestamps above 1e6 us, where 6 significant digits would only resolve 10 us
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  {
+    StageTimer timer("second stage");
+  }
+  {
+    StageTimer timer("third stage");
+  }
+  setStatsEnabled(false);
+  ASSERT_TRUE(writeChromeTrace(filename));
+  std::ifstream traceFile(filename);
+  std::stringstream trace;
+  trace << traceFile.rdbuf();
+
+  const std::string second = traceField(trace.str(), "second stage", "ts");
+  ASSERT_EQ(second.find('e'), std::string::npos) << second;
+  ASSERT_NE(second.find('.'), std::string::npos) << second;
+  EXPECT_EQ(second.size() - second.find('.'), 4u) << second;
+  const double secondTs = std::strtod(second.c_str(), nullptr);
+  EXPECT_GT(secondTs, 1e6);
+  // Back to back events stay in order and do not overlap
+  const double secondDur = std::strtod(traceField(trace.str(), "second stage", "dur").c_str(), nullptr);
+  const double thirdTs = std::strtod(traceField(trace.str(), "third stage", "ts").c_str(), nullptr);
+  EXPECT_GE(thirdTs, secondTs + secondDur);
+  EXPECT_LT(thirdTs - secondTs, 1000.0);
+  resetStats();
+  std::remove(filename.c_str());
+}
+#endif
@@ -0,0 +1,121 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+#include "CpuFeatures.h"
+#include "ImageProcessing.h"
+#include "IntegralImage.h"
+#include "Mat.h"
+#include "Parallel.h"
+#include "RandomMat.h"
+
+using namespace MicroCv;
+
+namespace
+{
+  // Sum of one channel over [x1, x2) x [y1, y2), pixel by pixel
+  uint64_t referenceBoxSum(const Mat& mat, int x1, int y1, int x2, int y2, int channel)
+  {
+    uint64_t sum = 0;
+    for(int y = y1; y < y2; y++)
+      for(int x = x1; x < x2; x++)
+        sum += mat.data()[(y*mat.width() + x)*mat.channels() + channel];
+    return sum;
+  }
+
+  // Every entry of the table against a direct sum
+  template<typename T>
+  void expectTableMatches(const IntegralImage<T>& sums, const Mat& mat)
+  {
+    ASSERT_EQ(sums.width(), mat.width());
+    ASSERT_EQ(sums.height(), mat.height());
+    ASSERT_EQ(sums.channels(), mat.channels());
+    for(int y = 0; y <= mat.height(); y++)
+    {
+      const T* row = sums.row(y);
+      for(int x = 0; x <= mat.width(); x++)
+        for(int c = 0; c < mat.channels(); c++)
+          ASSERT_EQ(row[x*mat.channels() + c], static_cast<T>(referenceBoxSum(mat, 0, 0, x, y, c)))
+              << "x " << x << " y " << y << " channel " << c;
+    }
+  }
+}
+
+TEST(TestIntegralImage, willSumEveryPixelAboveAndLeft)
+{
+  const SimdLevel bestLevel = detectSimdLevel();
+  for(int channels = 1; channels <= 3; channels += 2)
+  {
+    // Odd width so the scalar tails after the vector loops are exercised too
+    Mat original = RandomMat(37, 11, channels);
+    for(int level = SimdScalar; level <= bestLevel; level++)
+    {
+      setSimdLevel(static_cast<SimdLevel>(level));
+      expectTableMatches(IntegralImage32(original), original);
+      expectTableMatches(IntegralImage64(original), original);
+    }
+    // The sums of planar images are interleaved all the same
+    expectTableMatches(IntegralImage32(convertLayout(original, LayoutPlanar)), original);
+  }
+  setSimdLevel(bestLevel);
+}
+
+TEST(TestIntegralImage, willMatchForAnyNumberOfThreads)
+{
+  // Large enough to be split into bands, so the sums of the bands above are carried down
+  Mat original = NoiseMat(401, 613, 1);
+  setNumThreads(1);
+  IntegralImage32 expected(original);
+  setNumThreads(4);
+  IntegralImage32 sums(original);
+  for(int y = 0; y <= original.height(); y += 17)
+    for(int x = 0; x <= original.width(); x++)
+      ASSERT_EQ(sums.row(y)[x], expected.row(y)[x]) << "x " << x << " y " << y;
+  EXPECT_EQ(sums.row(original.height())[original.width()],
+      static_cast<uint32_t>(referenceBoxSum(original, 0, 0, original.width(), original.height(), 0)));
+  setNumThreads(0);
+}
+
+TEST(TestIntegralImage, boxSumWillClipTheBoxToTheImage)
+{
+  Mat original = RandomMat(20, 10, 3);
+  IntegralImage64 sums(original);
+  EXPECT_EQ(sums.boxSum(3, 2, 9, 7, 1), referenceBoxSum(original, 3, 2, 9, 7, 1));
+  EXPECT_EQ(sums.boxSum(-5, -5, 100, 100, 2), referenceBoxSum(original, 0, 0, 20, 10, 2));
+  EXPECT_EQ(sums.boxSum(15, 8, 30, 30), referenceBoxSum(original, 15, 8, 20, 10, 0));
+  EXPECT_EQ(sums.boxSum(5, 5, 5, 9), 0u);
+  EXPECT_EQ(sums.boxSum(8, 2, 4, 6), 0u);
+  EXPECT_EQ(sums.boxSum(0, 0, 20, 10, 3), 0u);
+}
+
+TEST(TestIntegralImage, boxSumsWillStayExactWhenTheTableWrapsAround)
+{
+  // 4096 x 4200 white pixels sum to more than 2^32
+  Mat white(4096, 4200, 1);
+  std::fill(white.vectorPtr()->begin(), white.vectorPtr()->end(), 255);
+  IntegralImage32 sums32(white);
+  IntegralImage64 sums64(white);
+  EXPECT_EQ(sums64.boxSum(0, 0, 4096, 4200), 255ull * 4096 * 4200);
+  EXPECT_NE(static_cast<uint64_t>(sums32.row(4200)[4096]), 255ull * 4096 * 4200);
+  EXPECT_EQ(sums32.boxSum(1000, 4000, 1100, 4200), 255u * 100 * 200);
+  EXPECT_EQ(sums32.boxSum(4000, 4100, 4096, 4200), sums64.boxSum(4000, 4100, 4096, 4200));
+}
+
+TEST(TestIntegralImage, willHandleEmptyMats)
+{
+  IntegralImage32 sums;
+  EXPECT_TRUE(sums.empty());
+  sums.compute(Mat());
+  EXPECT_TRUE(sums.empty());
+  EXPECT_EQ(sums.boxSum(0, 0, 10, 10), 0u);
+
+  // The table is recomputed for the new size
+  Mat original = RandomMat(5, 4, 1);
+  sums.compute(original);
+  EXPECT_FALSE(sums.empty());
+  expectTableMatches(sums, original);
+}
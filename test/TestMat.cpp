@@ -2,6 +2,7 @@
  *  Micro Computer Vision library
  *  @author Andrei Polzounov
  */
+#include <cstring>
 #include <iostream>
 #include <random>
 
@@ -73,3 +74,227 @@ TEST_F(TestMat, willCorrectlyUseCopyConstructorAndAssignmentOperator)
 
   EXPECT_EQ(mat_, other);
 }
+
+TEST_F(TestMat, willViewMatWithoutCopying)
+{
+  mat_ = RandomMat(31, 17, 3);
+  MatView view(mat_);
+
+  EXPECT_EQ(view.data(), mat_.data());
+  EXPECT_EQ(view.width(), mat_.width());
+  EXPECT_EQ(view.height(), mat_.height());
+  EXPECT_EQ(view.channels(), mat_.channels());
+  EXPECT_EQ(view.stride(), 31*3);
+  EXPECT_TRUE(view.isContinuous());
+  EXPECT_EQ(view.row(5), mat_.data() + 5*31*3);
+}
+
+TEST_F(TestMat, willCopyStridedViewIntoMat)
+{
+  Mat other = RandomMat(20, 10, 1);
+  // View the 8x4 block starting at (3, 2)
+  MatView view(other.data() + 2*20 + 3, 8, 4, 1, 20);
+  EXPECT_FALSE(view.isContinuous());
+
+  mat_ = Mat(view);
+  ASSERT_EQ(mat_.width(), 8);
+  ASSERT_EQ(mat_.height(), 4);
+  ASSERT_EQ(mat_.channels(), 1);
+  for(int y = 0; y < 4; y++)
+  {
+    for(int x = 0; x < 8; x++)
+    {
+      EXPECT_EQ(mat_.data()[y*8 + x], other.data()[(y+2)*20 + x+3]);
+    }
+  }
+}
+
+TEST_F(TestMat, willAlignAndPadRows)
+{
+  mat_.resize(37, 5, 3);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(mat_.data()) % PIXEL_ALIGNMENT, 0u);
+  EXPECT_TRUE(mat_.isContinuous());
+
+  mat_.resize(37, 5, 3, alignedStride(37, 3));
+  EXPECT_EQ(mat_.stride(), 128);
+  EXPECT_FALSE(mat_.isContinuous());
+  EXPECT_EQ(mat_.vectorPtr()->size(), static_cast<size_t>(128*5));
+  for(int y = 0; y < mat_.height(); y++)
+  {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(mat_.row(y)) % PIXEL_ALIGNMENT, 0u);
+  }
+
+  // Padding is ignored by comparisons and views
+  Mat other = RandomMat(37, 5, 3);
+  for(int y = 0; y < mat_.height(); y++)
+  {
+    std::copy(other.data() + y*37*3, other.data() + (y+1)*37*3, mat_.row(y));
+  }
+  EXPECT_EQ(mat_, other);
+  EXPECT_EQ(Mat(MatView(mat_)), other);
+  EXPECT_TRUE(Mat(MatView(mat_)).isContinuous());
+}
+
+TEST_F(TestMat, willReuseBuffersFromThePool)
+{
+  clearBufferPool();
+  const uint8_t* firstBuffer;
+  {
+    Mat first(640, 480, 3);
+    firstBuffer = first.data();
+  }
+  EXPECT_EQ(bufferPoolCachedBytes(), static_cast<size_t>(640*480*3));
+
+  // A buffer of the same size comes straight back from the free list
+  Mat second(640, 480, 3);
+  EXPECT_EQ(second.data(), firstBuffer);
+  EXPECT_EQ(bufferPoolCachedBytes(), 0u);
+
+  // Without pooling freed buffers go back to the system
+  const size_t capacity = bufferPoolCapacity();
+  setBufferPoolCapacity(0);
+  Mat().swap(second);
+  EXPECT_EQ(bufferPoolCachedBytes(), 0u);
+  setBufferPoolCapacity(capacity);
+}
+
+TEST_F(TestMat, willShareBufferUntilWritten)
+{
+  Mat original = RandomMat(33, 21, 3);
+  Mat copy = original;
+  EXPECT_TRUE(original.isShared());
+  EXPECT_EQ(static_cast<const Mat&>(copy).data(), static_cast<const Mat&>(original).data());
+
+  // Writing unshares the buffer, the original keeps its pixels
+  const uint8_t firstPixel = original.data()[0];
+  copy.data()[0] = firstPixel + 1;
+  EXPECT_FALSE(original.isShared());
+  EXPECT_FALSE(copy.isShared());
+  EXPECT_EQ(original.data()[0], firstPixel);
+  EXPECT_EQ(copy.data()[0], static_cast<uint8_t>(firstPixel + 1));
+}
+
+TEST_F(TestMat, willMoveWithoutCopying)
+{
+  Mat original = RandomMat(33, 21, 3);
+  const uint8_t* buffer = original.data();
+
+  Mat moved(std::move(original));
+  EXPECT_EQ(moved.data(), buffer);
+  EXPECT_EQ(original, Mat());
+
+  mat_ = std::move(moved);
+  EXPECT_EQ(mat_.data(), buffer);
+  EXPECT_EQ(mat_.width(), 33);
+  EXPECT_FALSE(mat_.isShared());
+}
+
+TEST_F(TestMat, willStorePlanarMatsAsAlignedPlanes)
+{
+  mat_.resize(37, 11, 3, LayoutPlanar);
+  EXPECT_TRUE(mat_.isPlanar());
+  EXPECT_EQ(mat_.stride(), 37);
+  EXPECT_TRUE(mat_.isContinuous());
+  EXPECT_GE(mat_.planeStride(), 37u * 11);
+  EXPECT_EQ(mat_.planeStride() % PIXEL_ALIGNMENT, 0u);
+  for(int c = 0; c < 3; c++)
+  {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(mat_.plane(c)) % PIXEL_ALIGNMENT, 0u);
+    EXPECT_EQ(mat_.plane(c), mat_.data() + c * mat_.planeStride());
+  }
+  EXPECT_EQ(mat_.row(3), mat_.data() + 3 * 37);
+
+  // Gray Mats are always interleaved, resizing without a layout makes them interleaved again
+  mat_.resize(37, 11, 1, LayoutPlanar);
+  EXPECT_FALSE(mat_.isPlanar());
+  EXPECT_EQ(mat_.planeStride(), 0u);
+  mat_.resize(37, 11, 3, LayoutPlanar);
+  mat_.resize(37, 11, 3);
+  EXPECT_FALSE(mat_.isPlanar());
+  EXPECT_EQ(mat_.stride(), 37 * 3);
+}
+
+TEST_F(TestMat, willCopyAndCompareMatsOfEachLayout)
+{
+  Mat planar(23, 9, 3, LayoutPlanar);
+  for(size_t i = 0; i < planar.vectorPtr()->size(); i++)
+    (*planar.vectorPtr())[i] = static_cast<uint8_t>(i * 7);
+
+  // Views keep the layout, deep copies of them too
+  const MatView view(planar);
+  EXPECT_TRUE(view.isPlanar());
+  EXPECT_EQ(view.planeStride(), planar.planeStride());
+  EXPECT_EQ(view.plane(2).data(), static_cast<const Mat&>(planar).plane(2));
+  EXPECT_EQ(view.plane(2).channels(), 1);
+  Mat copy(view);
+  EXPECT_TRUE(copy.isPlanar());
+  EXPECT_EQ(copy, planar);
+
+  // Only the pixels are compared, the layout must match too
+  copy.plane(1)[5] ^= 1;
+  EXPECT_FALSE(copy == planar);
+  EXPECT_FALSE(planar == Mat(23, 9, 3));
+
+  // Views onto planes that are not continuous are copied plane by plane
+  const MatView region(view.row(2) + 4, 10, 5, 3, view.stride(), view.planeStride());
+  Mat regionCopy(region);
+  ASSERT_TRUE(regionCopy.isPlanar());
+  for(int c = 0; c < 3; c++)
+    for(int y = 0; y < 5; y++)
+      for(int x = 0; x < 10; x++)
+        EXPECT_EQ(regionCopy.plane(c)[y*10 + x], planar.plane(c)[(y + 2)*23 + x + 4]);
+
+  Mat moved(std::move(copy));
+  EXPECT_TRUE(moved.isPlanar());
+  EXPECT_FALSE(copy.isPlanar());
+  moved.swap(mat_);
+  EXPECT_TRUE(mat_.isPlanar());
+  EXPECT_FALSE(moved.isPlanar());
+}
+
+TEST_F(TestMat, willHoldValuesOfOtherDepths)
+{
+  Mat gradients(17, 5, 2, DepthS16);
+  EXPECT_EQ(gradients.depth(), DepthS16);
+  EXPECT_EQ(gradients.elementSize(), 2);
+  EXPECT_EQ(gradients.stride(), 17 * 2 * 2);
+  EXPECT_TRUE(gradients.isContinuous());
+  EXPECT_EQ(gradients.row<int16_t>(4)[33], 0);
+  gradients.row<int16_t>(3)[7] = -1234;
+  EXPECT_EQ(gradients.row(3) + 14, reinterpret_cast<uint8_t*>(gradients.row<int16_t>(3) + 7));
+
+  // Views and copies keep the depth, which is compared along with the values
+  const MatView view(gradients);
+  EXPECT_EQ(view.depth(), DepthS16);
+  EXPECT_EQ(view.row<int16_t>(3)[7], -1234);
+  Mat copy(view);
+  EXPECT_EQ(copy.depth(), DepthS16);
+  EXPECT_EQ(copy, gradients);
+  copy.row<int16_t>(4)[33] = 1;
+  EXPECT_FALSE(copy == gradients);
+  Mat unsignedValues(17, 5, 2, DepthU16);
+  std::memcpy(unsignedValues.data(), gradients.data(), gradients.vectorPtr()->size());
+  EXPECT_FALSE(unsignedValues == gradients);
+
+  // Views with gaps between their rows are copied row by row
+  const MatView region(gradients.row(2) + 3 * 2 * 2, 5, 2, 2, gradients.stride(), DepthS16);
+  Mat regionCopy(region);
+  EXPECT_EQ(regionCopy.stride(), 5 * 2 * 2);
+  EXPECT_EQ(regionCopy.row<int16_t>(1)[1], -1234);
+
+  Mat floats(3, 2, 1, DepthF32);
+  floats.row<float>(1)[2] = 0.5f;
+  Mat moved(std::move(floats));
+  EXPECT_EQ(moved.depth(), DepthF32);
+  EXPECT_EQ(floats.depth(), DepthU8);
+  EXPECT_EQ(moved.row<float>(1)[2], 0.5f);
+  moved.swap(mat_);
+  EXPECT_EQ(mat_.depth(), DepthF32);
+
+  // Any other resize makes an 8 bit Mat again
+  mat_.resize(3, 2, 1);
+  EXPECT_EQ(mat_.depth(), DepthU8);
+  EXPECT_EQ(depthSize(DepthU16), 2);
+  EXPECT_EQ(depthSize(DepthF32), 4);
+  EXPECT_TRUE(DepthOf<uint16_t>::value == DepthU16);
+}
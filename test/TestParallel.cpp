@@ -0,0 +1,113 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "ImageProcessing.h"
+#include "Mat.h"
+#include "Parallel.h"
+#include "RandomMat.h"
+
+using namespace MicroCv;
+
+TEST(TestParallel, willPartitionRowsIntoContiguousBands)
+{
+  std::vector<RowBand> bands = partitionRows(103, 8, 1);
+
+  ASSERT_EQ(bands.size(), 8u);
+  EXPECT_EQ(bands.front().begin, 0);
+  EXPECT_EQ(bands.back().end, 103);
+  for(size_t i = 0; i < bands.size(); i++)
+  {
+    const int rows = bands[i].end - bands[i].begin;
+    EXPECT_TRUE(rows == 12 || rows == 13);
+    if(i > 0)
+    {
+      EXPECT_EQ(bands[i].begin, bands[i-1].end);
+    }
+    // Halo rows are clamped to the image
+    EXPECT_EQ(bands[i].haloBegin, std::max(0, bands[i].begin - 1));
+    EXPECT_EQ(bands[i].haloEnd, std::min(103, bands[i].end + 1));
+  }
+}
+
+TEST(TestParallel, willNotMakeMoreBandsThanRows)
+{
+  EXPECT_EQ(partitionRows(3, 16, 0).size(), 3u);
+}
+
+TEST(TestParallel, parallelForBandsWillRunTheBandsOfParallelForRows)
+{
+  setNumThreads(4);
+  const std::vector<RowBand> bands = rowBands(1000, 1000, 2);
+  ASSERT_GT(bands.size(), 1u);
+  EXPECT_EQ(bands.front().begin, 0);
+  EXPECT_EQ(bands.back().end, 1000);
+
+  std::vector<std::atomic<int>> counts(bands.size());
+  for(auto& count : counts)
+    count = 0;
+  parallelForBands(bands, [&](int i) { counts[i]++; });
+  for(auto& count : counts)
+    EXPECT_EQ(count, 1);
+
+  // Small images and a single thread make one band
+  EXPECT_EQ(rowBands(100, 100, 0).size(), 1u);
+  setNumThreads(1);
+  EXPECT_EQ(rowBands(1000, 1000, 0).size(), 1u);
+  EXPECT_TRUE(rowBands(0, 1000, 0).empty());
+  setNumThreads(0);
+}
+
+TEST(TestParallel, threadPoolWillRunEveryTaskOnce)
+{
+  ThreadPool pool(3);
+  std::vector<std::atomic<int>> counts(1000);
+  for(auto& count : counts)
+    count = 0;
+
+  pool.run(static_cast<int>(counts.size()), [&](int i)
+  {
+    // Nested calls run inline on the worker
+    pool.run(2, [&](int) { counts[i]++; });
+  });
+
+  for(auto& count : counts)
+    EXPECT_EQ(count, 2);
+}
+
+TEST(TestParallel, threadPoolWillRethrowTaskExceptions)
+{
+  ThreadPool pool(2);
+  EXPECT_THROW(pool.run(10, [](int i) { if(i == 7) throw std::runtime_error("task failed"); }),
+      std::runtime_error);
+}
+
+TEST(TestParallel, resultsWillNotDependOnTheNumberOfThreads)
+{
+  Mat original = NoiseMat(301, 517, 3);
+
+  setNumThreads(1);
+  Mat gray = rgbToGray(original);
+  Mat rgb = grayToRgb(gray);
+  Mat edges = sobelEdgeDetector(original);
+  Mat cropped = original;
+  cropMat(cropped, 10, 20, 300, 500);
+
+  setNumThreads(4);
+  EXPECT_EQ(numThreads(), 4);
+  EXPECT_EQ(rgbToGray(original), gray);
+  EXPECT_EQ(grayToRgb(gray), rgb);
+  EXPECT_EQ(sobelEdgeDetector(original), edges);
+  Mat croppedParallel = original;
+  cropMat(croppedParallel, 10, 20, 300, 500);
+  EXPECT_EQ(croppedParallel, cropped);
+
+  setNumThreads(0);
+}
@@ -0,0 +1,98 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <gtest/gtest.h>
+
+#include "ImageProcessing.h"
+#include "Mat.h"
+#include "Parallel.h"
+#include "Pipeline.h"
+#include "RandomMat.h"
+
+using namespace MicroCv;
+
+TEST(TestPipeline, cropGraySobelWillMatchChainedCalls)
+{
+  Mat original = RandomMat(211, 157, 3);
+  Mat expected = original;
+  cropMat(expected, 13, 7, 190, 150);
+  expected = sobelEdgeDetector(rgbToGray(expected, GrayBt601), SobelL2);
+
+  Pipeline pipeline(original);
+  pipeline.crop(13, 7, 190, 150).gray(GrayBt601).sobel(SobelL2);
+  EXPECT_EQ(pipeline.width(), 177);
+  EXPECT_EQ(pipeline.height(), 143);
+  EXPECT_EQ(pipeline.channels(), 1);
+  EXPECT_EQ(pipeline.evaluate(), expected);
+}
+
+TEST(TestPipeline, cropAfterSobelWillMatchChainedCalls)
+{
+  Mat original = RandomMat(120, 90, 3);
+  Mat expected = sobelEdgeDetector(original);
+  cropMat(expected, 0, 5, 60, 89);
+  cropMat(expected, 2, 3, 50, 70);
+
+  // The crops come after the neighbourhood operation, so they must not be pushed into the input
+  Mat edges = Pipeline(original).sobel().crop(0, 5, 60, 89).crop(2, 3, 50, 70).evaluate();
+  EXPECT_EQ(edges, expected);
+
+  Mat twice = sobelEdgeDetector(sobelEdgeDetector(original));
+  EXPECT_EQ(Pipeline(original).sobel().sobel().evaluate(), twice);
+}
+
+TEST(TestPipeline, willMatchForAnyNumberOfThreads)
+{
+  Mat original = NoiseMat(401, 613, 3);
+  setNumThreads(1);
+  Mat expected = Pipeline(original).crop(3, 4, 390, 600).sobel().evaluate();
+  setNumThreads(4);
+  EXPECT_EQ(Pipeline(original).crop(3, 4, 390, 600).sobel().evaluate(), expected);
+  setNumThreads(0);
+  EXPECT_EQ(Pipeline(original).crop(3, 4, 390, 600).sobel().evaluate(), expected);
+}
+
+TEST(TestPipeline, blurWillMatchGaussianBlur)
+{
+  Mat original = RandomMat(71, 43, 3);
+  EXPECT_EQ(Pipeline(original).blur(1.5).evaluate(), gaussianBlur(original, 1.5));
+  EXPECT_EQ(Pipeline(original).blur(3.0, BorderConstant).evaluate(), gaussianBlur(original, 3.0, BorderConstant));
+  EXPECT_EQ(Pipeline(original).blur(0).evaluate(), original);
+
+  // Fused blur and Sobel, the blurred image only exists as a window of rows
+  Mat gray = rgbToGray(original);
+  EXPECT_EQ(Pipeline(original).gray().blur(1.0).sobel().evaluate(), sobelEdgeDetector(gaussianBlur(gray, 1.0)));
+  Mat cropped = gaussianBlur(original, 2.0);
+  cropMat(cropped, 5, 6, 60, 40);
+  EXPECT_EQ(Pipeline(original).blur(2.0).crop(5, 6, 60, 40).evaluate(), cropped);
+  // Rows after a Sobel are requested out of order at the reflected border
+  EXPECT_EQ(Pipeline(gray).sobel().blur(0.8).evaluate(), gaussianBlur(sobelEdgeDetector(gray), 0.8));
+  EXPECT_EQ(Pipeline(gray).blur(-1).evaluate(), Mat());
+}
+
+TEST(TestPipeline, willReadPlanarInputAsInterleavedRows)
+{
+  Mat original = RandomMat(71, 43, 3);
+  const Mat planar = convertLayout(original, LayoutPlanar);
+  EXPECT_EQ(Pipeline(planar).crop(4, 3, 60, 40).blur(1.2).evaluate(),
+      Pipeline(original).crop(4, 3, 60, 40).blur(1.2).evaluate());
+  EXPECT_EQ(Pipeline(planar).gray().sobel().evaluate(), sobelEdgeDetector(original));
+
+  // The output may be the planar input
+  Mat mat = planar;
+  Pipeline(mat).blur(1.0).evaluate(mat);
+  EXPECT_EQ(mat, gaussianBlur(original, 1.0));
+}
+
+TEST(TestPipeline, willHandleUnsupportedInput)
+{
+  Mat rgba = RandomMat(10, 10, 4);
+  EXPECT_EQ(Pipeline(rgba).sobel().evaluate(), Mat());
+  EXPECT_EQ(Pipeline(rgba).gray().evaluate(), Mat());
+
+  // An invalid crop leaves the image unchanged
+  Mat gray = RandomMat(10, 10, 1);
+  EXPECT_EQ(Pipeline(gray).crop(5, 5, 2, 2).gray().evaluate(), gray);
+  EXPECT_EQ(Pipeline(gray).sobel().evaluate(), sobelEdgeDetector(gray));
+}
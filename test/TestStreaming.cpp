@@ -0,0 +1,92 @@
+/*
+ *  Micro Computer Vision library
+ *  @author Andrei Polzounov
+ */
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+
+#include <gtest/gtest.h>
+
+#include "FileIo.h"
+#include "ImageProcessing.h"
+#include "Mat.h"
+#include "RandomMat.h"
+#include "Streaming.h"
+
+using namespace MicroCv;
+
+TEST(TestStreaming, grayRowFilterWillMatchRgbToGray)
+{
+  Mat original = RandomMat(67, 45, 3);
+  ViewRowSource source(original);
+  GrayRowFilter gray(source, GrayBt709);
+
+  Mat streamed;
+  ASSERT_TRUE(readRowsIntoMat(gray, streamed));
+  EXPECT_EQ(streamed, rgbToGray(original, GrayBt709));
+
+  // Planar images are streamed as interleaved rows
+  const Mat planar = convertLayout(original, LayoutPlanar);
+  ViewRowSource planarSource(planar);
+  ASSERT_TRUE(readRowsIntoMat(planarSource, streamed));
+  EXPECT_EQ(streamed, original);
+}
+
+TEST(TestStreaming, sobelRowFilterWillMatchSobelEdgeDetector)
+{
+  Mat original = RandomMat(81, 37, 3);
+  ViewRowSource source(original);
+  SobelRowFilter edges(source);
+
+  Mat streamed;
+  ASSERT_TRUE(readRowsIntoMat(edges, streamed));
+  EXPECT_EQ(streamed, sobelEdgeDetector(original));
+
+  Mat gray = rgbToGray(original);
+  ViewRowSource graySource(gray);
+  SobelRowFilter l2Edges(graySource, SobelL2);
+  ASSERT_TRUE(readRowsIntoMat(l2Edges, streamed));
+  EXPECT_EQ(streamed, sobelEdgeDetector(gray, SobelL2));
+}
+
+TEST(TestStreaming, cropRowFilterWillMatchCropMat)
+{
+  Mat original = RandomMat(50, 40, 3);
+  ViewRowSource source(original);
+  CropRowFilter cropped(source, 7, 9, 31, 35);
+
+  Mat streamed;
+  ASSERT_TRUE(readRowsIntoMat(cropped, streamed));
+  Mat expected = original;
+  cropMat(expected, 7, 9, 31, 35);
+  EXPECT_EQ(streamed, expected);
+
+  // Invalid regions leave the image unchanged
+  ViewRowSource otherSource(original);
+  CropRowFilter notCropped(otherSource, 31, 9, 7, 35);
+  ASSERT_TRUE(readRowsIntoMat(notCropped, streamed));
+  EXPECT_EQ(streamed, original);
+}
+
+TEST(TestStreaming, willStreamFromFileToFile)
+{
+  std::string inFilename = "../images/test_stream_in.png";
+  std::string outFilename = "../images/test_stream_out.tiff";
+  RandomMat original(93, 61, 3);
+  ASSERT_TRUE(writeMatToFile(inFilename, original, ImageFileType::Png));
+
+  FileRowSource source;
+  ASSERT_TRUE(source.open(inFilename, ImageFileType::Png));
+  CropRowFilter cropped(source, 4, 6, 80, 50);
+  SobelRowFilter edges(cropped);
+  ASSERT_TRUE(writeRowsToFile(outFilename, edges, ImageFileType::Tiff));
+
+  bool readOk;
+  Mat readMat = readMatFromFile(outFilename, ImageFileType::Tiff, readOk);
+  ASSERT_TRUE(readOk);
+  EXPECT_EQ(readMat, sobelEdgeDetector(cropView(original, 4, 6, 80, 50)));
+
+  boost::filesystem::remove(inFilename);
+  boost::filesystem::remove(outFilename);
+}